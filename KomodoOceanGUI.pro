@@ -257,6 +257,7 @@ SOURCES += src\protobuf\google\protobuf\any.cc \
     src\crypto\haraka_portable.cpp \
     src\crypto\hmac_sha256.cpp \
     src\crypto\hmac_sha512.cpp \
+    src\crypto\muhash.cpp \
     src\crypto\ripemd160.cpp \
     src\crypto\sha1.cpp \
     src\crypto\sha256.cpp \
@@ -438,6 +439,7 @@ SOURCES += src\protobuf\google\protobuf\any.cc \
     src\transaction_builder.cpp \
     src\txdb.cpp \
     src\txmempool.cpp \
+    src\utxosnapshot.cpp \
     src\uint256.cpp \
     src\univalue\lib\univalue.cpp \
     src\univalue\lib\univalue_read.cpp \
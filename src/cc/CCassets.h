@@ -43,11 +43,29 @@ int64_t AssetValidateBuyvin(struct CCcontract_info *cp,Eval* eval,int64_t &tmppr
 int64_t AssetValidateSellvin(struct CCcontract_info *cp,Eval* eval,int64_t &tmpprice,std::vector<uint8_t> &tmporigpubkey,char *CCaddr,char *origaddr,const CTransaction &tx,uint256 assetid);
 bool AssetCalcAmounts(struct CCcontract_info *cpAssets, int64_t &inputs, int64_t &outputs, Eval* eval, const CTransaction &tx, uint256 assetid);
 
+// an open order: an unspent output on the assets global address (bids) or its tokens address (asks)
+struct CAssetOrder
+{
+    COutPoint outpoint;
+    uint8_t funcid;
+    uint8_t evalcode2;          // additional eval code of non-fungible asks, 0 otherwise
+    uint256 tokenid, otherid;
+    int64_t nValue;             // value of the order output
+    int64_t origValue;          // value of vout.0 of the order tx
+    int64_t price;              // price from the order opret
+    std::vector<uint8_t> origpubkey;
+    double unitprice;           // satoshis per token, used to sort the book
+};
+
+bool GetAssetOrders(uint256 tokenid, CPubKey pk, uint8_t additionalEvalCode, std::vector<CAssetOrder> &orders);
+bool GetAssetTopOfBook(uint256 tokenid, int32_t depth, std::vector<CAssetOrder> &bids, std::vector<CAssetOrder> &asks);
+
 // CCassetstx
 //int64_t GetAssetBalance(CPubKey pk,uint256 tokenid); // --> GetTokenBalance()
 int64_t AddAssetInputs(struct CCcontract_info *cp, CMutableTransaction &mtx, CPubKey pk, uint256 assetid, int64_t total, int32_t maxinputs);
 
 UniValue AssetOrders(uint256 tokenid, CPubKey pubkey, uint8_t additionalEvalCode);
+UniValue AssetTopOfBook(uint256 tokenid, int32_t depth);
 //UniValue AssetInfo(uint256 tokenid);
 //UniValue AssetList();
 //std::string CreateAsset(int64_t txfee,int64_t assetsupply,std::string name,std::string description);
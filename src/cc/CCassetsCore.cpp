@@ -647,3 +647,294 @@ bool AssetCalcAmounts(struct CCcontract_info *cpAssets, int64_t &inputs, int64_t
 		it's now done in Tokens  */
 	return(true);
 }
+
+/*
+ The order book keeps the open orders of the assets global addresses in memory, indexed by tokenid and sorted by price,
+ so tokenorders and mytokenorders do not have to load and decode every open order of every token on each call.
+ It is loaded from the address index on first use and then follows the active chain through AssetsOrderBookUpdate().
+ Like the address index it is built from, it holds confirmed orders only.
+ */
+class CAssetsOrderBook
+{
+public:
+    struct CSides
+    {
+        std::set<std::pair<double, COutPoint> > bids, asks;  // best bid is the last one, best ask is the first one
+    };
+
+    CCriticalSection cs;
+    std::map<COutPoint, CAssetOrder> orders;
+    std::map<uint256, CSides> books;
+
+    bool IsLoaded() const { return fLoaded; }
+    bool EnsureLoaded(uint8_t evalcode2);
+    void Connect(const CTransaction &tx);
+    void Disconnect(const CTransaction &tx);
+    uint8_t NonfungibleEvalCode(uint256 tokenid);
+
+private:
+    bool fLoaded = false;
+    std::string bidsaddr, asksaddr;
+    std::map<uint8_t, std::string> dualevaladdrs;
+    std::set<uint8_t> loadedEvalCodes2;
+    std::map<uint256, uint8_t> nonfungibleEvalCodes;
+
+    std::string DualEvalAddress(uint8_t evalcode2);
+    void LoadAddress(const std::string &coinaddr);
+    void AddOrders(const CTransaction &tx, int32_t onlyvout);
+    void RemoveOrder(const COutPoint &outpoint);
+};
+
+static CAssetsOrderBook assetsOrderBook;
+
+std::string CAssetsOrderBook::DualEvalAddress(uint8_t evalcode2)
+{
+    std::map<uint8_t, std::string>::iterator it = dualevaladdrs.find(evalcode2);
+    if (it == dualevaladdrs.end())
+    {
+        struct CCcontract_info *cpAssets, assetsC; char coinaddr[64];
+        cpAssets = CCinit(&assetsC, EVAL_ASSETS);
+        cpAssets->additionalTokensEvalcode2 = evalcode2;
+        GetTokensCCaddress(cpAssets, coinaddr, GetUnspendable(cpAssets, NULL));
+        it = dualevaladdrs.insert(std::make_pair(evalcode2, std::string(coinaddr))).first;
+    }
+    return it->second;
+}
+
+uint8_t CAssetsOrderBook::NonfungibleEvalCode(uint256 tokenid)
+{
+    std::map<uint256, uint8_t>::iterator it = nonfungibleEvalCodes.find(tokenid);
+    if (it == nonfungibleEvalCodes.end())
+    {
+        vscript_t vopretNonfungible;
+        GetNonfungibleData(tokenid, vopretNonfungible);
+        it = nonfungibleEvalCodes.insert(std::make_pair(tokenid, vopretNonfungible.size() > 0 ? vopretNonfungible.begin()[0] : (uint8_t)0)).first;
+    }
+    return it->second;
+}
+
+// loads the bids and asks addresses on first use, and the dual eval asks address for evalcode2 if it is not zero
+bool CAssetsOrderBook::EnsureLoaded(uint8_t evalcode2)
+{
+    if (!fLoaded)
+    {
+        struct CCcontract_info *cpAssets, assetsC; char coinaddr[64];
+        cpAssets = CCinit(&assetsC, EVAL_ASSETS);
+        GetCCaddress(cpAssets, coinaddr, GetUnspendable(cpAssets, NULL));
+        bidsaddr = coinaddr;
+        GetTokensCCaddress(cpAssets, coinaddr, GetUnspendable(cpAssets, NULL));
+        asksaddr = coinaddr;
+        LoadAddress(bidsaddr);
+        LoadAddress(asksaddr);
+        fLoaded = true;
+        LOGSTREAM("ccassets", CCLOG_INFO, stream << "CAssetsOrderBook loaded orders.size()=" << orders.size() << " for tokens.size()=" << books.size() << std::endl);
+    }
+    if (evalcode2 != 0 && loadedEvalCodes2.insert(evalcode2).second)
+        LoadAddress(DualEvalAddress(evalcode2));
+    return true;
+}
+
+void CAssetsOrderBook::LoadAddress(const std::string &coinaddr)
+{
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    char addr[64];
+
+    strcpy(addr, coinaddr.c_str());
+    SetCCunspents(unspentOutputs, addr, true);
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it = unspentOutputs.begin(); it != unspentOutputs.end(); it++)
+    {
+        CTransaction ordertx; uint256 hashBlock;
+        if (myGetTransaction(it->first.txhash, ordertx, hashBlock) != 0)
+            AddOrders(ordertx, (int32_t)it->first.index);
+    }
+}
+
+// adds the order outputs of tx, or only its vout onlyvout if it is not negative
+void CAssetsOrderBook::AddOrders(const CTransaction &tx, int32_t onlyvout)
+{
+    vscript_t vopret; uint256 tokenid, otherid; int64_t price; std::vector<uint8_t> origpubkey; uint8_t funcid, evalCode;
+
+    if (tx.vout.size() < 2)
+        return;
+    // skip the transactions that are not token transfers quickly, before decoding the opret
+    if (!GetOpReturnData(tx.vout.back().scriptPubKey, vopret) || vopret.size() < 2 || vopret[0] != EVAL_TOKENS || vopret[1] == 'c')
+        return;
+    if ((funcid = DecodeAssetTokenOpRet(tx.vout.back().scriptPubKey, evalCode, tokenid, otherid, price, origpubkey)) == 0)
+        return;
+
+    uint256 txid = tx.GetHash();
+    for (int32_t v = 0; v < (int32_t)tx.vout.size() - 1; v++)
+    {
+        char coinaddr[64]; uint8_t evalcode2 = 0;
+
+        if (onlyvout >= 0 && v != onlyvout)
+            continue;
+        if (tx.vout[v].nValue == 0 || !tx.vout[v].scriptPubKey.IsPayToCryptoCondition())
+            continue;
+        if (orders.find(COutPoint(txid, v)) != orders.end())
+            continue;
+        Getscriptaddress(coinaddr, tx.vout[v].scriptPubKey);
+        if (bidsaddr != coinaddr && asksaddr != coinaddr)
+        {
+            if ((evalcode2 = NonfungibleEvalCode(tokenid)) == 0 || DualEvalAddress(evalcode2) != coinaddr)
+                continue;
+        }
+
+        CAssetOrder order;
+        order.outpoint = COutPoint(txid, v);
+        order.funcid = funcid;
+        order.evalcode2 = evalcode2;
+        order.tokenid = tokenid;
+        order.otherid = otherid;
+        order.nValue = tx.vout[v].nValue;
+        order.origValue = tx.vout[0].nValue;
+        order.price = price;
+        order.origpubkey = origpubkey;
+        order.unitprice = 0;
+        if (funcid == 'b' || funcid == 'B')
+        {
+            if (price > 0)
+                order.unitprice = (double)order.origValue / price;
+            books[tokenid].bids.insert(std::make_pair(order.unitprice, order.outpoint));
+        }
+        else if (funcid == 's' || funcid == 'S')
+        {
+            if (order.origValue > 0)
+                order.unitprice = (double)price / order.origValue;
+            books[tokenid].asks.insert(std::make_pair(order.unitprice, order.outpoint));
+        }
+        orders.insert(std::make_pair(order.outpoint, order));
+        LOGSTREAM("ccassets", CCLOG_DEBUG2, stream << "CAssetsOrderBook added order funcid=" << (char)funcid << " txid=" << txid.GetHex() << " vout=" << v << " tokenid=" << tokenid.GetHex() << std::endl);
+    }
+}
+
+void CAssetsOrderBook::RemoveOrder(const COutPoint &outpoint)
+{
+    std::map<COutPoint, CAssetOrder>::iterator it = orders.find(outpoint);
+    if (it == orders.end())
+        return;
+
+    std::map<uint256, CSides>::iterator itBook = books.find(it->second.tokenid);
+    if (itBook != books.end())
+    {
+        itBook->second.bids.erase(std::make_pair(it->second.unitprice, outpoint));
+        itBook->second.asks.erase(std::make_pair(it->second.unitprice, outpoint));
+        if (itBook->second.bids.empty() && itBook->second.asks.empty())
+            books.erase(itBook);
+    }
+    orders.erase(it);
+}
+
+void CAssetsOrderBook::Connect(const CTransaction &tx)
+{
+    for (int32_t i = 0; i < tx.vin.size(); i++)
+        RemoveOrder(tx.vin[i].prevout);
+    AddOrders(tx, -1);
+}
+
+void CAssetsOrderBook::Disconnect(const CTransaction &tx)
+{
+    uint256 txid = tx.GetHash();
+    for (int32_t v = 0; v < tx.vout.size(); v++)
+        RemoveOrder(COutPoint(txid, v));
+    // orders are only spent by cc inputs, so only those previous transactions need to be reloaded
+    for (int32_t i = 0; i < tx.vin.size(); i++)
+    {
+        CTransaction prevtx; uint256 hashBlock;
+        if (IsCCInput(tx.vin[i].scriptSig) && myGetTransaction(tx.vin[i].prevout.hash, prevtx, hashBlock) != 0)
+            AddOrders(prevtx, (int32_t)tx.vin[i].prevout.n);
+    }
+}
+
+void AssetsOrderBookUpdate(const CBlock &block, bool fConnect)
+{
+    LOCK(assetsOrderBook.cs);
+    // nothing to follow until the book is loaded, loading reads the address index which already has this block
+    if (!assetsOrderBook.IsLoaded())
+        return;
+    if (fConnect)
+    {
+        for (int32_t i = 0; i < block.vtx.size(); i++)
+            assetsOrderBook.Connect(block.vtx[i]);
+    }
+    else
+    {
+        for (int32_t i = (int32_t)block.vtx.size() - 1; i >= 0; i--)
+            assetsOrderBook.Disconnect(block.vtx[i]);
+    }
+}
+
+// returns the open orders for tokenid (all tokens if zeroid), or the asks of pk if pk is set, best prices first.
+// Non-fungible asks are returned only for the tokenid requested or for additionalEvalCode
+bool GetAssetOrders(uint256 tokenid, CPubKey pk, uint8_t additionalEvalCode, std::vector<CAssetOrder> &orders)
+{
+    LOCK2(cs_main, assetsOrderBook.cs);
+
+    uint8_t evalcode2 = additionalEvalCode;
+    if (tokenid != zeroid)
+        evalcode2 = assetsOrderBook.NonfungibleEvalCode(tokenid);
+    if (!assetsOrderBook.EnsureLoaded(evalcode2))
+        return false;
+
+    auto addSide = [&](const CAssetsOrderBook::CSides &sides)
+    {
+        for (std::set<std::pair<double, COutPoint> >::const_reverse_iterator it = sides.bids.rbegin(); it != sides.bids.rend(); it++)
+        {
+            const CAssetOrder &order = assetsOrderBook.orders[it->second];
+            if (pk == CPubKey() && (order.evalcode2 == 0 || order.evalcode2 == evalcode2))
+                orders.push_back(order);
+        }
+        for (std::set<std::pair<double, COutPoint> >::const_iterator it = sides.asks.begin(); it != sides.asks.end(); it++)
+        {
+            const CAssetOrder &order = assetsOrderBook.orders[it->second];
+            if ((pk == CPubKey() || pk == pubkey2pk(order.origpubkey)) && (order.evalcode2 == 0 || order.evalcode2 == evalcode2))
+                orders.push_back(order);
+        }
+    };
+
+    if (tokenid != zeroid)
+    {
+        std::map<uint256, CAssetsOrderBook::CSides>::const_iterator itBook = assetsOrderBook.books.find(tokenid);
+        if (itBook != assetsOrderBook.books.end())
+            addSide(itBook->second);
+    }
+    else
+    {
+        for (std::map<uint256, CAssetsOrderBook::CSides>::const_iterator itBook = assetsOrderBook.books.begin(); itBook != assetsOrderBook.books.end(); itBook++)
+            addSide(itBook->second);
+    }
+    if (pk == CPubKey())
+    {
+        // swaps are not sorted into either side of a book
+        for (std::map<COutPoint, CAssetOrder>::const_iterator it = assetsOrderBook.orders.begin(); it != assetsOrderBook.orders.end(); it++)
+        {
+            const CAssetOrder &order = it->second;
+            if ((tokenid == zeroid || order.tokenid == tokenid) && order.funcid != 'b' && order.funcid != 'B' && order.funcid != 's' && order.funcid != 'S' &&
+                (order.evalcode2 == 0 || order.evalcode2 == evalcode2))
+                orders.push_back(order);
+        }
+    }
+    return true;
+}
+
+// returns up to depth best bids and asks for tokenid, skipping the orders already being filled or cancelled in the mempool
+bool GetAssetTopOfBook(uint256 tokenid, int32_t depth, std::vector<CAssetOrder> &bids, std::vector<CAssetOrder> &asks)
+{
+    LOCK2(cs_main, assetsOrderBook.cs);
+
+    if (!assetsOrderBook.EnsureLoaded(assetsOrderBook.NonfungibleEvalCode(tokenid)))
+        return false;
+
+    std::map<uint256, CAssetsOrderBook::CSides>::const_iterator itBook = assetsOrderBook.books.find(tokenid);
+    if (itBook == assetsOrderBook.books.end())
+        return true;
+
+    LOCK(mempool.cs);
+    for (std::set<std::pair<double, COutPoint> >::const_reverse_iterator it = itBook->second.bids.rbegin(); it != itBook->second.bids.rend() && bids.size() < depth; it++)
+        if (mempool.mapNextTx.count(it->second) == 0)
+            bids.push_back(assetsOrderBook.orders[it->second]);
+    for (std::set<std::pair<double, COutPoint> >::const_iterator it = itBook->second.asks.begin(); it != itBook->second.asks.end() && asks.size() < depth; it++)
+        if (mempool.mapNextTx.count(it->second) == 0)
+            asks.push_back(assetsOrderBook.orders[it->second]);
+    return true;
+}
@@ -17,9 +17,64 @@
 #include "CCtokens.h"
 #include "komodo_bitcoind.h"
 
+static UniValue AssetOrderToJSON(struct CCcontract_info *cpAssets, struct CCcontract_info *cpTokens, const CAssetOrder &order)
+{
+    UniValue item(UniValue::VOBJ);
+    char numstr[32], funcidstr[16], origaddr[64], origtokenaddr[64];
+
+    funcidstr[0] = order.funcid;
+    funcidstr[1] = 0;
+    item.push_back(Pair("funcid", funcidstr));
+    item.push_back(Pair("txid", order.outpoint.hash.GetHex()));
+    item.push_back(Pair("vout", (int64_t)order.outpoint.n));
+    if (order.funcid == 'b' || order.funcid == 'B')
+    {
+        sprintf(numstr, "%.8f", (double)order.nValue / COIN);
+        item.push_back(Pair("amount", numstr));
+        sprintf(numstr, "%.8f", (double)order.origValue / COIN);
+        item.push_back(Pair("bidamount", numstr));
+    }
+    else
+    {
+        sprintf(numstr, "%llu", (long long)order.nValue);
+        item.push_back(Pair("amount", numstr));
+        sprintf(numstr, "%llu", (long long)order.origValue);
+        item.push_back(Pair("askamount", numstr));
+    }
+    if (order.origpubkey.size() == CPubKey::COMPRESSED_PUBLIC_KEY_SIZE)
+    {
+        GetCCaddress(cpAssets, origaddr, pubkey2pk(order.origpubkey));
+        item.push_back(Pair("origaddress", origaddr));
+        GetTokensCCaddress(cpTokens, origtokenaddr, pubkey2pk(order.origpubkey));
+        item.push_back(Pair("origtokenaddress", origtokenaddr));
+    }
+    if (order.tokenid != zeroid)
+        item.push_back(Pair("tokenid", order.tokenid.GetHex()));
+    if (order.otherid != zeroid)
+        item.push_back(Pair("otherid", order.otherid.GetHex()));
+    if (order.price > 0)
+    {
+        if (order.funcid == 's' || order.funcid == 'S' || order.funcid == 'e' || order.funcid == 'e')
+        {
+            sprintf(numstr, "%.8f", (double)order.price / COIN);
+            item.push_back(Pair("totalrequired", numstr));
+            sprintf(numstr, "%.8f", (double)order.price / (COIN * order.origValue));
+            item.push_back(Pair("price", numstr));
+        }
+        else
+        {
+            item.push_back(Pair("totalrequired", (int64_t)order.price));
+            sprintf(numstr, "%.8f", (double)order.origValue / (order.price * COIN));
+            item.push_back(Pair("price", numstr));
+        }
+    }
+    return item;
+}
+
 UniValue AssetOrders(uint256 refassetid, CPubKey pk, uint8_t additionalEvalCode)
 {
 	UniValue result(UniValue::VARR);  
+    std::vector<CAssetOrder> orders;
 
     struct CCcontract_info *cpAssets, assetsC;
     struct CCcontract_info *cpTokens, tokensC;
@@ -27,131 +82,33 @@ UniValue AssetOrders(uint256 refassetid, CPubKey pk, uint8_t additionalEvalCode)
     cpAssets = CCinit(&assetsC, EVAL_ASSETS);
     cpTokens = CCinit(&tokensC, EVAL_TOKENS);
 
-	auto addOrders = [&](struct CCcontract_info *cp, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it)
-	{
-		uint256 txid, hashBlock, assetid, assetid2;
-		int64_t price;
-		std::vector<uint8_t> origpubkey;
-		CTransaction ordertx;
-		uint8_t funcid, evalCode;
-		char numstr[32], funcidstr[16], origaddr[64], origtokenaddr[64];
-
-        txid = it->first.txhash;
-        LOGSTREAM("ccassets", CCLOG_DEBUG2, stream << "addOrders() checking txid=" << txid.GetHex() << std::endl);
-        if ( myGetTransaction(txid, ordertx, hashBlock) != 0 )
-        {
-			// for logging: funcid = DecodeAssetOpRet(vintx.vout[vintx.vout.size() - 1].scriptPubKey, evalCode, assetid, assetid2, price, origpubkey);
-            if (ordertx.vout.size() > 0 && (funcid = DecodeAssetTokenOpRet(ordertx.vout[ordertx.vout.size()-1].scriptPubKey, evalCode, assetid, assetid2, price, origpubkey)) != 0)
-            {
-                LOGSTREAM("ccassets", CCLOG_DEBUG2, stream << "addOrders() checking ordertx.vout.size()=" << ordertx.vout.size() << " funcid=" << (char)(funcid ? funcid : ' ') << " assetid=" << assetid.GetHex() << std::endl);
-
-                if (pk == CPubKey() && (refassetid == zeroid || assetid == refassetid)  // tokenorders
-                    || pk != CPubKey() && pk == pubkey2pk(origpubkey) && (funcid == 'S' || funcid == 's'))  // mytokenorders, returns only asks (is this correct?)
-                {
-
-                    LOGSTREAM("ccassets", CCLOG_DEBUG2, stream << "addOrders() it->first.index=" << it->first.index << " ordertx.vout[it->first.index].nValue=" << ordertx.vout[it->first.index].nValue << std::endl);
-                    if (ordertx.vout[it->first.index].nValue == 0) {
-                        LOGSTREAM("ccassets", CCLOG_DEBUG2, stream << "addOrders() order with value=0 skipped" << std::endl);
-                        return;
-                    }
-
-                    UniValue item(UniValue::VOBJ);
-
-                    funcidstr[0] = funcid;
-                    funcidstr[1] = 0;
-                    item.push_back(Pair("funcid", funcidstr));
-                    item.push_back(Pair("txid", txid.GetHex()));
-                    item.push_back(Pair("vout", (int64_t)it->first.index));
-                    if (funcid == 'b' || funcid == 'B')
-                    {
-                        sprintf(numstr, "%.8f", (double)ordertx.vout[it->first.index].nValue / COIN);
-                        item.push_back(Pair("amount", numstr));
-                        sprintf(numstr, "%.8f", (double)ordertx.vout[0].nValue / COIN);
-                        item.push_back(Pair("bidamount", numstr));
-                    }
-                    else
-                    {
-                        sprintf(numstr, "%llu", (long long)ordertx.vout[it->first.index].nValue);
-                        item.push_back(Pair("amount", numstr));
-                        sprintf(numstr, "%llu", (long long)ordertx.vout[0].nValue);
-                        item.push_back(Pair("askamount", numstr));
-                    }
-                    if (origpubkey.size() == CPubKey::COMPRESSED_PUBLIC_KEY_SIZE)
-                    {
-                        GetCCaddress(cp, origaddr, pubkey2pk(origpubkey));  
-                        item.push_back(Pair("origaddress", origaddr));
-                        GetTokensCCaddress(cpTokens, origtokenaddr, pubkey2pk(origpubkey));
-                        item.push_back(Pair("origtokenaddress", origtokenaddr));
-
-                    }
-                    if (assetid != zeroid)
-                        item.push_back(Pair("tokenid", assetid.GetHex()));
-                    if (assetid2 != zeroid)
-                        item.push_back(Pair("otherid", assetid2.GetHex()));
-                    if (price > 0)
-                    {
-                        if (funcid == 's' || funcid == 'S' || funcid == 'e' || funcid == 'e')
-                        {
-                            sprintf(numstr, "%.8f", (double)price / COIN);
-                            item.push_back(Pair("totalrequired", numstr));
-                            sprintf(numstr, "%.8f", (double)price / (COIN * ordertx.vout[0].nValue));
-                            item.push_back(Pair("price", numstr));
-                        }
-                        else
-                        {
-                            item.push_back(Pair("totalrequired", (int64_t)price));
-                            sprintf(numstr, "%.8f", (double)ordertx.vout[0].nValue / (price * COIN));
-                            item.push_back(Pair("price", numstr));
-                        }
-                    }
-                    result.push_back(item);
-                    LOGSTREAM("ccassets", CCLOG_DEBUG1, stream << "addOrders() added order funcId=" << (char)(funcid ? funcid : ' ') << " it->first.index=" << it->first.index << " ordertx.vout[it->first.index].nValue=" << ordertx.vout[it->first.index].nValue << " tokenid=" << assetid.GetHex() << std::endl);
-                }
-            }
-        }
-	};
+    // the orders come from the in-memory order book (see CCassetsCore.cpp), bids first
+    GetAssetOrders(refassetid, pk, additionalEvalCode, orders);
+    for (std::vector<CAssetOrder>::const_iterator it = orders.begin(); it != orders.end(); it++)
+        result.push_back(AssetOrderToJSON(cpAssets, cpTokens, *it));
+    return(result);
+}
 
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputsTokens, unspentOutputsDualEvalTokens, unspentOutputsCoins;
+UniValue AssetTopOfBook(uint256 tokenid, int32_t depth)
+{
+    UniValue result(UniValue::VOBJ), bidsarray(UniValue::VARR), asksarray(UniValue::VARR);
+    std::vector<CAssetOrder> bids, asks;
 
-	char assetsUnspendableAddr[64];
-	GetCCaddress(cpAssets, assetsUnspendableAddr, GetUnspendable(cpAssets, NULL));
-	SetCCunspents(unspentOutputsCoins, assetsUnspendableAddr,true);
+    struct CCcontract_info *cpAssets, assetsC;
+    struct CCcontract_info *cpTokens, tokensC;
 
-	char assetsTokensUnspendableAddr[64];
-    std::vector<uint8_t> vopretNonfungible;
-    if (refassetid != zeroid) {
-        GetNonfungibleData(refassetid, vopretNonfungible);
-        if (vopretNonfungible.size() > 0)
-            cpAssets->additionalTokensEvalcode2 = vopretNonfungible.begin()[0];
-    }
-	GetTokensCCaddress(cpAssets, assetsTokensUnspendableAddr, GetUnspendable(cpAssets, NULL));
-	SetCCunspents(unspentOutputsTokens, assetsTokensUnspendableAddr,true);
-
-    // tokenbids:
-    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator itCoins = unspentOutputsCoins.begin();
-        itCoins != unspentOutputsCoins.end();
-        itCoins++)
-        addOrders(cpAssets, itCoins);
-    
-    // tokenasks:
-    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator itTokens = unspentOutputsTokens.begin();
-		itTokens != unspentOutputsTokens.end();
-		itTokens++)
-		addOrders(cpAssets, itTokens);
-
-    if (additionalEvalCode != 0) {  //this would be mytokenorders
-        char assetsDualEvalTokensUnspendableAddr[64];
-
-        // try also dual eval tokenasks (and we do not need bids):
-        cpAssets->additionalTokensEvalcode2 = additionalEvalCode;
-        GetTokensCCaddress(cpAssets, assetsDualEvalTokensUnspendableAddr, GetUnspendable(cpAssets, NULL));
-        SetCCunspents(unspentOutputsDualEvalTokens, assetsDualEvalTokensUnspendableAddr,true);
-
-        for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator itDualEvalTokens = unspentOutputsDualEvalTokens.begin();
-            itDualEvalTokens != unspentOutputsDualEvalTokens.end();
-            itDualEvalTokens++)
-            addOrders(cpAssets, itDualEvalTokens);
-    }
+    cpAssets = CCinit(&assetsC, EVAL_ASSETS);
+    cpTokens = CCinit(&tokensC, EVAL_TOKENS);
+
+    GetAssetTopOfBook(tokenid, depth, bids, asks);
+    for (std::vector<CAssetOrder>::const_iterator it = bids.begin(); it != bids.end(); it++)
+        bidsarray.push_back(AssetOrderToJSON(cpAssets, cpTokens, *it));
+    for (std::vector<CAssetOrder>::const_iterator it = asks.begin(); it != asks.end(); it++)
+        asksarray.push_back(AssetOrderToJSON(cpAssets, cpTokens, *it));
+    result.push_back(Pair("result", "success"));
+    result.push_back(Pair("tokenid", tokenid.GetHex()));
+    result.push_back(Pair("bids", bidsarray));
+    result.push_back(Pair("asks", asksarray));
     return(result);
 }
 
@@ -279,6 +279,7 @@ struct CCcontract_info *CCinit(struct CCcontract_info *cp, uint8_t evalcode)
             memcpy(cp->CCpriv,AssetsCCpriv,32);
             cp->validate = AssetsValidate;
             cp->ismyvin = IsAssetsInput;
+            cp->evalcacheable = 1;
             break;
         case EVAL_FAUCET:
             strcpy(cp->unspendableCCaddr,FaucetCCaddr);
@@ -376,6 +377,7 @@ struct CCcontract_info *CCinit(struct CCcontract_info *cp, uint8_t evalcode)
 			memcpy(cp->CCpriv, TokensCCpriv, 32);
 			cp->validate = TokensValidate;
 			cp->ismyvin = IsTokensInput;
+			cp->evalcacheable = 1;
 			break;
         case EVAL_IMPORTGATEWAY:
 			strcpy(cp->unspendableCCaddr, ImportGatewayCCaddr);
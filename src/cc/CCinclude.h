@@ -197,6 +197,11 @@ struct CCcontract_info
     /// \endcode
     bool (*ismyvin)(CScript const& scriptSig);	
 
+    /// set by CCinit if the validate callback's result depends only on the transaction, the transactions it looks up
+    /// and the chain height, not on the mempool, so a successful result can be cached from mempool accept to block connect
+    /// (the cache is keyed on the height, so height cutoffs in the validator are honoured)
+    uint8_t evalcacheable;
+
     /// @private
     uint8_t didinit;
 };
@@ -335,6 +340,7 @@ uint256 OraclesBatontxid(uint256 oracletxid,CPubKey pk);
 uint8_t DecodeOraclesCreateOpRet(const CScript &scriptPubKey,std::string &name,std::string &description,std::string &format);
 uint8_t DecodeOraclesOpRet(const CScript &scriptPubKey,uint256 &oracletxid,CPubKey &pk,int64_t &num);
 uint8_t DecodeOraclesData(const CScript &scriptPubKey,uint256 &oracletxid,uint256 &batontxid,CPubKey &pk,std::vector <uint8_t>&data);
+void OraclesDataIndexRecords(const CBlock &block,int32_t height,std::vector<std::pair<COraclesDataIndexKey, COraclesDataIndexValue> > &oraclesIndex);
 int32_t oracle_format(uint256 *hashp,int64_t *valp,char *str,uint8_t fmt,uint8_t *data,int32_t offset,int32_t datalen);
 /// \endcond
 
@@ -364,6 +370,25 @@ int64_t AddTokenCCInputs(struct CCcontract_info *cp, CMutableTransaction &mtx, C
 /// @returns true if vout is true token with the reftokenid id
 int64_t IsTokensvout(bool goDeeper, bool checkPubkeys, struct CCcontract_info *cp, Eval* eval, const CTransaction& tx, int32_t v, uint256 reftokenid);
 
+/// Collects the tokens index changes of a block
+/// @param block the block
+/// @param height its height
+/// @param fConnect true if the block is being connected. If false the outputs it created are read back from the index
+/// @param[out] created token outputs created by the block
+/// @param[out] spent indexed token outputs spent by the block
+void TokensIndexRecords(const CBlock &block, int32_t height, bool fConnect, std::vector<std::pair<CTokensIndexKey, CTokensIndexValue> > &created, std::vector<std::pair<CTokensIndexKey, CTokensIndexValue> > &spent);
+
+/// Applies a connected or disconnected block to the in-memory assets order book
+/// @param block the block
+/// @param fConnect true if the block is being connected to the tip, false if it is being disconnected
+void AssetsOrderBookUpdate(const CBlock &block, bool fConnect);
+
+/// Gets the key the tokens index uses for a CC address
+/// @param coinaddr the address
+/// @param[out] addressHash the key
+/// @returns false if the address could not be decoded
+bool GetTokensIndexAddressHash(const char *coinaddr, uint160 &addressHash);
+
 /// Decodes transaction object into hex encoding
 /// @param tx transaction object
 /// @param[out] strHexTx transaction in hex encoding
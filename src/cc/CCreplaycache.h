@@ -0,0 +1,154 @@
+/******************************************************************************
+ * Copyright © 2014-2019 The SuperNET Developers.                             *
+ *                                                                            *
+ * See the AUTHORS, DEVELOPER-AGREEMENT and LICENSE files at                  *
+ * the top-level directory of this distribution for the individual copyright  *
+ * holder information and the developer policies on copyright and licensing.  *
+ *                                                                            *
+ * Unless otherwise agreed in a custom licensing agreement, no part of the    *
+ * SuperNET software, including this file may be copied, modified, propagated *
+ * or distributed except according to the terms contained in the LICENSE file *
+ *                                                                            *
+ * Removal or modification of this copyright notice is prohibited.            *
+ *                                                                            *
+ ******************************************************************************/
+
+#ifndef CC_REPLAYCACHE_H
+#define CC_REPLAYCACHE_H
+
+// Caches shared by the rogue and games dapps, which replay a player's keystrokes from the game seed.
+// Both are included once per cclib build, so everything here is static.
+
+#include "CCinclude.h"
+#include "hash.h"
+#include <deque>
+#include <map>
+#include <mutex>
+
+#define CCREPLAY_MAXCHAINS 10000
+#define CCREPLAY_MAXRESULTS 256
+
+/** one keystrokes transaction of a baton chain and the raw keystrokes from its opreturn */
+struct CCbatonlink
+{
+    uint256 txid;
+    std::vector<uint8_t> keystrokes;
+};
+
+static std::mutex CCbatoncache_mutex;
+static std::map<uint256,std::vector<CCbatonlink> > CCbatoncache; // registration txid -> confirmed keystrokes transactions in spend order
+
+/****
+ * @brief get the confirmed part of a baton chain found before
+ * @param regtxid the registration transaction the chain starts from
+ * @param[out] links the keystrokes transactions in spend order
+ * @returns true if the chain is known and its last link still spends the one before it
+ */
+static bool CCbatoncache_get(uint256 regtxid,std::vector<CCbatonlink> &links)
+{
+    uint256 spenttxid,prevtxid;
+    {
+        std::lock_guard<std::mutex> lock(CCbatoncache_mutex);
+        std::map<uint256,std::vector<CCbatonlink> >::iterator it = CCbatoncache.find(regtxid);
+        if ( it == CCbatoncache.end() || it->second.empty() )
+            return(false);
+        links = it->second;
+    }
+    // each link spends the one before it, so a reorg that drops any of them also drops the last
+    prevtxid = links.size() > 1 ? links[links.size()-2].txid : regtxid;
+    if ( myIsutxo_spent(spenttxid,prevtxid,0) < 0 || spenttxid != links.back().txid )
+    {
+        std::lock_guard<std::mutex> lock(CCbatoncache_mutex);
+        CCbatoncache.erase(regtxid);
+        links.clear();
+        return(false);
+    }
+    return(true);
+}
+
+/****
+ * @brief remember the confirmed part of a baton chain
+ * @param regtxid the registration transaction the chain starts from
+ * @param links the confirmed keystrokes transactions in spend order
+ */
+static void CCbatoncache_put(uint256 regtxid,const std::vector<CCbatonlink> &links)
+{
+    if ( links.empty() )
+        return;
+    std::lock_guard<std::mutex> lock(CCbatoncache_mutex);
+    if ( CCbatoncache.size() >= CCREPLAY_MAXCHAINS && CCbatoncache.count(regtxid) == 0 )
+        CCbatoncache.clear();
+    CCbatoncache[regtxid] = links;
+}
+
+struct CCreplayresult
+{
+    uint256 inputhash;
+    std::vector<uint8_t> newdata;
+    int32_t num;
+};
+
+// the game engines keep their state in globals, so only one replay can run at a time
+static std::mutex CCreplay_mutex;
+static std::mutex CCreplaycache_mutex;
+static std::map<std::pair<uint64_t,int32_t>,CCreplayresult> CCreplaycache; // (seed, number of keystrokes) -> result
+static std::deque<std::pair<uint64_t,int32_t> > CCreplayorder;
+
+/****
+ * @brief run a replay function unless the same seed, keystrokes and starting player were replayed before
+ * @param replay rogue_replay2 or games_replay2
+ * @param newdata where the player data after the game is written
+ * @param seed the game seed
+ * @param keystrokes the keystrokes of the whole game
+ * @param num the number of keystrokes
+ * @param player the player carried into the game, 0 for a new one
+ * @param pcached set to 1 if the result came from the cache
+ * @returns the size of the player data, as the replay function
+ */
+template <typename KEYSTROKE,typename PLAYER>
+static int32_t CCreplay_cached(int32_t (*replay)(uint8_t *,uint64_t,KEYSTROKE *,int32_t,PLAYER *,int32_t),uint8_t *newdata,uint64_t seed,KEYSTROKE *keystrokes,int32_t num,PLAYER *player,int32_t *pcached=0)
+{
+    std::pair<uint64_t,int32_t> key(seed,num); CCreplayresult result; int32_t n;
+    CHashWriter ss(SER_GETHASH,PROTOCOL_VERSION);
+    ss << seed << num;
+    if ( num > 0 )
+        ss.write((const char *)keystrokes,num * sizeof(*keystrokes));
+    if ( player != 0 )
+        ss.write((const char *)player,sizeof(*player));
+    result.inputhash = ss.GetHash();
+    if ( pcached != 0 )
+        *pcached = 0;
+    {
+        std::lock_guard<std::mutex> lock(CCreplaycache_mutex);
+        std::map<std::pair<uint64_t,int32_t>,CCreplayresult>::iterator it = CCreplaycache.find(key);
+        if ( it != CCreplaycache.end() && it->second.inputhash == result.inputhash )
+        {
+            if ( newdata != 0 && it->second.newdata.size() > 0 )
+                memcpy(newdata,it->second.newdata.data(),it->second.newdata.size());
+            if ( pcached != 0 )
+                *pcached = 1;
+            return(it->second.num);
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(CCreplay_mutex);
+        n = (*replay)(newdata,seed,keystrokes,num,player,0);
+    }
+    result.num = n;
+    if ( newdata != 0 && n > 0 )
+        result.newdata.assign(newdata,newdata + n);
+    std::lock_guard<std::mutex> lock(CCreplaycache_mutex);
+    if ( CCreplaycache.count(key) == 0 )
+    {
+        CCreplayorder.push_back(key);
+        while ( CCreplayorder.size() > CCREPLAY_MAXRESULTS )
+        {
+            CCreplaycache.erase(CCreplayorder.front());
+            CCreplayorder.pop_front();
+        }
+    }
+    CCreplaycache[key] = result;
+    return(n);
+}
+
+#endif
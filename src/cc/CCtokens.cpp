@@ -16,6 +16,7 @@
 #include "CCtokens.h"
 #include "importcoin.h"
 #include "komodo_bitcoind.h"
+#include "txdb.h"
 
 /* TODO: correct this:
 -----------------------------
@@ -498,6 +499,88 @@ int64_t IsTokensvout(bool goDeeper, bool checkPubkeys /*<--not used, always true
 	return(0);
 }
 
+bool GetTokensIndexAddressHash(const char *coinaddr, uint160 &addressHash)
+{
+    int type = 0;
+    CBitcoinAddress address(coinaddr);
+    return address.GetIndexKey(addressHash, type, true);
+}
+
+void TokensIndexRecords(const CBlock &block, int32_t height, bool fConnect, std::vector<std::pair<CTokensIndexKey, CTokensIndexValue> > &created, std::vector<std::pair<CTokensIndexKey, CTokensIndexValue> > &spent)
+{
+    struct CCcontract_info *cpTokens, tokensC;
+    cpTokens = CCinit(&tokensC, EVAL_TOKENS);
+    std::map<COutPoint, std::pair<CTokensIndexKey, CTokensIndexValue> > blockOutputs;
+
+    for (const CTransaction &tx : block.vtx)
+    {
+        const uint256 txid = tx.GetHash();
+        std::map<uint256, int64_t> tokenInputs;
+
+        // token outputs can only be spent by cc inputs
+        if (!tx.IsCoinBase()) {
+            for (const CTxIn &vin : tx.vin) {
+                if (!IsCCInput(vin.scriptSig))
+                    continue;
+                std::pair<CTokensIndexKey, CTokensIndexValue> output;
+                std::map<COutPoint, std::pair<CTokensIndexKey, CTokensIndexValue> >::const_iterator it = blockOutputs.find(vin.prevout);
+                if (it != blockOutputs.end())
+                    output = it->second;
+                else if (!pblocktree->ReadTokensOutput(vin.prevout, output))
+                    continue;
+                spent.push_back(output);
+                tokenInputs[output.first.tokenid] += output.second.satoshis;
+            }
+        }
+
+        if (!fConnect) {
+            for (int32_t v = 0; v < tx.vout.size(); v++) {
+                std::pair<CTokensIndexKey, CTokensIndexValue> output;
+                if (tx.vout[v].scriptPubKey.IsPayToCryptoCondition() && pblocktree->ReadTokensOutput(COutPoint(txid, v), output)) {
+                    created.push_back(output);
+                    blockOutputs[COutPoint(txid, v)] = output;
+                }
+            }
+            continue;
+        }
+
+        uint8_t funcid, evalCode;
+        uint256 tokenid;
+        std::vector<CPubKey> voutPubkeys;
+        std::vector<std::pair<uint8_t, vscript_t>> oprets;
+        int32_t numvouts = tx.vout.size();
+        if (numvouts < 2 || (funcid = DecodeTokenOpRet(tx.vout.back().scriptPubKey, evalCode, tokenid, voutPubkeys, oprets)) == 0)
+            continue;
+        if (funcid == 'c' || funcid == 'i')
+            tokenid = txid;
+
+        std::vector<std::pair<int32_t, int64_t> > outputs;
+        int64_t total = 0, nValue;
+        for (int32_t v = 0; v < numvouts - 1; v++) {
+            if ((nValue = IsTokensvout(false, true, cpTokens, NULL, tx, v, tokenid)) > 0) {
+                outputs.push_back(std::make_pair(v, nValue));
+                total += nValue;
+            }
+        }
+        // as IsTokensvout(goDeeper=true) does: outputs of anything but the tokenbase only count
+        // if they carry exactly the token inputs spent, which here are known to be valid
+        if (funcid != 'c' && funcid != 'i' && total != tokenInputs[tokenid]) {
+            LOGSTREAM((char *)"cctokens", CCLOG_DEBUG1, stream << "TokensIndexRecords() skipping txid=" << txid.GetHex() << " token inputs != outputs for tokenid=" << tokenid.GetHex() << std::endl);
+            continue;
+        }
+
+        for (auto &o : outputs) {
+            char destaddr[64];
+            uint160 addressHash;
+            if (!Getscriptaddress(destaddr, tx.vout[o.first].scriptPubKey) || !GetTokensIndexAddressHash(destaddr, addressHash))
+                continue;
+            std::pair<CTokensIndexKey, CTokensIndexValue> output(CTokensIndexKey(tokenid, addressHash, txid, o.first), CTokensIndexValue(o.second, height));
+            created.push_back(output);
+            blockOutputs[COutPoint(txid, o.first)] = output;
+        }
+    }
+}
+
 bool IsTokenMarkerVout(CTxOut vout) {
     struct CCcontract_info *cpTokens, CCtokens_info;
     cpTokens = CCinit(&CCtokens_info, EVAL_TOKENS);
@@ -625,6 +708,35 @@ int64_t AddTokenCCInputs(struct CCcontract_info *cp, CMutableTransaction &mtx, C
         cp->additionalTokensEvalcode2 = vopretNonfungible.begin()[0];
 
 	GetTokensCCaddress(cp, tokenaddr, pk);
+
+    // the tokens index only holds outputs already checked to carry this token, so they need no revalidation
+    std::vector<std::pair<CTokensIndexKey, CTokensIndexValue> > tokenOutputs;
+    uint160 addressHash;
+    if (GetTokensIndexAddressHash(tokenaddr, addressHash) && GetTokensIndex(tokenid, addressHash, tokenOutputs))
+    {
+        threshold = total / (maxinputs != 0 ? maxinputs : CC_MAXVINS);
+        for (std::vector<std::pair<CTokensIndexKey, CTokensIndexValue> >::const_iterator it = tokenOutputs.begin(); it != tokenOutputs.end(); it++)
+        {
+            uint256 vintxid = it->first.txhash;
+            int32_t vout = (int32_t)it->first.index;
+            if (it->second.satoshis < threshold)
+                continue;
+            int32_t ivin;
+            for (ivin = 0; ivin < mtx.vin.size(); ivin ++)
+                if (vintxid == mtx.vin[ivin].prevout.hash && vout == mtx.vin[ivin].prevout.n)
+                    break;
+            if (ivin != mtx.vin.size() || myIsutxo_spentinmempool(ignoretxid,ignorevin,vintxid, vout) != 0)
+                continue;
+            if (total != 0 && maxinputs != 0)
+                mtx.vin.push_back(CTxIn(vintxid, vout, CScript()));
+            totalinputs += it->second.satoshis;
+            n++;
+            if ((total > 0 && totalinputs >= total) || (maxinputs > 0 && n >= maxinputs))
+                break;
+        }
+        return(totalinputs);
+    }
+
 	SetCCunspents(unspentOutputs, tokenaddr,true);
 
 
@@ -977,6 +1089,20 @@ UniValue TokenInfo(uint256 tokenid)
         if ((output = IsTokensvout(false, true, cpTokens, NULL, tokenbaseTx, v, tokenid)) > 0)
             supply += output;
 	result.push_back(Pair("supply", supply));
+
+    std::vector<std::pair<CTokensIndexKey, CTokensIndexValue> > tokenOutputs;
+    if (GetTokensIndex(tokenid, uint160(), tokenOutputs)) {
+        // outputs come grouped by holder address
+        int64_t circulating = 0;
+        int32_t owners = 0;
+        for (std::vector<std::pair<CTokensIndexKey, CTokensIndexValue> >::const_iterator it = tokenOutputs.begin(); it != tokenOutputs.end(); it++) {
+            if (it == tokenOutputs.begin() || it->first.addressHash != (it - 1)->first.addressHash)
+                owners++;
+            circulating += it->second.satoshis;
+        }
+        result.push_back(Pair("circulating", circulating));
+        result.push_back(Pair("owners", owners));
+    }
 	result.push_back(Pair("description", description));
 
     GetOpretBlob(oprets, OPRETID_NONFUNGIBLEDATA, vopretNonfungible);
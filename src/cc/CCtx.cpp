@@ -561,7 +561,15 @@ int64_t CCtoken_balance(char *coinaddr,uint256 reftokenid)
 	std::vector<uint8_t>  vopretExtra;
     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
 	uint8_t evalCode;
+    std::vector<std::pair<CTokensIndexKey, CTokensIndexValue> > tokenOutputs;
+    uint160 addressHash;
 
+    if ( GetTokensIndexAddressHash(coinaddr,addressHash) && GetTokensIndex(reftokenid,addressHash,tokenOutputs) )
+    {
+        for (std::vector<std::pair<CTokensIndexKey, CTokensIndexValue> >::const_iterator it=tokenOutputs.begin(); it!=tokenOutputs.end(); it++)
+            sum += it->second.satoshis;
+        return(sum);
+    }
     SetCCunspents(unspentOutputs,coinaddr,true);
     for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
     {
@@ -542,10 +542,83 @@ int64_t CCduration(int32_t &numblocks,uint256 txid)
     return(duration);
 }
 
+/**
+ * Checks whether an oracles data sample carries the merkle root published for height
+ * @param logcategory category for debug logging
+ * @param data the sample
+ * @param height the height searched for
+ * @param[out] mhash the merkle root
+ * @returns 1 if found, 0 if the sample is for height but has no merkle root, -1 if it is for another height
+ */
+static int32_t CCOraclesMerkleSample(char const *logcategory,const std::vector<uint8_t> &data,int32_t height,uint256 &mhash)
+{
+    uint256 hash; int32_t len,len2; int64_t val,merkleht; char str[65],str2[65];
+
+    mhash = zeroid;
+    if ( oracle_format(&hash,&merkleht,0,'I',(uint8_t *)data.data(),0,(int32_t)data.size()) == sizeof(int32_t) && merkleht == height )
+    {
+        len = oracle_format(&hash,&val,0,'h',(uint8_t *)data.data(),sizeof(int32_t),(int32_t)data.size());
+        len2 = oracle_format(&mhash,&val,0,'h',(uint8_t *)data.data(),(int32_t)(sizeof(int32_t)+sizeof(uint256)),(int32_t)data.size());
+
+        LogPrint(logcategory,"found merkleht.%d len.%d len2.%d %s %s\n",(int32_t)merkleht,len,len2,uint256_str(str,hash),uint256_str(str2,mhash));
+        if ( len == sizeof(hash)+sizeof(int32_t) && len2 == 2*sizeof(mhash)+sizeof(int32_t) && mhash != zeroid )
+            return(1);
+        LogPrint(logcategory,"missing hash\n");
+        mhash = zeroid;
+        return(0);
+    }
+    LogPrint(logcategory,"height.%d vs search ht.%d\n",(int32_t)merkleht,(int32_t)height);
+    return(-1);
+}
+
+/**
+ * Same search as CCOraclesReverseScan over a publisher's confirmed samples, newest first, read from the oracles data index
+ * @returns the merkle root, or zeroid if not found
+ */
+static uint256 CCOraclesIndexScan(char const *logcategory,uint256 &txid,int32_t height,uint256 reforacletxid,CPubKey publisher)
+{
+    static const int32_t CCORACLES_SCAN_CHUNK = 1000;
+    std::vector<std::pair<COraclesDataIndexKey, COraclesDataIndexValue> > samples; std::set<uint256> seen;
+    uint256 mhash; int32_t retval,end = 0,prevend = -1;
+
+    LogPrint(logcategory,"index scan for %s\n",HexStr(publisher).c_str());
+    while ( end != prevend )
+    {
+        samples.clear();
+        if ( GetOraclesDataIndex(reforacletxid,publisher,true,CCORACLES_SCAN_CHUNK,samples,0,end) == 0 )
+            break;
+        for (std::vector<std::pair<COraclesDataIndexKey, COraclesDataIndexValue> >::const_iterator it=samples.begin(); it!=samples.end(); it++)
+        {
+            // the chunk boundary can split a height, skip what the previous chunk already checked
+            if ( it->first.blockHeight == end && seen.count(it->first.txid) != 0 )
+                continue;
+            if ( (retval= CCOraclesMerkleSample(logcategory,it->second.data,height,mhash)) >= 0 )
+            {
+                if ( retval > 0 )
+                {
+                    txid = it->first.txid;
+                    LogPrint(logcategory,"set txid\n");
+                }
+                return(mhash);
+            }
+        }
+        if ( samples.size() < (size_t)CCORACLES_SCAN_CHUNK )
+            break;
+        prevend = end;
+        end = samples.back().first.blockHeight;
+        seen.clear();
+        for (std::vector<std::pair<COraclesDataIndexKey, COraclesDataIndexValue> >::const_iterator it=samples.begin(); it!=samples.end(); it++)
+            if ( it->first.blockHeight == end )
+                seen.insert(it->first.txid);
+    }
+    LogPrint(logcategory,"end of index scan\n");
+    return(zeroid);
+}
+
 uint256 CCOraclesReverseScan(char const *logcategory,uint256 &txid,int32_t height,uint256 reforacletxid,uint256 batontxid)
 {
-    CTransaction tx; uint256 hash,mhash,bhash,hashBlock,oracletxid; int32_t len,len2,numvouts;
-    int64_t val,merkleht; CPubKey pk; std::vector<uint8_t>data; char str[65],str2[65];
+    CTransaction tx; uint256 mhash,bhash,hashBlock,oracletxid; int32_t numvouts,retval;
+    CPubKey pk; std::vector<uint8_t>data; char str[65];
     
     txid = zeroid;
     LogPrint(logcategory,"start reverse scan %s\n",uint256_str(str,batontxid));
@@ -555,25 +628,18 @@ uint256 CCOraclesReverseScan(char const *logcategory,uint256 &txid,int32_t heigh
         if ( DecodeOraclesData(tx.vout[numvouts-1].scriptPubKey,oracletxid,bhash,pk,data) == 'D' && oracletxid == reforacletxid )
         {
             LogPrint(logcategory,"decoded %s\n",uint256_str(str,batontxid));
-            if ( oracle_format(&hash,&merkleht,0,'I',(uint8_t *)data.data(),0,(int32_t)data.size()) == sizeof(int32_t) && merkleht == height )
+            // from the first confirmed sample down, the baton chain is in the oracles data index
+            if ( fOraclesIndex && !hashBlock.IsNull() && pk.IsCompressed() )
+                return(CCOraclesIndexScan(logcategory,txid,height,reforacletxid,pk));
+            if ( (retval= CCOraclesMerkleSample(logcategory,data,height,mhash)) >= 0 )
             {
-                len = oracle_format(&hash,&val,0,'h',(uint8_t *)data.data(),sizeof(int32_t),(int32_t)data.size());
-                len2 = oracle_format(&mhash,&val,0,'h',(uint8_t *)data.data(),(int32_t)(sizeof(int32_t)+sizeof(uint256)),(int32_t)data.size());
-
-                LogPrint(logcategory,"found merkleht.%d len.%d len2.%d %s %s\n",(int32_t)merkleht,len,len2,uint256_str(str,hash),uint256_str(str2,mhash));
-                if ( len == sizeof(hash)+sizeof(int32_t) && len2 == 2*sizeof(mhash)+sizeof(int32_t) && mhash != zeroid )
+                if ( retval > 0 )
                 {
                     txid = batontxid;
                     LogPrint(logcategory,"set txid\n");
-                    return(mhash);
-                }
-                else
-                {
-                    LogPrint(logcategory,"missing hash\n");
-                    return(zeroid);
                 }
+                return(mhash);
             }
-            else LogPrint(logcategory,"height.%d vs search ht.%d\n",(int32_t)merkleht,(int32_t)height);
             batontxid = bhash;
             LogPrint(logcategory,"new hash %s\n",uint256_str(str,batontxid));
         } else break;
@@ -586,25 +652,12 @@ int32_t NSPV_coinaddr_inmempool(char const *logcategory,char *coinaddr,uint8_t C
 
 int32_t myIs_coinaddr_inmempoolvout(char const *logcategory,char *coinaddr)
 {
-    int32_t i,n; char destaddr[64];
     if ( KOMODO_NSPV_SUPERLITE )
         return(NSPV_coinaddr_inmempool(logcategory,coinaddr,1));
-    BOOST_FOREACH(const CTxMemPoolEntry &e,mempool.mapTx)
+    if ( mempool.hasDestOutputs(coinaddr) )
     {
-        const CTransaction &tx = e.GetTx();
-        if ( (n= tx.vout.size()) > 0 )
-        {
-            const uint256 &txid = tx.GetHash();
-            for (i=0; i<n; i++)
-            {
-                Getscriptaddress(destaddr,tx.vout[i].scriptPubKey);
-                if ( strcmp(destaddr,coinaddr) == 0 )
-                {
-                    LogPrint(logcategory,"found (%s) vout in mempool\n",coinaddr);
-                    return(1);
-                }
-            }
-        }
+        LogPrint(logcategory,"found (%s) vout in mempool\n",coinaddr);
+        return(1);
     }
     return(0);
 }
@@ -627,10 +680,15 @@ int32_t myGet_mempool_txs(std::vector<CTransaction> &txs,uint8_t evalcode,uint8_
         }
         return (NSPV_mempoolresult.numtxids);
     }
-    BOOST_FOREACH(const CTxMemPoolEntry &e,mempool.mapTx)
+    std::vector<uint256> txids; CTransaction tx;
+    mempool.getCCFuncTxids(evalcode,funcid,txids);
+    for (const uint256 &txid : txids)
     {
-        txs.push_back(e.GetTx());
-        i++;
+        if ( mempool.lookup(txid,tx) )
+        {
+            txs.push_back(tx);
+            i++;
+        }
     }
     return(i);
 }
@@ -82,6 +82,7 @@ CClib_methods[] =
     { (char *)"rogue", (char *)"games", (char *)"<no args>", 0, 0, 'F', EVAL_ROGUE },
     { (char *)"rogue", (char *)"setname", (char *)"pname", 1, 1, 'N', EVAL_ROGUE },
     { (char *)"rogue", (char *)"extract", (char *)"gametxid [pubkey]", 1, 2, 'X', EVAL_ROGUE },
+    { (char *)"rogue", (char *)"replaybench", (char *)"seed [iterations]", 1, 2, 'B', EVAL_ROGUE },
 #elif BUILD_CUSTOMCC
     RPC_FUNCS
 #elif BUILD_GAMESCC
@@ -129,6 +130,7 @@ UniValue rogue_players(uint64_t txfee,struct CCcontract_info *cp,cJSON *params);
 UniValue rogue_games(uint64_t txfee,struct CCcontract_info *cp,cJSON *params);
 UniValue rogue_setname(uint64_t txfee,struct CCcontract_info *cp,cJSON *params);
 UniValue rogue_extract(uint64_t txfee,struct CCcontract_info *cp,cJSON *params);
+UniValue rogue_replaybench(uint64_t txfee,struct CCcontract_info *cp,cJSON *params);
 
 #else
 bool sudoku_validate(struct CCcontract_info *cp,int32_t height,Eval *eval,const CTransaction tx);
@@ -217,6 +219,8 @@ UniValue CClib_method(struct CCcontract_info *cp,char *method,char *jsonstr)
             return(rogue_highlander(txfee,cp,params));
         else if ( strcmp(method,"extract") == 0 )
             return(rogue_extract(txfee,cp,params));
+        else if ( strcmp(method,"replaybench") == 0 )
+            return(rogue_replaybench(txfee,cp,params));
         else if ( strcmp(method,"playerinfo") == 0 )
             return(rogue_playerinfo(txfee,cp,params));
         else if ( strcmp(method,"players") == 0 )
@@ -37,6 +37,7 @@ char *CClib_name();
 Eval* EVAL_TEST = 0;
 struct CCcontract_info CCinfos[0x100];
 extern pthread_mutex_t KOMODO_CC_mutex;
+std::atomic<uint32_t> CCEvalChainEpoch(0);
 
 bool RunCCEval(const CC *cond, const CTransaction &tx, unsigned int nIn)
 {
@@ -70,6 +71,27 @@ bool RunCCEval(const CC *cond, const CTransaction &tx, unsigned int nIn)
 }
 
 
+int32_t CCEvalHeight()
+{
+    return chainActive.Height();
+}
+
+
+bool IsCCEvalCacheable(const CC *cond)
+{
+    // ProcessCC passes everything without running the validator while not connecting
+    if (EVAL_TEST || cond->codeLength == 0 || KOMODO_CONNECTING < 0)
+        return false;
+    uint8_t ecode = cond->code[0];
+    if ( ecode >= EVAL_FIRSTUSER && ecode <= EVAL_LASTUSER )
+        return false;
+    pthread_mutex_lock(&KOMODO_CC_mutex);
+    bool out = CCinfos[ecode].didinit != 0 && CCinfos[ecode].evalcacheable != 0;
+    pthread_mutex_unlock(&KOMODO_CC_mutex);
+    return out;
+}
+
+
 /*
  * Test the validity of an Eval node
  */
@@ -16,6 +16,7 @@
 #ifndef CC_EVAL_H
 #define CC_EVAL_H
 
+#include <atomic>
 #include <cryptoconditions.h>
 
 #include "cc/utils.h"
@@ -133,6 +134,27 @@ public:
 bool RunCCEval(const CC *cond, const CTransaction &tx, unsigned int nIn);
 
 
+/*
+ * Bumped whenever a block is disconnected. Cached CC eval results are keyed on
+ * it, so results that may have looked at the old chain are not reused
+ */
+extern std::atomic<uint32_t> CCEvalChainEpoch;
+
+
+/*
+ * The chain height a validator sees, cached CC eval results are keyed on it
+ */
+int32_t CCEvalHeight();
+
+
+/*
+ * Whether a successful evaluation of cond may be cached between mempool accept
+ * and block connect, ie its module has declared itself cacheable and its
+ * validator actually ran
+ */
+bool IsCCEvalCacheable(const CC *cond);
+
+
 /*
  * Virtual machine to use in the case of on-chain app evaluation
  */
@@ -21,6 +21,7 @@
 #endif
 #include "komodo_bitcoind.h"
 #include "miner.h" // for komodo_sendmessage
+#include "CCreplaycache.h"
 
 int32_t GAMEDATA(struct games_player *P,void *ptr);
 
@@ -965,9 +966,26 @@ int64_t games_registrationbaton(CMutableTransaction &mtx,uint256 gametxid,CTrans
     return(0);
 }
 
+void games_addkeystrokes(gamesevent **keystrokesp,int32_t &numkeys,const std::vector<uint8_t> &k)
+{
+    int32_t i,j; gamesevent *keystrokes,val;
+    if ( k.size() < sizeof(gamesevent) )
+        return;
+    keystrokes = (gamesevent *)realloc(*keystrokesp,(int32_t)(sizeof(*keystrokes)*numkeys + k.size()));
+    for (i=0; i+sizeof(gamesevent)<=k.size(); i+=sizeof(gamesevent))
+    {
+        val = 0;
+        for (j=0; j<sizeof(gamesevent); j++)
+            val = (val << 8) | k[i + j];
+        keystrokes[numkeys+i/sizeof(gamesevent)] = val;
+    }
+    numkeys += (int32_t)k.size() / sizeof(gamesevent);
+    (*keystrokesp) = keystrokes;
+}
+
 int32_t games_findbaton(struct CCcontract_info *cp,uint256 &playertxid,gamesevent **keystrokesp,int32_t &numkeys,int32_t &regslot,std::vector<uint8_t> &playerdata,uint256 &batontxid,int32_t &batonvout,int64_t &batonvalue,int32_t &batonht,uint256 gametxid,CTransaction gametx,int32_t maxplayers,char *destaddr,int32_t &numplayers,std::string &symbol,std::string &pname)
 {
-    int32_t i,numvouts,spentvini,n,matches = 0; CPubKey pk; uint256 tid,active,spenttxid,tokenid,hashBlock,txid,origplayergame; CTransaction spenttx,matchtx,batontx; std::vector<uint8_t> checkdata; CBlockIndex *pindex; char ccaddr[64]; gamesevent *keystrokes=0;
+    int32_t i,numvouts,spentvini,n,matches = 0; CPubKey pk; uint256 tid,active,spenttxid,tokenid,hashBlock,txid,origplayergame; CTransaction spenttx,matchtx,batontx; std::vector<uint8_t> checkdata; CBlockIndex *pindex; char ccaddr[64];
     batonvalue = numkeys = numplayers = batonht = 0;
     playertxid = batontxid = zeroid;
     if ( keystrokesp != 0 )
@@ -1005,6 +1023,15 @@ int32_t games_findbaton(struct CCcontract_info *cp,uint256 &playertxid,gameseven
                 txid = matchtx.GetHash();
                 //LogPrintf("scan forward active.%s spenttxid.%s\n",active.GetHex().c_str(),txid.GetHex().c_str());
                 n = 0;
+                // resume after the confirmed keystrokes found by an earlier scan of this registration
+                std::vector<CCbatonlink> links; int32_t numcached = 0; bool extend = (keystrokesp != 0);
+                if ( keystrokesp != 0 && CCbatoncache_get(txid,links) != 0 )
+                {
+                    for (i=0; i<links.size(); i++)
+                        games_addkeystrokes(keystrokesp,numkeys,links[i].keystrokes);
+                    txid = links.back().txid;
+                    n = numcached = (int32_t)links.size();
+                }
                 while ( CCgettxout(txid,0,1,0) < 0 )
                 {
                     spenttxid = zeroid;
@@ -1026,26 +1053,23 @@ int32_t games_findbaton(struct CCcontract_info *cp,uint256 &playertxid,gameseven
                         //LogPrintf("gameisover n.%d next txid.%s/v%d\n",n,txid.GetHex().c_str(),spentvini);
                         return(0);
                     }
+                    hashBlock = zeroid;
                     if ( keystrokesp != 0 && myGetTransaction(spenttxid,spenttx,hashBlock) != 0 && spenttx.vout.size() >= 2 )
                     {
                         uint256 g,b; CPubKey p; std::vector<uint8_t> k;
                         if ( games_keystrokesopretdecode(g,b,p,k,spenttx.vout[spenttx.vout.size()-1].scriptPubKey) == 'K' )
                         {
-                            //LogPrintf("update keystrokes.%p[%d]\n",keystrokes,numkeys);
-                            keystrokes = (gamesevent *)realloc(keystrokes,(int32_t)(sizeof(*keystrokes)*numkeys + k.size()));
-                            for (i=0; i<k.size(); i+=sizeof(gamesevent))
+                            games_addkeystrokes(keystrokesp,numkeys,k);
+                            //LogPrintf("updated keystrokes.%p[%d]\n",*keystrokesp,numkeys);
+                            if ( extend && hashBlock != zeroid )
                             {
-                                int32_t j;
-                                gamesevent val = 0;
-                                for (j=0; j<sizeof(gamesevent); j++)
-                                    val = (val << 8) | k[i + j];
-                                keystrokes[numkeys+i/sizeof(gamesevent)] = val;
-                            }
-                            numkeys += (int32_t)k.size() / sizeof(gamesevent);
-                            (*keystrokesp) = keystrokes;
-                            //LogPrintf("updated keystrokes.%p[%d]\n",keystrokes,numkeys);
-                        }
-                    }
+                                CCbatonlink link;
+                                link.txid = spenttxid;
+                                link.keystrokes = k;
+                                links.push_back(link);
+                            } else extend = false;
+                        } else extend = false;
+                    } else extend = false;
                     //LogPrintf("n.%d txid.%s\n",n,txid.GetHex().c_str());
                     if ( ++n >= GAMES_MAXITERATIONS )
                     {
@@ -1053,6 +1077,8 @@ int32_t games_findbaton(struct CCcontract_info *cp,uint256 &playertxid,gameseven
                         return(-5);
                     }
                 }
+                if ( (int32_t)links.size() > numcached )
+                    CCbatoncache_put(matchtx.GetHash(),links);
                 //LogPrintf("set baton %s\n",txid.GetHex().c_str());
                 batontxid = txid;
                 batonvout = 0; // not vini
@@ -1389,7 +1415,7 @@ gamesevent *games_extractgame(int32_t makefiles,char *str,int32_t *numkeysp,std:
                         fclose(fp);
                     }
                 }
-                num = games_replay2(newplayer,seed,keystrokes,numkeys,playerdata.size()==0?0:&P,0);
+                num = CCreplay_cached(games_replay2,newplayer,seed,keystrokes,numkeys,playerdata.size()==0?(struct games_player *)0:&P);
                 newdata.resize(num);
                 for (i=0; i<num; i++)
                 {
@@ -1543,7 +1569,7 @@ UniValue games_finish(uint64_t txfee,struct CCcontract_info *cp,cJSON *params,ch
                     }
                     if ( keystrokes != 0 )
                     {
-                        num = games_replay2(player,seed,keystrokes,numkeys,playerdata.size()==0?0:&P,0);
+                        num = CCreplay_cached(games_replay2,player,seed,keystrokes,numkeys,playerdata.size()==0?(struct games_player *)0:&P);
                         if ( keystrokes != 0 )
                             free(keystrokes), keystrokes = 0;
                     } else num = 0;
@@ -230,6 +230,28 @@ int64_t OracleCurrentDatafee(uint256 reforacletxid,char *markeraddr,CPubKey publ
     return(datafee);
 }
 
+/**
+ * Collects the oracles data index records of a block, one per data transaction
+ * @param block the block
+ * @param height its height
+ * @param[out] oraclesIndex the records
+ */
+void OraclesDataIndexRecords(const CBlock &block,int32_t height,std::vector<std::pair<COraclesDataIndexKey, COraclesDataIndexValue> > &oraclesIndex)
+{
+    uint256 oracletxid,batontxid; CPubKey publisher; std::vector<uint8_t> data; char batonaddr[64]; int32_t numvouts;
+    for (std::vector<CTransaction>::const_iterator it=block.vtx.begin(); it!=block.vtx.end(); it++)
+    {
+        const CTransaction &tx = *it;
+        if ( (numvouts= tx.vout.size()) < 3 || tx.vout[1].nValue != CC_MARKER_VALUE )
+            continue;
+        if ( DecodeOraclesData(tx.vout[numvouts-1].scriptPubKey,oracletxid,batontxid,publisher,data) != 'D' || !publisher.IsCompressed() )
+            continue;
+        if ( Getscriptaddress(batonaddr,tx.vout[1].scriptPubKey) == 0 )
+            continue;
+        oraclesIndex.push_back(std::make_pair(COraclesDataIndexKey(oracletxid,publisher,height,tx.GetHash()),COraclesDataIndexValue(batonaddr,data)));
+    }
+}
+
 int64_t OracleDatafee(CScript &scriptPubKey,uint256 oracletxid,CPubKey publisher)
 {
     CTransaction oracletx; char markeraddr[64]; uint256 hashBlock; std::string name,description,format; int32_t numvouts; int64_t datafee = 0;
@@ -495,13 +517,15 @@ int64_t correlate_price(int32_t height,int64_t *prices,int32_t n)
 
 int64_t OracleCorrelatedPrice(int32_t height,std::vector <int64_t> origprices)
 {
-    std::vector <int64_t> sorted; int32_t i,n; int64_t *prices,price;
+    int32_t i,n; int64_t *prices,price;
     if ( (n= origprices.size()) == 1 )
         return(origprices[0]);
+    if ( n == 0 )
+        return(0);
     std::sort(origprices.begin(), origprices.end());
     prices = (int64_t *)calloc(n,sizeof(*prices));
     i = 0;
-    for (std::vector<int64_t>::const_iterator it=sorted.begin(); it!=sorted.end(); it++)
+    for (std::vector<int64_t>::const_iterator it=origprices.begin(); it!=origprices.end(); it++)
         prices[i++] = *it;
     price = correlate_price(height,prices,i);
     free(prices);
@@ -534,44 +558,34 @@ int32_t oracleprice_add(std::vector<struct oracleprice_info> &publishers,CPubKey
     } else return(0);
 }
 
-/*int64_t OraclePrice(int32_t height,uint256 reforacletxid,char *markeraddr,char *format)
+int64_t OraclePrice(int32_t height,uint256 reforacletxid,char *markeraddr,char *format)
 {
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
-    CTransaction regtx; uint256 hash,txid,oracletxid,batontxid; CPubKey pk; int32_t i,ht,maxheight=0; int64_t datafee,price; char batonaddr[64]; std::vector <uint8_t> data; struct CCcontract_info *cp,C; std::vector <struct oracleprice_info> publishers; std::vector <int64_t> prices;
+    std::vector<std::pair<COraclesDataIndexKey, COraclesDataIndexValue> > samples;
+    uint256 hash; int32_t maxheight = 0; int64_t price; std::vector <int64_t> prices;
     if ( format[0] != 'L' )
         return(0);
-    cp = CCinit(&C,EVAL_ORACLES);
-    SetCCunspents(unspentOutputs,markeraddr,false);
-    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
-    {
-        txid = it->first.txhash;
-        ht = (int32_t)it->second.blockHeight;
-        if ( myGetTransaction(txid,regtx,hash) != 0 )
-        {
-            if ( regtx.vout.size() > 0 && DecodeOraclesOpRet(regtx.vout[regtx.vout.size()-1].scriptPubKey,oracletxid,pk,datafee) == 'R' && oracletxid == reforacletxid )
-            {
-                Getscriptaddress(batonaddr,regtx.vout[1].scriptPubKey);
-                batontxid = OracleBatonUtxo(10000,cp,oracletxid,batonaddr,pk,data);
-                if ( batontxid != zeroid && (ht= oracleprice_add(publishers,pk,ht,data,maxheight)) > maxheight )
-                    maxheight = ht;
-            }
-        }
-    }
+    // latest sample of every publisher up to height, straight from the oracles data index
+    if ( GetOraclesDataPublishers(reforacletxid,height,samples) == 0 )
+        return(0);
+    for (std::vector<std::pair<COraclesDataIndexKey, COraclesDataIndexValue> >::const_iterator it=samples.begin(); it!=samples.end(); it++)
+        if ( it->first.blockHeight > maxheight )
+            maxheight = it->first.blockHeight;
     if ( maxheight > 10 )
     {
-        for (std::vector<struct oracleprice_info>::const_iterator it=publishers.begin(); it!=publishers.end(); it++)
+        for (std::vector<std::pair<COraclesDataIndexKey, COraclesDataIndexValue> >::const_iterator it=samples.begin(); it!=samples.end(); it++)
         {
-            if ( it->height >= maxheight-10 )
+            if ( it->first.blockHeight >= maxheight-10 )
             {
-                oracle_format(&hash,&price,0,'L',(uint8_t *)it->data.data(),0,(int32_t)it->data.size());
+                oracle_format(&hash,&price,0,'L',(uint8_t *)it->second.data.data(),0,(int32_t)it->second.data.size());
                 if ( price != 0 )
                     prices.push_back(price);
             }
         }
-        return(OracleCorrelatedPrice(height,prices));
+        if ( prices.size() > 0 )
+            return(OracleCorrelatedPrice(height,prices));
     }
     return(0);
-}*/
+}
 
 int64_t IsOraclesvout(struct CCcontract_info *cp,const CTransaction& tx,int32_t v)
 {
@@ -1098,6 +1112,30 @@ UniValue OracleDataSamples(uint256 reforacletxid,char* batonaddr,int32_t num)
                     }
                 }
             }
+            if ( fOraclesIndex )
+            {
+                // confirmed samples come from the oracles data index, without loading the transactions
+                std::vector<std::pair<COraclesDataIndexKey, COraclesDataIndexValue> > publishers,samples;
+                GetOraclesDataPublishers(reforacletxid,0,publishers);
+                for (std::vector<std::pair<COraclesDataIndexKey, COraclesDataIndexValue> >::const_iterator it=publishers.begin(); it!=publishers.end(); it++)
+                {
+                    if ( it->second.batonaddr != batonaddr )
+                        continue;
+                    GetOraclesDataIndex(reforacletxid,it->first.publisher,true,num != 0 ? num-n : 0,samples);
+                    break;
+                }
+                if ( (formatstr= (char *)format.c_str()) == 0 )
+                    formatstr = (char *)"";
+                for (std::vector<std::pair<COraclesDataIndexKey, COraclesDataIndexValue> >::const_iterator it=samples.begin(); it!=samples.end(); it++)
+                {
+                    UniValue a(UniValue::VOBJ);
+                    a.push_back(Pair("txid",it->first.txid.GetHex()));
+                    a.push_back(Pair("data",OracleFormat((uint8_t *)it->second.data.data(),(int32_t)it->second.data.size(),formatstr,(int32_t)format.size())));
+                    b.push_back(a);
+                }
+                result.push_back(Pair("samples",b));
+                return(result);
+            }
             SetCCtxids(txids,batonaddr,true,EVAL_ORACLES,reforacletxid,'D');
             if (txids.size()>0)
             {
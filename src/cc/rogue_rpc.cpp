@@ -26,6 +26,7 @@
 #define ROGUE_MAXCASHOUT (777 * COIN)
 
 #include "rogue/rogue_player.h"
+#include "CCreplaycache.h"
 
 std::string Rogue_pname = "";
 
@@ -522,9 +523,21 @@ int32_t rogue_playerdataspend(CMutableTransaction &mtx,uint256 playertxid,int32_
     }
 }
 
+void rogue_addkeystrokes(char **keystrokesp,int32_t &numkeys,const std::vector<uint8_t> &k)
+{
+    int32_t i; char *keystrokes;
+    if ( k.size() == 0 )
+        return;
+    keystrokes = (char *)realloc(*keystrokesp,numkeys + (int32_t)k.size());
+    for (i=0; i<k.size(); i++)
+        keystrokes[numkeys+i] = (char)k[i];
+    numkeys += (int32_t)k.size();
+    (*keystrokesp) = keystrokes;
+}
+
 int32_t rogue_findbaton(struct CCcontract_info *cp,uint256 &playertxid,char **keystrokesp,int32_t &numkeys,int32_t &regslot,std::vector<uint8_t> &playerdata,uint256 &batontxid,int32_t &batonvout,int64_t &batonvalue,int32_t &batonht,uint256 gametxid,CTransaction gametx,int32_t maxplayers,char *destaddr,int32_t &numplayers,std::string &symbol,std::string &pname)
 {
-    int32_t i,numvouts,spentvini,n,matches = 0; CPubKey pk; uint256 tid,active,spenttxid,tokenid,hashBlock,txid,origplayergame; CTransaction spenttx,matchtx,batontx; std::vector<uint8_t> checkdata; CBlockIndex *pindex; char ccaddr[64],*keystrokes=0;
+    int32_t i,numvouts,spentvini,n,matches = 0; CPubKey pk; uint256 tid,active,spenttxid,tokenid,hashBlock,txid,origplayergame; CTransaction spenttx,matchtx,batontx; std::vector<uint8_t> checkdata; CBlockIndex *pindex; char ccaddr[64];
     batonvalue = numkeys = numplayers = batonht = 0;
     playertxid = batontxid = zeroid;
     if ( keystrokesp != 0 )
@@ -562,6 +575,15 @@ int32_t rogue_findbaton(struct CCcontract_info *cp,uint256 &playertxid,char **ke
                 txid = matchtx.GetHash();
                 //LogPrintf("scan forward active.%s spenttxid.%s\n",active.GetHex().c_str(),txid.GetHex().c_str());
                 n = 0;
+                // resume after the confirmed keystrokes found by an earlier scan of this registration
+                std::vector<CCbatonlink> links; int32_t numcached = 0; bool extend = (keystrokesp != 0);
+                if ( keystrokesp != 0 && CCbatoncache_get(txid,links) != 0 )
+                {
+                    for (i=0; i<links.size(); i++)
+                        rogue_addkeystrokes(keystrokesp,numkeys,links[i].keystrokes);
+                    txid = links.back().txid;
+                    n = numcached = (int32_t)links.size();
+                }
                 while ( CCgettxout(txid,0,1,0) < 0 )
                 {
                     spenttxid = zeroid;
@@ -582,19 +604,23 @@ int32_t rogue_findbaton(struct CCcontract_info *cp,uint256 &playertxid,char **ke
                     {
                         return(0);
                     }
+                    hashBlock = zeroid;
                     if ( keystrokesp != 0 && myGetTransaction(spenttxid,spenttx,hashBlock) != 0 && spenttx.vout.size() >= 2 )
                     {
                         uint256 g,b; CPubKey p; std::vector<uint8_t> k;
                         if ( rogue_keystrokesopretdecode(g,b,p,k,spenttx.vout[spenttx.vout.size()-1].scriptPubKey) == 'K' )
                         {
-                            keystrokes = (char *)realloc(keystrokes,numkeys + (int32_t)k.size());
-                            for (i=0; i<k.size(); i++)
-                                keystrokes[numkeys+i] = (char)k[i];
-                            numkeys += (int32_t)k.size();
-                            (*keystrokesp) = keystrokes;
-                            //LogPrintf("updated keystrokes.%p[%d]\n",keystrokes,numkeys);
-                        }
-                    }
+                            rogue_addkeystrokes(keystrokesp,numkeys,k);
+                            //LogPrintf("updated keystrokes.%p[%d]\n",*keystrokesp,numkeys);
+                            if ( extend && hashBlock != zeroid )
+                            {
+                                CCbatonlink link;
+                                link.txid = spenttxid;
+                                link.keystrokes = k;
+                                links.push_back(link);
+                            } else extend = false;
+                        } else extend = false;
+                    } else extend = false;
                     //LogPrintf("n.%d txid.%s\n",n,txid.GetHex().c_str());
                     if ( ++n >= ROGUE_MAXITERATIONS )
                     {
@@ -602,6 +628,8 @@ int32_t rogue_findbaton(struct CCcontract_info *cp,uint256 &playertxid,char **ke
                         return(-5);
                     }
                 }
+                if ( (int32_t)links.size() > numcached )
+                    CCbatoncache_put(matchtx.GetHash(),links);
                 //LogPrintf("set baton %s\n",txid.GetHex().c_str());
                 batontxid = txid;
                 batonvout = 0; // not vini
@@ -1014,7 +1042,7 @@ char *rogue_extractgame(int32_t makefiles,char *str,int32_t *numkeysp,std::vecto
                     }
                 }
                 //LogPrintf("call replay2\n");
-                num = rogue_replay2(newplayer,seed,keystrokes,numkeys,playerdata.size()==0?0:&P,0);
+                num = CCreplay_cached(rogue_replay2,newplayer,seed,keystrokes,numkeys,playerdata.size()==0?(struct rogue_player *)0:&P);
                 newdata.resize(num);
                 for (i=0; i<num; i++)
                 {
@@ -1114,6 +1142,61 @@ UniValue rogue_extract(uint64_t txfee,struct CCcontract_info *cp,cJSON *params)
     return(result);
 }
 
+char *rogue_keystrokesload(int32_t *numkeysp,uint64_t seed,int32_t counter);
+
+// replays a game saved by extract (rogue.<seed>.N and rogue.<seed>.player) with and without the replay cache
+UniValue rogue_replaybench(uint64_t txfee,struct CCcontract_info *cp,cJSON *params)
+{
+    UniValue result(UniValue::VOBJ); int32_t i,n,num,numkeys,cached,iterations = 1,hits = 0; uint64_t seed; int64_t start,uncached,total; char fname[64],*keystrokes; FILE *fp; uint8_t newplayer[10000]; struct rogue_player P,*player = 0;
+    result.push_back(Pair("name","rogue"));
+    result.push_back(Pair("method","replaybench"));
+    if ( params == 0 || (n= cJSON_GetArraySize(params)) < 1 || (seed= j64bitsi(params,0)) == 0 )
+        return(cclib_error(result,"need seed"));
+    if ( n > 1 && (iterations= juint(jitem(params,1),0)) <= 0 )
+        iterations = 1;
+    else if ( iterations > 1000 )
+        iterations = 1000;
+    if ( (keystrokes= rogue_keystrokesload(&numkeys,seed,0)) == 0 || numkeys <= 0 )
+    {
+        if ( keystrokes != 0 )
+            free(keystrokes);
+        return(cclib_error(result,"no keystrokes saved for seed, run extract first"));
+    }
+    sprintf(fname,"rogue.%llu.player",(long long)seed);
+    memset(&P,0,sizeof(P));
+    if ( (fp= fopen(fname,"rb")) != 0 )
+    {
+        if ( fread(&P,1,sizeof(P),fp) > 0 )
+            player = &P;
+        fclose(fp);
+    }
+    {
+        // the same lock CCreplay_cached takes, validation may be replaying at the same time
+        std::lock_guard<std::mutex> lock(CCreplay_mutex);
+        start = GetTimeMicros();
+        for (i=0; i<iterations; i++)
+            num = rogue_replay2(newplayer,seed,keystrokes,numkeys,player,0);
+        uncached = GetTimeMicros() - start;
+    }
+    start = GetTimeMicros();
+    for (i=0; i<iterations; i++)
+    {
+        num = CCreplay_cached(rogue_replay2,newplayer,seed,keystrokes,numkeys,player,&cached);
+        hits += cached;
+    }
+    total = GetTimeMicros() - start;
+    free(keystrokes);
+    result.push_back(Pair("result","success"));
+    result.push_back(Pair("seed",(int64_t)seed));
+    result.push_back(Pair("numkeys",(int64_t)numkeys));
+    result.push_back(Pair("playerdata",(int64_t)num));
+    result.push_back(Pair("iterations",(int64_t)iterations));
+    result.push_back(Pair("uncached_micros",uncached / iterations));
+    result.push_back(Pair("cached_micros",total / iterations));
+    result.push_back(Pair("cachehits",(int64_t)hits));
+    return(result);
+}
+
 int64_t rogue_cashout(struct rogue_player *P)
 {
     int32_t dungeonlevel; int64_t cashout,mult = 10;
@@ -1258,7 +1341,7 @@ UniValue rogue_finishgame(uint64_t txfee,struct CCcontract_info *cp,cJSON *param
                     }
                     if ( keystrokes != 0 )
                     {
-                        num = rogue_replay2(player,seed,keystrokes,numkeys,playerdata.size()==0?0:&P,0);
+                        num = CCreplay_cached(rogue_replay2,player,seed,keystrokes,numkeys,playerdata.size()==0?(struct rogue_player *)0:&P);
                         if ( keystrokes != 0 )
                             free(keystrokes), keystrokes = 0;
                     } else num = 0;
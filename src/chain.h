@@ -216,7 +216,11 @@ public:
     unsigned int nTime;
     unsigned int nBits;
     uint256 nNonce;
+protected:
+    //! Equihash solution. Only kept in memory until the index entry is written to the
+    //! block tree db, after that GetSolution() reads it back on demand.
     std::vector<unsigned char> nSolution;
+public:
 
     //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
     uint32_t nSequenceId;
@@ -291,6 +295,22 @@ public:
         return ret;
     }
 
+    //! true while the solution is still held in memory
+    bool HasSolution() const
+    {
+        return !nSolution.empty();
+    }
+
+    //! Drop the in-memory solution, only valid once this entry is in the block tree db
+    void TrimSolution()
+    {
+        std::vector<unsigned char> empty;
+        nSolution.swap(empty);
+    }
+
+    //! The Equihash solution, from memory or else from the block tree db (defined in main.cpp)
+    std::vector<unsigned char> GetSolution() const;
+
     CBlockHeader GetBlockHeader() const
     {
         CBlockHeader block;
@@ -302,7 +322,7 @@ public:
         block.nTime          = nTime;
         block.nBits          = nBits;
         block.nNonce         = nNonce;
-        block.nSolution      = nSolution;
+        block.nSolution      = GetSolution();
         return block;
     }
 
@@ -390,6 +410,8 @@ public:
 
     explicit CDiskBlockIndex(const CBlockIndex* pindex) : CBlockIndex(*pindex) {
         hashPrev = (pprev ? pprev->GetBlockHash() : uint256());
+        if (!HasSolution())
+            nSolution = pindex->GetSolution();
     }
 
     ADD_SERIALIZE_METHODS;
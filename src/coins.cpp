@@ -30,6 +30,8 @@
 #include "komodo_interest.h"
 
 #include <assert.h>
+#include <atomic>
+#include <thread>
 
 /**
  * calculate number of bytes for the bitmask, and its number of non-zero bytes
@@ -102,7 +104,7 @@ bool CCoinsViewBacked::GetStats(CCoinsStats &stats) const { return base->GetStat
 
 CCoinsKeyHasher::CCoinsKeyHasher() : salt(GetRandHash()) {}
 
-CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), hasModifier(false), cachedCoinsUsage(0) { }
+CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), hasModifier(false), cachedCoinsUsage(0), nUseCounter(0) { }
 
 CCoinsViewCache::~CCoinsViewCache()
 {
@@ -120,12 +122,15 @@ size_t CCoinsViewCache::DynamicMemoryUsage() const {
 
 CCoinsMap::const_iterator CCoinsViewCache::FetchCoins(const uint256 &txid) const {
     CCoinsMap::iterator it = cacheCoins.find(txid);
-    if (it != cacheCoins.end())
+    if (it != cacheCoins.end()) {
+        it->second.nLastUse = ++nUseCounter;
         return it;
+    }
     CCoins tmp;
     if (!base->GetCoins(txid, tmp))
         return cacheCoins.end();
     CCoinsMap::iterator ret = cacheCoins.insert(std::make_pair(txid, CCoinsCacheEntry())).first;
+    ret->second.nLastUse = ++nUseCounter;
     tmp.swap(ret->second.coins);
     if (ret->second.coins.IsPruned()) {
         // The parent only has an empty entry for this txid; we can consider our
@@ -377,6 +382,7 @@ CCoinsModifier CCoinsViewCache::ModifyCoins(const uint256 &txid) {
     }
     // Assume that whenever ModifyCoins is called, the entry will be modified.
     ret.first->second.flags |= CCoinsCacheEntry::DIRTY;
+    ret.first->second.nLastUse = ++nUseCounter;
     return CCoinsModifier(*this, ret.first, cachedCoinUsage);
 }
 
@@ -513,6 +519,7 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins,
                     entry.coins.swap(it->second.coins);
                     cachedCoinsUsage += entry.coins.DynamicMemoryUsage();
                     entry.flags = CCoinsCacheEntry::DIRTY | CCoinsCacheEntry::FRESH;
+                    entry.nLastUse = ++nUseCounter;
                 }
             } else {
                 if ((itUs->second.flags & CCoinsCacheEntry::FRESH) && it->second.coins.IsPruned()) {
@@ -527,6 +534,7 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins,
                     itUs->second.coins.swap(it->second.coins);
                     cachedCoinsUsage += itUs->second.coins.DynamicMemoryUsage();
                     itUs->second.flags |= CCoinsCacheEntry::DIRTY;
+                    itUs->second.nLastUse = ++nUseCounter;
                 }
             }
         }
@@ -557,6 +565,120 @@ bool CCoinsViewCache::Flush() {
     return fOk;
 }
 
+template<typename Map, typename Entry>
+static void ExtractDirtyEntries(Map &cacheMap, Map &deltaMap)
+{
+    for (typename Map::iterator it = cacheMap.begin(); it != cacheMap.end(); ++it) {
+        if (it->second.flags & Entry::DIRTY) {
+            deltaMap.insert(*it);
+            it->second.flags = 0;
+        }
+    }
+}
+
+void CCoinsViewCache::ExtractDirty(CCoinsCacheDelta &delta) {
+    assert(!hasModifier);
+    for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end(); ++it) {
+        if (it->second.flags & CCoinsCacheEntry::DIRTY) {
+            delta.mapCoins.insert(*it);
+            // once delta is written the base view has this entry, so it is no longer fresh
+            it->second.flags = 0;
+        }
+    }
+    ExtractDirtyEntries<CAnchorsSproutMap, CAnchorsSproutCacheEntry>(cacheSproutAnchors, delta.mapSproutAnchors);
+    ExtractDirtyEntries<CAnchorsSaplingMap, CAnchorsSaplingCacheEntry>(cacheSaplingAnchors, delta.mapSaplingAnchors);
+    ExtractDirtyEntries<CNullifiersMap, CNullifiersCacheEntry>(cacheSproutNullifiers, delta.mapSproutNullifiers);
+    ExtractDirtyEntries<CNullifiersMap, CNullifiersCacheEntry>(cacheSaplingNullifiers, delta.mapSaplingNullifiers);
+    delta.hashBlock = hashBlock;
+    delta.hashSproutAnchor = hashSproutAnchor;
+    delta.hashSaplingAnchor = hashSaplingAnchor;
+}
+
+size_t CCoinsViewCache::Trim(size_t nTargetUsage) {
+    assert(!hasModifier);
+    if (DynamicMemoryUsage() <= nTargetUsage)
+        return 0;
+
+    // Clean nullifiers are cheap to read back, drop them first
+    size_t nEvicted = 0;
+    for (CNullifiersMap *pmap : { &cacheSproutNullifiers, &cacheSaplingNullifiers }) {
+        for (CNullifiersMap::iterator it = pmap->begin(); it != pmap->end(); ) {
+            if (it->second.flags == 0) {
+                pmap->erase(it++);
+                nEvicted++;
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    std::vector<std::pair<uint32_t, CCoinsMap::iterator> > vClean;
+    for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end(); ++it) {
+        if (it->second.flags == 0)
+            vClean.push_back(std::make_pair(nUseCounter - it->second.nLastUse, it));
+    }
+    // Oldest first; ages are taken relative to the counter so wrapping does not matter
+    std::sort(vClean.begin(), vClean.end(), [](const std::pair<uint32_t, CCoinsMap::iterator> &a, const std::pair<uint32_t, CCoinsMap::iterator> &b) {
+        return a.first > b.first;
+    });
+    for (size_t i = 0; i < vClean.size() && DynamicMemoryUsage() > nTargetUsage; i++) {
+        cachedCoinsUsage -= vClean[i].second->second.coins.DynamicMemoryUsage();
+        cacheCoins.erase(vClean[i].second);
+        nEvicted++;
+    }
+    return nEvicted;
+}
+
+size_t CCoinsViewCache::PrefetchCoins(const std::vector<uint256> &vTxids, unsigned int nThreads) {
+    // Reading in parallel only pays off when there is enough to read per thread
+    static const size_t PREFETCH_MIN_PER_THREAD = 16;
+
+    std::vector<uint256> vMissing;
+    vMissing.reserve(vTxids.size());
+    {
+        std::set<uint256> setSeen;
+        for (const uint256 &txid : vTxids) {
+            if (cacheCoins.count(txid) == 0 && setSeen.insert(txid).second)
+                vMissing.push_back(txid);
+        }
+    }
+    if (vMissing.empty())
+        return 0;
+
+    std::vector<CCoins> vCoins(vMissing.size());
+    std::vector<char> vFound(vMissing.size(), 0);
+    std::atomic<size_t> nNext(0);
+    auto reader = [&]() {
+        size_t i;
+        while ((i = nNext++) < vMissing.size())
+            vFound[i] = base->GetCoins(vMissing[i], vCoins[i]);
+    };
+    nThreads = std::min<size_t>(nThreads, vMissing.size() / PREFETCH_MIN_PER_THREAD);
+    if (nThreads <= 1) {
+        reader();
+    } else {
+        std::vector<std::thread> vReaders;
+        for (unsigned int i = 1; i < nThreads; i++)
+            vReaders.emplace_back(reader);
+        reader();
+        for (std::thread &t : vReaders)
+            t.join();
+    }
+
+    // Insert as FetchCoins would have
+    for (size_t i = 0; i < vMissing.size(); i++) {
+        if (!vFound[i])
+            continue;
+        CCoinsMap::iterator ret = cacheCoins.insert(std::make_pair(vMissing[i], CCoinsCacheEntry())).first;
+        ret->second.nLastUse = ++nUseCounter;
+        vCoins[i].swap(ret->second.coins);
+        if (ret->second.coins.IsPruned())
+            ret->second.flags = CCoinsCacheEntry::FRESH;
+        cachedCoinsUsage += ret->second.coins.DynamicMemoryUsage();
+    }
+    return vMissing.size();
+}
+
 unsigned int CCoinsViewCache::GetCacheSize() const {
     return cacheCoins.size();
 }
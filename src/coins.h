@@ -295,13 +295,14 @@ struct CCoinsCacheEntry
 {
     CCoins coins; // The actual cached data.
     unsigned char flags;
+    uint32_t nLastUse; // Cache use counter at the last access, for evicting the least recently used entries.
 
     enum Flags {
         DIRTY = (1 << 0), // This cache entry is potentially different from the version in the parent view.
         FRESH = (1 << 1), // The parent view does not have this entry (or it is pruned).
     };
 
-    CCoinsCacheEntry() : coins(), flags(0) {}
+    CCoinsCacheEntry() : coins(), flags(0), nLastUse(0) {}
 };
 
 struct CAnchorsSproutCacheEntry
@@ -361,6 +362,7 @@ struct CCoinsStats
     uint64_t nTransactionOutputs;
     uint64_t nSerializedSize;
     uint256 hashSerialized;
+    uint256 hashMuHash;
     CAmount nTotalAmount;
 
     CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), nTotalAmount(0) {}
@@ -462,6 +464,27 @@ public:
     friend class CCoinsViewCache;
 };
 
+/**
+ * The dirty entries of a CCoinsViewCache, copied out so they can be written to
+ * its base view without holding up further use of the cache.
+ */
+struct CCoinsCacheDelta
+{
+    CCoinsMap mapCoins;
+    uint256 hashBlock;
+    uint256 hashSproutAnchor;
+    uint256 hashSaplingAnchor;
+    CAnchorsSproutMap mapSproutAnchors;
+    CAnchorsSaplingMap mapSaplingAnchors;
+    CNullifiersMap mapSproutNullifiers;
+    CNullifiersMap mapSaplingNullifiers;
+
+    //! Number of entries to be written
+    size_t GetCount() const {
+        return mapCoins.size() + mapSproutAnchors.size() + mapSaplingAnchors.size() + mapSproutNullifiers.size() + mapSaplingNullifiers.size();
+    }
+};
+
 class CTransactionExceptionData
 {
     public:
@@ -495,6 +518,9 @@ protected:
     /* Cached dynamic memory usage for the inner CCoins objects. */
     mutable size_t cachedCoinsUsage;
 
+    /* Incremented on every coins access, see CCoinsCacheEntry::nLastUse. */
+    mutable uint32_t nUseCounter;
+
 public:
     CCoinsViewCache(CCoinsView *baseIn);
     ~CCoinsViewCache();
@@ -550,6 +576,31 @@ public:
      */
     bool Flush();
 
+    /**
+     * Copy all dirty entries into delta and mark them clean, keeping everything cached.
+     * The caller must write delta to the base view before entries are evicted with
+     * Trim, or before anything else reads the base view directly.
+     */
+    void ExtractDirty(CCoinsCacheDelta &delta);
+
+    /**
+     * Evict clean entries, least recently used coins first, until the dynamic
+     * memory usage is at most nTargetUsage or only dirty entries are left.
+     * @returns the number of entries evicted
+     */
+    size_t Trim(size_t nTargetUsage);
+
+    /**
+     * Load the coins of the given txids that are not cached yet, reading them from
+     * the base view on up to nThreads threads. The base view must allow concurrent
+     * GetCoins calls (as the database view does); nothing else may use this cache
+     * while the prefetch runs.
+     * @param vTxids the txids to load, duplicates allowed
+     * @param nThreads maximum number of reader threads, 0 or 1 reads on the calling thread
+     * @returns the number of txids that were read from the base view
+     */
+    size_t PrefetchCoins(const std::vector<uint256> &vTxids, unsigned int nThreads);
+
     //! Calculate the size of the cache (in number of transactions)
     unsigned int GetCacheSize() const;
 
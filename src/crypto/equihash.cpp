@@ -17,6 +17,7 @@
 #endif
 
 #include "compat/endian.h"
+#include "crypto/common.h"
 #include "crypto/equihash.h"
 #include "util.h"
 #ifndef __linux__
@@ -27,6 +28,17 @@
 #include <stdexcept>
 
 #include <boost/optional.hpp>
+
+#if defined(USE_ASM) && (defined(__x86_64__) || defined(__amd64__) || defined(__i386__))
+#include <cpuid.h>
+#endif
+
+#if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
+namespace eh_blake2b_avx2
+{
+void Compress_4way(unsigned char* out, const uint64_t* h, const uint64_t* tf, const unsigned char* block, size_t pos, const uint32_t* indices);
+}
+#endif
 /*
 #ifdef __APPLE__
 #include <machine/endian.h>
@@ -134,6 +146,281 @@ void GenerateHash(const eh_HashState& base_state, eh_index g,
     }
 }
 
+// Batched hashing for solution verification.
+//
+// Every hash checked by IsValidSolution is BLAKE2b(header || le32(g)), so they
+// all share the state left by the header and differ only in four bytes of the
+// final block. We finish the shared part once and then compress the final
+// blocks directly, four at a time where AVX2 is available. This reads the
+// internals of libsodium's BLAKE2b state, so it stays disabled until
+// EhBlake2bAutoDetect() has checked the result against libsodium itself.
+namespace
+{
+
+/** Layout of libsodium's (opaque) crypto_generichash_blake2b_state. */
+struct EhBlake2bState
+{
+    uint64_t h[8];
+    uint64_t t[2];
+    uint64_t f[2];
+    uint8_t buf[2 * 128];
+    size_t buflen;
+    uint8_t last_node;
+};
+static_assert(sizeof(EhBlake2bState) <= sizeof(eh_HashState), "unexpected BLAKE2b state size");
+
+/** The BLAKE2b final block for a base state, shared by every index. */
+struct EhFinalBlock
+{
+    uint64_t h[8];
+    uint64_t tf[4];
+    unsigned char block[128];
+    size_t pos;
+};
+
+const uint64_t blake2b_IV[8] = {
+    0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+    0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL, 0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL,
+};
+
+const uint8_t blake2b_sigma[12][16] = {
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 },
+    { 11,  8, 12,  0,  5,  2, 15, 13, 10, 14,  3,  6,  7,  1,  9,  4 },
+    {  7,  9,  3,  1, 13, 12, 11, 14,  2,  6,  5, 10,  4,  0, 15,  8 },
+    {  9,  0,  5,  7,  2,  4, 10, 15, 14,  1, 11, 12,  6,  8,  3, 13 },
+    {  2, 12,  6, 10,  0, 11,  8,  3,  4, 13,  7,  5, 15, 14,  1,  9 },
+    { 12,  5,  1, 15, 14, 13,  4, 10,  0,  7,  6,  3,  9,  2,  8, 11 },
+    { 13, 11,  7, 14, 12,  1,  3,  9,  5,  0, 15,  4,  8,  6,  2, 10 },
+    {  6, 15, 14,  9, 11,  3,  0,  8, 12,  2, 13,  7,  1,  4, 10,  5 },
+    { 10,  2,  8,  4,  7,  6,  1,  5, 15, 11,  9, 14,  3, 12, 13,  0 },
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 },
+};
+
+typedef void (*EhCompress4Fn)(unsigned char*, const uint64_t*, const uint64_t*, const unsigned char*, size_t, const uint32_t*);
+
+bool ehBatchEnabled = false;
+EhCompress4Fn ehCompress4way = nullptr;
+
+inline uint64_t RotR64(uint64_t x, int c) { return (x >> c) | (x << (64 - c)); }
+
+#define EH_G(r, i, a, b, c, d) do { \
+        a = a + b + m[blake2b_sigma[r][2 * i]]; \
+        d = RotR64(d ^ a, 32); \
+        c = c + d; \
+        b = RotR64(b ^ c, 24); \
+        a = a + b + m[blake2b_sigma[r][2 * i + 1]]; \
+        d = RotR64(d ^ a, 16); \
+        c = c + d; \
+        b = RotR64(b ^ c, 63); \
+    } while (0)
+
+void Blake2bCompress(uint64_t h[8], const uint64_t tf[4], const unsigned char* block)
+{
+    uint64_t m[16], v[16];
+    for (int i = 0; i < 16; i++) {
+        m[i] = ReadLE64(block + 8 * i);
+    }
+    for (int i = 0; i < 8; i++) {
+        v[i] = h[i];
+        v[i + 8] = blake2b_IV[i];
+    }
+    for (int i = 0; i < 4; i++) {
+        v[12 + i] ^= tf[i];
+    }
+    for (int r = 0; r < 12; r++) {
+        EH_G(r, 0, v[0], v[4], v[8], v[12]);
+        EH_G(r, 1, v[1], v[5], v[9], v[13]);
+        EH_G(r, 2, v[2], v[6], v[10], v[14]);
+        EH_G(r, 3, v[3], v[7], v[11], v[15]);
+        EH_G(r, 4, v[0], v[5], v[10], v[15]);
+        EH_G(r, 5, v[1], v[6], v[11], v[12]);
+        EH_G(r, 6, v[2], v[7], v[8], v[13]);
+        EH_G(r, 7, v[3], v[4], v[9], v[14]);
+    }
+    for (int i = 0; i < 8; i++) {
+        h[i] ^= v[i] ^ v[i + 8];
+    }
+}
+
+#undef EH_G
+
+/**
+ * Do the work crypto_generichash_blake2b_update/final would do on a copy of
+ * base_state before reaching the block holding the index. Returns false for
+ * states this does not handle (already finalised, or the index would straddle
+ * two blocks); callers then fall back to libsodium.
+ */
+bool PrepareFinalBlock(const eh_HashState& base_state, EhFinalBlock& fb)
+{
+    const EhBlake2bState& s = reinterpret_cast<const EhBlake2bState&>(base_state);
+    if (s.f[0] != 0 || s.buflen > sizeof(s.buf) - sizeof(eh_index)) {
+        return false;
+    }
+    memcpy(fb.h, s.h, sizeof(fb.h));
+    uint64_t t0 = s.t[0], t1 = s.t[1];
+    const unsigned char* buf = s.buf;
+    size_t buflen = s.buflen;
+    if (buflen + sizeof(eh_index) > 128) {
+        if (buflen < 128) {
+            return false;
+        }
+        t0 += 128;
+        t1 += (t0 < 128);
+        const uint64_t tf[4] = {t0, t1, 0, 0};
+        Blake2bCompress(fb.h, tf, buf);
+        buf += 128;
+        buflen -= 128;
+    }
+    t0 += buflen + sizeof(eh_index);
+    t1 += (t0 < buflen + sizeof(eh_index));
+    fb.tf[0] = t0;
+    fb.tf[1] = t1;
+    fb.tf[2] = ~(uint64_t)0;
+    fb.tf[3] = s.last_node ? ~(uint64_t)0 : 0;
+    memset(fb.block, 0, sizeof(fb.block));
+    memcpy(fb.block, buf, buflen);
+    fb.pos = buflen;
+    return true;
+}
+
+/** Compress the final block once per index, writing hLen bytes of each hash to out. */
+void HashFinalBlocks(const EhFinalBlock& fb, const eh_index* indices, size_t n,
+                     unsigned char* out, size_t hLen)
+{
+    size_t i = 0;
+    if (ehCompress4way) {
+        unsigned char lanes[4 * BLAKE2B_OUTBYTES];
+        for (; i + 4 <= n; i += 4) {
+            ehCompress4way(lanes, fb.h, fb.tf, fb.block, fb.pos, indices + i);
+            for (size_t l = 0; l < 4; l++) {
+                memcpy(out + (i + l) * hLen, lanes + l * BLAKE2B_OUTBYTES, hLen);
+            }
+        }
+    }
+    unsigned char block[128], hash[BLAKE2B_OUTBYTES];
+    for (; i < n; i++) {
+        uint64_t h[8];
+        memcpy(h, fb.h, sizeof(h));
+        memcpy(block, fb.block, sizeof(block));
+        WriteLE32(block + fb.pos, indices[i]);
+        Blake2bCompress(h, fb.tf, block);
+        for (int j = 0; j < 8; j++) {
+            WriteLE64(hash + 8 * j, h[j]);
+        }
+        memcpy(out + i * hLen, hash, hLen);
+    }
+}
+
+/** Equivalent to calling GenerateHash for each of the n indices, writing hLen bytes apiece to out. */
+void GenerateHashes(const eh_HashState& base_state, const eh_index* indices, size_t n,
+                    unsigned char* out, size_t hLen, size_t N)
+{
+    EhFinalBlock fb;
+    if (!ehBatchEnabled || ASSETCHAINS_NK[0] != 0 || ASSETCHAINS_NK[1] != 0 ||
+        !PrepareFinalBlock(base_state, fb)) {
+        for (size_t i = 0; i < n; i++) {
+            GenerateHash(base_state, indices[i], out + i * hLen, hLen, N);
+        }
+        return;
+    }
+    HashFinalBlocks(fb, indices, n, out, hLen);
+}
+
+/** Check the batched hashing against libsodium over a spread of state shapes. */
+bool EhBlake2bSelfTest()
+{
+    // 126 and 254 leave the index straddling two blocks and must be refused.
+    static const size_t prefixes[] = {0, 1, 100, 124, 126, 128, 129, 140, 200, 252, 254, 300};
+    static const eh_index indices[] = {0, 1, 0x1234567, 0x1ffffff, 0xdeadbeef, 7, 42};
+    const size_t nIndices = sizeof(indices) / sizeof(indices[0]);
+    unsigned char data[300];
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (unsigned char)(i * 37 + 11);
+    }
+    unsigned char personalization[crypto_generichash_blake2b_PERSONALBYTES] = {};
+    memcpy(personalization, "ZcashPoW", 8);
+    for (uint8_t outlen : {50, 54, 64}) {
+        personalization[8] = outlen;
+        for (size_t prefix : prefixes) {
+            eh_HashState state;
+            if (crypto_generichash_blake2b_init_salt_personal(&state, NULL, 0, outlen, NULL, personalization) != 0) {
+                return false;
+            }
+            crypto_generichash_blake2b_update(&state, data, prefix);
+            size_t buflen = prefix > 256 ? prefix - 128 : prefix;
+            EhFinalBlock fb;
+            bool straddles = buflen > 124 && buflen < 128;
+            if (PrepareFinalBlock(state, fb) == (straddles || buflen > 252)) {
+                return false;
+            }
+            if (straddles || buflen > 252) {
+                continue;
+            }
+            unsigned char actual[nIndices * BLAKE2B_OUTBYTES];
+            HashFinalBlocks(fb, indices, nIndices, actual, outlen);
+            for (size_t i = 0; i < nIndices; i++) {
+                unsigned char expected[BLAKE2B_OUTBYTES];
+                eh_HashState copy = state;
+                eh_index lei = htole32(indices[i]);
+                crypto_generichash_blake2b_update(&copy, (const unsigned char*)&lei, sizeof(eh_index));
+                crypto_generichash_blake2b_final(&copy, expected, outlen);
+                if (memcmp(actual + i * outlen, expected, outlen) != 0) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+#if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL) && defined(USE_ASM) && \
+    (defined(__x86_64__) || defined(__amd64__) || defined(__i386__))
+/** Check whether the OS has enabled AVX registers. */
+bool EhAVXEnabled()
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 6) == 6;
+}
+#endif
+
+} // namespace
+
+std::string EhBlake2bAutoDetect()
+{
+    std::string ret = "standard";
+    ehBatchEnabled = false;
+    ehCompress4way = nullptr;
+    if (!EhBlake2bSelfTest()) {
+        return ret;
+    }
+    ehBatchEnabled = true;
+    ret = "batched(1way)";
+
+#if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL) && defined(USE_ASM) && \
+    (defined(__x86_64__) || defined(__amd64__) || defined(__i386__))
+    uint32_t eax, ebx, ecx, edx;
+    __cpuid_count(1, 0, eax, ebx, ecx, edx);
+    bool have_xsave = (ecx >> 27) & 1;
+    bool have_avx = (ecx >> 28) & 1;
+    if (have_xsave && have_avx && EhAVXEnabled()) {
+        __cpuid_count(7, 0, eax, ebx, ecx, edx);
+        if ((ebx >> 5) & 1) {
+            ehCompress4way = eh_blake2b_avx2::Compress_4way;
+            if (EhBlake2bSelfTest()) {
+                ret += ",avx2(4way)";
+            } else {
+                ehCompress4way = nullptr;
+            }
+        }
+    }
+#endif
+
+    return ret;
+}
+
 void ExpandArray(const unsigned char* in, size_t in_len,
                  unsigned char* out, size_t out_len,
                  size_t bit_len, size_t byte_pad)
@@ -816,10 +1103,16 @@ bool Equihash<N,K>::IsValidSolution(const eh_HashState& base_state, std::vector<
 
     std::vector<FullStepRow<FinalFullWidth>> X;
     X.reserve(1 << K);
-    unsigned char tmpHash[HashOutput];
-    for (eh_index i : GetIndicesFromMinimal(soln, CollisionBitLength)) {
-        GenerateHash(base_state, i/IndicesPerHashOutput, tmpHash, HashOutput, N);
-        X.emplace_back(tmpHash+((i % IndicesPerHashOutput) * GetSizeInBytes(N)),
+    std::vector<eh_index> indices = GetIndicesFromMinimal(soln, CollisionBitLength);
+    std::vector<eh_index> hashIndices(indices.size());
+    for (size_t j = 0; j < indices.size(); j++) {
+        hashIndices[j] = indices[j]/IndicesPerHashOutput;
+    }
+    std::vector<unsigned char> hashes(indices.size() * HashOutput);
+    GenerateHashes(base_state, hashIndices.data(), hashIndices.size(), hashes.data(), HashOutput, N);
+    for (size_t j = 0; j < indices.size(); j++) {
+        eh_index i = indices[j];
+        X.emplace_back(&hashes[j * HashOutput]+((i % IndicesPerHashOutput) * GetSizeInBytes(N)),
                        GetSizeInBytes(N), HashLength, CollisionBitLength, i);
     }
 
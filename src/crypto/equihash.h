@@ -18,6 +18,7 @@
 #include <functional>
 #include <memory>
 #include <set>
+#include <string>
 #include <vector>
 
 #include <boost/static_assert.hpp>
@@ -39,6 +40,9 @@ void CompressArray(const unsigned char* in, size_t in_len,
 eh_index ArrayToEhIndex(const unsigned char* array);
 eh_trunc TruncateIndex(const eh_index i, const unsigned int ilen);
 
+/** Autodetect the fastest way to compute the hashes checked by IsValidSolution, and return a description. */
+std::string EhBlake2bAutoDetect();
+
 std::vector<eh_index> GetIndicesFromMinimal(std::vector<unsigned char> minimal,
                                             size_t cBitLen);
 std::vector<unsigned char> GetMinimalFromIndices(std::vector<eh_index> indices,
@@ -0,0 +1,201 @@
+// Copyright (c) 2017-2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "crypto/muhash.h"
+
+#include "crypto/common.h"
+#include "crypto/sha256.h"
+
+#include <string.h>
+
+namespace {
+
+/** 2^3072 - p */
+const Num3072::limb_t MAX_PRIME_DIFF = 1103717;
+
+const Num3072::limb_t LIMB_MAX = ~(Num3072::limb_t)0;
+
+Num3072::limb_t ReadLimb(const unsigned char* ptr)
+{
+#ifdef __SIZEOF_INT128__
+    return ReadLE64(ptr);
+#else
+    return ReadLE32(ptr);
+#endif
+}
+
+void WriteLimb(unsigned char* ptr, Num3072::limb_t x)
+{
+#ifdef __SIZEOF_INT128__
+    WriteLE64(ptr, x);
+#else
+    WriteLE32(ptr, x);
+#endif
+}
+
+} // namespace
+
+Num3072::Num3072(const unsigned char data[BYTE_SIZE])
+{
+    for (int i = 0; i < LIMBS; i++)
+        limbs[i] = ReadLimb(data + i * (LIMB_SIZE / 8));
+}
+
+void Num3072::SetToOne()
+{
+    limbs[0] = 1;
+    for (int i = 1; i < LIMBS; i++)
+        limbs[i] = 0;
+}
+
+void Num3072::ToBytes(unsigned char out[BYTE_SIZE]) const
+{
+    for (int i = 0; i < LIMBS; i++)
+        WriteLimb(out + i * (LIMB_SIZE / 8), limbs[i]);
+}
+
+bool Num3072::IsOverflow() const
+{
+    if (limbs[0] <= LIMB_MAX - MAX_PRIME_DIFF)
+        return false;
+    for (int i = 1; i < LIMBS; i++) {
+        if (limbs[i] != LIMB_MAX)
+            return false;
+    }
+    return true;
+}
+
+void Num3072::FullReduce()
+{
+    // Only called when p <= this < 2^3072: adding 2^3072 - p and dropping the
+    // carry out of the top limb subtracts p.
+    limb_t carry = MAX_PRIME_DIFF;
+    for (int i = 0; i < LIMBS; i++) {
+        double_limb_t t = (double_limb_t)limbs[i] + carry;
+        limbs[i] = (limb_t)t;
+        carry = (limb_t)(t >> LIMB_SIZE);
+    }
+}
+
+void Num3072::Reduce(const limb_t tmp[2 * LIMBS])
+{
+    // tmp = lo + hi * 2^3072, and 2^3072 = MAX_PRIME_DIFF (mod p).
+    limb_t carry = 0;
+    for (int i = 0; i < LIMBS; i++) {
+        double_limb_t t = (double_limb_t)tmp[LIMBS + i] * MAX_PRIME_DIFF + tmp[i] + carry;
+        limbs[i] = (limb_t)t;
+        carry = (limb_t)(t >> LIMB_SIZE);
+    }
+    // Fold whatever spilled past 2^3072 back in the same way.
+    while (carry != 0) {
+        double_limb_t t = (double_limb_t)carry * MAX_PRIME_DIFF;
+        carry = 0;
+        for (int i = 0; i < LIMBS && t != 0; i++) {
+            t += limbs[i];
+            limbs[i] = (limb_t)t;
+            t >>= LIMB_SIZE;
+        }
+        carry = (limb_t)t;
+    }
+    if (IsOverflow())
+        FullReduce();
+}
+
+void Num3072::Multiply(const Num3072& a)
+{
+    limb_t tmp[2 * LIMBS] = {};
+    for (int i = 0; i < LIMBS; i++) {
+        limb_t carry = 0;
+        for (int j = 0; j < LIMBS; j++) {
+            double_limb_t t = (double_limb_t)limbs[i] * a.limbs[j] + tmp[i + j] + carry;
+            tmp[i + j] = (limb_t)t;
+            carry = (limb_t)(t >> LIMB_SIZE);
+        }
+        tmp[i + LIMBS] = carry;
+    }
+    Reduce(tmp);
+}
+
+Num3072 Num3072::GetInverse() const
+{
+    // Fermat: a^-1 = a^(p-2), with p - 2 = 2^3072 - MAX_PRIME_DIFF - 2.
+    limb_t e[LIMBS];
+    e[0] = LIMB_MAX - MAX_PRIME_DIFF - 1;
+    for (int i = 1; i < LIMBS; i++)
+        e[i] = LIMB_MAX;
+
+    Num3072 out;
+    for (int i = LIMBS - 1; i >= 0; i--) {
+        for (int b = LIMB_SIZE - 1; b >= 0; b--) {
+            out.Multiply(out);
+            if ((e[i] >> b) & 1)
+                out.Multiply(*this);
+        }
+    }
+    return out;
+}
+
+void Num3072::Divide(const Num3072& a)
+{
+    Multiply(a.GetInverse());
+}
+
+Num3072 MuHash3072::ToNum3072(const unsigned char* data, size_t len)
+{
+    unsigned char key[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(data, len).Finalize(key);
+    // Expand the digest to a 3072 bit number with the ChaCha20 keystream keyed by it.
+    static const unsigned char nonce[crypto_stream_chacha20_NONCEBYTES] = {};
+    unsigned char bytes[Num3072::BYTE_SIZE];
+    crypto_stream_chacha20(bytes, sizeof(bytes), nonce, key);
+    return Num3072(bytes);
+}
+
+MuHash3072& MuHash3072::Insert(const unsigned char* data, size_t len)
+{
+    numerator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072& MuHash3072::Remove(const unsigned char* data, size_t len)
+{
+    denominator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator*=(const MuHash3072& mul)
+{
+    numerator.Multiply(mul.numerator);
+    denominator.Multiply(mul.denominator);
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator/=(const MuHash3072& div)
+{
+    numerator.Multiply(div.denominator);
+    denominator.Multiply(div.numerator);
+    return *this;
+}
+
+void MuHash3072::Finalize(unsigned char out[OUTPUT_SIZE])
+{
+    numerator.Divide(denominator);
+    denominator.SetToOne();
+
+    unsigned char bytes[Num3072::BYTE_SIZE];
+    numerator.ToBytes(bytes);
+    CSHA256().Write(bytes, sizeof(bytes)).Finalize(out);
+}
+
+void MuHash3072::ToBytes(unsigned char out[STATE_SIZE]) const
+{
+    numerator.ToBytes(out);
+    denominator.ToBytes(out + Num3072::BYTE_SIZE);
+}
+
+void MuHash3072::FromBytes(const unsigned char in[STATE_SIZE])
+{
+    numerator = Num3072(in);
+    denominator = Num3072(in + Num3072::BYTE_SIZE);
+}
@@ -0,0 +1,87 @@
+// Copyright (c) 2017-2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_MUHASH_H
+#define BITCOIN_CRYPTO_MUHASH_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/** A number modulo the prime 2^3072 - 1103717, stored as little endian limbs. */
+class Num3072
+{
+public:
+#ifdef __SIZEOF_INT128__
+    typedef unsigned __int128 double_limb_t;
+    typedef uint64_t limb_t;
+    static const int LIMBS = 48;
+    static const int LIMB_SIZE = 64;
+#else
+    typedef uint64_t double_limb_t;
+    typedef uint32_t limb_t;
+    static const int LIMBS = 96;
+    static const int LIMB_SIZE = 32;
+#endif
+    static const size_t BYTE_SIZE = 384;
+
+    limb_t limbs[LIMBS];
+
+    Num3072() { SetToOne(); }
+    explicit Num3072(const unsigned char data[BYTE_SIZE]);
+
+    void SetToOne();
+    //! this = this * a (mod p)
+    void Multiply(const Num3072& a);
+    //! this = this * a^-1 (mod p)
+    void Divide(const Num3072& a);
+    Num3072 GetInverse() const;
+    void ToBytes(unsigned char out[BYTE_SIZE]) const;
+
+private:
+    bool IsOverflow() const;
+    void FullReduce();
+    void Reduce(const limb_t tmp[2 * LIMBS]);
+};
+
+/**
+ * A rolling hash over a set of byte strings (MuHash3072).
+ *
+ * Each element is mapped to a number modulo a 3072 bit prime, and the set hash is
+ * the product of those numbers. Adding or removing an element is a single modular
+ * multiplication, so the hash of a large set can be kept up to date as the set
+ * changes instead of being recomputed from scratch. Removals are collected in a
+ * separate denominator so that the expensive inverse is only taken in Finalize().
+ */
+class MuHash3072
+{
+private:
+    Num3072 numerator;
+    Num3072 denominator;
+
+    static Num3072 ToNum3072(const unsigned char* data, size_t len);
+
+public:
+    static const size_t OUTPUT_SIZE = 32;
+    //! Size of the serialized state: numerator followed by denominator
+    static const size_t STATE_SIZE = 2 * Num3072::BYTE_SIZE;
+
+    //! Hash of the empty set
+    MuHash3072() {}
+
+    MuHash3072& Insert(const unsigned char* data, size_t len);
+    MuHash3072& Remove(const unsigned char* data, size_t len);
+
+    //! Combine with another set: adds its insertions and its removals
+    MuHash3072& operator*=(const MuHash3072& mul);
+    //! Take another set back out: the inverse of operator*=
+    MuHash3072& operator/=(const MuHash3072& div);
+
+    //! Compute the 32 byte set hash. Folds the denominator into the numerator.
+    void Finalize(unsigned char out[OUTPUT_SIZE]);
+
+    void ToBytes(unsigned char out[STATE_SIZE]) const;
+    void FromBytes(const unsigned char in[STATE_SIZE]);
+};
+
+#endif // BITCOIN_CRYPTO_MUHASH_H
@@ -26,6 +26,7 @@
 #include "src/secp256k1.c"
 #include "src/anon.c"
 #include "src/eval.c"
+#include "src/der.c"
 #include "src/json_rpc.c"
 #include <cJSON.h>
 
@@ -116,7 +117,7 @@ uint32_t fromAsnSubtypes(const ConditionTypes_t types) {
 }
 
 
-size_t cc_conditionBinary(const CC *cond, unsigned char *buf) {
+size_t asnConditionBinary(const CC *cond, unsigned char *buf) {
     Condition_t *asn = calloc(1, sizeof(Condition_t));
     asnCondition(cond, asn);
     size_t out = 0;
@@ -129,6 +130,13 @@ end:
 }
 
 
+size_t cc_conditionBinary(const CC *cond, unsigned char *buf) {
+    size_t fast = derConditionBinary(cond, buf, 1000);
+    if (fast) return fast;
+    return asnConditionBinary(cond, buf);
+}
+
+
 size_t cc_fulfillmentBinary(const CC *cond, unsigned char *buf, size_t length) {
     Fulfillment_t *ffill = asnFulfillmentNew(cond);
     asn_enc_rval_t rc = der_encode_to_buffer(&asn_DEF_Fulfillment, ffill, buf, length);
@@ -195,7 +203,9 @@ CC *fulfillmentToCC(Fulfillment_t *ffill) {
 
 
 CC *cc_readFulfillmentBinary(const unsigned char *ffill_bin, size_t ffill_bin_len) {
-    CC *cond = 0;
+    CC *cond = derFulfillmentToCC(ffill_bin, ffill_bin_len);
+    if (cond) return cond;
+
     unsigned char *buf = calloc(1,ffill_bin_len);
     Fulfillment_t *ffill = 0;
     asn_dec_rval_t rval = ber_decode(0, &asn_DEF_Fulfillment, (void **)&ffill, ffill_bin, ffill_bin_len);
@@ -222,6 +232,9 @@ end:
 int cc_readFulfillmentBinaryExt(const unsigned char *ffill_bin, size_t ffill_bin_len, CC **ppcc) {
 
     int error = 0;
+    if ((*ppcc = derFulfillmentToCC(ffill_bin, ffill_bin_len)))
+        return 0;
+
     unsigned char *buf = calloc(1,ffill_bin_len);
     Fulfillment_t *ffill = 0;
     asn_dec_rval_t rval = ber_decode(0, &asn_DEF_Fulfillment, (void **)&ffill, ffill_bin, ffill_bin_len);
@@ -0,0 +1,449 @@
+/******************************************************************************
+ * Copyright © 2014-2019 The SuperNET Developers.                             *
+ *                                                                            *
+ * See the AUTHORS, DEVELOPER-AGREEMENT and LICENSE files at                  *
+ * the top-level directory of this distribution for the individual copyright  *
+ * holder information and the developer policies on copyright and licensing.  *
+ *                                                                            *
+ * Unless otherwise agreed in a custom licensing agreement, no part of the    *
+ * SuperNET software, including this file may be copied, modified, propagated *
+ * or distributed except according to the terms contained in the LICENSE file *
+ *                                                                            *
+ * Removal or modification of this copyright notice is prohibited.            *
+ *                                                                            *
+ ******************************************************************************/
+
+#include "include/sha256.h"
+#include "cryptoconditions.h"
+#include "internal.h"
+
+
+/*
+ * Hand rolled DER reader and writer for the condition shapes Komodo actually
+ * uses: thresholds of secp256k1 and eval nodes, with anonymous subconditions.
+ *
+ * The reader only accepts input that the asn1c decoder followed by the DER
+ * re-encode malleability check would also accept, and builds the same tree.
+ * Anything else (other types, long form tags, unsorted sets, odd sizes) is
+ * reported as unhandled so the caller falls back to asn1c, which then makes
+ * the final decision. The writer likewise produces the same bytes as
+ * asnCondition + der_encode, computing every fingerprint exactly once.
+ */
+
+
+#define DER_MAX_DEPTH 8
+#define DER_CONDITION_MAX 64
+
+
+/*
+ * Read one tag-length-value with a single byte tag and a minimal definite
+ * length, advancing *pp past it
+ */
+static int derReadTLV(const uint8_t **pp, const uint8_t *end, uint8_t *tag,
+                      const uint8_t **value, size_t *length) {
+    const uint8_t *p = *pp;
+    size_t len;
+
+    if (end - p < 2) return 0;
+    *tag = *p++;
+    if ((*tag & 0x1f) == 0x1f) return 0;
+
+    if (*p < 0x80) {
+        len = *p++;
+    } else if (*p == 0x81) {
+        if (end - p < 2 || p[1] < 0x80) return 0;
+        len = p[1];
+        p += 2;
+    } else if (*p == 0x82) {
+        if (end - p < 3 || p[1] == 0) return 0;
+        len = (p[1] << 8) | p[2];
+        p += 3;
+    } else {
+        return 0;
+    }
+
+    if ((size_t)(end - p) < len) return 0;
+    *value = p;
+    *length = len;
+    *pp = p + len;
+    return 1;
+}
+
+
+static int derReadOctets(const uint8_t **pp, const uint8_t *end, uint8_t expectTag,
+                         const uint8_t **value, size_t *length) {
+    uint8_t tag;
+    return derReadTLV(pp, end, &tag, value, length) && tag == expectTag;
+}
+
+
+/*
+ * Non negative INTEGER of at most 32 bits in minimal form
+ */
+static int derReadCost(const uint8_t **pp, const uint8_t *end, uint8_t expectTag,
+                       unsigned long *out) {
+    const uint8_t *v;
+    size_t len;
+    if (!derReadOctets(pp, end, expectTag, &v, &len)) return 0;
+    if (len < 1 || len > 5 || v[0] & 0x80) return 0;
+    if (len > 1 && v[0] == 0 && !(v[1] & 0x80)) return 0;
+    if (len == 5 && v[0] != 0) return 0;
+    unsigned long n = 0;
+    for (size_t i=0; i<len; i++) n = (n << 8) | v[i];
+    *out = n;
+    return 1;
+}
+
+
+/*
+ * Order of elements in a DER SET OF, as in asn1c's _el_buf_cmp
+ */
+static int derCmpElements(const uint8_t *a, size_t aLength, const uint8_t *b, size_t bLength) {
+    int ret = memcmp(a, b, aLength < bLength ? aLength : bLength);
+    if (ret == 0 && aLength != bLength)
+        ret = aLength < bLength ? -1 : 1;
+    return ret;
+}
+
+
+static int derIsCompound(int typeId) {
+    return typeId == CC_Prefix || typeId == CC_Threshold;
+}
+
+
+static CC *derReadAnon(const uint8_t *tlv, size_t tlvLength) {
+    const uint8_t *p = tlv, *end = tlv + tlvLength, *v, *fp, *bits;
+    size_t len, fpLength, bitsLength;
+    uint8_t tag;
+    unsigned long cost;
+    uint32_t subtypes = 0;
+
+    if (!derReadTLV(&p, end, &tag, &v, &len) || p != end) return NULL;
+    if ((tag & 0xe0) != 0xa0) return NULL;
+
+    int typeId = tag & 0x1f;
+    if (typeId >= CCTypeRegistryLength || !CCTypeRegistry[typeId]) return NULL;
+
+    p = v; end = v + len;
+    if (!derReadOctets(&p, end, 0x80, &fp, &fpLength) || fpLength != 32) return NULL;
+    if (!derReadCost(&p, end, 0x81, &cost)) return NULL;
+
+    if (derIsCompound(typeId)) {
+        if (!derReadOctets(&p, end, 0x82, &bits, &bitsLength)) return NULL;
+        if (bitsLength < 2 || bitsLength > 5 || bits[0] > 7) return NULL;
+        if (bits[bitsLength-1] & ((1 << bits[0]) - 1)) return NULL;
+        for (int i=0; i<(int)(bitsLength-1)*8; i++) {
+            if (bits[1 + (i >> 3)] & (1 << (7 - i % 8))) {
+                subtypes |= 1u << i;
+            }
+        }
+    }
+    if (p != end) return NULL;
+
+    CC *cond = cc_new(CC_Anon);
+    cond->conditionType = CCTypeRegistry[typeId];
+    memcpy(cond->fingerprint, fp, 32);
+    cond->cost = cost;
+    cond->subtypes = subtypes;
+    return cond;
+}
+
+
+static CC *derReadFulfillment(const uint8_t *tlv, size_t tlvLength, int depth);
+
+
+/*
+ * Read the elements of a SET OF, checking they are in DER order
+ */
+static int derReadSet(const uint8_t *p, const uint8_t *end, int isFulfillment,
+                      CC **out, int *count, int max, int depth) {
+    const uint8_t *prev = 0, *start, *v;
+    size_t prevLength = 0, len;
+    uint8_t tag;
+
+    while (p < end) {
+        start = p;
+        if (*count == max) return 0;
+        if (!derReadTLV(&p, end, &tag, &v, &len)) return 0;
+        if (prev && derCmpElements(prev, prevLength, start, p - start) > 0) return 0;
+        out[*count] = isFulfillment ? derReadFulfillment(start, p - start, depth + 1)
+                                    : derReadAnon(start, p - start);
+        if (!out[*count]) return 0;
+        (*count)++;
+        prev = start;
+        prevLength = p - start;
+    }
+    return 1;
+}
+
+
+static CC *derReadThreshold(const uint8_t *p, const uint8_t *end, int depth) {
+    const uint8_t *ffills, *conds;
+    size_t ffillsLength, condsLength;
+    CC *subconditions[255];
+    int nFulfillments = 0, nConditions = 0;
+
+    if (!derReadOctets(&p, end, 0xa0, &ffills, &ffillsLength)) return NULL;
+    if (!derReadOctets(&p, end, 0xa1, &conds, &condsLength)) return NULL;
+    if (p != end) return NULL;
+
+    if (!derReadSet(ffills, ffills + ffillsLength, 1, subconditions, &nFulfillments, 255, depth))
+        goto fail;
+    if (!derReadSet(conds, conds + condsLength, 0, subconditions + nFulfillments, &nConditions,
+                    255 - nFulfillments, depth))
+        goto fail;
+    if (nFulfillments == 0) goto fail;
+
+    CC *cond = cc_new(CC_Threshold);
+    cond->threshold = nFulfillments;
+    cond->size = nFulfillments + nConditions;
+    cond->subconditions = calloc(cond->size, sizeof(CC*));
+    memcpy(cond->subconditions, subconditions, cond->size * sizeof(CC*));
+    return cond;
+fail:
+    for (int i=0; i<nFulfillments+nConditions; i++) cc_free(subconditions[i]);
+    return NULL;
+}
+
+
+static CC *derReadFulfillment(const uint8_t *tlv, size_t tlvLength, int depth) {
+    const uint8_t *p = tlv, *end = tlv + tlvLength, *v, *pk, *sig, *code;
+    size_t len, pkLength, sigLength, codeLength;
+    uint8_t tag;
+
+    if (depth > DER_MAX_DEPTH) return NULL;
+    if (!derReadTLV(&p, end, &tag, &v, &len) || p != end) return NULL;
+    p = v; end = v + len;
+
+    if (tag == (0xa0 | CC_Threshold)) {
+        return derReadThreshold(p, end, depth);
+    }
+    if (tag == (0xa0 | CC_Secp256k1)) {
+        if (!derReadOctets(&p, end, 0x80, &pk, &pkLength) || pkLength != SECP256K1_PK_SIZE) return NULL;
+        if (!derReadOctets(&p, end, 0x81, &sig, &sigLength) || sigLength != SECP256K1_SIG_SIZE) return NULL;
+        if (p != end) return NULL;
+        return cc_secp256k1Condition(pk, sig);
+    }
+    if (tag == (0xa0 | CC_Eval)) {
+        if (!derReadOctets(&p, end, 0x80, &code, &codeLength) || codeLength == 0) return NULL;
+        if (p != end) return NULL;
+        CC *cond = cc_new(CC_Eval);
+        cond->code = calloc(1, codeLength);
+        memcpy(cond->code, code, codeLength);
+        cond->codeLength = codeLength;
+        return cond;
+    }
+    return NULL;
+}
+
+
+/*
+ * Parse a fulfillment binary without going through asn1c. Returns NULL if
+ * the shape is not handled here, in which case the caller should fall back.
+ */
+CC *derFulfillmentToCC(const uint8_t *ffill_bin, size_t ffill_bin_len) {
+    return derReadFulfillment(ffill_bin, ffill_bin_len, 0);
+}
+
+
+/*
+ * A condition in DER along with what its parent needs to know about it
+ */
+typedef struct DERCondition {
+    uint8_t bin[DER_CONDITION_MAX];
+    size_t length;
+    unsigned long cost;
+    uint32_t typeMask;
+} DERCondition;
+
+
+static size_t derWriteLength(uint8_t *out, size_t len) {
+    if (len < 0x80) {
+        out[0] = len;
+        return 1;
+    }
+    if (len < 0x100) {
+        out[0] = 0x81;
+        out[1] = len;
+        return 2;
+    }
+    out[0] = 0x82;
+    out[1] = len >> 8;
+    out[2] = len;
+    return 3;
+}
+
+
+/*
+ * Minimal big endian INTEGER contents of a non negative value
+ */
+static size_t derIntegerContents(uint8_t *out, unsigned long n) {
+    uint8_t buf[sizeof(n) + 1];
+    size_t len = 0;
+    do {
+        buf[sizeof(buf) - 1 - len++] = n & 0xff;
+        n >>= 8;
+    } while (n);
+    if (buf[sizeof(buf) - len] & 0x80)
+        buf[sizeof(buf) - 1 - len++] = 0;
+    memcpy(out, buf + sizeof(buf) - len, len);
+    return len;
+}
+
+
+static void derWriteCondition(int typeId, const uint8_t *fp, unsigned long cost,
+                              uint32_t subtypes, DERCondition *out) {
+    uint8_t body[DER_CONDITION_MAX], *p = body;
+    size_t len;
+
+    *p++ = 0x80;
+    *p++ = 32;
+    memcpy(p, fp, 32);
+    p += 32;
+
+    *p++ = 0x81;
+    len = derIntegerContents(p + 1, cost);
+    *p++ = len;
+    p += len;
+
+    if (derIsCompound(typeId)) {
+        // As asnSubtypes; bit string without trailing zero trimming
+        int maxId = 0;
+        for (int i=0; i<32; i++)
+            if (subtypes & (1u << i)) maxId = i;
+        *p++ = 0x82;
+        *p++ = 2 + (maxId >> 3);
+        *p++ = 7 - maxId % 8;
+        memset(p, 0, 1 + (maxId >> 3));
+        for (int i=0; i<=maxId; i++)
+            if (subtypes & (1u << i)) p[i >> 3] |= 1 << (7 - i % 8);
+        p += 1 + (maxId >> 3);
+    }
+
+    out->bin[0] = 0xa0 | typeId;
+    out->length = 1 + derWriteLength(out->bin + 1, p - body);
+    memcpy(out->bin + out->length, body, p - body);
+    out->length += p - body;
+    out->cost = cost;
+    out->typeMask = (1u << typeId) | subtypes;
+}
+
+
+static int derCmpConditionPtr(const void *a, const void *b) {
+    const DERCondition *ca = *(const DERCondition**)a;
+    const DERCondition *cb = *(const DERCondition**)b;
+    return derCmpElements(ca->bin, ca->length, cb->bin, cb->length);
+}
+
+
+static int derEncodeCondition(const CC *cond, DERCondition *out, int depth);
+
+
+static int derEncodeThreshold(const CC *cond, DERCondition *out, int depth) {
+    DERCondition local[8], *subs = local, *localSorted[8], **sorted = localSorted;
+    unsigned long localCosts[8], *costs = localCosts, cost = 0;
+    uint32_t subtypes = 0;
+    size_t setLength = 0;
+    uint8_t header[16], *p;
+    uint8_t fp[32];
+    int ok = 0;
+
+    if (cond->size == 0 || cond->threshold < 1 || cond->threshold > cond->size) return 0;
+    if (cond->size > 8) {
+        subs = calloc(cond->size, sizeof(DERCondition));
+        sorted = calloc(cond->size, sizeof(DERCondition*));
+        costs = calloc(cond->size, sizeof(unsigned long));
+    }
+
+    for (int i=0; i<cond->size; i++) {
+        if (!derEncodeCondition(cond->subconditions[i], &subs[i], depth + 1)) goto end;
+        sorted[i] = &subs[i];
+        costs[i] = subs[i].cost;
+        subtypes |= subs[i].typeMask;
+        setLength += subs[i].length;
+    }
+
+    // ThresholdFingerprintContents ::= SEQUENCE { threshold, SET OF Condition }
+    uint8_t thresholdInt[sizeof(long) + 1];
+    size_t thresholdLength = derIntegerContents(thresholdInt, cond->threshold);
+    if (setLength > BUF_SIZE) goto end;
+
+    size_t setHeaderLength = 1 + (setLength < 0x80 ? 1 : setLength < 0x100 ? 2 : 3);
+    size_t seqLength = 2 + thresholdLength + setHeaderLength + setLength;
+    p = header;
+    *p++ = 0x30;
+    p += derWriteLength(p, seqLength);
+    *p++ = 0x80;
+    *p++ = thresholdLength;
+    memcpy(p, thresholdInt, thresholdLength);
+    p += thresholdLength;
+    *p++ = 0xa1;
+    p += derWriteLength(p, setLength);
+    // asn1c hashes these contents out of a BUF_SIZE buffer and fails the condition if they
+    // don't fit, leave such trees to that path so both give the same answer
+    if ((size_t)(p - header) + setLength > BUF_SIZE) goto end;
+
+    qsort(sorted, cond->size, sizeof(DERCondition*), derCmpConditionPtr);
+
+    sha256_context_t ctx;
+    sha256_init(&ctx);
+    sha256_update(&ctx, header, p - header);
+    for (int i=0; i<cond->size; i++)
+        sha256_update(&ctx, sorted[i]->bin, sorted[i]->length);
+    sha256_final(fp, &ctx);
+
+    // Same ordering as thresholdCost
+    qsort(costs, cond->size, sizeof(unsigned long), cmpCostDesc);
+    for (int i=0; i<cond->threshold; i++)
+        cost += costs[i];
+    cost += 1024 * cond->size;
+
+    derWriteCondition(CC_Threshold, fp, cost, subtypes & ~(1u << CC_Threshold), out);
+    ok = 1;
+end:
+    if (subs != local) {
+        free(subs);
+        free(sorted);
+        free(costs);
+    }
+    return ok;
+}
+
+
+static int derEncodeCondition(const CC *cond, DERCondition *out, int depth) {
+    uint8_t fp[32];
+
+    if (depth > DER_MAX_DEPTH) return 0;
+
+    switch (cond->type->typeId) {
+    case CC_Threshold:
+        return derEncodeThreshold(cond, out, depth);
+    case CC_Anon:
+        derWriteCondition(cond->conditionType->typeId, cond->fingerprint,
+                          cond->cost, cond->subtypes, out);
+        return 1;
+    case CC_Secp256k1: {
+        // Secp256k1FingerprintContents ::= SEQUENCE { publicKey }
+        uint8_t contents[37] = { 0x30, 35, 0x80, 33 };
+        memcpy(contents + 4, cond->publicKey, 33);
+        sha256(contents, sizeof(contents), fp);
+        break;
+    }
+    default:
+        cond->type->fingerprint(cond, fp);
+    }
+    derWriteCondition(cond->type->typeId, fp, cc_getCost(cond), cond->type->getSubtypes(cond), out);
+    return 1;
+}
+
+
+/*
+ * Condition binary of a tree in a single bottom up pass. Returns 0 if it
+ * could not be encoded here, in which case the caller should fall back.
+ */
+size_t derConditionBinary(const CC *cond, uint8_t *buf, size_t bufLength) {
+    DERCondition out;
+    if (!derEncodeCondition(cond, &out, 0) || out.length > bufLength) return 0;
+    memcpy(buf, out.bin, out.length);
+    return out.length;
+}
@@ -70,6 +70,9 @@ Condition_t *asnConditionNew(const CC *cond);
 Fulfillment_t *asnFulfillmentNew(const CC *cond);
 struct CC *fulfillmentToCC(Fulfillment_t *ffill);
 struct CCType *getTypeByAsnEnum(Condition_PR present);
+struct CC *derFulfillmentToCC(const uint8_t *ffill_bin, size_t ffill_bin_len);
+size_t derConditionBinary(const CC *cond, uint8_t *buf, size_t bufLength);
+size_t asnConditionBinary(const CC *cond, unsigned char *buf);
 
 
 /*
@@ -43,14 +43,46 @@ static const size_t SECP256K1_SK_SIZE = 32;
 static const size_t SECP256K1_SIG_SIZE = 64;
 
 
-secp256k1_context *ec_ctx_sign = 0, *ec_ctx_verify = 0;
-pthread_mutex_t cc_secp256k1ContextLock = PTHREAD_MUTEX_INITIALIZER;
+/*
+ * The verify context is created once and never modified afterwards, so it
+ * is shared by all threads without locking. Signing contexts are per thread,
+ * since randomizing a context mutates it.
+ */
+secp256k1_context *ec_ctx_verify = 0;
+static pthread_once_t cc_secp256k1VerifyOnce = PTHREAD_ONCE_INIT;
+static pthread_once_t cc_secp256k1SignKeyOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t cc_secp256k1SignKey;
 
 
-void lockSign() {
-    pthread_mutex_lock(&cc_secp256k1ContextLock);
-    if (!ec_ctx_sign) {
-        ec_ctx_sign = secp256k1_context_create(SECP256K1_CONTEXT_SIGN);
+static void createVerify() {
+    ec_ctx_verify = secp256k1_context_create(SECP256K1_CONTEXT_VERIFY);
+}
+
+
+void initVerify() {
+    pthread_once(&cc_secp256k1VerifyOnce, createVerify);
+}
+
+
+static void destroySign(void *ctx) {
+    secp256k1_context_destroy((secp256k1_context*) ctx);
+}
+
+
+static void createSignKey() {
+    pthread_key_create(&cc_secp256k1SignKey, destroySign);
+}
+
+
+/*
+ * This thread's signing context, freshly randomized
+ */
+static secp256k1_context *getSign() {
+    pthread_once(&cc_secp256k1SignKeyOnce, createSignKey);
+    secp256k1_context *ctx = pthread_getspecific(cc_secp256k1SignKey);
+    if (!ctx) {
+        ctx = secp256k1_context_create(SECP256K1_CONTEXT_SIGN);
+        pthread_setspecific(cc_secp256k1SignKey, ctx);
     }
     unsigned char ent[32];
 #ifdef SYS_getrandom
@@ -66,25 +98,11 @@ void lockSign() {
         for (i=0; i<32; i++)
             ((uint8_t *)ent)[i] = rand();
     }
-    if (!secp256k1_context_randomize(ec_ctx_sign, ent)) {
+    if (!secp256k1_context_randomize(ctx, ent)) {
         fprintf(stderr, "Could not randomize secp256k1 context\n");
         exit(-1);
     }
-}
-
-
-void unlockSign() {
-    pthread_mutex_unlock(&cc_secp256k1ContextLock);
-}
-
-
-void initVerify() {
-    if (!ec_ctx_verify) {
-        pthread_mutex_lock(&cc_secp256k1ContextLock);
-        if (!ec_ctx_verify)
-            ec_ctx_verify = secp256k1_context_create(SECP256K1_CONTEXT_VERIFY);
-        pthread_mutex_unlock(&cc_secp256k1ContextLock);
-    }
+    return ctx;
 }
 
 
@@ -95,12 +113,11 @@ static void secp256k1Fingerprint(const CC *cond, uint8_t *out) {
 }
 
 
-int secp256k1Verify(CC *cond, CCVisitor visitor) {
-    if (cond->type->typeId != CC_Secp256k1Type.typeId) return 1;
-    initVerify();
-
+static int secp256k1VerifyNode(const CC *cond, const unsigned char *msg32) {
     int rc;
 
+    if (!cond->signature) return 0;
+
     // parse pubkey
     secp256k1_pubkey pk;
     rc = secp256k1_ec_pubkey_parse(ec_ctx_verify, &pk, cond->publicKey, SECP256K1_PK_SIZE);
@@ -112,13 +129,48 @@ int secp256k1Verify(CC *cond, CCVisitor visitor) {
     if (rc != 1) return 0;
 
     // Only accepts lower S signatures
-    rc = secp256k1_ecdsa_verify(ec_ctx_verify, &sig, visitor.msg, &pk);
+    rc = secp256k1_ecdsa_verify(ec_ctx_verify, &sig, msg32, &pk);
     if (rc != 1) return 0;
 
     return 1;
 }
 
 
+int secp256k1Verify(CC *cond, CCVisitor visitor) {
+    if (cond->type->typeId != CC_Secp256k1Type.typeId) return 1;
+    initVerify();
+    return secp256k1VerifyNode(cond, visitor.msg);
+}
+
+
+/*
+ * Secp256k1 nodes of a tree, each distinct key and signature pair once
+ */
+typedef struct CCSecp256k1Batch {
+    const CC **nodes;
+    int count, capacity;
+} CCSecp256k1Batch;
+
+
+static int secp256k1Collect(CC *cond, CCVisitor visitor) {
+    if (cond->type->typeId != CC_Secp256k1) return 1;
+    CCSecp256k1Batch *batch = (CCSecp256k1Batch*) visitor.context;
+    if (!cond->signature) return 0;
+    for (int i=0; i<batch->count; i++) {
+        const CC *other = batch->nodes[i];
+        if (0 == memcmp(other->publicKey, cond->publicKey, SECP256K1_PK_SIZE) &&
+            0 == memcmp(other->signature, cond->signature, SECP256K1_SIG_SIZE))
+            return 1;
+    }
+    if (batch->count == batch->capacity) {
+        batch->capacity = batch->capacity ? batch->capacity * 2 : 8;
+        batch->nodes = realloc(batch->nodes, batch->capacity * sizeof(CC*));
+    }
+    batch->nodes[batch->count++] = cond;
+    return 1;
+}
+
+
 int cc_secp256k1VerifyTreeMsg32(const CC *cond, const unsigned char *msg32) {
     int subtypes = cc_typeMask(cond);
     if (subtypes & (1 << CC_PrefixType.typeId) &&
@@ -127,8 +179,17 @@ int cc_secp256k1VerifyTreeMsg32(const CC *cond, const unsigned char *msg32) {
         // how to combine message and prefix into 32 byte hash
         return 0;
     }
-    CCVisitor visitor = {&secp256k1Verify, msg32, 0, NULL};
+    // Gather the nodes first, then check them in one go against the shared context
+    CCSecp256k1Batch batch = {0};
+    CCVisitor visitor = {&secp256k1Collect, msg32, 0, &batch};
     int out = cc_visit(cond, visitor);
+    if (out && batch.count) {
+        initVerify();
+        for (int i=0; i<batch.count && out; i++) {
+            out = secp256k1VerifyNode(batch.nodes[i], msg32);
+        }
+    }
+    free(batch.nodes);
     return out;
 }
 
@@ -152,9 +213,7 @@ static int secp256k1Sign(CC *cond, CCVisitor visitor) {
     if (0 != memcmp(cond->publicKey, signing->pk, SECP256K1_PK_SIZE)) return 1;
 
     secp256k1_ecdsa_signature sig;
-    lockSign();
-    int rc = secp256k1_ecdsa_sign(ec_ctx_sign, &sig, visitor.msg, signing->sk, NULL, NULL);
-    unlockSign();
+    int rc = secp256k1_ecdsa_sign(getSign(), &sig, visitor.msg, signing->sk, NULL, NULL);
 
     if (rc != 1)
     {
@@ -179,12 +238,11 @@ int cc_signTreeSecp256k1Msg32(CC *cond, const unsigned char *privateKey, const u
         // how to combine message and prefix into 32 byte hash
         return 0;
     }
+    initVerify();
 
     // derive the pubkey
     secp256k1_pubkey spk;
-    lockSign();
-    int rc = secp256k1_ec_pubkey_create(ec_ctx_sign, &spk, privateKey);
-    unlockSign();
+    int rc = secp256k1_ec_pubkey_create(getSign(), &spk, privateKey);
     if (rc != 1) {
         fprintf(stderr, "Cryptoconditions couldn't derive secp256k1 pubkey\n");
         return 0;
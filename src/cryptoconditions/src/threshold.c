@@ -129,6 +129,9 @@ static CC *thresholdFromFulfillment(const Fulfillment_t *ffill) {
     int threshold = t->subfulfillments.list.count;
     int size = threshold + t->subconditions.list.count;
 
+    // cond->size is a uint8_t, a larger SET OF would be truncated
+    if (size > 255) return 0;
+
     CC **subconditions = calloc(size, sizeof(CC*));
 
     for (int i=0; i<size; i++) {
@@ -202,6 +205,11 @@ static CC *thresholdFromJSON(const cJSON *params, char *err) {
         return NULL;
     }
 
+    if (cJSON_GetArraySize(subfulfillments_item) > 255) {
+        strcpy(err, "too many subfulfillments");
+        return NULL;
+    }
+
     CC *cond = cc_new(CC_Threshold);
     cond->threshold = (long) threshold_item->valuedouble;
     cond->size = cJSON_GetArraySize(subfulfillments_item);
@@ -13,13 +13,64 @@
 #include <leveldb/filter_policy.h>
 #include <memenv.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 
-static leveldb::Options GetOptions(size_t nCacheSize, bool compression, int maxOpenFiles)
+#include <mutex>
+#include <set>
+#include <sstream>
+
+namespace {
+
+/** A block cache that counts lookups and hits for CDBWrapper::GetStats */
+class CCountingCache : public leveldb::Cache
+{
+private:
+    leveldb::Cache *cache;
+
+public:
+    std::atomic<uint64_t> nLookups;
+    std::atomic<uint64_t> nHits;
+
+    explicit CCountingCache(size_t capacity) : cache(leveldb::NewLRUCache(capacity)), nLookups(0), nHits(0) {}
+    ~CCountingCache() { delete cache; }
+
+    Handle* Insert(const leveldb::Slice& key, void* value, size_t charge,
+                   void (*deleter)(const leveldb::Slice& key, void* value)) { return cache->Insert(key, value, charge, deleter); }
+    Handle* Lookup(const leveldb::Slice& key)
+    {
+        Handle *handle = cache->Lookup(key);
+        nLookups++;
+        if (handle != NULL)
+            nHits++;
+        return handle;
+    }
+    void Release(Handle* handle) { cache->Release(handle); }
+    void* Value(Handle* handle) { return cache->Value(handle); }
+    void Erase(const leveldb::Slice& key) { cache->Erase(key); }
+    uint64_t NewId() { return cache->NewId(); }
+    void Prune() { cache->Prune(); }
+    size_t TotalCharge() const { return cache->TotalCharge(); }
+};
+
+std::mutex cs_openDatabases;
+
+std::set<const CDBWrapper*>& OpenDatabases()
+{
+    static std::set<const CDBWrapper*> setOpen;
+    return setOpen;
+}
+
+} // anon namespace
+
+static leveldb::Options GetOptions(size_t nCacheSize, bool compression, int maxOpenFiles, const CDBTuning& tuning)
 {
     leveldb::Options options;
-    options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
+    options.block_cache = new CCountingCache(nCacheSize * tuning.nBlockCachePercent / 100);
+    options.write_buffer_size = nCacheSize * tuning.nWriteBufferPercent / 100; // up to two write buffers may be held in memory simultaneously
+    options.filter_policy = tuning.nBloomBitsPerKey > 0 ? leveldb::NewBloomFilterPolicy(tuning.nBloomBitsPerKey) : NULL;
+    if (tuning.nMaxFileSize != 0)
+        options.max_file_size = tuning.nMaxFileSize;
     options.compression = compression ? leveldb::kSnappyCompression : leveldb::kNoCompression;
     options.max_open_files = maxOpenFiles;
     if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
@@ -30,14 +81,19 @@ static leveldb::Options GetOptions(size_t nCacheSize, bool compression, int maxO
     return options;
 }
 
-CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool compression, int maxOpenFiles)
+CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool compression, int maxOpenFiles, const CDBTuning& tuning)
+    : nReads(0), nReadsFound(0), nBatches(0)
 {
     penv = NULL;
+    strName = path.string();
+    std::string strDataDir = GetDataDir().string();
+    if (strName.compare(0, strDataDir.size(), strDataDir) == 0 && strName.size() > strDataDir.size() + 1)
+        strName = strName.substr(strDataDir.size() + 1);
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize, compression, maxOpenFiles);
+    options = GetOptions(nCacheSize, compression, maxOpenFiles, tuning);
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -60,10 +116,16 @@ CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, b
         pdb->CompactRange(nullptr, nullptr);
         LogPrintf("Finished database compaction of %s\n", path.string());
     }
+    std::lock_guard<std::mutex> lock(cs_openDatabases);
+    OpenDatabases().insert(this);
 }
 
 CDBWrapper::~CDBWrapper()
 {
+    {
+        std::lock_guard<std::mutex> lock(cs_openDatabases);
+        OpenDatabases().erase(this);
+    }
     delete pdb;
     pdb = NULL;
     delete options.filter_policy;
@@ -76,6 +138,7 @@ CDBWrapper::~CDBWrapper()
 
 bool CDBWrapper::WriteBatch(CDBBatch& batch, bool fSync)
 {
+    nBatches++;
     leveldb::Status status = pdb->Write(fSync ? syncoptions : writeoptions, &batch.batch);
     dbwrapper_private::HandleError(status);
     return true;
@@ -88,6 +151,56 @@ bool CDBWrapper::IsEmpty()
     return !(it->Valid());
 }
 
+CDBStats CDBWrapper::GetStats() const
+{
+    CDBStats stats;
+    std::string strValue;
+    stats.strName = strName;
+    stats.nReads = nReads;
+    stats.nReadsFound = nReadsFound;
+    stats.nBatches = nBatches;
+
+    // all keys of our databases start below 0xff, so this range covers the whole database
+    leveldb::Range range("", std::string(8, '\xff'));
+    pdb->GetApproximateSizes(&range, 1, &stats.nApproximateSize);
+    if (pdb->GetProperty("leveldb.approximate-memory-usage", &strValue))
+        stats.nMemoryUsage = strtoull(strValue.c_str(), NULL, 10);
+
+    const CCountingCache *pcache = static_cast<const CCountingCache*>(options.block_cache);
+    stats.nCacheLookups = pcache->nLookups;
+    stats.nCacheHits = pcache->nHits;
+
+    if (pdb->GetProperty("leveldb.stats", &strValue))
+        ParseCompactionStats(strValue, stats);
+    return stats;
+}
+
+void CDBWrapper::ParseCompactionStats(const std::string& strStats, CDBStats& stats)
+{
+    // the compaction table of leveldb.stats has one row per level:
+    // Level Files Size(MB) Time(sec) Read(MB) Write(MB)
+    std::istringstream ss(strStats);
+    std::string strLine;
+    while (std::getline(ss, strLine)) {
+        int nLevel, nFiles; double nSize, nTime, nRead, nWrite;
+        if (sscanf(strLine.c_str(), "%d %d %lf %lf %lf %lf", &nLevel, &nFiles, &nSize, &nTime, &nRead, &nWrite) == 6) {
+            stats.nFiles += nFiles;
+            stats.nCompactionSeconds += nTime;
+            stats.nCompactionReadMB += nRead;
+            stats.nCompactionWriteMB += nWrite;
+        }
+    }
+}
+
+std::vector<CDBStats> CDBWrapper::GetAllStats()
+{
+    std::vector<CDBStats> vStats;
+    std::lock_guard<std::mutex> lock(cs_openDatabases);
+    for (const CDBWrapper *pdbwrapper : OpenDatabases())
+        vStats.push_back(pdbwrapper->GetStats());
+    return vStats;
+}
+
 CDBIterator::~CDBIterator() { delete piter; }
 bool CDBIterator::Valid() { return piter->Valid(); }
 void CDBIterator::SeekToFirst() { piter->SeekToFirst(); }
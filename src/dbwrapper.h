@@ -16,6 +16,10 @@
 #include <leveldb/db.h>
 #include <leveldb/write_batch.h>
 
+#include <atomic>
+#include <memory>
+#include <vector>
+
 static const size_t DBWRAPPER_PREALLOC_KEY_SIZE = 64;
 static const size_t DBWRAPPER_PREALLOC_VALUE_SIZE = 1024;
 
@@ -27,6 +31,32 @@ public:
 
 class CDBWrapper;
 
+/** LevelDB settings of one database that go beyond its cache size */
+struct CDBTuning
+{
+    int nBloomBitsPerKey = 10;      //!< bloom filter bits per key, 0 for no filter
+    int nBlockCachePercent = 50;    //!< share of the cache size used for the block cache
+    int nWriteBufferPercent = 25;   //!< share of the cache size used for each of the (up to two) write buffers
+    size_t nMaxFileSize = 0;        //!< size at which table files are split, 0 for the LevelDB default
+};
+
+/** A snapshot of the statistics of one open database, see CDBWrapper::GetStats */
+struct CDBStats
+{
+    std::string strName;
+    uint64_t nApproximateSize = 0;  //!< bytes on disk, as estimated by LevelDB
+    uint64_t nMemoryUsage = 0;      //!< memtables and block cache in use
+    uint64_t nReads = 0;            //!< point reads (Read and Exists)
+    uint64_t nReadsFound = 0;       //!< point reads that found the key
+    uint64_t nCacheLookups = 0;     //!< block cache lookups
+    uint64_t nCacheHits = 0;        //!< block cache lookups that found the block
+    uint64_t nBatches = 0;          //!< batches written
+    int nFiles = 0;                 //!< table files over all levels
+    double nCompactionSeconds = 0;  //!< time spent compacting since the database was opened
+    double nCompactionReadMB = 0;
+    double nCompactionWriteMB = 0;
+};
+
 /** These should be considered an implementation detail of the specific database.
  */
 namespace dbwrapper_private {
@@ -137,6 +167,16 @@ public:
         return piter->key().size();
     }
 
+    bool GetValueDataStream(CDataStream &ssValue) {
+        leveldb::Slice slValue = piter->value();
+        try {
+            ssValue = CDataStream(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+        } catch(std::exception &e) {
+            return false;
+        }
+        return true;
+    }
+
     template<typename V> bool GetValue(V& value) {
         leveldb::Slice slValue = piter->value();
         try {
@@ -154,6 +194,135 @@ public:
 
 };
 
+/** Deserializes straight out of the bytes of a leveldb::Slice, without copying them into a CDataStream */
+class CSliceReader
+{
+private:
+    const char *pbegin;
+    const char *pend;
+    const int nType;
+    const int nVersion;
+
+public:
+    CSliceReader(const leveldb::Slice& slice, int nTypeIn = SER_DISK, int nVersionIn = CLIENT_VERSION) :
+        pbegin(slice.data()), pend(slice.data() + slice.size()), nType(nTypeIn), nVersion(nVersionIn) { }
+
+    int GetType() const { return nType; }
+    int GetVersion() const { return nVersion; }
+    size_t size() const { return pend - pbegin; }
+    bool empty() const { return pbegin == pend; }
+
+    void read(char* pch, size_t nSize)
+    {
+        if (nSize > size())
+            throw std::ios_base::failure("CSliceReader::read(): end of data");
+        if (nSize > 0)
+            memcpy(pch, pbegin, nSize);
+        pbegin += nSize;
+    }
+
+    template<typename T>
+    CSliceReader& operator>>(T& obj)
+    {
+        ::Unserialize(*this, obj);
+        return (*this);
+    }
+};
+
+/**
+ * Walks the records of a CDBWrapper whose keys start with the serialization of a prefix, in key
+ * order, optionally stopping before an upper bound. Keys and values are available as slices into
+ * the iterator, or decoded in place through GetKey/GetValue or ForEach.
+ */
+class CDBRangeCursor
+{
+private:
+    std::unique_ptr<leveldb::Iterator> piter;
+    std::string strPrefix;
+    std::string strEnd;
+
+    template<typename K> static std::string SerializeKey(const K& key)
+    {
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
+        ssKey << key;
+        return std::string(ssKey.begin(), ssKey.end());
+    }
+
+public:
+    /**
+     * @param[in] _piter   The leveldb iterator, owned by the cursor from now on
+     * @param[in] prefix   Only keys whose serialization starts with that of prefix are visited
+     */
+    template<typename P> CDBRangeCursor(leveldb::Iterator *_piter, const P& prefix) :
+        piter(_piter), strPrefix(SerializeKey(prefix))
+    {
+        piter->Seek(strPrefix);
+    }
+
+    /** Move to the first key at or after key, which should share the prefix */
+    template<typename K> void Seek(const K& key) { piter->Seek(SerializeKey(key)); }
+
+    /** Stop before the first key at or after key */
+    template<typename K> void SetUpperBound(const K& key) { strEnd = SerializeKey(key); }
+
+    bool Valid() const
+    {
+        if (!piter->Valid())
+            return false;
+        leveldb::Slice slKey = piter->key();
+        if (!slKey.starts_with(strPrefix))
+            return false;
+        return strEnd.empty() || slKey.compare(strEnd) < 0;
+    }
+
+    void Next() { piter->Next(); }
+
+    leveldb::Slice KeySlice() const { return piter->key(); }
+    leveldb::Slice ValueSlice() const { return piter->value(); }
+
+    template<typename K> bool GetKey(K& key) const
+    {
+        try {
+            CSliceReader(piter->key()) >> key;
+        } catch (const std::exception&) {
+            return false;
+        }
+        return true;
+    }
+
+    template<typename V> bool GetValue(V& value) const
+    {
+        try {
+            CSliceReader(piter->value()) >> value;
+        } catch (const std::exception&) {
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * Decode each remaining record and pass it to visitor(const K& key, const V& value), which
+     * returns false to stop early. A key that does not decode ends the range, as it did for the
+     * iterator loops this replaces
+     * @returns false if a value could not be decoded
+     */
+    template<typename K, typename V, typename Visitor> bool ForEach(Visitor visitor)
+    {
+        for (; Valid(); Next()) {
+            K key;
+            V value;
+            if (!GetKey(key))
+                break;
+            if (!GetValue(value))
+                return false;
+            if (!visitor(key, value))
+                break;
+        }
+        return true;
+    }
+};
+
 /****
  * A wrapper around the leveldb database
  */
@@ -181,6 +350,14 @@ private:
     //! the database itself
     leveldb::DB* pdb;
 
+    //! name reported by GetStats, the path below the data directory
+    std::string strName;
+
+    //! counters reported by GetStats
+    mutable std::atomic<uint64_t> nReads;
+    mutable std::atomic<uint64_t> nReadsFound;
+    std::atomic<uint64_t> nBatches;
+
 public:
     /**
      * @param[in] path        Location in the filesystem where leveldb data will be stored.
@@ -189,11 +366,29 @@ public:
      * @param[in] fWipe       If true, remove all existing data.
      * @param[in] compression
      * @param[in] maxOpenFiles
+     * @param[in] tuning      How the cache is split up, bloom filter and table file size
      */
     CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, 
-            bool fWipe = false, bool compression = false, int maxOpenFiles = 64);
+            bool fWipe = false, bool compression = false, int maxOpenFiles = 64, const CDBTuning& tuning = CDBTuning());
     ~CDBWrapper();
 
+    /****
+     * @returns the statistics of this database
+     */
+    CDBStats GetStats() const;
+
+    /****
+     * @returns the statistics of every open database
+     */
+    static std::vector<CDBStats> GetAllStats();
+
+    /****
+     * Add up the files, compaction time and compaction volume of every level
+     * @param strStats the leveldb.stats property
+     * @param stats where the totals are added
+     */
+    static void ParseCompactionStats(const std::string& strStats, CDBStats& stats);
+
     /****
      * Retrieve the value for the given key
      * @param key the key
@@ -210,12 +405,14 @@ public:
 
         std::string strValue;
         leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        nReads++;
         if (!status.ok()) {
             if (status.IsNotFound())
                 return false;
             LogPrintf("LevelDB read failure: %s\n", status.ToString());
             dbwrapper_private::HandleError(status);
         }
+        nReadsFound++;
         try {
             CDataStream ssValue(strValue.data(), strValue.data() + strValue.size(), SER_DISK, CLIENT_VERSION);
             ssValue >> value;
@@ -255,12 +452,14 @@ public:
 
         std::string strValue;
         leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        nReads++;
         if (!status.ok()) {
             if (status.IsNotFound())
                 return false;
             LogPrintf("LevelDB read failure: %s\n", status.ToString());
             dbwrapper_private::HandleError(status);
         }
+        nReadsFound++;
         return true;
     }
 
@@ -315,6 +514,16 @@ public:
         return new CDBIterator(*this, pdb->NewIterator(iteroptions));
     }
 
+    /***
+     * Get a cursor over the records whose keys start with prefix
+     * @param prefix the key prefix, e.g. the record type character, or a pair of it and a partial key
+     * @returns the cursor, positioned on the first matching record
+     */
+    template<typename P> CDBRangeCursor NewRangeCursor(const P& prefix)
+    {
+        return CDBRangeCursor(pdb->NewIterator(iteroptions), prefix);
+    }
+
     /**
      * @returns true if the database managed by this class contains no entries.
      */
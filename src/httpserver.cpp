@@ -71,10 +71,11 @@ private:
     CWaitableCriticalSection cs;
     CConditionVariable cond;
     /* XXX in C++11 we can use std::unique_ptr here and avoid manual cleanup */
-    std::deque<WorkItem*> queue;
+    std::deque<std::pair<WorkItem*, int64_t> > queue;
     bool running;
     size_t maxDepth;
     int numThreads;
+    HTTPWorkQueueStats stats;
 
     /** RAII object to keep track of number of running worker threads */
     class ThreadCounter
@@ -106,7 +107,7 @@ public:
     ~WorkQueue()
     {
         while (!queue.empty()) {
-            delete queue.front();
+            delete queue.front().first;
             queue.pop_front();
         }
     }
@@ -115,9 +116,11 @@ public:
     {
         boost::unique_lock<boost::mutex> lock(cs);
         if (queue.size() >= maxDepth) {
+            stats.nRejected++;
             return false;
         }
-        queue.push_back(item);
+        queue.push_back(std::make_pair(item, GetTimeMicros()));
+        stats.nMaxDepth = std::max(stats.nMaxDepth, queue.size());
         cond.notify_one();
         return true;
     }
@@ -133,7 +136,9 @@ public:
                     cond.wait(lock);
                 if (!running)
                     break;
-                i = queue.front();
+                i = queue.front().first;
+                stats.nProcessed++;
+                stats.nWaitMicros += GetTimeMicros() - queue.front().second;
                 queue.pop_front();
             }
             (*i)();
@@ -161,6 +166,15 @@ public:
         boost::unique_lock<boost::mutex> lock(cs);
         return queue.size();
     }
+
+    /** Return the counters, with the current depth */
+    HTTPWorkQueueStats Stats()
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        HTTPWorkQueueStats ret = stats;
+        ret.nDepth = queue.size();
+        return ret;
+    }
 };
 
 struct HTTPPathHandler
@@ -520,6 +534,12 @@ void StopHTTPServer()
     LogPrint("http", "Stopped HTTP server\n");
 }
 
+void GetHTTPWorkQueueStats(HTTPWorkQueueStats &stats)
+{
+    if (workQueue)
+        stats = workQueue->Stats();
+}
+
 struct event_base* EventBase()
 {
     return eventBase;
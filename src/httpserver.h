@@ -47,6 +47,19 @@ void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPR
 /** Unregister handler for prefix */
 void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch);
 
+/** Counters of the HTTP work queue since startup */
+struct HTTPWorkQueueStats
+{
+    size_t nDepth = 0;
+    size_t nMaxDepth = 0;
+    uint64_t nProcessed = 0;
+    uint64_t nRejected = 0;
+    int64_t nWaitMicros = 0;
+};
+
+/** Fill stats from the HTTP work queue, left zero if the HTTP server is not running */
+void GetHTTPWorkQueueStats(HTTPWorkQueueStats &stats);
+
 /** Return evhttp event base. This can be used by submodules to
  * queue timers or custom events.
  */
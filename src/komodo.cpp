@@ -25,6 +25,7 @@ static FILE *fp; // for stateupdate
 //int32_t KOMODO_EXTERNAL_NOTARIES = 0; //todo remove
 #include "komodo_gateway.h"
 #include "komodo_events.h"
+#include "komodo_kv.h"
 #include "komodo_ccdata.h"
 
 void komodo_currentheight_set(int32_t height)
@@ -228,6 +229,8 @@ void komodo_stateupdate(int32_t height,uint8_t notarypubs[][33],uint8_t numnotar
         komodo_statefname(fname,chainName.symbol().c_str(),(char *)"komodostate");
         if ( (fp= fopen(fname,"rb+")) != nullptr )
         {
+            // the KV index skips the events it already holds
+            komodo_kvreplay(true);
             if ( komodo_faststateinit(sp, fname, symbol, dest) )
                 fseek(fp,0,SEEK_END);
             else
@@ -237,6 +240,7 @@ void komodo_stateupdate(int32_t height,uint8_t notarypubs[][33],uint8_t numnotar
                 while (!ShutdownRequested() && komodo_parsestatefile(sp,fp,symbol,dest) >= 0)
                     ;
             }
+            komodo_kvreplay(false);
         } 
         else 
             fp = fopen(fname,"wb+"); // the state file probably did not exist, create it.
@@ -684,6 +688,8 @@ int32_t komodo_connectblock(bool fJustCheck, CBlockIndex *pindex,CBlock& block)
             komodo_stateupdate(pindex->nHeight,0,0,0,zero,0,0,-pindex->nHeight,pindex->nTime,0,0,0,0,zero,0);
         }
     }
+    if ( !fJustCheck )
+        komodo_kvsweep(pindex->nHeight);
     komodo_currentheight_set(chainActive.Tip()->nHeight);
     int transaction = 0;
     if ( pindex != 0 )
@@ -100,7 +100,7 @@ void komodo_eventadd_opreturn( komodo_state *sp, char *symbol, int32_t height, k
         //komodo_opreturn(height, opret->value, opret->opret.data(), opret->opret.size(), opret->txid, opret->vout, symbol);
         if ( opret.opret.data()[0] == 'K' && opret.opret.size() != 40 )
         {
-            komodo_kvupdate(opret.opret.data(), opret.opret.size(), opret.value);
+            komodo_kvupdate(opret.opret.data(), opret.opret.size(), opret.value, height);
         }
     }
 }
@@ -129,6 +129,7 @@ void komodo_event_rewind(komodo_state *sp, char *symbol, int32_t height)
 {
     if ( sp != nullptr )
     {
+        komodo_kvrewind(sp,height);
         if ( chainName.isKMD() && height <= KOMODO_LASTMINED && prevKOMODO_LASTMINED != 0 )
         {
             LogPrintf("undo KOMODO_LASTMINED %d <- %d\n",KOMODO_LASTMINED,prevKOMODO_LASTMINED);
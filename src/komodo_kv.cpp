@@ -13,26 +13,467 @@
  *                                                                            *
  ******************************************************************************/
 #include "komodo_kv.h"
+#include "komodo_structs.h" // komodo_state events, replayed by a deep rewind
 #include "komodo_globals.h"
 #include "komodo_utils.h" // portable_mutex_lock
 #include "komodo_curve25519.h" // for komodo_kvsigverify
+#include "dbwrapper.h"
+#include "main.h" // fReindex
+#include "util.h"
 #include <mutex>
+#include <unordered_map>
 
 std::mutex kv_mutex;
 
-struct komodo_kv 
-{ 
-    UT_hash_handle hh; 
-    bits256 pubkey; 
-    uint8_t *key;
-    uint8_t *value; 
-    int32_t height; 
-    uint32_t flags; 
-    uint16_t keylen;
-    uint16_t valuesize; 
+/** How many blocks of KV undo data are kept, comfortably deeper than MAX_REORG_LENGTH */
+static const int32_t KOMODO_KVUNDO_DEPTH = 200;
+/** The read cache is split by key hash so lookups from RPC threads rarely contend */
+static const int32_t KOMODO_KVCACHE_SHARDS = 16;
+static const size_t KOMODO_KVCACHE_SHARDMAX = 4096;
+
+static const char DB_KV_RECORD = 'k';
+static const char DB_KV_EXPIRY = 'e';
+static const char DB_KV_UNDO = 'u';
+static const char DB_KV_BESTHEIGHT = 'H';
+
+/** The current state of one key */
+struct CKVRecord
+{
+    uint256 pubkey;
+    int32_t height;
+    uint32_t flags;
+    std::vector<uint8_t> value;
+
+    CKVRecord() : height(0), flags(0) {}
+
+    /** the record is gone for lookups above this height */
+    int32_t Expiry() const { return height + komodo_kvduration(flags); }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(pubkey);
+        READWRITE(height);
+        READWRITE(flags);
+        READWRITE(value);
+    }
 };
 
-komodo_kv *KOMODO_KV;
+/** What a block changed for one key, so a disconnect can put it back */
+struct CKVUndo
+{
+    std::vector<uint8_t> key;
+    bool fExisted;
+    CKVRecord prev;
+
+    CKVUndo() : fExisted(false) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(key);
+        READWRITE(fExisted);
+        READWRITE(prev);
+    }
+};
+
+/** 'k' followed by the raw key bytes, so LevelDB keeps the records in key order */
+struct CKVRecordKey
+{
+    std::vector<uint8_t> key;
+
+    CKVRecordKey(const std::vector<uint8_t> &keyIn) : key(keyIn) {}
+
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        ser_writedata8(s, DB_KV_RECORD);
+        if ( key.size() > 0 )
+            s.write((const char *)key.data(), key.size());
+    }
+};
+
+/** 'e', the expiry height big endian and the raw key, walked in height order by the sweep */
+struct CKVExpiryKey
+{
+    uint32_t expiry;
+    std::vector<uint8_t> key;
+
+    CKVExpiryKey(uint32_t expiryIn, const std::vector<uint8_t> &keyIn) : expiry(expiryIn), key(keyIn) {}
+
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        ser_writedata8(s, DB_KV_EXPIRY);
+        ser_writedata32be(s, expiry);
+        if ( key.size() > 0 )
+            s.write((const char *)key.data(), key.size());
+    }
+};
+
+/** 'u', the block height and a sequence number within the block, both big endian */
+struct CKVUndoKey
+{
+    uint32_t height;
+    uint32_t seq;
+
+    CKVUndoKey(uint32_t heightIn, uint32_t seqIn) : height(heightIn), seq(seqIn) {}
+
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        ser_writedata8(s, DB_KV_UNDO);
+        ser_writedata32be(s, height);
+        ser_writedata32be(s, seq);
+    }
+};
+
+/** a database key exactly as read back from an iterator */
+struct CKVRawKey
+{
+    std::vector<uint8_t> raw;
+
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        if ( raw.size() > 0 )
+            s.write((const char *)raw.data(), raw.size());
+    }
+};
+
+/****
+ * The KV records in a LevelDB under <datadir>/kvindex. Changes are written per block along
+ * with undo data for the last KOMODO_KVUNDO_DEPTH blocks, so a reorg rolls them back and a
+ * restart does not have to rebuild anything from the komodostate events.
+ * Writers hold kv_mutex; lookups only take the lock of one cache shard.
+ */
+class CKVIndex
+{
+private:
+    struct CacheShard
+    {
+        std::mutex mutex;
+        std::unordered_map<std::string,CKVRecord> records;
+        uint64_t generation = 0; // bumped on every change, so a lookup racing a write does not cache the old record
+    };
+
+    CDBWrapper db;
+    CacheShard shards[KOMODO_KVCACHE_SHARDS];
+    int32_t nBestHeight; // the index holds every change up to this block, -1 if empty
+    int32_t nBlockHeight; // block whose changes are being written, -1 if none
+    uint32_t nUndoSeq;
+    bool fReplay;
+    bool fReplayCaughtUp;
+
+    CacheShard &Shard(const std::string &key)
+    {
+        return shards[std::hash<std::string>()(key) % KOMODO_KVCACHE_SHARDS];
+    }
+
+    void Uncache(const std::vector<uint8_t> &key)
+    {
+        std::string strKey(key.begin(),key.end());
+        CacheShard &shard = Shard(strKey);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.records.erase(strKey);
+        shard.generation++;
+    }
+
+    void UncacheAll()
+    {
+        for (int32_t i=0; i<KOMODO_KVCACHE_SHARDS; i++)
+        {
+            std::lock_guard<std::mutex> lock(shards[i].mutex);
+            shards[i].records.clear();
+            shards[i].generation++;
+        }
+    }
+
+    /** queue the change of one key together with its undo record */
+    void WriteRecord(CDBBatch &batch,const std::vector<uint8_t> &key,const CKVRecord *record)
+    {
+        CKVUndo undo;
+        undo.key = key;
+        if ( (undo.fExisted= db.Read(CKVRecordKey(key),undo.prev)) )
+            batch.Erase(CKVExpiryKey(undo.prev.Expiry(),key));
+        batch.Write(CKVUndoKey(nBlockHeight,nUndoSeq++),undo);
+        if ( record != nullptr )
+        {
+            batch.Write(CKVRecordKey(key),*record);
+            batch.Write(CKVExpiryKey(record->Expiry(),key),'1');
+        }
+        else
+            batch.Erase(CKVRecordKey(key));
+    }
+
+    /** the keys with the given prefix byte whose next four bytes, big endian, are below nLimit */
+    void ScanBelow(char chPrefix,uint32_t nLimit,std::vector<CKVRawKey> &raws)
+    {
+        std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+        for (pcursor->Seek(chPrefix); pcursor->Valid(); pcursor->Next())
+        {
+            CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+            if ( !pcursor->GetKeyDataStream(ssKey) || ssKey.size() < 5 || ssKey[0] != chPrefix )
+                break;
+            CKVRawKey raw;
+            raw.raw.assign(ssKey.begin(),ssKey.end());
+            ssKey.ignore(1);
+            if ( ser_readdata32be(ssKey) >= nLimit )
+                break;
+            raws.push_back(raw);
+        }
+    }
+
+    /** start or continue writing the changes of the block at height, false to skip them */
+    bool BeginBlock(CDBBatch &batch,int32_t height)
+    {
+        if ( fReplay && !fReplayCaughtUp )
+        {
+            // replaying komodostate events the index already holds
+            if ( height <= nBestHeight )
+                return false;
+            fReplayCaughtUp = true;
+        }
+        if ( height != nBlockHeight )
+        {
+            // connecting a block at or below the best one again, its old changes have to go first
+            if ( height <= nBestHeight )
+                Rewind(height);
+            nBlockHeight = height;
+            nUndoSeq = 0;
+            if ( height > KOMODO_KVUNDO_DEPTH )
+            {
+                std::vector<CKVRawKey> raws;
+                ScanBelow(DB_KV_UNDO,height - KOMODO_KVUNDO_DEPTH,raws);
+                for (const CKVRawKey &raw : raws)
+                    batch.Erase(raw);
+            }
+        }
+        return true;
+    }
+
+    bool CommitBlock(CDBBatch &batch)
+    {
+        batch.Write(DB_KV_BESTHEIGHT,nBlockHeight);
+        if ( !db.WriteBatch(batch) )
+            return false;
+        nBestHeight = nBlockHeight;
+        return true;
+    }
+
+public:
+    CKVIndex() : db(GetDataDir() / "kvindex", 8 << 20, false, fReindex, true), nBlockHeight(-1), nUndoSeq(0), fReplay(false), fReplayCaughtUp(false)
+    {
+        if ( !db.Read(DB_KV_BESTHEIGHT,nBestHeight) )
+            nBestHeight = -1;
+        LogPrintf("KV index opened at height %d\n",nBestHeight);
+    }
+
+    /****
+     * @param key the key
+     * @param[out] record the current record, expired or not
+     * @returns true if the key is in the index
+     */
+    bool Get(const std::vector<uint8_t> &key,CKVRecord &record)
+    {
+        std::string strKey(key.begin(),key.end());
+        CacheShard &shard = Shard(strKey);
+        uint64_t generation;
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.records.find(strKey);
+            if ( it != shard.records.end() )
+            {
+                record = it->second;
+                return true;
+            }
+            generation = shard.generation;
+        }
+        if ( !db.Read(CKVRecordKey(key),record) )
+            return false;
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if ( shard.generation == generation )
+        {
+            if ( shard.records.size() >= KOMODO_KVCACHE_SHARDMAX )
+                shard.records.clear();
+            shard.records.emplace(strKey,record);
+        }
+        return true;
+    }
+
+    /** store a record changed by the block at height, kv_mutex must be held */
+    void Put(int32_t height,const std::vector<uint8_t> &key,const CKVRecord &record)
+    {
+        CDBBatch batch(db);
+        if ( !BeginBlock(batch,height) )
+            return;
+        WriteRecord(batch,key,&record);
+        if ( !CommitBlock(batch) )
+            LogPrintf("KV index: unable to write key at height %d\n",height);
+        Uncache(key);
+    }
+
+    /** remove the records that expired before the block at height, kv_mutex must be held */
+    void Sweep(int32_t height)
+    {
+        std::vector<CKVRawKey> raws;
+        if ( height <= 0 )
+            return;
+        ScanBelow(DB_KV_EXPIRY,height,raws);
+        if ( raws.empty() )
+            return;
+        CDBBatch batch(db);
+        if ( !BeginBlock(batch,height) )
+            return;
+        for (const CKVRawKey &raw : raws)
+        {
+            batch.Erase(raw);
+            WriteRecord(batch,std::vector<uint8_t>(raw.raw.begin()+5,raw.raw.end()),nullptr);
+        }
+        if ( !CommitBlock(batch) )
+            LogPrintf("KV index: unable to sweep at height %d\n",height);
+        UncacheAll();
+        LogPrint("kv","KV index: swept %d expired keys at height %d\n",(int32_t)raws.size(),height);
+    }
+
+    /****
+     * undo the changes of every block from height up, kv_mutex must be held
+     * @returns false if the undo data does not reach back to height, the index is then empty
+     * and has to be rebuilt from the komodostate events below height
+     */
+    bool Rewind(int32_t height)
+    {
+        bool fUndone = true;
+        if ( height > nBestHeight || height <= 0 )
+            return fUndone;
+        CDBBatch batch(db);
+        if ( height <= nBestHeight - KOMODO_KVUNDO_DEPTH )
+        {
+            LogPrintf("KV index: rewind to %d is deeper than the undo data at %d, rebuilding the index\n",height,nBestHeight);
+            std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+            for (pcursor->SeekToFirst(); pcursor->Valid(); pcursor->Next())
+            {
+                CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+                if ( !pcursor->GetKeyDataStream(ssKey) )
+                    continue;
+                CKVRawKey raw;
+                raw.raw.assign(ssKey.begin(),ssKey.end());
+                batch.Erase(raw);
+            }
+            nBestHeight = -1;
+            fUndone = false;
+        }
+        else
+        {
+            // newest first, so each key ends up with the value it had before the oldest undone change
+            std::vector<CKVUndo> undos;
+            std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+            for (pcursor->Seek(CKVUndoKey(height,0)); pcursor->Valid(); pcursor->Next())
+            {
+                CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+                CKVUndo undo;
+                if ( !pcursor->GetKeyDataStream(ssKey) || ssKey.size() != 9 || ssKey[0] != DB_KV_UNDO )
+                    break;
+                if ( pcursor->GetValue(undo) )
+                    undos.push_back(undo);
+                CKVRawKey raw;
+                raw.raw.assign(ssKey.begin(),ssKey.end());
+                batch.Erase(raw);
+            }
+            std::map<std::vector<uint8_t>,CKVUndo> restore;
+            for (auto it = undos.rbegin(); it != undos.rend(); ++it)
+                restore[it->key] = *it;
+            for (auto &item : restore)
+            {
+                CKVRecord current;
+                if ( db.Read(CKVRecordKey(item.first),current) )
+                    batch.Erase(CKVExpiryKey(current.Expiry(),item.first));
+                if ( item.second.fExisted )
+                {
+                    batch.Write(CKVRecordKey(item.first),item.second.prev);
+                    batch.Write(CKVExpiryKey(item.second.prev.Expiry(),item.first),'1');
+                }
+                else
+                    batch.Erase(CKVRecordKey(item.first));
+            }
+            nBestHeight = height - 1;
+            LogPrint("kv","KV index: rewound %d changes of %d keys to height %d\n",(int32_t)undos.size(),(int32_t)restore.size(),nBestHeight);
+        }
+        batch.Write(DB_KV_BESTHEIGHT,nBestHeight);
+        if ( !db.WriteBatch(batch) )
+            LogPrintf("KV index: unable to rewind to height %d\n",height);
+        nBlockHeight = -1;
+        UncacheAll();
+        return fUndone;
+    }
+
+    /** the events below height have been put back after a rebuild, kv_mutex must be held */
+    void Rebuilt(int32_t height)
+    {
+        // drop what expired on the way, then hold every block below height even if it had no changes
+        Sweep(height - 1);
+        if ( nBestHeight < height - 1 )
+        {
+            nBestHeight = height - 1;
+            if ( !db.Write(DB_KV_BESTHEIGHT,nBestHeight) )
+                LogPrintf("KV index: unable to write best height %d\n",nBestHeight);
+        }
+        nBlockHeight = -1;
+        LogPrintf("KV index: rebuilt to height %d\n",nBestHeight);
+    }
+
+    /** komodostate events are being replayed at startup, kv_mutex must be held */
+    void SetReplay(bool fReplayIn)
+    {
+        fReplay = fReplayIn;
+        fReplayCaughtUp = false;
+    }
+
+    /** true for komodostate events replayed at startup that the index already holds */
+    bool Skip(int32_t height) const { return fReplay && !fReplayCaughtUp && height <= nBestHeight; }
+
+    /****
+     * @param[out] items the live records with keys in [start,end), in key order
+     * @param current_height records that expired below this height are skipped
+     * @param start the first key
+     * @param end the key to stop at, empty for no limit
+     * @param skip how many matching records to skip first
+     * @param count the most records to return
+     */
+    void List(std::vector<komodo_kvitem> &items,int32_t current_height,const std::vector<uint8_t> &start,const std::vector<uint8_t> &end,int32_t skip,int32_t count)
+    {
+        std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+        for (pcursor->Seek(CKVRecordKey(start)); pcursor->Valid() && (int32_t)items.size() < count; pcursor->Next())
+        {
+            CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+            if ( !pcursor->GetKeyDataStream(ssKey) || ssKey.size() < 1 || ssKey[0] != DB_KV_RECORD )
+                break;
+            std::vector<uint8_t> key(ssKey.begin()+1,ssKey.end());
+            if ( end.size() > 0 && key >= end )
+                break;
+            CKVRecord record;
+            if ( !pcursor->GetValue(record) || current_height > record.Expiry() )
+                continue;
+            if ( skip > 0 )
+            {
+                skip--;
+                continue;
+            }
+            komodo_kvitem item;
+            item.key.assign(key.begin(),key.end());
+            item.pubkey = record.pubkey;
+            item.height = record.height;
+            item.flags = record.flags;
+            item.value.assign(record.value.begin(),record.value.end());
+            items.push_back(item);
+        }
+    }
+};
+
+/** the index is opened on first use, once the data directory is known */
+static CKVIndex &KVIndex()
+{
+    static CKVIndex index;
+    return index;
+}
 
 /****
  * @brief build a private key from the public key and passphrase
@@ -158,38 +599,20 @@ int32_t komodo_kvsearch(uint256 *pubkeyp, int32_t current_height, uint32_t *flag
     *heightp = -1;
     *flagsp = 0;
 
-    komodo_kv *ptr; 
     int32_t retval = -1;
     memset(pubkeyp,0,sizeof(*pubkeyp));
-    std::lock_guard<std::mutex> lock(kv_mutex);
-    // look in hashtable for key
-    HASH_FIND(hh,KOMODO_KV,key,keylen,ptr);
-    if ( ptr != nullptr )
+    if ( keylen <= 0 )
+        return retval;
+    CKVRecord record;
+    // expired entries stay in the index until the next sweep, they are not found here
+    if ( KVIndex().Get(std::vector<uint8_t>(key,key+keylen),record) && current_height <= record.Expiry() )
     {
-        int32_t duration = komodo_kvduration(ptr->flags);
-        if ( current_height > (ptr->height + duration) )
-        {
-            // entry has expired, remove it
-            HASH_DELETE(hh,KOMODO_KV,ptr);
-            if ( ptr->value != 0 )
-                free(ptr->value);
-            if ( ptr->key != 0 )
-                free(ptr->key);
-            free(ptr);
-        }
-        else
-        {
-            // place values into parameters
-            *heightp = ptr->height;
-            *flagsp = ptr->flags;
-            for (int32_t i=0; i<32; i++)
-            {
-                ((uint8_t *)pubkeyp)[i] = ((uint8_t *)&ptr->pubkey)[31-i];
-            }
-            memcpy(pubkeyp,&ptr->pubkey,sizeof(*pubkeyp));
-            if ( (retval= ptr->valuesize) > 0 )
-                memcpy(value,ptr->value,retval);
-        }
+        // place values into parameters
+        *heightp = record.height;
+        *flagsp = record.flags;
+        memcpy(pubkeyp,&record.pubkey,sizeof(*pubkeyp));
+        if ( (retval= (int32_t)record.value.size()) > 0 )
+            memcpy(value,record.value.data(),retval);
     }
     if ( retval < 0 )
     {
@@ -204,12 +627,18 @@ int32_t komodo_kvsearch(uint256 *pubkeyp, int32_t current_height, uint32_t *flag
  * @param opretlen length of opretbuf
  * @param value the value to be related to the key
  */
-void komodo_kvupdate(uint8_t *opretbuf,int32_t opretlen,uint64_t value)
+void komodo_kvupdate(uint8_t *opretbuf,int32_t opretlen,uint64_t value,int32_t blockheight)
 {
     static uint256 zeroes;
 
     if (chainName.isKMD()) // disable KV for KMD
         return;
+    {
+        // replaying an event the index already holds
+        std::lock_guard<std::mutex> lock(kv_mutex);
+        if ( KVIndex().Skip(blockheight) )
+            return;
+    }
 
     // parse opretbuf
     uint16_t keylen;
@@ -275,10 +704,11 @@ void komodo_kvupdate(uint8_t *opretbuf,int32_t opretlen,uint64_t value)
             }
             // with validation complete, update internal storage
             std::lock_guard<std::mutex> lock(kv_mutex);
-            komodo_kv *ptr;
-            bool newflag = false;
-            HASH_FIND(hh,KOMODO_KV,key,keylen,ptr);
-            if ( ptr != 0 )
+            CKVIndex &index = KVIndex();
+            std::vector<uint8_t> vkey(key,key+keylen);
+            CKVRecord record;
+            bool newflag = !index.Get(vkey,record) || height > record.Expiry();
+            if ( !newflag )
             {
                 // We are updating an existing entry
                 // if we are doing a transfer, log it and insert the pubkey
@@ -291,37 +721,17 @@ void komodo_kvupdate(uint8_t *opretbuf,int32_t opretlen,uint64_t value)
                         ((uint8_t *)&pubkey)[31-i] = _decode_hex(&transferpubstr[i*2]);
                 }
             }
-            else if ( ptr == 0 )
-            {
-                // add a new entry to the hashtable
-                ptr = (komodo_kv *)calloc(1,sizeof(*ptr));
-                ptr->key = (uint8_t *)calloc(1,keylen);
-                ptr->keylen = keylen;
-                memcpy(ptr->key,key,keylen);
-                newflag = true;
-                HASH_ADD_KEYPTR(hh,KOMODO_KV,ptr->key,ptr->keylen,ptr);
-            }
-            if ( newflag || (ptr->flags & KOMODO_KVPROTECTED) == 0 ) // can we edit the value?
-            {
-                if ( ptr->value != nullptr )
-                {
-                    // clear out old value
-                    free(ptr->value);
-                    ptr->value = nullptr;
-                }
-                if ( (ptr->valuesize= valuesize) != 0 )
-                {
-                    // add value
-                    ptr->value = (uint8_t *)calloc(1,valuesize);
-                    memcpy(ptr->value,valueptr,valuesize);
-                }
-            } 
+            else
+                record = CKVRecord();
+            if ( newflag || (record.flags & KOMODO_KVPROTECTED) == 0 ) // can we edit the value?
+                record.value.assign(valueptr,valueptr+valuesize);
             else 
                 LogPrintf("newflag.%d zero or protected %d\n",(uint16_t)newflag,
-                        (ptr->flags & KOMODO_KVPROTECTED));
-            memcpy(&ptr->pubkey,&pubkey,sizeof(ptr->pubkey));
-            ptr->height = height;
-            ptr->flags = flags; // jl777 used to or in KVPROTECTED
+                        (record.flags & KOMODO_KVPROTECTED));
+            record.pubkey = pubkey;
+            record.height = height;
+            record.flags = flags; // jl777 used to or in KVPROTECTED
+            index.Put(blockheight,vkey,record);
         } 
         else 
             LogPrintf("KV update size mismatch %d vs %d\n",opretlen,coresize);
@@ -329,3 +739,77 @@ void komodo_kvupdate(uint8_t *opretbuf,int32_t opretlen,uint64_t value)
     else 
         LogPrintf("not enough fee\n");
 }
+
+/****
+ * @brief undo the KV changes of the blocks from height up
+ * @param sp the state holding the events, replayed when the undo data does not reach back to height
+ * @param height the first block to undo
+ */
+void komodo_kvrewind(komodo_state *sp,int32_t height)
+{
+    if (chainName.isKMD())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(kv_mutex);
+        CKVIndex &index = KVIndex();
+        // a rewind replayed from komodostate is already part of the index
+        if ( index.Skip(height) || index.Rewind(height) )
+            return;
+    }
+    // too deep for the undo data, the index was cleared: put back the KV events below height
+    if ( sp != nullptr )
+    {
+        for (const std::shared_ptr<komodo::event> &ev : sp->events)
+        {
+            if ( ev->height >= height || ev->type != komodo::komodo_event_type::EVENT_OPRETURN )
+                continue;
+            komodo::event_opreturn *opret = static_cast<komodo::event_opreturn *>(ev.get());
+            if ( opret->opret.size() > 0 && opret->opret[0] == 'K' && opret->opret.size() != 40 )
+                komodo_kvupdate(opret->opret.data(),opret->opret.size(),opret->value,ev->height);
+        }
+    }
+    std::lock_guard<std::mutex> lock(kv_mutex);
+    KVIndex().Rebuilt(height);
+}
+
+/****
+ * @brief remove the entries that expired before a block
+ * @param height the height of the block being connected
+ */
+void komodo_kvsweep(int32_t height)
+{
+    if (chainName.isKMD())
+        return;
+    std::lock_guard<std::mutex> lock(kv_mutex);
+    KVIndex().Sweep(height);
+}
+
+/****
+ * @brief mark the replay of the komodostate events at startup
+ * @param fReplay true when the replay starts, false when it is done
+ */
+void komodo_kvreplay(bool fReplay)
+{
+    if (chainName.isKMD())
+        return;
+    std::lock_guard<std::mutex> lock(kv_mutex);
+    KVIndex().SetReplay(fReplay);
+}
+
+/****
+ * @brief list the live entries in key order
+ * @param[out] items the entries found
+ * @param current_height entries that expired below this height are left out
+ * @param start the first key
+ * @param end the key to stop before, empty for no limit
+ * @param skip the number of entries to skip
+ * @param count the most entries to return
+ */
+void komodo_kvlist(std::vector<komodo_kvitem> &items,int32_t current_height,const std::string &start,
+        const std::string &end,int32_t skip,int32_t count)
+{
+    if (chainName.isKMD())
+        return;
+    KVIndex().List(items,current_height,std::vector<uint8_t>(start.begin(),start.end()),
+            std::vector<uint8_t>(end.begin(),end.end()),skip,count);
+}
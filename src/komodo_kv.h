@@ -16,6 +16,20 @@
 #include "uint256.h"
 #include "komodo_defs.h"
 #include <cstdint>
+#include <string>
+#include <vector>
+
+class komodo_state;
+
+/** One entry of the KV index as returned by komodo_kvlist */
+struct komodo_kvitem
+{
+    std::string key;
+    uint256 pubkey;
+    int32_t height;
+    uint32_t flags;
+    std::string value;
+};
 
 /***
  * @brief calculate the duration in minutes
@@ -52,8 +66,40 @@ int32_t komodo_kvsearch(uint256 *pubkeyp,int32_t current_height,uint32_t *flagsp
  * @param opretbuf what to write
  * @param opretlen length of opretbuf
  * @param value the value to be related to the key
+ * @param blockheight the height of the block carrying the update
+ */
+void komodo_kvupdate(uint8_t *opretbuf,int32_t opretlen,uint64_t value,int32_t blockheight);
+
+/****
+ * @brief undo the KV changes of the blocks from height up
+ * @param sp the state holding the events, replayed when the undo data does not reach back to height
+ * @param height the first block to undo
+ */
+void komodo_kvrewind(komodo_state *sp,int32_t height);
+
+/****
+ * @brief remove the entries that expired before a block
+ * @param height the height of the block being connected
+ */
+void komodo_kvsweep(int32_t height);
+
+/****
+ * @brief mark the replay of the komodostate events at startup
+ * @param fReplay true when the replay starts, false when it is done
+ */
+void komodo_kvreplay(bool fReplay);
+
+/****
+ * @brief list the live entries in key order
+ * @param[out] items the entries found
+ * @param current_height entries that expired below this height are left out
+ * @param start the first key
+ * @param end the key to stop before, empty for no limit
+ * @param skip the number of entries to skip
+ * @param count the most entries to return
  */
-void komodo_kvupdate(uint8_t *opretbuf,int32_t opretlen,uint64_t value);
+void komodo_kvlist(std::vector<komodo_kvitem> &items,int32_t current_height,const std::string &start,
+        const std::string &end,int32_t skip,int32_t count);
 
 /****
  * @brief build a private key from the public key and passphrase
@@ -26,6 +26,13 @@
 #ifndef KOMODO_NSPV_H
 #define KOMODO_NSPV_H
 
+// broadcasts and remote rpc calls run or relay something for the peer, so even tagged they stay at one per second and request type
+
+int32_t NSPV_pertypelimit(uint8_t reqtype)
+{
+    return(reqtype == NSPV_BROADCAST || reqtype == NSPV_REMOTERPC);
+}
+
 int32_t iguana_rwbuf(int32_t rwflag,uint8_t *serialized,int32_t len,uint8_t *buf)
 {
     if ( rwflag != 0 )
@@ -536,6 +543,10 @@ int32_t NSPV_fastnotariescount(CTransaction tx,uint8_t elected[64][33],uint32_t
 int32_t NSPV_notariescount(CTransaction tx,uint8_t elected[64][33])
 {
     uint8_t *script; CTransaction vintx; int64_t rewardsum = 0; int32_t i,j,utxovout,scriptlen,numsigs = 0,txheight,currentheight; uint256 hashBlock;
+    std::vector<std::pair<uint256,int32_t> > txidvouts;
+    for (i=0; i<tx.vin.size(); i++)
+        txidvouts.push_back(std::make_pair(tx.vin[i].prevout.hash,(int32_t)tx.vin[i].prevout.n));
+    NSPV_txproof_prefetch(txidvouts,std::vector<int32_t>());
     for (i=0; i<tx.vin.size(); i++)
     {
         utxovout = tx.vin[i].prevout.n;
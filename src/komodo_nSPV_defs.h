@@ -17,9 +17,13 @@
 #ifndef KOMODO_NSPV_DEFSH
 #define KOMODO_NSPV_DEFSH
 
-#define NSPV_PROTOCOL_VERSION 0x00000004
+#define NSPV_PROTOCOL_VERSION 0x00000005
 #define NSPV_POLLITERS 200
 #define NSPV_POLLMICROS 50000
+#define NSPV_TAGGED_VERSION 0x00000005 // first protocol version answering tagged requests
+#define NSPV_MAXTAGGEDPERSEC 32 // tagged requests a fullnode answers per peer and second
+#define NSPV_MAXINFLIGHT 8 // tagged requests a superlite client keeps in flight per peer
+#define NSPV_REQTIMEOUT 10 // seconds to wait for a response before asking another peer
 #define NSPV_MAXVINS 64
 #define NSPV_AUTOLOGOUT 777
 
@@ -53,6 +57,7 @@
 #define NSPV_CC_TXIDS 16
 #define NSPV_REMOTERPC 0x14
 #define NSPV_REMOTERPCRESP 0x15
+#define NSPV_TAGGED 0xfe // wraps a request or response with a 32 bit request id
 
 extern int32_t KOMODO_NSPV;
 
@@ -68,6 +73,7 @@ int32_t NSPV_gettransaction(int32_t skipvalidation,int32_t vout,uint256 txid,int
 UniValue NSPV_spend(char *srcaddr,char *destaddr,int64_t satoshis);
 extern uint256 SIG_TXHASH;
 uint32_t NSPV_blocktime(int32_t hdrheight);
+void NSPV_txproof_prefetch(const std::vector<std::pair<uint256,int32_t> > &txidvouts,const std::vector<int32_t> &heights);
 
 struct NSPV_equihdr
 {
@@ -124,7 +124,10 @@ int32_t NSPV_setequihdr(struct NSPV_equihdr *hdr,int32_t height)
         hdr->nTime = pindex->nTime;
         hdr->nBits = pindex->nBits;
         hdr->nNonce = pindex->nNonce;
-        memcpy(hdr->nSolution,&pindex->nSolution[0],sizeof(hdr->nSolution));
+        std::vector<unsigned char> solution = pindex->GetSolution();
+        if ( solution.size() != sizeof(hdr->nSolution) )
+            return(-1);
+        memcpy(hdr->nSolution,&solution[0],sizeof(hdr->nSolution));
         return(sizeof(*hdr));
     }
     return(-1);
@@ -484,7 +487,7 @@ int32_t NSPV_getaddresstxids(struct NSPV_txidsresp *ptr,char *coinaddr,bool isCC
 
 int32_t NSPV_mempoolfuncs(bits256 *satoshisp,int32_t *vindexp,std::vector<uint256> &txids,char *coinaddr,bool isCC,uint8_t funcid,uint256 txid,int32_t vout)
 {
-    int32_t num = 0,vini = 0,vouti = 0; uint8_t evalcode=0,func=0;  std::vector<uint8_t> vopret; char destaddr[64];
+    int32_t num = 0; uint8_t evalcode=0,func=0;
     *vindexp = -1;
     memset(satoshisp,0,sizeof(*satoshisp));
     if ( funcid == NSPV_CC_TXIDS)
@@ -540,82 +543,52 @@ int32_t NSPV_mempoolfuncs(bits256 *satoshisp,int32_t *vindexp,std::vector<uint25
     }
     if ( mempool.size() == 0 )
         return(0);
-    if ( funcid == NSPV_MEMPOOL_CCEVALCODE )
+    if ( funcid == NSPV_MEMPOOL_ALL )
     {
-        isCC = true;
-        evalcode = vout & 0xff;
-        func = (vout >> 8) & 0xff;
+        mempool.queryHashes(txids);
+        return((int32_t)txids.size());
     }
-    LOCK(mempool.cs);
-    BOOST_FOREACH(const CTxMemPoolEntry &e,mempool.mapTx)
+    else if ( funcid == NSPV_MEMPOOL_INMEMPOOL )
     {
-        const CTransaction &tx = e.GetTx();
-        const uint256 &hash = tx.GetHash();
-        if ( funcid == NSPV_MEMPOOL_ALL )
-        {
-            txids.push_back(hash);
-            num++;
-            continue;
-        }
-        else if ( funcid == NSPV_MEMPOOL_INMEMPOOL )
+        if ( mempool.exists(txid) )
         {
-            if ( hash == txid )
-            {
-                txids.push_back(hash);
-                return(++num);
-            }
-            continue;
-        }
-        else if ( funcid == NSPV_MEMPOOL_CCEVALCODE )
-        {
-            if ( tx.vout.size() > 1 )
-            {
-                CScript scriptPubKey = tx.vout[tx.vout.size()-1].scriptPubKey;
-                if ( GetOpReturnData(scriptPubKey,vopret) != 0 )
-                {
-                    if ( vopret[0] == evalcode && vopret[1] == func )
-                    {
-                        txids.push_back(hash);
-                        num++;
-                    }
-                }
-            }
-            continue;
+            txids.push_back(txid);
+            return(++num);
         }
-        if ( funcid == NSPV_MEMPOOL_ISSPENT )
+    }
+    else if ( funcid == NSPV_MEMPOOL_CCEVALCODE )
+    {
+        evalcode = vout & 0xff;
+        func = (vout >> 8) & 0xff;
+        mempool.getCCFuncTxids(evalcode,func,txids);
+        return((int32_t)txids.size());
+    }
+    else if ( funcid == NSPV_MEMPOOL_ISSPENT )
+    {
+        LOCK(mempool.cs);
+        std::map<COutPoint, CInPoint>::const_iterator it = mempool.mapNextTx.find(COutPoint(txid,vout));
+        if ( it != mempool.mapNextTx.end() )
         {
-            BOOST_FOREACH(const CTxIn &txin,tx.vin)
-            {
-                //LogPrintf("%s/v%d ",uint256_str(str,txin.prevout.hash),txin.prevout.n);
-                if ( txin.prevout.n == vout && txin.prevout.hash == txid )
-                {
-                    txids.push_back(hash);
-                    *vindexp = vini;
-                    return(++num);
-                }
-                vini++;
-            }
+            txids.push_back(it->second.ptx->GetHash());
+            *vindexp = it->second.n;
+            return(++num);
         }
-        else if ( funcid == NSPV_MEMPOOL_ADDRESS )
+    }
+    else if ( funcid == NSPV_MEMPOOL_ADDRESS )
+    {
+        std::vector<COutPoint> outputs; CTransaction tx;
+        mempool.getDestOutputs(coinaddr,outputs);
+        for (const COutPoint &output : outputs)
         {
-            BOOST_FOREACH(const CTxOut &txout,tx.vout)
+            if ( mempool.lookup(output.hash,tx) && tx.vout[output.n].scriptPubKey.IsPayToCryptoCondition() == isCC )
             {
-                if ( txout.scriptPubKey.IsPayToCryptoCondition() == isCC )
-                {
-                    Getscriptaddress(destaddr,txout.scriptPubKey);
-                    if ( strcmp(destaddr,coinaddr) == 0 )
-                    {
-                        txids.push_back(hash);
-                        *vindexp = vouti;
-                        if ( num < 4 )
-                            satoshisp->ulongs[num] = txout.nValue;
-                        num++;
-                    }
-                }
-                vouti++;
+                txids.push_back(output.hash);
+                *vindexp = output.n;
+                if ( num < 4 )
+                    satoshisp->ulongs[num] = tx.vout[output.n].nValue;
+                num++;
             }
         }
-        //LogPrintf("are vins for %s\n",uint256_str(str,hash));
     }
     return(num);
 }
@@ -874,19 +847,49 @@ int32_t NSPV_getspentinfo(struct NSPV_spentinfo *ptr,uint256 txid,int32_t vout)
     return(len);
 }
 
+// a tagged response carries the request id of the tagged request it answers, so the client can have many requests in flight
+
+void NSPV_respond(CNode *pfrom,std::vector<uint8_t> &response,int32_t tagged,uint32_t reqid)
+{
+    if ( tagged != 0 )
+    {
+        std::vector<uint8_t> tagresp(1 + sizeof(reqid) + response.size());
+        tagresp[0] = NSPV_TAGGED;
+        iguana_rwnum(1,&tagresp[1],sizeof(reqid),&reqid);
+        memcpy(&tagresp[1 + sizeof(reqid)],&response[0],response.size());
+        pfrom->PushMessage("nSPV",tagresp);
+    } else pfrom->PushMessage("nSPV",response);
+}
+
 void komodo_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a request
 {
-    int32_t len,slen,ind,reqheight,n; std::vector<uint8_t> response; uint32_t timestamp = (uint32_t)time(NULL);
+    int32_t len,slen,ind,reqheight,n,tagged = 0,limited; std::vector<uint8_t> response; uint32_t prevtime,reqid = 0,timestamp = (uint32_t)time(NULL);
+    if ( request.size() > 1 + sizeof(reqid) && request[0] == NSPV_TAGGED )
+    {
+        // tagged requests are limited per peer and second instead of one per request type, see NSPV_pertypelimit for the exceptions
+        if ( pfrom->nspvtaggedtime != timestamp )
+        {
+            pfrom->nspvtaggedtime = timestamp;
+            pfrom->nspvtaggedcount = 0;
+        }
+        if ( ++pfrom->nspvtaggedcount > NSPV_MAXTAGGEDPERSEC )
+            return;
+        iguana_rwnum(0,&request[1],sizeof(reqid),&reqid);
+        request.erase(request.begin(),request.begin() + 1 + sizeof(reqid));
+        tagged = 1;
+    }
     if ( (len= request.size()) > 0 )
     {
         if ( (ind= request[0]>>1) >= sizeof(pfrom->prevtimes)/sizeof(*pfrom->prevtimes) )
             ind = (int32_t)(sizeof(pfrom->prevtimes)/sizeof(*pfrom->prevtimes)) - 1;
         if ( pfrom->prevtimes[ind] > timestamp )
             pfrom->prevtimes[ind] = 0;
+        limited = (tagged == 0 || NSPV_pertypelimit(request[0]) != 0);
+        prevtime = (limited != 0) ? pfrom->prevtimes[ind] : 0;
         if ( request[0] == NSPV_INFO ) // info
         {
             //LogPrintf("check info %u vs %u, ind.%d\n",timestamp,pfrom->prevtimes[ind],ind);
-            if ( timestamp > pfrom->prevtimes[ind] )
+            if ( timestamp > prevtime )
             {
                 struct NSPV_inforesp I;
                 if ( len == 1+sizeof(reqheight) )
@@ -902,8 +905,9 @@ void komodo_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a req
                     if ( NSPV_rwinforesp(1,&response[1],&I) == slen )
                     {
                         //LogPrintf("send info resp to id %d\n",(int32_t)pfrom->id);
-                        pfrom->PushMessage("nSPV",response);
-                        pfrom->prevtimes[ind] = timestamp;
+                        NSPV_respond(pfrom,response,tagged,reqid);
+                        if ( limited != 0 )
+                            pfrom->prevtimes[ind] = timestamp;
                     }
                     NSPV_inforesp_purge(&I);
                 }
@@ -912,7 +916,7 @@ void komodo_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a req
         else if ( request[0] == NSPV_UTXOS )
         {
             //LogPrintf("utxos: %u > %u, ind.%d, len.%d\n",timestamp,pfrom->prevtimes[ind],ind,len);
-            if ( timestamp > pfrom->prevtimes[ind] )
+            if ( timestamp > prevtime )
             {
                 struct NSPV_utxosresp U;
                 if ( len < 64+5 && (request[1] == len-3 || request[1] == len-7 || request[1] == len-11) )
@@ -942,8 +946,9 @@ void komodo_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a req
                         response[0] = NSPV_UTXOSRESP;
                         if ( NSPV_rwutxosresp(1,&response[1],&U) == slen )
                         {
-                            pfrom->PushMessage("nSPV",response);
-                            pfrom->prevtimes[ind] = timestamp;
+                            NSPV_respond(pfrom,response,tagged,reqid);
+                            if ( limited != 0 )
+                                pfrom->prevtimes[ind] = timestamp;
                         }
                         NSPV_utxosresp_purge(&U);
                     }
@@ -952,7 +957,7 @@ void komodo_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a req
         }
         else if ( request[0] == NSPV_TXIDS )
         {
-            if ( timestamp > pfrom->prevtimes[ind] )
+            if ( timestamp > prevtime )
             {
                 struct NSPV_txidsresp T;
                 if ( len < 64+5 && (request[1] == len-3 || request[1] == len-7 || request[1] == len-11) )
@@ -983,8 +988,9 @@ void komodo_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a req
                         response[0] = NSPV_TXIDSRESP;
                         if ( NSPV_rwtxidsresp(1,&response[1],&T) == slen )
                         {
-                            pfrom->PushMessage("nSPV",response);
-                            pfrom->prevtimes[ind] = timestamp;
+                            NSPV_respond(pfrom,response,tagged,reqid);
+                            if ( limited != 0 )
+                                pfrom->prevtimes[ind] = timestamp;
                         }
                         NSPV_txidsresp_purge(&T);
                     }
@@ -993,7 +999,7 @@ void komodo_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a req
         }
         else if ( request[0] == NSPV_MEMPOOL )
         {
-            if ( timestamp > pfrom->prevtimes[ind] )
+            if ( timestamp > prevtime )
             {
                 struct NSPV_mempoolresp M; char coinaddr[64];
                 if ( len < sizeof(M)+64 )
@@ -1019,8 +1025,9 @@ void komodo_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a req
                             response[0] = NSPV_MEMPOOLRESP;
                             if ( NSPV_rwmempoolresp(1,&response[1],&M) == slen )
                             {
-                                pfrom->PushMessage("nSPV",response);
-                                pfrom->prevtimes[ind] = timestamp;
+                                NSPV_respond(pfrom,response,tagged,reqid);
+                                if ( limited != 0 )
+                                    pfrom->prevtimes[ind] = timestamp;
                             }
                             NSPV_mempoolresp_purge(&M);
                         }
@@ -1030,7 +1037,7 @@ void komodo_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a req
         }
         else if ( request[0] == NSPV_NTZS )
         {
-            if ( timestamp > pfrom->prevtimes[ind] )
+            if ( timestamp > prevtime )
             {
                 struct NSPV_ntzsresp N; int32_t height;
                 if ( len == 1+sizeof(height) )
@@ -1043,8 +1050,9 @@ void komodo_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a req
                         response[0] = NSPV_NTZSRESP;
                         if ( NSPV_rwntzsresp(1,&response[1],&N) == slen )
                         {
-                            pfrom->PushMessage("nSPV",response);
-                            pfrom->prevtimes[ind] = timestamp;
+                            NSPV_respond(pfrom,response,tagged,reqid);
+                            if ( limited != 0 )
+                                pfrom->prevtimes[ind] = timestamp;
                         }
                         NSPV_ntzsresp_purge(&N);
                     }
@@ -1053,7 +1061,7 @@ void komodo_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a req
         }
         else if ( request[0] == NSPV_NTZSPROOF )
         {
-            if ( timestamp > pfrom->prevtimes[ind] )
+            if ( timestamp > prevtime )
             {
                 struct NSPV_ntzsproofresp P; uint256 prevntz,nextntz;
                 if ( len == 1+sizeof(prevntz)+sizeof(nextntz) )
@@ -1068,8 +1076,9 @@ void komodo_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a req
                         response[0] = NSPV_NTZSPROOFRESP;
                         if ( NSPV_rwntzsproofresp(1,&response[1],&P) == slen )
                         {
-                            pfrom->PushMessage("nSPV",response);
-                            pfrom->prevtimes[ind] = timestamp;
+                            NSPV_respond(pfrom,response,tagged,reqid);
+                            if ( limited != 0 )
+                                pfrom->prevtimes[ind] = timestamp;
                         }
                         NSPV_ntzsproofresp_purge(&P);
                     } else LogPrintf("err.%d\n",slen);
@@ -1078,7 +1087,7 @@ void komodo_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a req
         }
         else if ( request[0] == NSPV_TXPROOF )
         {
-            if ( timestamp > pfrom->prevtimes[ind] )
+            if ( timestamp > prevtime )
             {
                 struct NSPV_txproof P; uint256 txid; int32_t height,vout;
                 if ( len == 1+sizeof(txid)+sizeof(height)+sizeof(vout) )
@@ -1096,8 +1105,9 @@ void komodo_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a req
                         if ( NSPV_rwtxproof(1,&response[1],&P) == slen )
                         {
                             //LogPrintf("send response\n");
-                            pfrom->PushMessage("nSPV",response);
-                            pfrom->prevtimes[ind] = timestamp;
+                            NSPV_respond(pfrom,response,tagged,reqid);
+                            if ( limited != 0 )
+                                pfrom->prevtimes[ind] = timestamp;
                         }
                         NSPV_txproof_purge(&P);
                     } else LogPrintf("gettxproof error.%d\n",slen);
@@ -1106,7 +1116,7 @@ void komodo_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a req
         }
         else if ( request[0] == NSPV_SPENTINFO )
         {
-            if ( timestamp > pfrom->prevtimes[ind] )
+            if ( timestamp > prevtime )
             {
                 struct NSPV_spentinfo S; int32_t vout; uint256 txid;
                 if ( len == 1+sizeof(txid)+sizeof(vout) )
@@ -1120,8 +1130,9 @@ void komodo_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a req
                         response[0] = NSPV_SPENTINFORESP;
                         if ( NSPV_rwspentinfo(1,&response[1],&S) == slen )
                         {
-                            pfrom->PushMessage("nSPV",response);
-                            pfrom->prevtimes[ind] = timestamp;
+                            NSPV_respond(pfrom,response,tagged,reqid);
+                            if ( limited != 0 )
+                                pfrom->prevtimes[ind] = timestamp;
                         }
                         NSPV_spentinfo_purge(&S);
                     }
@@ -1130,7 +1141,7 @@ void komodo_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a req
         }
         else if ( request[0] == NSPV_BROADCAST )
         {
-            if ( timestamp > pfrom->prevtimes[ind] )
+            if ( timestamp > prevtime )
             {
                 struct NSPV_broadcastresp B; uint32_t n,offset; uint256 txid;
                 if ( len > 1+sizeof(txid)+sizeof(n) )
@@ -1145,8 +1156,9 @@ void komodo_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a req
                         response[0] = NSPV_BROADCASTRESP;
                         if ( NSPV_rwbroadcastresp(1,&response[1],&B) == slen )
                         {
-                            pfrom->PushMessage("nSPV",response);
-                            pfrom->prevtimes[ind] = timestamp;
+                            NSPV_respond(pfrom,response,tagged,reqid);
+                            if ( limited != 0 )
+                                pfrom->prevtimes[ind] = timestamp;
                         }
                         NSPV_broadcast_purge(&B);
                     }
@@ -1155,7 +1167,7 @@ void komodo_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a req
         }
         else if ( request[0] == NSPV_REMOTERPC )
         {
-            if ( timestamp > pfrom->prevtimes[ind] )
+            if ( timestamp > prevtime )
             {
                 struct NSPV_remoterpcresp R; int32_t p;
                 p = 1;
@@ -1166,8 +1178,9 @@ void komodo_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a req
                     response.resize(1 + slen);
                     response[0] = NSPV_REMOTERPCRESP;
                     NSPV_rwremoterpcresp(1,&response[1],&R,slen);
-                    pfrom->PushMessage("nSPV",response);
-                    pfrom->prevtimes[ind] = timestamp;
+                    NSPV_respond(pfrom,response,tagged,reqid);
+                    if ( limited != 0 )
+                        pfrom->prevtimes[ind] = timestamp;
                     NSPV_remoterpc_purge(&R);
                 }                
             }
@@ -1175,7 +1188,7 @@ void komodo_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a req
         else if (request[0] == NSPV_CCMODULEUTXOS)  // get cc module utxos from coinaddr for the requested amount, evalcode, funcid list and txid
         {
             //LogPrintf("utxos: %u > %u, ind.%d, len.%d\n",timestamp,pfrom->prevtimes[ind],ind,len);
-            if (timestamp > pfrom->prevtimes[ind])
+            if (timestamp > prevtime)
             {
                 struct NSPV_utxosresp U;
                 char coinaddr[64];
@@ -1220,8 +1233,9 @@ void komodo_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a req
                                 response[0] = NSPV_CCMODULEUTXOSRESP;
                                 if (NSPV_rwutxosresp(1, &response[1], &U) == slen)
                                 {
-                                    pfrom->PushMessage("nSPV", response);
-                                    pfrom->prevtimes[ind] = timestamp;
+                                    NSPV_respond(pfrom,response,tagged,reqid);
+                                    if ( limited != 0 )
+                                        pfrom->prevtimes[ind] = timestamp;
                                     std::cerr << __func__ << " " << "returned nSPV response" << std::endl;
                                 }
                                 NSPV_utxosresp_purge(&U);
@@ -17,9 +17,10 @@
 #ifndef KOMODO_NSPVSUPERLITE_H
 #define KOMODO_NSPVSUPERLITE_H
 
-// nSPV client. VERY simplistic "single threaded" networking model. for production GUI best to multithread, etc.
-// no caching, no optimizations, no reducing the number of ntzsproofs needed by detecting overlaps, etc.
-// advantage is that it is simpler to implement and understand to create a design for a more performant version
+// nSPV client. requests are sent with NSPV_request, which waits for the response to that request instead of polling the global results.
+// peers with protocol version NSPV_TAGGED_VERSION or later get tagged requests carrying a request id, so several can be in flight per peer,
+// older peers get plain requests, at most one per request type and second as before.
+// no reducing the number of ntzsproofs needed by detecting overlaps, etc.
 
 
 CAmount AmountFromValue(const UniValue& value);
@@ -30,110 +31,335 @@ CKey NSPV_key;
 char NSPV_wifstr[64],NSPV_pubkeystr[67],NSPV_lastpeer[128];
 std::string NSPV_address;
 struct NSPV_inforesp NSPV_inforesult;
+// the last utxos, txids and mempool answers, stored by the request that got them for the wallet and CC code
 struct NSPV_utxosresp NSPV_utxosresult;
 struct NSPV_txidsresp NSPV_txidsresult;
 struct NSPV_mempoolresp NSPV_mempoolresult;
-struct NSPV_spentinfo NSPV_spentresult;
-struct NSPV_ntzsresp NSPV_ntzsresult;
-struct NSPV_ntzsproofresp NSPV_ntzsproofresult;
-struct NSPV_txproof NSPV_txproofresult;
-struct NSPV_broadcastresp NSPV_broadcastresult;
-
-struct NSPV_ntzsresp NSPV_ntzsresp_cache[NSPV_MAXVINS];
-struct NSPV_ntzsproofresp NSPV_ntzsproofresp_cache[NSPV_MAXVINS * 2];
-struct NSPV_txproof NSPV_txproof_cache[NSPV_MAXVINS * 4];
-
-struct NSPV_ntzsresp *NSPV_ntzsresp_find(int32_t reqheight)
-{
-    int32_t i;
-    for (i=0; i<sizeof(NSPV_ntzsresp_cache)/sizeof(*NSPV_ntzsresp_cache); i++)
-        if ( NSPV_ntzsresp_cache[i].reqheight == reqheight )
-            return(&NSPV_ntzsresp_cache[i]);
-    return(0);
-}
 
-struct NSPV_ntzsresp *NSPV_ntzsresp_add(struct NSPV_ntzsresp *ptr)
+// a request waiting for its response, answered from komodo_nSPVresp by request id or, for older peers, by response type
+struct NSPV_pendingreq
 {
-    int32_t i;
-    for (i=0; i<sizeof(NSPV_ntzsresp_cache)/sizeof(*NSPV_ntzsresp_cache); i++)
-        if ( NSPV_ntzsresp_cache[i].reqheight == 0 )
-            break;
-    if ( i == sizeof(NSPV_ntzsresp_cache)/sizeof(*NSPV_ntzsresp_cache) )
-        i = (rand() % (sizeof(NSPV_ntzsresp_cache)/sizeof(*NSPV_ntzsresp_cache)));
-    NSPV_ntzsresp_purge(&NSPV_ntzsresp_cache[i]);
-    NSPV_ntzsresp_copy(&NSPV_ntzsresp_cache[i],ptr);
-    LogPrintf("ADD CACHE ntzsresp req.%d\n",ptr->reqheight);
-    return(&NSPV_ntzsresp_cache[i]);
-}
+    uint32_t reqid;
+    NodeId nodeid;
+    uint8_t resptype;
+    int32_t tagged,done;
+    int64_t sentmicros;
+    std::vector<uint8_t> response;
+};
 
-struct NSPV_txproof *NSPV_txproof_find(uint256 txid)
+struct NSPV_reqstat
 {
-    int32_t i; struct NSPV_txproof *backup = 0;
-    for (i=0; i<sizeof(NSPV_txproof_cache)/sizeof(*NSPV_txproof_cache); i++)
-        if ( NSPV_txproof_cache[i].txid == txid )
+    int64_t requests,responses,timeouts,totalmicros,maxmicros;
+};
+
+CWaitableCriticalSection NSPV_pendingcs;
+CConditionVariable NSPV_pendingcond;
+std::list<struct NSPV_pendingreq *> NSPV_pendingreqs;
+std::map<NodeId,int32_t> NSPV_peerversions;
+struct NSPV_reqstat NSPV_reqstats[16]; // indexed by request type >> 1
+uint32_t NSPV_lastreqid;
+
+// the ntzs, ntzsproof and txproof caches are hash maps bounded by NSPV_CACHE_*, evicting the oldest entries first.
+// brackets and txproofs that passed validation in NSPV_gettransaction are also written to the nspv store in the datadir,
+// so a restarted client finds them there instead of asking the network again. they are still validated again when used.
+
+#define NSPV_CACHE_NTZS NSPV_MAXVINS
+#define NSPV_CACHE_NTZSPROOFS (NSPV_MAXVINS * 2)
+#define NSPV_CACHE_TXPROOFS (NSPV_MAXVINS * 4)
+#define NSPV_STORE_DEFAULTMAX 100000
+
+#define NSPV_STORE_NTZS 'n'
+#define NSPV_STORE_NTZSPROOF 'p'
+#define NSPV_STORE_TXPROOF 't'
+#define NSPV_STORE_SEQ 's'
+#define NSPV_STORE_COUNTERS 'C'
+
+struct NSPV_uint256hasher
+{
+    size_t operator()(const uint256 &x) const { return(x.GetCheapHash()); }
+};
+
+struct NSPV_uint256pairhasher
+{
+    size_t operator()(const std::pair<uint256,uint256> &x) const { return(x.first.GetCheapHash() ^ (x.second.GetCheapHash() * 31)); }
+};
+
+CCriticalSection NSPV_cachecs;
+std::unordered_map<int32_t,struct NSPV_ntzsresp> NSPV_ntzsresp_cache;
+std::unordered_map<std::pair<uint256,uint256>,struct NSPV_ntzsproofresp,NSPV_uint256pairhasher> NSPV_ntzsproofresp_cache;
+std::unordered_map<uint256,struct NSPV_txproof,NSPV_uint256hasher> NSPV_txproof_cache;
+std::deque<int32_t> NSPV_ntzsresp_order;
+std::deque<std::pair<uint256,uint256> > NSPV_ntzsproofresp_order;
+std::deque<uint256> NSPV_txproof_order;
+CDBWrapper *NSPV_storedb;
+int32_t NSPV_storeinit;
+uint64_t NSPV_storefirst,NSPV_storenext;
+
+template <typename K,typename M>
+void NSPV_cache_evict(M &cache,std::deque<K> &order,size_t maxsize,void (*purgefunc)(typename M::mapped_type *))
+{
+    while ( order.size() > maxsize )
+    {
+        typename M::iterator it = cache.find(order.front());
+        if ( it != cache.end() )
         {
-            if ( NSPV_txproof_cache[i].txprooflen != 0 )
-                return(&NSPV_txproof_cache[i]);
-            else backup = &NSPV_txproof_cache[i];
+            (*purgefunc)(&it->second);
+            cache.erase(it);
         }
-    return(backup);
+        order.pop_front();
+    }
 }
 
-struct NSPV_txproof *NSPV_txproof_add(struct NSPV_txproof *ptr)
+template <typename K,typename M>
+void NSPV_cache_clear(M &cache,std::deque<K> &order,void (*purgefunc)(typename M::mapped_type *))
 {
-    int32_t i;
-    for (i=0; i<sizeof(NSPV_txproof_cache)/sizeof(*NSPV_txproof_cache); i++)
-        if ( NSPV_txproof_cache[i].txid == ptr->txid )
+    for (typename M::iterator it=cache.begin(); it!=cache.end(); it++)
+        (*purgefunc)(&it->second);
+    cache.clear();
+    order.clear();
+}
+
+CDBWrapper *NSPV_store() // NSPV_cachecs must be held
+{
+    if ( NSPV_storeinit == 0 )
+    {
+        NSPV_storeinit = 1;
+        if ( KOMODO_NSPV_SUPERLITE && GetBoolArg("-nspvstore",true) != 0 )
         {
-            if ( NSPV_txproof_cache[i].txprooflen == 0 && ptr->txprooflen != 0 )
+            try
             {
-                NSPV_txproof_purge(&NSPV_txproof_cache[i]);
-                NSPV_txproof_copy(&NSPV_txproof_cache[i],ptr);
-                return(&NSPV_txproof_cache[i]);
+                std::pair<uint64_t,uint64_t> counters;
+                NSPV_storedb = new CDBWrapper(GetDataDir() / "nspv",1 << 20,false,false,true);
+                if ( NSPV_storedb->Read(NSPV_STORE_COUNTERS,counters) != 0 )
+                {
+                    NSPV_storefirst = counters.first;
+                    NSPV_storenext = counters.second;
+                }
+                LogPrintf("nSPV store opened with %llu records\n",(long long)(NSPV_storenext - NSPV_storefirst));
+            }
+            catch (const std::exception &e)
+            {
+                LogPrintf("nSPV store disabled: %s\n",e.what());
+                NSPV_storedb = 0;
             }
-            else if ( NSPV_txproof_cache[i].txprooflen != 0 || ptr->txprooflen == 0 )
-                return(&NSPV_txproof_cache[i]);
         }
-    for (i=0; i<sizeof(NSPV_txproof_cache)/sizeof(*NSPV_txproof_cache); i++)
-        if ( NSPV_txproof_cache[i].txlen == 0 )
-            break;
-    if ( i == sizeof(NSPV_txproof_cache)/sizeof(*NSPV_txproof_cache) )
-        i = (rand() % (sizeof(NSPV_txproof_cache)/sizeof(*NSPV_txproof_cache)));
-    NSPV_txproof_purge(&NSPV_txproof_cache[i]);
-    NSPV_txproof_copy(&NSPV_txproof_cache[i],ptr);
+    }
+    return(NSPV_storedb);
+}
+
+void NSPV_storeput(char type,const uint256 &id,const std::vector<uint8_t> &data)
+{
+    CDBWrapper *db; uint64_t maxrecords; std::pair<char,uint256> key(type,id),oldkey;
+    LOCK(NSPV_cachecs);
+    if ( (db= NSPV_store()) == 0 || db->Exists(key) != 0 )
+        return;
+    maxrecords = std::max((int64_t)1,GetArg("-nspvstoremax",NSPV_STORE_DEFAULTMAX));
+    CDBBatch batch(*db);
+    batch.Write(key,data);
+    batch.Write(std::make_pair(NSPV_STORE_SEQ,NSPV_storenext),key);
+    NSPV_storenext++;
+    while ( NSPV_storenext - NSPV_storefirst > maxrecords )
+    {
+        if ( db->Read(std::make_pair(NSPV_STORE_SEQ,NSPV_storefirst),oldkey) != 0 )
+            batch.Erase(oldkey);
+        batch.Erase(std::make_pair(NSPV_STORE_SEQ,NSPV_storefirst));
+        NSPV_storefirst++;
+    }
+    batch.Write(NSPV_STORE_COUNTERS,std::make_pair(NSPV_storefirst,NSPV_storenext));
+    if ( db->WriteBatch(batch) == 0 )
+        LogPrintf("nSPV store write error\n");
+}
+
+int32_t NSPV_storeget(char type,const uint256 &id,std::vector<uint8_t> &data)
+{
+    CDBWrapper *db;
+    LOCK(NSPV_cachecs);
+    if ( (db= NSPV_store()) == 0 || db->Read(std::make_pair(type,id),data) == 0 || data.size() == 0 )
+        return(0);
+    return((int32_t)data.size());
+}
+
+uint256 NSPV_ntzsid(int32_t reqheight)
+{
+    uint256 id;
+    memcpy(id.begin(),&reqheight,sizeof(reqheight));
+    return(id);
+}
+
+uint256 NSPV_ntzsproofid(uint256 prevtxid,uint256 nexttxid)
+{
+    return(Hash(prevtxid.begin(),prevtxid.end(),nexttxid.begin(),nexttxid.end()));
+}
+
+void NSPV_ntzsresp_add(struct NSPV_ntzsresp *ptr);
+void NSPV_ntzsproof_add(struct NSPV_ntzsproofresp *ptr);
+void NSPV_txproof_add(struct NSPV_txproof *ptr);
+
+// the find functions copy the cached entry into dest (0 to only test for it), as it can be evicted once NSPV_cachecs is released
+
+int32_t NSPV_ntzsresp_find(struct NSPV_ntzsresp *dest,int32_t reqheight)
+{
+    std::vector<uint8_t> data; struct NSPV_ntzsresp N; uint8_t buf[512];
+    LOCK(NSPV_cachecs);
+    std::unordered_map<int32_t,struct NSPV_ntzsresp>::iterator it = NSPV_ntzsresp_cache.find(reqheight);
+    if ( it == NSPV_ntzsresp_cache.end() && NSPV_storeget(NSPV_STORE_NTZS,NSPV_ntzsid(reqheight),data) > 0 && data.size() <= sizeof(buf) )
+    {
+        memset(buf,0,sizeof(buf));
+        memcpy(buf,&data[0],data.size());
+        memset(&N,0,sizeof(N));
+        if ( NSPV_rwntzsresp(0,buf,&N) == data.size() && N.reqheight == reqheight )
+            NSPV_ntzsresp_add(&N);
+        NSPV_ntzsresp_purge(&N);
+        it = NSPV_ntzsresp_cache.find(reqheight);
+    }
+    if ( it == NSPV_ntzsresp_cache.end() )
+        return(0);
+    if ( dest != 0 )
+        NSPV_ntzsresp_copy(dest,&it->second);
+    return(1);
+}
+
+void NSPV_ntzsresp_add(struct NSPV_ntzsresp *ptr)
+{
+    LOCK(NSPV_cachecs);
+    std::pair<std::unordered_map<int32_t,struct NSPV_ntzsresp>::iterator,bool> ret = NSPV_ntzsresp_cache.insert(std::make_pair(ptr->reqheight,NSPV_ntzsresp()));
+    if ( ret.second == false )
+        return;
+    memset(&ret.first->second,0,sizeof(ret.first->second));
+    NSPV_ntzsresp_copy(&ret.first->second,ptr);
+    NSPV_ntzsresp_order.push_back(ptr->reqheight);
+    NSPV_cache_evict(NSPV_ntzsresp_cache,NSPV_ntzsresp_order,NSPV_CACHE_NTZS,NSPV_ntzsresp_purge);
+    LogPrintf("ADD CACHE ntzsresp req.%d\n",ptr->reqheight);
+}
+
+int32_t NSPV_txproof_find(struct NSPV_txproof *dest,uint256 txid)
+{
+    std::vector<uint8_t> data; struct NSPV_txproof P;
+    LOCK(NSPV_cachecs);
+    std::unordered_map<uint256,struct NSPV_txproof,NSPV_uint256hasher>::iterator it = NSPV_txproof_cache.find(txid);
+    if ( (it == NSPV_txproof_cache.end() || it->second.txprooflen == 0) && NSPV_storeget(NSPV_STORE_TXPROOF,txid,data) > 0 )
+    {
+        memset(&P,0,sizeof(P));
+        if ( data.size() >= 64 && NSPV_rwtxproof(0,&data[0],&P) == data.size() && P.txid == txid && P.txprooflen != 0 )
+            NSPV_txproof_add(&P);
+        NSPV_txproof_purge(&P);
+        it = NSPV_txproof_cache.find(txid);
+    }
+    if ( it == NSPV_txproof_cache.end() )
+        return(0);
+    if ( dest != 0 )
+        NSPV_txproof_copy(dest,&it->second);
+    return(1);
+}
+
+void NSPV_txproof_add(struct NSPV_txproof *ptr)
+{
+    LOCK(NSPV_cachecs);
+    std::pair<std::unordered_map<uint256,struct NSPV_txproof,NSPV_uint256hasher>::iterator,bool> ret = NSPV_txproof_cache.insert(std::make_pair(ptr->txid,NSPV_txproof()));
+    if ( ret.second == false )
+    {
+        // an entry without merkle proof is replaced by one with it
+        if ( ret.first->second.txprooflen == 0 && ptr->txprooflen != 0 )
+        {
+            NSPV_txproof_purge(&ret.first->second);
+            NSPV_txproof_copy(&ret.first->second,ptr);
+        }
+        return;
+    }
+    memset(&ret.first->second,0,sizeof(ret.first->second));
+    NSPV_txproof_copy(&ret.first->second,ptr);
+    NSPV_txproof_order.push_back(ptr->txid);
+    NSPV_cache_evict(NSPV_txproof_cache,NSPV_txproof_order,NSPV_CACHE_TXPROOFS,NSPV_txproof_purge);
     LogPrintf("ADD CACHE txproof %s\n",ptr->txid.GetHex().c_str());
-    return(&NSPV_txproof_cache[i]);
 }
 
-struct NSPV_ntzsproofresp *NSPV_ntzsproof_find(uint256 prevtxid,uint256 nexttxid)
+int32_t NSPV_ntzsproof_find(struct NSPV_ntzsproofresp *dest,uint256 prevtxid,uint256 nexttxid)
 {
-    int32_t i;
-    for (i=0; i<sizeof(NSPV_ntzsproofresp_cache)/sizeof(*NSPV_ntzsproofresp_cache); i++)
-        if ( NSPV_ntzsproofresp_cache[i].prevtxid == prevtxid && NSPV_ntzsproofresp_cache[i].nexttxid == nexttxid )
-            return(&NSPV_ntzsproofresp_cache[i]);
-    return(0);
+    std::vector<uint8_t> data; struct NSPV_ntzsproofresp P;
+    LOCK(NSPV_cachecs);
+    std::unordered_map<std::pair<uint256,uint256>,struct NSPV_ntzsproofresp,NSPV_uint256pairhasher>::iterator it = NSPV_ntzsproofresp_cache.find(std::make_pair(prevtxid,nexttxid));
+    if ( it == NSPV_ntzsproofresp_cache.end() && NSPV_storeget(NSPV_STORE_NTZSPROOF,NSPV_ntzsproofid(prevtxid,nexttxid),data) > 0 )
+    {
+        memset(&P,0,sizeof(P));
+        if ( data.size() >= 128 && NSPV_rwntzsproofresp(0,&data[0],&P) == data.size() && P.prevtxid == prevtxid && P.nexttxid == nexttxid )
+            NSPV_ntzsproof_add(&P);
+        NSPV_ntzsproofresp_purge(&P);
+        it = NSPV_ntzsproofresp_cache.find(std::make_pair(prevtxid,nexttxid));
+    }
+    if ( it == NSPV_ntzsproofresp_cache.end() )
+        return(0);
+    if ( dest != 0 )
+        NSPV_ntzsproofresp_copy(dest,&it->second);
+    return(1);
 }
 
-struct NSPV_ntzsproofresp *NSPV_ntzsproof_add(struct NSPV_ntzsproofresp *ptr)
+void NSPV_ntzsproof_add(struct NSPV_ntzsproofresp *ptr)
 {
-    int32_t i;
-    for (i=0; i<sizeof(NSPV_ntzsproofresp_cache)/sizeof(*NSPV_ntzsproofresp_cache); i++)
-        if ( NSPV_ntzsproofresp_cache[i].common.hdrs == 0 )
-            break;
-    if ( i == sizeof(NSPV_ntzsproofresp_cache)/sizeof(*NSPV_ntzsproofresp_cache) )
-        i = (rand() % (sizeof(NSPV_ntzsproofresp_cache)/sizeof(*NSPV_ntzsproofresp_cache)));
-    NSPV_ntzsproofresp_purge(&NSPV_ntzsproofresp_cache[i]);
-    NSPV_ntzsproofresp_copy(&NSPV_ntzsproofresp_cache[i],ptr);
+    std::pair<uint256,uint256> key(ptr->prevtxid,ptr->nexttxid);
+    LOCK(NSPV_cachecs);
+    std::pair<std::unordered_map<std::pair<uint256,uint256>,struct NSPV_ntzsproofresp,NSPV_uint256pairhasher>::iterator,bool> ret = NSPV_ntzsproofresp_cache.insert(std::make_pair(key,NSPV_ntzsproofresp()));
+    if ( ret.second == false )
+        return;
+    memset(&ret.first->second,0,sizeof(ret.first->second));
+    NSPV_ntzsproofresp_copy(&ret.first->second,ptr);
+    NSPV_ntzsproofresp_order.push_back(key);
+    NSPV_cache_evict(NSPV_ntzsproofresp_cache,NSPV_ntzsproofresp_order,NSPV_CACHE_NTZSPROOFS,NSPV_ntzsproofresp_purge);
     LogPrintf("ADD CACHE ntzsproof %s %s\n",ptr->prevtxid.GetHex().c_str(),ptr->nexttxid.GetHex().c_str());
-    return(&NSPV_ntzsproofresp_cache[i]);
+}
+
+// called by NSPV_gettransaction once the txproof matched the merkle root of a header in a validated notarization bracket
+
+void NSPV_store_validated(struct NSPV_ntzsresp *ntzs,struct NSPV_ntzsproofresp *ntzsproof,struct NSPV_txproof *txproof)
+{
+    std::vector<uint8_t> data;
+    if ( ntzs->reqheight != 0 && ntzs->prevntz.txid == ntzsproof->prevtxid && ntzs->nextntz.txid == ntzsproof->nexttxid )
+    {
+        data.resize(512);
+        data.resize(NSPV_rwntzsresp(1,&data[0],ntzs));
+        NSPV_storeput(NSPV_STORE_NTZS,NSPV_ntzsid(ntzs->reqheight),data);
+    }
+    if ( ntzsproof->common.hdrs != 0 )
+    {
+        data.resize(256 + ntzsproof->common.numhdrs*sizeof(*ntzsproof->common.hdrs) + ntzsproof->prevtxlen + ntzsproof->nexttxlen);
+        data.resize(NSPV_rwntzsproofresp(1,&data[0],ntzsproof));
+        NSPV_storeput(NSPV_STORE_NTZSPROOF,NSPV_ntzsproofid(ntzsproof->prevtxid,ntzsproof->nexttxid),data);
+    }
+    if ( txproof->txprooflen != 0 && txproof->txlen != 0 )
+    {
+        data.resize(256 + txproof->txlen + txproof->txprooflen);
+        data.resize(NSPV_rwtxproof(1,&data[0],txproof));
+        NSPV_storeput(NSPV_STORE_TXPROOF,txproof->txid,data);
+    }
 }
 
 // komodo_nSPVresp is called from async message processing
 
+void NSPV_reqcomplete(CNode *pfrom,std::vector<uint8_t> &response,int32_t tagged,uint32_t reqid)
+{
+    boost::unique_lock<boost::mutex> lock(NSPV_pendingcs);
+    BOOST_FOREACH(struct NSPV_pendingreq *req,NSPV_pendingreqs)
+    {
+        if ( req->done != 0 || req->nodeid != pfrom->id || req->resptype != response[0] || req->tagged != tagged )
+            continue;
+        if ( tagged != 0 && req->reqid != reqid )
+            continue;
+        req->response = response;
+        req->done = 1;
+        NSPV_pendingcond.notify_all();
+        break;
+    }
+}
+
 void komodo_nSPVresp(CNode *pfrom,std::vector<uint8_t> response) // received a response
 {
-    struct NSPV_inforesp I; int32_t len; uint32_t timestamp = (uint32_t)time(NULL);
+    struct NSPV_inforesp I; int32_t len,tagged = 0; uint32_t reqid = 0,timestamp = (uint32_t)time(NULL);
     strncpy(NSPV_lastpeer,pfrom->addr.ToString().c_str(),sizeof(NSPV_lastpeer)-1);
+    if ( response.size() > 1+sizeof(reqid) && response[0] == NSPV_TAGGED )
+    {
+        iguana_rwnum(0,&response[1],sizeof(reqid),&reqid);
+        response.erase(response.begin(),response.begin() + 1 + sizeof(reqid));
+        tagged = 1;
+    }
     if ( (len= response.size()) > 0 )
     {
         switch ( response[0] )
@@ -143,6 +369,10 @@ void komodo_nSPVresp(CNode *pfrom,std::vector<uint8_t> response) // received a r
                 I = NSPV_inforesult;
                 NSPV_inforesp_purge(&NSPV_inforesult);
                 NSPV_rwinforesp(0,&response[1],&NSPV_inforesult);
+                {
+                    boost::unique_lock<boost::mutex> lock(NSPV_pendingcs);
+                    NSPV_peerversions[pfrom->id] = NSPV_inforesult.version;
+                }
                 if ( NSPV_inforesult.height < I.height )
                 {
                     LogPrintf("got old info response %u size.%d height.%d\n",timestamp,(int32_t)response.size(),NSPV_inforesult.height); // update current height and ntrz status
@@ -157,61 +387,60 @@ void komodo_nSPVresp(CNode *pfrom,std::vector<uint8_t> response) // received a r
                         NSPV_tiptime = NSPV_inforesult.H.nTime;
                 }
                 break;
+            // the other responses are decoded by the request that waits for them, only the caches are filled here
             case NSPV_UTXOSRESP:
-                NSPV_utxosresp_purge(&NSPV_utxosresult);
-                NSPV_rwutxosresp(0,&response[1],&NSPV_utxosresult);
                 LogPrintf("got utxos response %u size.%d\n",timestamp,(int32_t)response.size());
                 break;
             case NSPV_TXIDSRESP:
-                NSPV_txidsresp_purge(&NSPV_txidsresult);
-                NSPV_rwtxidsresp(0,&response[1],&NSPV_txidsresult);
-                LogPrintf("got txids response %u size.%d %s CC.%d num.%d\n",timestamp,(int32_t)response.size(),NSPV_txidsresult.coinaddr,NSPV_txidsresult.CCflag,NSPV_txidsresult.numtxids);
+                LogPrintf("got txids response %u size.%d\n",timestamp,(int32_t)response.size());
                 break;
             case NSPV_MEMPOOLRESP:
-                NSPV_mempoolresp_purge(&NSPV_mempoolresult);
-                NSPV_rwmempoolresp(0,&response[1],&NSPV_mempoolresult);
-                LogPrintf("got mempool response %u size.%d %s CC.%d num.%d funcid.%d %s/v%d\n",timestamp,(int32_t)response.size(),NSPV_mempoolresult.coinaddr,NSPV_mempoolresult.CCflag,NSPV_mempoolresult.numtxids,NSPV_mempoolresult.funcid,NSPV_mempoolresult.txid.GetHex().c_str(),NSPV_mempoolresult.vout);
+                LogPrintf("got mempool response %u size.%d\n",timestamp,(int32_t)response.size());
                 break;
            case NSPV_NTZSRESP:
-                NSPV_ntzsresp_purge(&NSPV_ntzsresult);
-                NSPV_rwntzsresp(0,&response[1],&NSPV_ntzsresult);
-                if ( NSPV_ntzsresp_find(NSPV_ntzsresult.reqheight) == 0 )
-                    NSPV_ntzsresp_add(&NSPV_ntzsresult);
-                LogPrintf("got ntzs response %u size.%d %s prev.%d, %s next.%d\n",timestamp,(int32_t)response.size(),NSPV_ntzsresult.prevntz.txid.GetHex().c_str(),NSPV_ntzsresult.prevntz.height,NSPV_ntzsresult.nextntz.txid.GetHex().c_str(),NSPV_ntzsresult.nextntz.height);
+                {
+                    struct NSPV_ntzsresp N;
+                    memset(&N,0,sizeof(N));
+                    NSPV_rwntzsresp(0,&response[1],&N);
+                    NSPV_ntzsresp_add(&N);
+                    LogPrintf("got ntzs response %u size.%d %s prev.%d, %s next.%d\n",timestamp,(int32_t)response.size(),N.prevntz.txid.GetHex().c_str(),N.prevntz.height,N.nextntz.txid.GetHex().c_str(),N.nextntz.height);
+                    NSPV_ntzsresp_purge(&N);
+                }
                 break;
             case NSPV_NTZSPROOFRESP:
-                NSPV_ntzsproofresp_purge(&NSPV_ntzsproofresult);
-                NSPV_rwntzsproofresp(0,&response[1],&NSPV_ntzsproofresult);
-                if ( NSPV_ntzsproof_find(NSPV_ntzsproofresult.prevtxid,NSPV_ntzsproofresult.nexttxid) == 0 )
-                    NSPV_ntzsproof_add(&NSPV_ntzsproofresult);
-                LogPrintf("got ntzproof response %u size.%d prev.%d next.%d\n",timestamp,(int32_t)response.size(),NSPV_ntzsproofresult.common.prevht,NSPV_ntzsproofresult.common.nextht);
+                {
+                    struct NSPV_ntzsproofresp P;
+                    memset(&P,0,sizeof(P));
+                    NSPV_rwntzsproofresp(0,&response[1],&P);
+                    NSPV_ntzsproof_add(&P);
+                    LogPrintf("got ntzproof response %u size.%d prev.%d next.%d\n",timestamp,(int32_t)response.size(),P.common.prevht,P.common.nextht);
+                    NSPV_ntzsproofresp_purge(&P);
+                }
                 break;
             case NSPV_TXPROOFRESP:
-                NSPV_txproof_purge(&NSPV_txproofresult);
-                NSPV_rwtxproof(0,&response[1],&NSPV_txproofresult);
-                if ( NSPV_txproof_find(NSPV_txproofresult.txid) == 0 )
-                    NSPV_txproof_add(&NSPV_txproofresult);
-                LogPrintf("got txproof response %u size.%d %s ht.%d\n",timestamp,(int32_t)response.size(),NSPV_txproofresult.txid.GetHex().c_str(),NSPV_txproofresult.height);
+                {
+                    struct NSPV_txproof P;
+                    memset(&P,0,sizeof(P));
+                    NSPV_rwtxproof(0,&response[1],&P);
+                    NSPV_txproof_add(&P);
+                    LogPrintf("got txproof response %u size.%d %s ht.%d\n",timestamp,(int32_t)response.size(),P.txid.GetHex().c_str(),P.height);
+                    NSPV_txproof_purge(&P);
+                }
                 break;
             case NSPV_SPENTINFORESP:
-                NSPV_spentinfo_purge(&NSPV_spentresult);
-                NSPV_rwspentinfo(0,&response[1],&NSPV_spentresult);
                 LogPrintf("got spentinfo response %u size.%d\n",timestamp,(int32_t)response.size());
                 break;
             case NSPV_BROADCASTRESP:
-                NSPV_broadcast_purge(&NSPV_broadcastresult);
-                NSPV_rwbroadcastresp(0,&response[1],&NSPV_broadcastresult);
-                LogPrintf("got broadcast response %u size.%d %s retcode.%d\n",timestamp,(int32_t)response.size(),NSPV_broadcastresult.txid.GetHex().c_str(),NSPV_broadcastresult.retcode);
+                LogPrintf("got broadcast response %u size.%d\n",timestamp,(int32_t)response.size());
                 break;
             case NSPV_CCMODULEUTXOSRESP:
-                NSPV_utxosresp_purge(&NSPV_utxosresult);
-                NSPV_rwutxosresp(0, &response[1], &NSPV_utxosresult);
                 LogPrintf( "got cc module utxos response %u size.%d\n", timestamp, (int32_t)response.size());
                 break;
 
             default: LogPrintf("unexpected response %02x size.%d at %u\n",response[0],(int32_t)response.size(),timestamp);
                 break;
         }
+        NSPV_reqcomplete(pfrom,response,tagged,reqid);
     }
 }
 
@@ -258,6 +487,149 @@ CNode *NSPV_req(CNode *pnode,uint8_t *msg,int32_t len,uint64_t mask,int32_t ind)
     return(0);
 }
 
+// sends msg to the least busy peer with the services in mask, preferring peers not in tried, and registers req to wait for its response
+
+CNode *NSPV_reqsend(struct NSPV_pendingreq *req,uint8_t *msg,int32_t len,uint64_t mask,std::set<NodeId> &tried)
+{
+    int32_t ind,best = -1; CNode *pnode = 0; std::vector<std::pair<CNode *,int32_t> > candidates; std::vector<uint8_t> request; uint32_t timestamp = (uint32_t)time(NULL);
+    if ( KOMODO_NSPV_FULLNODE || len <= 0 )
+        return(0);
+    ind = msg[0] >> 1;
+    LOCK(cs_vNodes);
+    {
+        boost::unique_lock<boost::mutex> lock(NSPV_pendingcs);
+        BOOST_FOREACH(CNode *ptr,vNodes)
+        {
+            int32_t tagged,score,inflight = 0,sametype = 0; std::map<NodeId,int32_t>::iterator it;
+            if ( ptr->hSocket == INVALID_SOCKET || (ptr->nServices & mask) != mask )
+                continue;
+            if ( ptr->prevtimes[ind] > timestamp )
+                ptr->prevtimes[ind] = 0;
+            tagged = ((it= NSPV_peerversions.find(ptr->id)) != NSPV_peerversions.end() && it->second >= NSPV_TAGGED_VERSION);
+            BOOST_FOREACH(struct NSPV_pendingreq *other,NSPV_pendingreqs)
+                if ( other->nodeid == ptr->id )
+                {
+                    inflight++;
+                    if ( other->resptype == msg[0]+1 )
+                        sametype++;
+                }
+            if ( tagged != 0 && inflight >= NSPV_MAXINFLIGHT )
+                continue;
+            if ( (tagged == 0 || NSPV_pertypelimit(msg[0]) != 0) && (sametype != 0 || timestamp <= ptr->prevtimes[ind]) )
+                continue;
+            score = (tagged != 0) ? inflight : NSPV_MAXINFLIGHT + inflight;
+            if ( tried.count(ptr->id) != 0 )
+                score += 2 * NSPV_MAXINFLIGHT;
+            if ( best < 0 || score < best )
+            {
+                best = score;
+                candidates.clear();
+            }
+            if ( score == best )
+                candidates.push_back(std::make_pair(ptr,tagged));
+        }
+        if ( candidates.size() == 0 )
+            return(0);
+        std::pair<CNode *,int32_t> chosen = candidates[rand() % candidates.size()];
+        pnode = chosen.first;
+        req->reqid = ++NSPV_lastreqid;
+        req->nodeid = pnode->id;
+        req->resptype = msg[0] + 1;
+        req->tagged = chosen.second;
+        req->done = 0;
+        req->sentmicros = GetTimeMicros();
+        req->response.clear();
+        NSPV_pendingreqs.push_back(req);
+        NSPV_reqstats[ind].requests++;
+    }
+    if ( req->tagged != 0 )
+    {
+        request.resize(1 + sizeof(req->reqid) + len);
+        request[0] = NSPV_TAGGED;
+        iguana_rwnum(1,&request[1],sizeof(req->reqid),&req->reqid);
+        memcpy(&request[1 + sizeof(req->reqid)],msg,len);
+    }
+    else
+    {
+        request.resize(len);
+        memcpy(&request[0],msg,len);
+    }
+    if ( req->tagged == 0 || NSPV_pertypelimit(msg[0]) != 0 )
+        pnode->prevtimes[ind] = timestamp;
+    pnode->PushMessage("getnSPV",request);
+    tried.insert(pnode->id);
+    return(pnode);
+}
+
+// waits up to timeout seconds for the response to req sent by NSPV_reqsend, returns 1 if it arrived
+
+int32_t NSPV_reqwait(struct NSPV_pendingreq *req,int32_t timeout)
+{
+    int64_t elapsed; struct NSPV_reqstat *stat = &NSPV_reqstats[req->resptype >> 1];
+    boost::unique_lock<boost::mutex> lock(NSPV_pendingcs);
+    boost::system_time deadline = boost::get_system_time() + boost::posix_time::seconds(timeout);
+    while ( req->done == 0 )
+        if ( !NSPV_pendingcond.timed_wait(lock,deadline) )
+            break;
+    NSPV_pendingreqs.remove(req);
+    elapsed = GetTimeMicros() - req->sentmicros;
+    if ( req->done != 0 )
+    {
+        stat->responses++;
+        stat->totalmicros += elapsed;
+        stat->maxmicros = std::max(stat->maxmicros,elapsed);
+    } else stat->timeouts++;
+    return(req->done);
+}
+
+// sends msg and waits for its response, asking up to three peers
+
+int32_t NSPV_request(std::vector<uint8_t> &response,uint8_t *msg,int32_t len,uint64_t mask)
+{
+    struct NSPV_pendingreq req; std::set<NodeId> tried; int32_t iter;
+    for (iter=0; iter<3; iter++)
+    {
+        if ( NSPV_reqsend(&req,msg,len,mask,tried) == 0 )
+        {
+            sleep(1);
+            continue;
+        }
+        if ( NSPV_reqwait(&req,NSPV_REQTIMEOUT) != 0 && req.response.size() > 0 )
+        {
+            response.swap(req.response);
+            return(1);
+        }
+    }
+    return(0);
+}
+
+UniValue NSPV_reqstats_json()
+{
+    UniValue result(UniValue::VOBJ),array(UniValue::VARR); int32_t i,numtagged = 0;
+    boost::unique_lock<boost::mutex> lock(NSPV_pendingcs);
+    for (i=0; i<sizeof(NSPV_reqstats)/sizeof(*NSPV_reqstats); i++)
+    {
+        struct NSPV_reqstat *stat = &NSPV_reqstats[i];
+        if ( stat->requests == 0 )
+            continue;
+        UniValue item(UniValue::VOBJ);
+        item.push_back(Pair("type",(int64_t)(i << 1)));
+        item.push_back(Pair("requests",stat->requests));
+        item.push_back(Pair("responses",stat->responses));
+        item.push_back(Pair("timeouts",stat->timeouts));
+        item.push_back(Pair("avg_ms",stat->responses != 0 ? (double)stat->totalmicros / stat->responses / 1000. : 0.));
+        item.push_back(Pair("max_ms",(double)stat->maxmicros / 1000.));
+        array.push_back(item);
+    }
+    for (std::map<NodeId,int32_t>::iterator it=NSPV_peerversions.begin(); it!=NSPV_peerversions.end(); it++)
+        if ( it->second >= NSPV_TAGGED_VERSION )
+            numtagged++;
+    result.push_back(Pair("inflight",(int64_t)NSPV_pendingreqs.size()));
+    result.push_back(Pair("taggedpeers",(int64_t)numtagged));
+    result.push_back(Pair("types",array));
+    return(result);
+}
+
 UniValue NSPV_logout()
 {
     UniValue result(UniValue::VOBJ);
@@ -265,9 +637,12 @@ UniValue NSPV_logout()
     if ( NSPV_logintime != 0 )
         LogPrintf("scrub wif and privkey from NSPV memory\n");
     else result.push_back(Pair("status","wasnt logged in"));
-    memset(NSPV_ntzsproofresp_cache,0,sizeof(NSPV_ntzsproofresp_cache));
-    memset(NSPV_txproof_cache,0,sizeof(NSPV_txproof_cache));
-    memset(NSPV_ntzsresp_cache,0,sizeof(NSPV_ntzsresp_cache));
+    {
+        LOCK(NSPV_cachecs);
+        NSPV_cache_clear(NSPV_ntzsproofresp_cache,NSPV_ntzsproofresp_order,NSPV_ntzsproofresp_purge);
+        NSPV_cache_clear(NSPV_txproof_cache,NSPV_txproof_order,NSPV_txproof_purge);
+        NSPV_cache_clear(NSPV_ntzsresp_cache,NSPV_ntzsresp_order,NSPV_ntzsresp_purge);
+    }
     memset(NSPV_wifstr,0,sizeof(NSPV_wifstr));
     memset(&NSPV_key,0,sizeof(NSPV_key));
     NSPV_logintime = 0;
@@ -377,6 +752,7 @@ UniValue NSPV_getinfo_json(struct NSPV_inforesp *ptr)
     result.push_back(Pair("notarization",NSPV_ntz_json(&ptr->notarization)));
     result.push_back(Pair("header",NSPV_header_json(&ptr->H,ptr->hdrheight)));
     result.push_back(Pair("protocolversion",(int64_t)ptr->version));
+    result.push_back(Pair("requests",NSPV_reqstats_json()));
     result.push_back(Pair("lastpeer",NSPV_lastpeer));
     return(result);
 }
@@ -557,16 +933,9 @@ UniValue NSPV_getinfo_req(int32_t reqht)
     NSPV_inforesp_purge(&NSPV_inforesult);
     msg[len++] = NSPV_INFO;
     len += iguana_rwnum(1,&msg[len],sizeof(reqht),&reqht);
-    for (iter=0; iter<3; iter++)
-    if ( NSPV_req(0,msg,len,NODE_NSPV,msg[0]>>1) != 0 )
-    {
-        for (i=0; i<NSPV_POLLITERS; i++)
-        {
-            usleep(NSPV_POLLMICROS);
-            if ( NSPV_inforesult.height != 0 )
-                return(NSPV_getinfo_json(&NSPV_inforesult));
-        }
-    } else sleep(1);
+    std::vector<uint8_t> response;
+    if ( NSPV_request(response,msg,len,NODE_NSPV) != 0 && NSPV_inforesult.height != 0 )
+        return(NSPV_getinfo_json(&NSPV_inforesult));
     memset(&I,0,sizeof(I));
     return(NSPV_getinfo_json(&NSPV_inforesult));
 }
@@ -611,16 +980,21 @@ UniValue NSPV_addressutxos(char *coinaddr,int32_t CCflag,int32_t skipcount,int32
     msg[len++] = (CCflag != 0);
     len += iguana_rwnum(1,&msg[len],sizeof(skipcount),&skipcount);
     len += iguana_rwnum(1,&msg[len],sizeof(filter),&filter);
-    for (iter=0; iter<3; iter++)
-    if ( NSPV_req(0,msg,len,NODE_ADDRINDEX,msg[0]>>1) != 0 )
+    std::vector<uint8_t> response;
+    if ( NSPV_request(response,msg,len,NODE_ADDRINDEX) != 0 && response[0] == NSPV_UTXOSRESP )
     {
-        for (i=0; i<NSPV_POLLITERS; i++)
+        UniValue retjson; struct NSPV_utxosresp R;
+        memset(&R,0,sizeof(R));
+        NSPV_rwutxosresp(0,&response[1],&R);
+        if ( (NSPV_inforesult.height == 0 || R.nodeheight >= NSPV_inforesult.height) && strcmp(coinaddr,R.coinaddr) == 0 && CCflag == R.CCflag )
         {
-            usleep(NSPV_POLLMICROS);
-            if ( (NSPV_inforesult.height == 0 || NSPV_utxosresult.nodeheight >= NSPV_inforesult.height) && strcmp(coinaddr,NSPV_utxosresult.coinaddr) == 0 && CCflag == NSPV_utxosresult.CCflag )
-                return(NSPV_utxosresp_json(&NSPV_utxosresult));
+            retjson = NSPV_utxosresp_json(&R);
+            std::swap(NSPV_utxosresult,R);
         }
-    } else sleep(1);
+        NSPV_utxosresp_purge(&R);
+        if ( !retjson.isNull() )
+            return(retjson);
+    }
     result.push_back(Pair("result","error"));
     result.push_back(Pair("error","no utxos result"));
     result.push_back(Pair("lastpeer",NSPV_lastpeer));
@@ -649,16 +1023,21 @@ UniValue NSPV_addresstxids(char *coinaddr,int32_t CCflag,int32_t skipcount,int32
     len += iguana_rwnum(1,&msg[len],sizeof(skipcount),&skipcount);
     len += iguana_rwnum(1,&msg[len],sizeof(filter),&filter);
     //LogPrintf("skipcount.%d\n",skipcount);
-    for (iter=0; iter<3; iter++)
-    if ( NSPV_req(0,msg,len,NODE_ADDRINDEX,msg[0]>>1) != 0 )
+    std::vector<uint8_t> response;
+    if ( NSPV_request(response,msg,len,NODE_ADDRINDEX) != 0 && response[0] == NSPV_TXIDSRESP )
     {
-        for (i=0; i<NSPV_POLLITERS; i++)
+        UniValue retjson; struct NSPV_txidsresp R;
+        memset(&R,0,sizeof(R));
+        NSPV_rwtxidsresp(0,&response[1],&R);
+        if ( (NSPV_inforesult.height == 0 || R.nodeheight >= NSPV_inforesult.height) && strcmp(coinaddr,R.coinaddr) == 0 && CCflag == R.CCflag )
         {
-            usleep(NSPV_POLLMICROS);
-            if ( (NSPV_inforesult.height == 0 || NSPV_txidsresult.nodeheight >= NSPV_inforesult.height) && strcmp(coinaddr,NSPV_txidsresult.coinaddr) == 0 && CCflag == NSPV_txidsresult.CCflag )
-                return(NSPV_txidsresp_json(&NSPV_txidsresult));
+            retjson = NSPV_txidsresp_json(&R);
+            std::swap(NSPV_txidsresult,R);
         }
-    } else sleep(1);
+        NSPV_txidsresp_purge(&R);
+        if ( !retjson.isNull() )
+            return(retjson);
+    }
     result.push_back(Pair("result","error"));
     result.push_back(Pair("error","no txid result"));
     result.push_back(Pair("lastpeer",NSPV_lastpeer));
@@ -688,16 +1067,21 @@ UniValue NSPV_ccaddresstxids(char *coinaddr,int32_t CCflag,int32_t skipcount,uin
     msg[len++] = slen;
     memcpy(&msg[len],coinaddr,slen), len += slen;
     LogPrintf("(%s) func.%d CC.%d %s skipcount.%d len.%d\n",coinaddr,NSPV_CC_TXIDS,CCflag,filtertxid.GetHex().c_str(),skipcount,len);
-    for (iter=0; iter<3; iter++)
-    if ( NSPV_req(0,msg,len,NODE_NSPV,msg[0]>>1) != 0 )
+    std::vector<uint8_t> response;
+    if ( NSPV_request(response,msg,len,NODE_NSPV) != 0 && response[0] == NSPV_MEMPOOLRESP )
     {
-        for (i=0; i<NSPV_POLLITERS; i++)
+        UniValue retjson; struct NSPV_mempoolresp R;
+        memset(&R,0,sizeof(R));
+        NSPV_rwmempoolresp(0,&response[1],&R);
+        if ( R.nodeheight >= NSPV_inforesult.height && strcmp(coinaddr,R.coinaddr) == 0 && CCflag == R.CCflag && filtertxid == R.txid && vout == R.vout && funcid == R.funcid )
         {
-            usleep(NSPV_POLLMICROS);
-            if ( NSPV_mempoolresult.nodeheight >= NSPV_inforesult.height && strcmp(coinaddr,NSPV_mempoolresult.coinaddr) == 0 && CCflag == NSPV_mempoolresult.CCflag && filtertxid == NSPV_mempoolresult.txid && vout == NSPV_mempoolresult.vout && funcid == NSPV_mempoolresult.funcid )
-                return(NSPV_mempoolresp_json(&NSPV_mempoolresult));
+            retjson = NSPV_mempoolresp_json(&R);
+            std::swap(NSPV_mempoolresult,R);
         }
-    } else sleep(1);
+        NSPV_mempoolresp_purge(&R);
+        if ( !retjson.isNull() )
+            return(retjson);
+    }
     result.push_back(Pair("result","error"));
     result.push_back(Pair("error","no txid result"));
     result.push_back(Pair("lastpeer",NSPV_lastpeer));
@@ -726,16 +1110,21 @@ UniValue NSPV_mempooltxids(char *coinaddr,int32_t CCflag,uint8_t funcid,uint256
     msg[len++] = slen;
     memcpy(&msg[len],coinaddr,slen), len += slen;
     LogPrintf("(%s) func.%d CC.%d %s/v%d len.%d\n",coinaddr,funcid,CCflag,txid.GetHex().c_str(),vout,len);
-    for (iter=0; iter<3; iter++)
-    if ( NSPV_req(0,msg,len,NODE_NSPV,msg[0]>>1) != 0 )
+    std::vector<uint8_t> response;
+    if ( NSPV_request(response,msg,len,NODE_NSPV) != 0 && response[0] == NSPV_MEMPOOLRESP )
     {
-        for (i=0; i<NSPV_POLLITERS; i++)
+        UniValue retjson; struct NSPV_mempoolresp R;
+        memset(&R,0,sizeof(R));
+        NSPV_rwmempoolresp(0,&response[1],&R);
+        if ( R.nodeheight >= NSPV_inforesult.height && strcmp(coinaddr,R.coinaddr) == 0 && CCflag == R.CCflag && txid == R.txid && vout == R.vout && funcid == R.funcid )
         {
-            usleep(NSPV_POLLMICROS);
-            if ( NSPV_mempoolresult.nodeheight >= NSPV_inforesult.height && strcmp(coinaddr,NSPV_mempoolresult.coinaddr) == 0 && CCflag == NSPV_mempoolresult.CCflag && txid == NSPV_mempoolresult.txid && vout == NSPV_mempoolresult.vout && funcid == NSPV_mempoolresult.funcid )
-                return(NSPV_mempoolresp_json(&NSPV_mempoolresult));
+            retjson = NSPV_mempoolresp_json(&R);
+            std::swap(NSPV_mempoolresult,R);
         }
-    } else sleep(1);
+        NSPV_mempoolresp_purge(&R);
+        if ( !retjson.isNull() )
+            return(retjson);
+    }
     result.push_back(Pair("result","error"));
     result.push_back(Pair("error","no txid result"));
     result.push_back(Pair("lastpeer",NSPV_lastpeer));
@@ -781,118 +1170,166 @@ bool NSPV_evalcode_inmempool(uint8_t evalcode,uint8_t funcid)
     else return(false);
 }
 
-UniValue NSPV_notarizations(int32_t reqheight)
+// the fetch functions copy the answer into dest, from the cache or from a peer, and return 1 if there was one. dest is zeroed otherwise
+
+int32_t NSPV_fetchntzs(struct NSPV_ntzsresp *dest,int32_t reqheight)
 {
-    uint8_t msg[512]; int32_t i,iter,len = 0; struct NSPV_ntzsresp N,*ptr;
-    if ( (ptr= NSPV_ntzsresp_find(reqheight)) != 0 )
+    uint8_t msg[512]; int32_t len = 0;
+    memset(dest,0,sizeof(*dest));
+    if ( NSPV_ntzsresp_find(dest,reqheight) != 0 )
     {
         LogPrintf("FROM CACHE NSPV_notarizations.%d\n",reqheight);
-        NSPV_ntzsresp_purge(&NSPV_ntzsresult);
-        NSPV_ntzsresp_copy(&NSPV_ntzsresult,ptr);
-        return(NSPV_ntzsresp_json(ptr));
+        return(1);
     }
     msg[len++] = NSPV_NTZS;
     len += iguana_rwnum(1,&msg[len],sizeof(reqheight),&reqheight);
-    for (iter=0; iter<3; iter++)
-    if ( NSPV_req(0,msg,len,NODE_NSPV,msg[0]>>1) != 0 )
+    std::vector<uint8_t> response;
+    if ( NSPV_request(response,msg,len,NODE_NSPV) != 0 && response[0] == NSPV_NTZSRESP )
     {
-        for (i=0; i<NSPV_POLLITERS; i++)
-        {
-            usleep(NSPV_POLLMICROS);
-            if ( NSPV_ntzsresult.reqheight == reqheight )
-                return(NSPV_ntzsresp_json(&NSPV_ntzsresult));
-        }
-    } else sleep(1);
-    memset(&N,0,sizeof(N));
-    return(NSPV_ntzsresp_json(&N));
+        NSPV_rwntzsresp(0,&response[1],dest);
+        if ( dest->reqheight == reqheight )
+            return(1);
+        NSPV_ntzsresp_purge(dest);
+    }
+    return(0);
 }
 
-UniValue NSPV_txidhdrsproof(uint256 prevtxid,uint256 nexttxid)
+int32_t NSPV_fetchntzsproof(struct NSPV_ntzsproofresp *dest,uint256 prevtxid,uint256 nexttxid)
 {
-    uint8_t msg[512]; int32_t i,iter,len = 0; struct NSPV_ntzsproofresp P,*ptr;
-    if ( (ptr= NSPV_ntzsproof_find(prevtxid,nexttxid)) != 0 )
+    uint8_t msg[512]; int32_t len = 0;
+    memset(dest,0,sizeof(*dest));
+    if ( NSPV_ntzsproof_find(dest,prevtxid,nexttxid) != 0 )
     {
-        LogPrintf("FROM CACHE NSPV_txidhdrsproof %s %s\n",ptr->prevtxid.GetHex().c_str(),ptr->nexttxid.GetHex().c_str());
-        NSPV_ntzsproofresp_purge(&NSPV_ntzsproofresult);
-        NSPV_ntzsproofresp_copy(&NSPV_ntzsproofresult,ptr);
-        return(NSPV_ntzsproof_json(ptr));
+        LogPrintf("FROM CACHE NSPV_txidhdrsproof %s %s\n",prevtxid.GetHex().c_str(),nexttxid.GetHex().c_str());
+        return(1);
     }
-    NSPV_ntzsproofresp_purge(&NSPV_ntzsproofresult);
     msg[len++] = NSPV_NTZSPROOF;
     len += iguana_rwbignum(1,&msg[len],sizeof(prevtxid),(uint8_t *)&prevtxid);
     len += iguana_rwbignum(1,&msg[len],sizeof(nexttxid),(uint8_t *)&nexttxid);
-    for (iter=0; iter<3; iter++)
-    if ( NSPV_req(0,msg,len,NODE_NSPV,msg[0]>>1) != 0 )
+    std::vector<uint8_t> response;
+    if ( NSPV_request(response,msg,len,NODE_NSPV) != 0 && response[0] == NSPV_NTZSPROOFRESP )
     {
-        for (i=0; i<NSPV_POLLITERS; i++)
-        {
-            usleep(NSPV_POLLMICROS);
-            if ( NSPV_ntzsproofresult.prevtxid == prevtxid && NSPV_ntzsproofresult.nexttxid == nexttxid )
-                return(NSPV_ntzsproof_json(&NSPV_ntzsproofresult));
-        }
-    } else sleep(1);
-    memset(&P,0,sizeof(P));
-    return(NSPV_ntzsproof_json(&P));
-}
-
-UniValue NSPV_hdrsproof(int32_t prevht,int32_t nextht)
-{
-    uint256 prevtxid,nexttxid;
-    NSPV_notarizations(prevht);
-    prevtxid = NSPV_ntzsresult.prevntz.txid;
-    NSPV_notarizations(nextht);
-    nexttxid = NSPV_ntzsresult.nextntz.txid;
-    return(NSPV_txidhdrsproof(prevtxid,nexttxid));
+        NSPV_rwntzsproofresp(0,&response[1],dest);
+        if ( dest->prevtxid == prevtxid && dest->nexttxid == nexttxid )
+            return(1);
+        NSPV_ntzsproofresp_purge(dest);
+    }
+    return(0);
 }
 
-UniValue NSPV_txproof(int32_t vout,uint256 txid,int32_t height)
+int32_t NSPV_fetchtxproof(struct NSPV_txproof *dest,int32_t vout,uint256 txid,int32_t height)
 {
-    uint8_t msg[512]; int32_t i,iter,len = 0; struct NSPV_txproof P,*ptr;
-    if ( (ptr= NSPV_txproof_find(txid)) != 0 )
+    uint8_t msg[512]; int32_t len = 0;
+    memset(dest,0,sizeof(*dest));
+    if ( NSPV_txproof_find(dest,txid) != 0 )
     {
         LogPrintf("FROM CACHE NSPV_txproof %s\n",txid.GetHex().c_str());
-        NSPV_txproof_purge(&NSPV_txproofresult);
-        NSPV_txproof_copy(&NSPV_txproofresult,ptr);
-        return(NSPV_txproof_json(ptr));
+        return(1);
     }
-    NSPV_txproof_purge(&NSPV_txproofresult);
     msg[len++] = NSPV_TXPROOF;
     len += iguana_rwnum(1,&msg[len],sizeof(height),&height);
     len += iguana_rwnum(1,&msg[len],sizeof(vout),&vout);
     len += iguana_rwbignum(1,&msg[len],sizeof(txid),(uint8_t *)&txid);
     LogPrintf("req txproof %s/v%d at height.%d\n",txid.GetHex().c_str(),vout,height);
-    for (iter=0; iter<3; iter++)
-    if ( NSPV_req(0,msg,len,NODE_NSPV,msg[0]>>1) != 0 )
+    std::vector<uint8_t> response;
+    if ( NSPV_request(response,msg,len,NODE_NSPV) != 0 && response[0] == NSPV_TXPROOFRESP )
     {
-        for (i=0; i<NSPV_POLLITERS; i++)
+        NSPV_rwtxproof(0,&response[1],dest);
+        if ( dest->txid == txid )
+            return(1);
+        NSPV_txproof_purge(dest);
+    }
+    LogPrintf("txproof timeout\n");
+    return(0);
+}
+
+UniValue NSPV_notarizations(int32_t reqheight)
+{
+    UniValue retjson; struct NSPV_ntzsresp N;
+    NSPV_fetchntzs(&N,reqheight);
+    retjson = NSPV_ntzsresp_json(&N);
+    NSPV_ntzsresp_purge(&N);
+    return(retjson);
+}
+
+UniValue NSPV_txidhdrsproof(uint256 prevtxid,uint256 nexttxid)
+{
+    UniValue retjson; struct NSPV_ntzsproofresp P;
+    NSPV_fetchntzsproof(&P,prevtxid,nexttxid);
+    retjson = NSPV_ntzsproof_json(&P);
+    NSPV_ntzsproofresp_purge(&P);
+    return(retjson);
+}
+
+UniValue NSPV_hdrsproof(int32_t prevht,int32_t nextht)
+{
+    uint256 prevtxid,nexttxid; struct NSPV_ntzsresp N;
+    NSPV_fetchntzs(&N,prevht);
+    prevtxid = N.prevntz.txid;
+    NSPV_ntzsresp_purge(&N);
+    NSPV_fetchntzs(&N,nextht);
+    nexttxid = N.nextntz.txid;
+    NSPV_ntzsresp_purge(&N);
+    return(NSPV_txidhdrsproof(prevtxid,nexttxid));
+}
+
+UniValue NSPV_txproof(int32_t vout,uint256 txid,int32_t height)
+{
+    UniValue retjson; struct NSPV_txproof P;
+    NSPV_fetchtxproof(&P,vout,txid,height);
+    retjson = NSPV_txproof_json(&P);
+    NSPV_txproof_purge(&P);
+    return(retjson);
+}
+
+// requests the txproofs of several outputs at once, spread over the peers, so that the following NSPV_gettransaction calls find them in the cache
+
+void NSPV_txproof_prefetch(const std::vector<std::pair<uint256,int32_t> > &txidvouts,const std::vector<int32_t> &heights)
+{
+    std::list<struct NSPV_pendingreq> reqs; std::set<uint256> requested; std::set<NodeId> tried; uint8_t msg[512]; int32_t i,vout,height,len;
+    for (i=0; i<txidvouts.size(); i++)
+    {
+        uint256 txid = txidvouts[i].first;
+        if ( requested.insert(txid).second == false || NSPV_txproof_find(0,txid) != 0 )
+            continue;
+        vout = txidvouts[i].second;
+        height = i < heights.size() ? heights[i] : 0;
+        len = 0;
+        msg[len++] = NSPV_TXPROOF;
+        len += iguana_rwnum(1,&msg[len],sizeof(height),&height);
+        len += iguana_rwnum(1,&msg[len],sizeof(vout),&vout);
+        len += iguana_rwbignum(1,&msg[len],sizeof(txid),(uint8_t *)&txid);
+        reqs.push_back(NSPV_pendingreq());
+        if ( NSPV_reqsend(&reqs.back(),msg,len,NODE_NSPV,tried) == 0 )
         {
-            usleep(NSPV_POLLMICROS);
-            if ( NSPV_txproofresult.txid == txid )
-                return(NSPV_txproof_json(&NSPV_txproofresult));
+            // no peer can take more requests now, the rest is fetched one by one when needed
+            reqs.pop_back();
+            break;
         }
-    } else sleep(1);
-    LogPrintf("txproof timeout\n");
-    memset(&P,0,sizeof(P));
-    return(NSPV_txproof_json(&P));
+    }
+    int64_t deadline = GetTime() + NSPV_REQTIMEOUT;
+    BOOST_FOREACH(struct NSPV_pendingreq &req,reqs)
+        NSPV_reqwait(&req,(int32_t)std::max((int64_t)1,deadline - GetTime()));
 }
 
 UniValue NSPV_spentinfo(uint256 txid,int32_t vout)
 {
     uint8_t msg[512]; int32_t i,iter,len = 0; struct NSPV_spentinfo I;
-    NSPV_spentinfo_purge(&NSPV_spentresult);
     msg[len++] = NSPV_SPENTINFO;
     len += iguana_rwnum(1,&msg[len],sizeof(vout),&vout);
     len += iguana_rwbignum(1,&msg[len],sizeof(txid),(uint8_t *)&txid);
-    for (iter=0; iter<3; iter++)
-    if ( NSPV_req(0,msg,len,NODE_SPENTINDEX,msg[0]>>1) != 0 )
+    std::vector<uint8_t> response;
+    if ( NSPV_request(response,msg,len,NODE_SPENTINDEX) != 0 && response[0] == NSPV_SPENTINFORESP )
     {
-        for (i=0; i<NSPV_POLLITERS; i++)
-        {
-            usleep(NSPV_POLLMICROS);
-            if ( NSPV_spentresult.txid == txid && NSPV_spentresult.vout == vout )
-                return(NSPV_spentinfo_json(&NSPV_spentresult));
-        }
-    } else sleep(1);
+        UniValue retjson; struct NSPV_spentinfo R;
+        memset(&R,0,sizeof(R));
+        NSPV_rwspentinfo(0,&response[1],&R);
+        if ( R.txid == txid && R.vout == vout )
+            retjson = NSPV_spentinfo_json(&R);
+        NSPV_spentinfo_purge(&R);
+        if ( !retjson.isNull() )
+            return(retjson);
+    }
     memset(&I,0,sizeof(I));
     return(NSPV_spentinfo_json(&I));
 }
@@ -900,7 +1337,6 @@ UniValue NSPV_spentinfo(uint256 txid,int32_t vout)
 UniValue NSPV_broadcast(char *hex)
 {
     uint8_t *msg,*data; uint256 txid; int32_t i,n,iter,len = 0; struct NSPV_broadcastresp B;
-    NSPV_broadcast_purge(&NSPV_broadcastresult);
     n = (int32_t)strlen(hex) >> 1;
     data = (uint8_t *)malloc(n);
     decode_hex(data,n,hex);
@@ -912,19 +1348,17 @@ UniValue NSPV_broadcast(char *hex)
     memcpy(&msg[len],data,n), len += n;
     free(data);
     //LogPrintf("send txid.%s\n",txid.GetHex().c_str());
-    for (iter=0; iter<3; iter++)
-    if ( NSPV_req(0,msg,len,NODE_NSPV,msg[0]>>1) != 0 )
+    std::vector<uint8_t> response;
+    if ( NSPV_request(response,msg,len,NODE_NSPV) != 0 && response[0] == NSPV_BROADCASTRESP )
     {
-        for (i=0; i<NSPV_POLLITERS; i++)
+        memset(&B,0,sizeof(B));
+        NSPV_rwbroadcastresp(0,&response[1],&B);
+        if ( B.txid == txid )
         {
-            usleep(NSPV_POLLMICROS);
-            if ( NSPV_broadcastresult.txid == txid )
-            {
-                free(msg);
-                return(NSPV_broadcast_json(&NSPV_broadcastresult,txid));
-            }
+            free(msg);
+            return(NSPV_broadcast_json(&B,txid));
         }
-    } else sleep(1);
+    }
     free(msg);
     memset(&B,0,sizeof(B));
     B.retcode = -2;
@@ -961,21 +1395,25 @@ UniValue NSPV_ccmoduleutxos(char *coinaddr, int64_t amount, uint8_t evalcode, st
     memcpy(&msg[len], funcids.data(), slen), len += slen;
 
     len += iguana_rwbignum(1, &msg[len], sizeof(filtertxid), (uint8_t *)&filtertxid);
-    for (iter = 0; iter<3; iter++)
-        if (NSPV_req(0, msg, len, NODE_ADDRINDEX, msg[0] >> 1) != 0)
+    std::vector<uint8_t> response;
+    if (NSPV_request(response, msg, len, NODE_ADDRINDEX) != 0 && response[0] == NSPV_CCMODULEUTXOSRESP)
+    {
+        UniValue retjson; struct NSPV_utxosresp R;
+        memset(&R, 0, sizeof(R));
+        NSPV_rwutxosresp(0, &response[1], &R);
+        if ((NSPV_inforesult.height == 0 || R.nodeheight >= NSPV_inforesult.height) && strcmp(coinaddr, R.coinaddr) == 0 && CCflag == R.CCflag)
         {
-            for (i = 0; i<NSPV_POLLITERS; i++)
-            {
-                usleep(NSPV_POLLMICROS);
-                if ((NSPV_inforesult.height == 0 || NSPV_utxosresult.nodeheight >= NSPV_inforesult.height) && strcmp(coinaddr, NSPV_utxosresult.coinaddr) == 0 && CCflag == NSPV_utxosresult.CCflag)
-                    return(NSPV_utxosresp_json(&NSPV_utxosresult));
-            }
+            retjson = NSPV_utxosresp_json(&R);
+            std::swap(NSPV_utxosresult, R);
         }
-        else sleep(1);
-        result.push_back(Pair("result", "error"));
-        result.push_back(Pair("error", "no utxos result"));
-        result.push_back(Pair("lastpeer", NSPV_lastpeer));
-        return(result);
+        NSPV_utxosresp_purge(&R);
+        if (!retjson.isNull())
+            return(retjson);
+    }
+    result.push_back(Pair("result", "error"));
+    result.push_back(Pair("error", "no utxos result"));
+    result.push_back(Pair("lastpeer", NSPV_lastpeer));
+    return(result);
 }
 
 #endif // KOMODO_NSPVSUPERLITE_H
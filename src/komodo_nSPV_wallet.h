@@ -47,7 +47,6 @@ int32_t NSPV_validatehdrs(struct NSPV_ntzsproofresp *ptr)
         if ( blockhash != ptr->common.hdrs[i].hashPrevBlock )
             return(-i-13);
     }
-    sleep(1); // need this to get past the once per second rate limiter per message
     if ( NSPV_txextract(tx,ptr->prevntz,ptr->prevtxlen) < 0 )
         return(-8);
     else if ( tx.GetHash() != ptr->prevtxid )
@@ -63,21 +62,18 @@ int32_t NSPV_validatehdrs(struct NSPV_ntzsproofresp *ptr)
 
 int32_t NSPV_gettransaction(int32_t skipvalidation,int32_t vout,uint256 txid,int32_t height,CTransaction &tx,uint256 &hashblock,int32_t &txheight,int32_t &currentheight,int64_t extradata,uint32_t tiptime,int64_t &rewardsum)
 {
-    struct NSPV_txproof *ptr; int32_t i,offset,retval; int64_t rewards = 0; uint32_t nLockTime; std::vector<uint8_t> proof;
+    struct NSPV_txproof P,*ptr = &P; struct NSPV_ntzsresp N; struct NSPV_ntzsproofresp H; int32_t i,offset,retval; int64_t rewards = 0; uint32_t nLockTime; std::vector<uint8_t> proof;
     retval = skipvalidation != 0 ? 0 : -1;
 
     //LogPrintf("NSPV_gettx %s/v%d ht.%d\n",txid.GetHex().c_str(),vout,height);
-    if ( (ptr= NSPV_txproof_find(txid)) == 0 )
-    {
-        NSPV_txproof(vout,txid,height);
-        ptr = &NSPV_txproofresult;
-    }
+    NSPV_fetchtxproof(&P,vout,txid,height);
     hashblock=ptr->hashblock;
     txheight=ptr->height;
     currentheight=NSPV_inforesult.height;
     if ( ptr->txid != txid )
     {
         LogPrintf("txproof error %s != %s\n",ptr->txid.GetHex().c_str(),txid.GetHex().c_str());
+        NSPV_txproof_purge(&P);
         return(-1);
     }
     else if ( NSPV_txextract(tx,ptr->tx,ptr->txlen) < 0 || ptr->txlen <= 0 )
@@ -104,37 +100,45 @@ int32_t NSPV_gettransaction(int32_t skipvalidation,int32_t vout,uint256 txid,int
             proof.resize(ptr->txprooflen);
             memcpy(&proof[0],ptr->txproof,ptr->txprooflen);
         }
-        NSPV_notarizations(height); // gets the prev and next notarizations
-        if ( NSPV_inforesult.notarization.height >= height && (NSPV_ntzsresult.prevntz.height == 0 || NSPV_ntzsresult.prevntz.height >= NSPV_ntzsresult.nextntz.height) )
+        NSPV_fetchntzs(&N,height); // gets the prev and next notarizations
+        if ( NSPV_inforesult.notarization.height >= height && (N.prevntz.height == 0 || N.prevntz.height >= N.nextntz.height) )
         {
             LogPrintf("issue manual bracket\n");
             NSPV_notarizations(height-1);
             NSPV_notarizations(height+1);
-            NSPV_notarizations(height); // gets the prev and next notarizations
+            NSPV_ntzsresp_purge(&N);
+            NSPV_fetchntzs(&N,height); // gets the prev and next notarizations
         }
-        if ( NSPV_ntzsresult.prevntz.height != 0 && NSPV_ntzsresult.prevntz.height <= NSPV_ntzsresult.nextntz.height )
+        if ( N.prevntz.height != 0 && N.prevntz.height <= N.nextntz.height )
         {
-            LogPrintf(">>>>> gettx ht.%d prev.%d next.%d\n",height,NSPV_ntzsresult.prevntz.height, NSPV_ntzsresult.nextntz.height);
-            offset = (height - NSPV_ntzsresult.prevntz.height);
-            if ( offset >= 0 && height <= NSPV_ntzsresult.nextntz.height )
+            LogPrintf(">>>>> gettx ht.%d prev.%d next.%d\n",height,N.prevntz.height, N.nextntz.height);
+            offset = (height - N.prevntz.height);
+            if ( offset >= 0 && height <= N.nextntz.height )
             {
-                //LogPrintf("call NSPV_txidhdrsproof %s %s\n",NSPV_ntzsresult.prevntz.txid.GetHex().c_str(),NSPV_ntzsresult.nextntz.txid.GetHex().c_str());
-                NSPV_txidhdrsproof(NSPV_ntzsresult.prevntz.txid,NSPV_ntzsresult.nextntz.txid);
-                usleep(10000);
-                if ( (retval= NSPV_validatehdrs(&NSPV_ntzsproofresult)) == 0 )
+                //LogPrintf("call NSPV_txidhdrsproof %s %s\n",N.prevntz.txid.GetHex().c_str(),N.nextntz.txid.GetHex().c_str());
+                NSPV_fetchntzsproof(&H,N.prevntz.txid,N.nextntz.txid);
+                if ( (retval= NSPV_validatehdrs(&H)) == 0 )
                 {
                     std::vector<uint256> txids; uint256 proofroot;
                     proofroot = BitcoinGetProofMerkleRoot(proof,txids);
-                    if ( proofroot != NSPV_ntzsproofresult.common.hdrs[offset].hashMerkleRoot || txids[0] != txid )
+                    if ( proofroot != H.common.hdrs[offset].hashMerkleRoot || txids[0] != txid )
                     {
                         LogPrintf("txid.%s vs txids[0] %s\n",txid.GetHex().c_str(),txids[0].GetHex().c_str());
-                        LogPrintf("prooflen.%d proofroot.%s vs %s\n",(int32_t)proof.size(),proofroot.GetHex().c_str(),NSPV_ntzsproofresult.common.hdrs[offset].hashMerkleRoot.GetHex().c_str());
+                        LogPrintf("prooflen.%d proofroot.%s vs %s\n",(int32_t)proof.size(),proofroot.GetHex().c_str(),H.common.hdrs[offset].hashMerkleRoot.GetHex().c_str());
                         retval = -2003;
-                    } else retval = 0;
+                    }
+                    else
+                    {
+                        retval = 0;
+                        NSPV_store_validated(&N,&H,ptr);
+                    }
                 }
+                NSPV_ntzsproofresp_purge(&H);
             } else retval = -2005;
         } else retval = -2004;
+        NSPV_ntzsresp_purge(&N);
     }
+    NSPV_txproof_purge(&P);
     return(retval);
 }
 
@@ -284,11 +288,18 @@ std::string NSPV_signtx(int64_t &rewardsum,int64_t &interestsum,UniValue &retcod
     }
     if ( opret.size() > 0 )
         mtx.vout.push_back(CTxOut(0,opret));
+    {
+        std::vector<std::pair<uint256,int32_t> > txidvouts; std::vector<int32_t> heights;
+        for (i=0; i<n; i++)
+        {
+            txidvouts.push_back(std::make_pair(mtx.vin[i].prevout.hash,(int32_t)mtx.vin[i].prevout.n));
+            heights.push_back(used[i].height);
+        }
+        NSPV_txproof_prefetch(txidvouts,heights);
+    }
     for (i=0; i<n; i++)
     {
         utxovout = mtx.vin[i].prevout.n;
-        if ( i > 0 )
-            sleep(1);
         validation = NSPV_gettransaction(0,utxovout,mtx.vin[i].prevout.hash,used[i].height,vintx,hashBlock,txheight,currentheight,used[i].extradata,NSPV_tiptime,rewardsum);
         retcodes.push_back(validation);
         if ( validation != -1 ) // most others are degraded security
@@ -485,6 +485,22 @@ const notarized_checkpoint *komodo_state::CheckpointAtHeight(int32_t height) con
     return nullptr;
 }
 
+/****
+ * @brief copy the checkpoints recorded at or below a particular height
+ * @param nHeight the maximum height (nHeight member) of the checkpoints returned
+ * @returns the checkpoints in the order they were added
+ */
+std::vector<notarized_checkpoint> komodo_state::CheckpointsUpTo(int32_t nHeight) const
+{
+    std::vector<notarized_checkpoint> result;
+    for(const notarized_checkpoint& np : NPOINTS)
+    {
+        if ( np.nHeight <= nHeight )
+            result.push_back(np);
+    }
+    return result;
+}
+
 void komodo_state::clear_checkpoints() { NPOINTS.clear(); }
 const uint256& komodo_state::LastNotarizedHash() const { return last.notarized_hash; }
 void komodo_state::SetLastNotarizedHash(const uint256 &in) { last.notarized_hash = in; }
@@ -358,4 +358,11 @@ public:
      * @returns the checkpoint or nullptr
      */
     const notarized_checkpoint *CheckpointAtHeight(int32_t height) const;
+
+    /****
+     * @brief copy the checkpoints recorded at or below a particular height
+     * @param nHeight the maximum height (nHeight member) of the checkpoints returned
+     * @returns the checkpoints in the order they were added
+     */
+    std::vector<notarized_checkpoint> CheckpointsUpTo(int32_t nHeight) const;
 };
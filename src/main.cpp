@@ -66,7 +66,11 @@
 #include <cstring>
 #include <algorithm>
 #include <atomic>
+#include <future>
+#include <list>
+#include <memory>
 #include <sstream>
+#include <thread>
 #include <map>
 #include <unordered_map>
 #include <vector>
@@ -94,18 +98,68 @@ using namespace std;
 CCriticalSection cs_main;
 
 BlockMap mapBlockIndex;
+
+/** Holds the CBlockIndex entries made by InsertBlockIndex in chunks instead of one heap
+ *  allocation each, which is most of the entries at startup. They are only freed together,
+ *  so code deleting block index entries must skip the ones the arena owns. */
+class CBlockIndexArena
+{
+private:
+    static const size_t CHUNK_SIZE = 16384;
+    std::vector<CBlockIndex*> vChunks;
+    std::map<const CBlockIndex*, const CBlockIndex*> mapChunks; // chunk begin -> end
+    size_t nUsed = CHUNK_SIZE;
+
+public:
+    ~CBlockIndexArena() { Clear(); }
+
+    CBlockIndex *Alloc()
+    {
+        if (nUsed == CHUNK_SIZE) {
+            vChunks.push_back(new CBlockIndex[CHUNK_SIZE]);
+            mapChunks.insert(std::make_pair(vChunks.back(), vChunks.back() + CHUNK_SIZE));
+            nUsed = 0;
+        }
+        return &vChunks.back()[nUsed++];
+    }
+
+    bool Owns(const CBlockIndex *pindex) const
+    {
+        std::map<const CBlockIndex*, const CBlockIndex*>::const_iterator it = mapChunks.upper_bound(pindex);
+        if (it == mapChunks.begin())
+            return false;
+        --it;
+        return pindex < it->second;
+    }
+
+    void Clear()
+    {
+        BOOST_FOREACH(CBlockIndex *chunk, vChunks)
+            delete[] chunk;
+        vChunks.clear();
+        mapChunks.clear();
+        nUsed = CHUNK_SIZE;
+    }
+};
+static CBlockIndexArena blockIndexArena;
+
 CChain chainActive;
 CBlockIndex *pindexBestHeader = NULL;
 static int64_t nTimeBestReceived = 0;
 CWaitableCriticalSection csBestBlock;
 CConditionVariable cvBlockChange;
 int nScriptCheckThreads = 0;
+int nPrefetchThreads = 0;
+unsigned int nTxLookupCacheSize = DEFAULT_TX_LOOKUP_CACHE;
+unsigned int nBlockFileHandles = DEFAULT_BLOCK_FILE_HANDLES;
 bool fExperimentalMode = true;
 bool fImporting = false;
 bool fReindex = false;
 bool fTxIndex = false;
 bool fAddressIndex = false;
 bool fTimestampIndex = false;
+bool fOraclesIndex = false;
+bool fTokensIndex = false;
 bool fSpentIndex = false;
 bool fHavePruned = false;
 bool fPruneMode = false;
@@ -631,6 +685,7 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 }
 
 CCoinsViewCache *pcoinsTip = nullptr;
+CCoinsViewDB *pcoinsdbview = nullptr;
 CBlockTreeDB *pblocktree = nullptr;
 
 // Komodo globals
@@ -2159,6 +2214,54 @@ bool GetAddressUnspent(uint160 addressHash, int type,
     return true;
 }
 
+bool ForEachAddressIndex(uint160 addressHash, int type,
+                         const std::function<bool(const CAddressIndexKey&, CAmount)> &visitor, int start, int end)
+{
+    if (!fAddressIndex)
+        return error("address index not enabled");
+
+    if (!pblocktree->ForEachAddressIndex(addressHash, type, visitor, start, end))
+        return error("unable to get txids for address");
+
+    return true;
+}
+
+bool GetOraclesDataIndex(const uint256 &oracletxid, const CPubKey &publisher, bool fNewestFirst, int32_t limit,
+                         std::vector<std::pair<COraclesDataIndexKey, COraclesDataIndexValue> > &samples, int start, int end)
+{
+    if (!fOraclesIndex)
+        return false;
+
+    if (!pblocktree->ReadOraclesDataIndex(oracletxid, publisher, fNewestFirst, limit, samples, start, end))
+        return error("unable to get samples for oracle");
+
+    return true;
+}
+
+bool GetOraclesDataPublishers(const uint256 &oracletxid, int end,
+                              std::vector<std::pair<COraclesDataIndexKey, COraclesDataIndexValue> > &samples)
+{
+    if (!fOraclesIndex)
+        return false;
+
+    if (!pblocktree->ReadOraclesDataPublishers(oracletxid, end, samples))
+        return error("unable to get publishers for oracle");
+
+    return true;
+}
+
+bool GetTokensIndex(const uint256 &tokenid, const uint160 &addressHash,
+                    std::vector<std::pair<CTokensIndexKey, CTokensIndexValue> > &outputs)
+{
+    if (!fTokensIndex)
+        return false;
+
+    if (!pblocktree->ReadTokensIndex(tokenid, addressHash, outputs))
+        return error("unable to get outputs for tokenid");
+
+    return true;
+}
+
 struct CompareBlocksByHeightMain
 {
     bool operator()(const CBlockIndex* a, const CBlockIndex* b) const
@@ -2201,6 +2304,283 @@ bool myAddtomempool(const CTransaction &tx, CValidationState *pstate, bool fSkip
     return true;
 }
 
+/**
+ * Confirmed transactions decoded from the txindex, with the block they were
+ * found in, kept in least recently used order. CC validation and the nSPV
+ * server look the same few transactions up over and over, mostly through
+ * the lock-free myGetTransaction, so the cache is split into shards by txid
+ * rather than guarded by one mutex.
+ */
+class CTxLookupCache
+{
+    static const unsigned int NUM_SHARDS = 16;
+
+    struct CEntry
+    {
+        std::shared_ptr<const CTransaction> ptx;
+        uint256 hashBlock;
+        int nHeight;
+        std::list<uint256>::iterator itLru;
+    };
+
+    struct CShard
+    {
+        CCriticalSection cs;
+        std::map<uint256, CEntry> mapEntries;
+        std::list<uint256> lru; // most recently used first
+    };
+
+    CShard shards[NUM_SHARDS];
+    //! Bumped whenever txindex entries are rewritten, so that a lookup that
+    //! raced with the rewrite does not put the old position back
+    std::atomic<uint64_t> nEpoch;
+
+    CShard &GetShard(const uint256 &txid) { return shards[txid.GetCheapHash() % NUM_SHARDS]; }
+
+public:
+    CTxLookupCache() : nEpoch(0) {}
+
+    uint64_t GetEpoch() const { return nEpoch; }
+
+    bool Get(const uint256 &txid, std::shared_ptr<const CTransaction> &ptx, uint256 &hashBlock, int &nHeight)
+    {
+        if ( nTxLookupCacheSize == 0 )
+            return false;
+        CShard &shard = GetShard(txid);
+        LOCK(shard.cs);
+        std::map<uint256, CEntry>::iterator it = shard.mapEntries.find(txid);
+        if ( it == shard.mapEntries.end() )
+            return false;
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second.itLru);
+        ptx = it->second.ptx;
+        hashBlock = it->second.hashBlock;
+        nHeight = it->second.nHeight;
+        return true;
+    }
+
+    /** Adds a transaction whose txindex entry was read at nEpochRead */
+    void Put(const uint256 &txid, const std::shared_ptr<const CTransaction> &ptx, const uint256 &hashBlock, int nHeight, uint64_t nEpochRead)
+    {
+        size_t nMaxPerShard = nTxLookupCacheSize / NUM_SHARDS;
+        if ( nMaxPerShard == 0 )
+            return;
+        CShard &shard = GetShard(txid);
+        LOCK(shard.cs);
+        if ( nEpochRead != nEpoch || shard.mapEntries.count(txid) != 0 )
+            return;
+        while ( shard.mapEntries.size() >= nMaxPerShard )
+        {
+            shard.mapEntries.erase(shard.lru.back());
+            shard.lru.pop_back();
+        }
+        shard.lru.push_front(txid);
+        CEntry &entry = shard.mapEntries[txid];
+        entry.ptx = ptx;
+        entry.hashBlock = hashBlock;
+        entry.nHeight = nHeight;
+        entry.itLru = shard.lru.begin();
+    }
+
+    /** Drops transactions whose txindex entries have just been rewritten */
+    void Erase(const std::vector<std::pair<uint256, CDiskTxPos> > &vPos)
+    {
+        nEpoch++;
+        for (const std::pair<uint256, CDiskTxPos> &item : vPos)
+        {
+            CShard &shard = GetShard(item.first);
+            LOCK(shard.cs);
+            std::map<uint256, CEntry>::iterator it = shard.mapEntries.find(item.first);
+            if ( it != shard.mapEntries.end() )
+            {
+                shard.lru.erase(it->second.itLru);
+                shard.mapEntries.erase(it);
+            }
+        }
+    }
+};
+
+/**
+ * Read-only blk file handles kept open between transaction lookups. A handle
+ * belongs to one reader between Acquire and Release; Release keeps it for
+ * the next reader of that file unless nBlockFileHandles are already idle.
+ */
+class CBlockFileHandlePool
+{
+    CCriticalSection cs;
+    std::multimap<int, FILE*> mapIdle;
+
+public:
+    ~CBlockFileHandlePool()
+    {
+        for (std::pair<const int, FILE*> &item : mapIdle)
+            fclose(item.second);
+    }
+
+    /** @returns a handle positioned at pos, or NULL on error */
+    FILE* Acquire(const CDiskBlockPos &pos)
+    {
+        FILE *file = NULL;
+        {
+            LOCK(cs);
+            std::multimap<int, FILE*>::iterator it = mapIdle.find(pos.nFile);
+            if ( it != mapIdle.end() )
+            {
+                file = it->second;
+                mapIdle.erase(it);
+            }
+        }
+        if ( file == NULL )
+        {
+            boost::filesystem::path path = GetBlockPosFilename(pos, "blk");
+            if ( (file= fopen(path.string().c_str(), "rb")) == NULL )
+            {
+                LogPrintf("Unable to open file %s\n", path.string());
+                return NULL;
+            }
+        }
+        if ( fseek(file, pos.nPos, SEEK_SET) != 0 )
+        {
+            LogPrintf("Unable to seek to position %u of blk%05u.dat\n", pos.nPos, pos.nFile);
+            fclose(file);
+            return NULL;
+        }
+        return file;
+    }
+
+    void Release(int nFile, FILE *file)
+    {
+        {
+            LOCK(cs);
+            if ( mapIdle.size() < nBlockFileHandles )
+            {
+                mapIdle.insert(std::make_pair(nFile, file));
+                return;
+            }
+        }
+        fclose(file);
+    }
+
+    /** Closes the idle handles on files that are about to be deleted */
+    void Close(const std::set<int> &setFiles)
+    {
+        LOCK(cs);
+        for (int nFile : setFiles)
+        {
+            std::pair<std::multimap<int, FILE*>::iterator, std::multimap<int, FILE*>::iterator> range = mapIdle.equal_range(nFile);
+            for (std::multimap<int, FILE*>::iterator it = range.first; it != range.second; ++it)
+                fclose(it->second);
+            mapIdle.erase(range.first, range.second);
+        }
+    }
+};
+
+static CTxLookupCache txLookupCache;
+static CBlockFileHandlePool blockFileHandles;
+
+/** Serialized size of the fixed-size fields of CBlockHeader (nVersion up to nNonce) */
+static const unsigned int BLOCK_HEADER_FIXED_SIZE = 4 + 32 + 32 + 32 + 4 + 4 + 32;
+
+/*****
+ * @brief read a transaction found in the txindex and add it to the lookup cache
+ * @param[in] hash the transaction id
+ * @param[in] postx its txindex entry
+ * @param[in] nEpoch the lookup cache epoch from before postx was read
+ * @param[in] fUpgrade true to rewrite an entry without block hash (cs_main must be held)
+ * @param[out] txOut the transaction
+ * @param[out] hashBlock the block it was found in
+ * @returns true on success
+ */
+static bool ReadIndexedTransaction(const uint256 &hash, CDiskTxPos postx, uint64_t nEpoch, bool fUpgrade, CTransaction &txOut, uint256 &hashBlock)
+{
+    FILE *pfile = blockFileHandles.Acquire(postx);
+    if (pfile == NULL)
+        return error("%s: OpenBlockFile failed", __func__);
+    CAutoFile file(pfile, SER_DISK, CLIENT_VERSION);
+    try {
+        if ( postx.hashBlock.IsNull() )
+        {
+            CBlockHeader header;
+            file >> header;
+            hashBlock = header.GetHash();
+        }
+        else
+        {
+            // no need to decode and hash the header, only to step over it
+            if ( fseek(file.Get(), BLOCK_HEADER_FIXED_SIZE, SEEK_CUR) != 0 )
+                return error("%s: unable to skip the block header", __func__);
+            uint64_t nSolutionSize = ReadCompactSize(file);
+            if ( fseek(file.Get(), nSolutionSize, SEEK_CUR) != 0 )
+                return error("%s: unable to skip the block solution", __func__);
+            hashBlock = postx.hashBlock;
+        }
+        if ( fseek(file.Get(), postx.nTxOffset, SEEK_CUR) != 0 )
+            return error("%s: unable to seek to the transaction", __func__);
+        file >> txOut;
+    } catch (const std::exception& e) {
+        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+    }
+    blockFileHandles.Release(postx.nFile, file.release());
+    if (txOut.GetHash() != hash)
+        return error("%s: txid mismatch", __func__);
+
+    // an entry without block hash is only upgraded by callers holding cs_main, which mapBlockIndex needs
+    if ( fUpgrade && postx.hashBlock.IsNull() )
+    {
+        AssertLockHeld(cs_main);
+        BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+        if ( mi != mapBlockIndex.end() && mi->second != 0 )
+            postx.nHeight = mi->second->nHeight;
+        if ( postx.nHeight >= 0 )
+        {
+            postx.hashBlock = hashBlock;
+            std::vector<std::pair<uint256, CDiskTxPos> > vPos(1, std::make_pair(hash, postx));
+            if ( !pblocktree->WriteTxIndex(vPos) )
+                LogPrintf("%s: unable to upgrade txindex entry for %s\n", __func__, hash.ToString());
+        }
+    }
+    txLookupCache.Put(hash, std::make_shared<const CTransaction>(txOut), hashBlock, postx.nHeight, nEpoch);
+    return true;
+}
+
+/*****
+ * @brief look a confirmed transaction up in the txindex
+ * @param[in] hash what to look for
+ * @param[out] txOut the found transaction
+ * @param[out] hashBlock the hash of the block it was found in
+ * @param[in] fUpgrade true to rewrite an entry without block hash (cs_main must be held)
+ * @returns true if found
+ */
+static bool GetIndexedTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlock, bool fUpgrade)
+{
+    std::shared_ptr<const CTransaction> ptx;
+    int nHeight;
+    if ( txLookupCache.Get(hash, ptx, hashBlock, nHeight) )
+    {
+        txOut = *ptx;
+        return true;
+    }
+    uint64_t nEpoch = txLookupCache.GetEpoch();
+    CDiskTxPos postx;
+    if ( !pblocktree->ReadTxIndex(hash, postx) )
+        return false;
+    if ( ReadIndexedTransaction(hash, postx, nEpoch, fUpgrade, txOut, hashBlock) )
+        return true;
+    // the entry points into a block, read all of it and look for the transaction there
+    CBlock block;
+    if ( !ReadBlockFromDisk(block, postx, false) )
+        return false;
+    for (const CTransaction &tx : block.vtx)
+    {
+        if ( tx.GetHash() == hash )
+        {
+            txOut = tx;
+            hashBlock = block.GetHash();
+            return true;
+        }
+    }
+    return error("%s: %s not in the block of its txindex entry", __func__, hash.ToString());
+}
+
 /*****
  * @brief get a transaction by its hash (without locks)
  * @param[in] hash what to look for
@@ -2237,26 +2617,8 @@ bool myGetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlo
 
     if (fTxIndex) 
     {
-        CDiskTxPos postx;
-        //LogPrintf("ReadTxIndex\n");
-        if (pblocktree->ReadTxIndex(hash, postx)) 
+        if (GetIndexedTransaction(hash, txOut, hashBlock, false))
         {
-            //LogPrintf("OpenBlockFile\n");
-            CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-            if (file.IsNull())
-                return error("%s: OpenBlockFile failed", __func__);
-            CBlockHeader header;
-            //LogPrintf("seek and read\n");
-            try {
-                file >> header;
-                fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                file >> txOut;
-            } catch (const std::exception& e) {
-                return error("%s: Deserialize or I/O error - %s", __func__, e.what());
-            }
-            hashBlock = header.GetHash();
-            if (txOut.GetHash() != hash)
-                return error("%s: txid mismatch", __func__);
             //LogPrintf("found on disk %s\n",hash.GetHex().c_str());
             return true;
         }
@@ -2303,24 +2665,9 @@ bool GetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlock
     }
 
     if (fTxIndex) {
-        CDiskTxPos postx;
-        if (pblocktree->ReadTxIndex(hash, postx)) {
-            CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-            if (file.IsNull())
-                return error("%s: OpenBlockFile failed", __func__);
-            CBlockHeader header;
-            try {
-                file >> header;
-                fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                file >> txOut;
-            } catch (const std::exception& e) {
-                return error("%s: Deserialize or I/O error - %s", __func__, e.what());
-            }
-            hashBlock = header.GetHash();
-            if (txOut.GetHash() != hash)
-                return error("%s: txid mismatch", __func__);
+        if (GetIndexedTransaction(hash, txOut, hashBlock, true))
             return true;
-        }
+        // an unreadable entry still leaves the coins lookup below
     }
 
     CBlockIndex *pindexSlow = nullptr;
@@ -3224,13 +3571,24 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
         return true;
     }
 
-    if (fAddressIndex) {
-        if (!pblocktree->EraseAddressIndex(addressIndex)) {
+    if (fAddressIndex || fSpentIndex || fTimestampIndex) {
+        if (!pblocktree->UpdateIndexes(addressIndex, true, addressUnspentIndex, spentIndex,
+                pindex->GetBlockHash(), 0, pindex->pprev->GetBlockHash()))
             return AbortNode(state, "Failed to delete address index");
-        }
-        if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
-            return AbortNode(state, "Failed to write address unspent index");
-        }
+    }
+
+    if (fOraclesIndex) {
+        std::vector<std::pair<COraclesDataIndexKey, COraclesDataIndexValue> > oraclesIndex;
+        OraclesDataIndexRecords(block, pindex->nHeight, oraclesIndex);
+        if (!oraclesIndex.empty() && !pblocktree->EraseOraclesDataIndex(oraclesIndex))
+            return AbortNode(state, "Failed to delete oracles data index");
+    }
+
+    if (fTokensIndex) {
+        std::vector<std::pair<CTokensIndexKey, CTokensIndexValue> > created, spent;
+        TokensIndexRecords(block, pindex->nHeight, false, created, spent);
+        if ((!created.empty() || !spent.empty()) && !pblocktree->UpdateTokensIndex(created, spent, false))
+            return AbortNode(state, "Failed to delete tokens index");
     }
 
     return fClean;
@@ -3334,6 +3692,30 @@ void PartitionCheck(bool (*initialDownloadCheck)(), CCriticalSection& cs, const
 }
 
 
+static int64_t nTimePrefetch = 0;
+/****
+ * The timestamp recorded for a block in the timestamp index: its own time, unless that
+ * is not after the previous block's logical timestamp
+ * @param pindex the block
+ * @returns the logical timestamp
+ */
+static unsigned int GetLogicalTimestamp(const CBlockIndex *pindex)
+{
+    unsigned int logicalTS = pindex->nTime;
+    unsigned int prevLogicalTS = 0;
+
+    // retrieve logical timestamp of the previous block
+    if (pindex->pprev)
+        if (!pblocktree->ReadTimestampBlockIndex(pindex->pprev->GetBlockHash(), prevLogicalTS))
+            LogPrintf("%s: Failed to read previous block's logical timestamp\n", __func__);
+
+    if (logicalTS <= prevLogicalTS) {
+        logicalTS = prevLogicalTS + 1;
+        LogPrintf("%s: Previous logical timestamp is newer Actual[%d] prevLogical[%d] Logical[%d]\n", __func__, pindex->nTime, prevLogicalTS, logicalTS);
+    }
+    return logicalTS;
+}
+
 static int64_t nTimeVerify = 0;
 static int64_t nTimeConnect = 0;
 static int64_t nTimeIndex = 0;
@@ -3495,13 +3877,37 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     */
     CCheckQueueControl<CScriptCheck> control(fExpensiveChecks && nScriptCheckThreads ? &scriptcheckqueue : NULL);
 
+    if ( !fJustCheck && nPrefetchThreads > 0 )
+    {
+        // load the block's inputs into the tip cache in parallel, instead of one
+        // database read at a time as each transaction is checked below
+        int64_t nTimePrefetchStart = GetTimeMicros();
+        std::set<uint256> setBlockTxids;
+        std::vector<uint256> vPrevTxids;
+        for (const CTransaction &tx : block.vtx)
+        {
+            if ( !tx.IsMint() )
+            {
+                for (const CTxIn &txin : tx.vin)
+                {
+                    if ( setBlockTxids.count(txin.prevout.hash) == 0 )
+                        vPrevTxids.push_back(txin.prevout.hash);
+                }
+            }
+            setBlockTxids.insert(tx.GetHash());
+        }
+        size_t nRead = pcoinsTip->PrefetchCoins(vPrevTxids, nPrefetchThreads);
+        int64_t nTimePrefetchEnd = GetTimeMicros(); nTimePrefetch += nTimePrefetchEnd - nTimePrefetchStart;
+        LogPrint("bench", "      - Prefetch %u inputs (%u read): %.2fms [%.2fs]\n", (unsigned)vPrevTxids.size(), (unsigned)nRead, 0.001 * (nTimePrefetchEnd - nTimePrefetchStart), nTimePrefetch * 0.000001);
+    }
+
     int64_t nTimeStart = GetTimeMicros();
     CAmount nFees = 0;
     int nInputs = 0;
     uint64_t valueout;
     int64_t voutsum = 0, prevsum = 0, interest, sum = 0, stakeTxValue = 0;
     unsigned int nSigOps = 0;
-    CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
+    CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()), pindex->GetBlockHash(), pindex->nHeight);
     std::vector<std::pair<uint256, CDiskTxPos> > vPos;
     vPos.reserve(block.vtx.size());
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
@@ -3767,42 +4173,34 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     ConnectNotarisations(block, pindex->nHeight); // MoMoM notarisation DB.
 
     if (fTxIndex)
+    {
         if (!pblocktree->WriteTxIndex(vPos))
             return AbortNode(state, "Failed to write transaction index");
-    if (fAddressIndex) {
-        if (!pblocktree->WriteAddressIndex(addressIndex)) {
-            return AbortNode(state, "Failed to write address index");
-        }
-
-        if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
-            return AbortNode(state, "Failed to write address unspent index");
-        }
+        txLookupCache.Erase(vPos);
     }
-
-    if (fSpentIndex)
-        if (!pblocktree->UpdateSpentIndex(spentIndex))
-            return AbortNode(state, "Failed to write transaction index");
-
-    if (fTimestampIndex)
+    if (fAddressIndex || fSpentIndex || fTimestampIndex)
     {
-        unsigned int logicalTS = pindex->nTime;
-        unsigned int prevLogicalTS = 0;
-
-        // retrieve logical timestamp of the previous block
-        if (pindex->pprev)
-            if (!pblocktree->ReadTimestampBlockIndex(pindex->pprev->GetBlockHash(), prevLogicalTS))
-                LogPrintf("%s: Failed to read previous block's logical timestamp\n", __func__);
-
-        if (logicalTS <= prevLogicalTS) {
-            logicalTS = prevLogicalTS + 1;
-            LogPrintf("%s: Previous logical timestamp is newer Actual[%d] prevLogical[%d] Logical[%d]\n", __func__, pindex->nTime, prevLogicalTS, logicalTS);
-        }
+        unsigned int logicalTS = fTimestampIndex ? GetLogicalTimestamp(pindex) : 0;
+        // one batch for all of the block's index records instead of one per index
+        if (!pblocktree->UpdateIndexes(fAddressIndex ? addressIndex : std::vector<std::pair<CAddressIndexKey, CAmount> >(), false,
+                fAddressIndex ? addressUnspentIndex : std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >(),
+                fSpentIndex ? spentIndex : std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >(),
+                pindex->GetBlockHash(), logicalTS, pindex->GetBlockHash()))
+            return AbortNode(state, "Failed to write address index");
+    }
 
-        if (!pblocktree->WriteTimestampIndex(CTimestampIndexKey(logicalTS, pindex->GetBlockHash())))
-            return AbortNode(state, "Failed to write timestamp index");
+    if (fOraclesIndex) {
+        std::vector<std::pair<COraclesDataIndexKey, COraclesDataIndexValue> > oraclesIndex;
+        OraclesDataIndexRecords(block, pindex->nHeight, oraclesIndex);
+        if (!oraclesIndex.empty() && !pblocktree->WriteOraclesDataIndex(oraclesIndex))
+            return AbortNode(state, "Failed to write oracles data index");
+    }
 
-        if (!pblocktree->WriteTimestampBlockIndex(CTimestampBlockIndexKey(pindex->GetBlockHash()), CTimestampBlockIndexValue(logicalTS)))
-            return AbortNode(state, "Failed to write blockhash index");
+    if (fTokensIndex) {
+        std::vector<std::pair<CTokensIndexKey, CTokensIndexValue> > created, spent;
+        TokensIndexRecords(block, pindex->nHeight, true, created, spent);
+        if ((!created.empty() || !spent.empty()) && !pblocktree->UpdateTokensIndex(created, spent, true))
+            return AbortNode(state, "Failed to write tokens index");
     }
 
     // add this block to the view's block chain
@@ -3837,6 +4235,86 @@ enum FlushStateMode {
     FLUSH_STATE_ALWAYS
 };
 
+const int64_t CCoinsFlushStats::LATENCY_BOUNDS[CCoinsFlushStats::BUCKETS - 1] = { 10, 100, 1000, 10000, 60000 };
+const int64_t CCoinsFlushStats::SIZE_BOUNDS[CCoinsFlushStats::BUCKETS - 1] = { 1000, 10000, 100000, 1000000, 10000000 };
+
+static CCriticalSection cs_coinsFlushStats;
+static CCoinsFlushStats coinsFlushStats;
+/** The chainstate write running in the background, if any (cs_main) */
+static std::future<bool> futureCoinsFlush;
+
+static void RecordCoinsFlush(int64_t nMicros, size_t nEntries, bool fBackground)
+{
+    LOCK(cs_coinsFlushStats);
+    coinsFlushStats.nFlushes++;
+    if ( fBackground )
+        coinsFlushStats.nBackgroundFlushes++;
+    coinsFlushStats.nEntriesWritten += nEntries;
+    coinsFlushStats.nLastFlushMicros = nMicros;
+    coinsFlushStats.nLastFlushEntries = nEntries;
+    int i;
+    for (i = 0; i < CCoinsFlushStats::BUCKETS - 1 && nMicros / 1000 >= CCoinsFlushStats::LATENCY_BOUNDS[i]; i++)
+        ;
+    coinsFlushStats.vLatency[i]++;
+    for (i = 0; i < CCoinsFlushStats::BUCKETS - 1 && (int64_t)nEntries >= CCoinsFlushStats::SIZE_BOUNDS[i]; i++)
+        ;
+    coinsFlushStats.vSize[i]++;
+}
+
+CCoinsFlushStats GetCoinsFlushStats()
+{
+    CCoinsFlushStats stats;
+    {
+        LOCK(cs_coinsFlushStats);
+        stats = coinsFlushStats;
+    }
+    {
+        LOCK(cs_main);
+        stats.fPending = futureCoinsFlush.valid();
+    }
+    return stats;
+}
+
+/**
+ * Write a copy of the dirty chainstate entries to the database.
+ * Runs either on the calling thread or in the background, without cs_main.
+ */
+static bool WriteCoinsDelta(std::shared_ptr<CCoinsCacheDelta> delta, bool fBackground)
+{
+    int64_t nStart = GetTimeMicros();
+    size_t nEntries = delta->GetCount();
+    bool fOk = pcoinsdbview->BatchWrite(delta->mapCoins, delta->hashBlock, delta->hashSproutAnchor, delta->hashSaplingAnchor,
+        delta->mapSproutAnchors, delta->mapSaplingAnchors, delta->mapSproutNullifiers, delta->mapSaplingNullifiers);
+    int64_t nMicros = GetTimeMicros() - nStart;
+    RecordCoinsFlush(nMicros, nEntries, fBackground);
+    LogPrint("bench", "  - Chainstate write%s: %u entries %.2fms\n", fBackground ? " (background)" : "", (unsigned)nEntries, nMicros * 0.001);
+    return fOk;
+}
+
+/**
+ * Wait for the background chainstate write, if any. Required before clean
+ * entries are evicted from pcoinsTip and before the database is read directly.
+ * Rethrows what the write threw.
+ */
+static bool WaitForCoinsFlush()
+{
+    AssertLockHeld(cs_main);
+    if ( !futureCoinsFlush.valid() )
+        return true;
+    return futureCoinsFlush.get();
+}
+
+/** Evict clean entries from pcoinsTip once it holds more than nCoinCacheUsage * COINS_CACHE_TRIM_PERCENT / 100 */
+static void TrimCoinsCache()
+{
+    size_t nEvicted = pcoinsTip->Trim(nCoinCacheUsage * COINS_CACHE_TRIM_PERCENT / 100);
+    if ( nEvicted != 0 )
+    {
+        LOCK(cs_coinsFlushStats);
+        coinsFlushStats.nEvicted += nEvicted;
+    }
+}
+
 /**
  * Update the on-disk chain state.
  * The caches and indexes are flushed depending on the mode we're called with
@@ -3901,14 +4379,20 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
                     setDirtyFileInfo.erase(it++);
                 }
                 std::vector<const CBlockIndex*> vBlocks;
+                std::vector<CBlockIndex*> vTrim;
                 vBlocks.reserve(setDirtyBlockIndex.size());
+                vTrim.reserve(setDirtyBlockIndex.size());
                 for (set<CBlockIndex*>::iterator it = setDirtyBlockIndex.begin(); it != setDirtyBlockIndex.end(); ) {
                     vBlocks.push_back(*it);
+                    vTrim.push_back(*it);
                     setDirtyBlockIndex.erase(it++);
                 }
                 if (!pblocktree->WriteBatchSync(vFiles, nLastBlockFile, vBlocks)) {
                     return AbortNode(state, "Files to write to block index database");
                 }
+                // the solutions are in the block tree db now, GetSolution() reads them from there
+                BOOST_FOREACH(CBlockIndex *pindex, vTrim)
+                    pindex->TrimSolution();
             }
             // Finally remove any pruned files
             if (fFlushForPrune)
@@ -3924,12 +4408,35 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
             // overwrite one. Still, use a conservative safety factor of 2.
             if (!CheckDiskSpace(128 * 2 * 2 * pcoinsTip->GetCacheSize()))
                 return state.Error("out of disk space");
-            // Flush the chainstate (which may refer to block index entries).
-            if (!pcoinsTip->Flush())
+            // Only one chainstate write at a time, and in order.
+            if (!WaitForCoinsFlush())
                 return AbortNode(state, "Failed to write to coin database");
+            // Flush the chainstate (which may refer to block index entries).
+            // Only the dirty entries are written; the cache stays warm. The write
+            // runs in the background unless the caller needs the database current
+            // or the cache is over its limit and has to be trimmed right away.
+            std::shared_ptr<CCoinsCacheDelta> delta = std::make_shared<CCoinsCacheDelta>();
+            pcoinsTip->ExtractDirty(*delta);
+            if (mode == FLUSH_STATE_ALWAYS || fCacheCritical || fFlushForPrune) {
+                if (!WriteCoinsDelta(delta, false))
+                    return AbortNode(state, "Failed to write to coin database");
+                TrimCoinsCache();
+            } else {
+                futureCoinsFlush = std::async(std::launch::async, WriteCoinsDelta, delta, true);
+            }
             nLastFlush = nNow;
+        } else if (futureCoinsFlush.valid() && futureCoinsFlush.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            // The background write finished, its entries may be evicted now.
+            if (!WaitForCoinsFlush())
+                return AbortNode(state, "Failed to write to coin database");
+            TrimCoinsCache();
         }
-        if ((mode == FLUSH_STATE_ALWAYS || mode == FLUSH_STATE_PERIODIC) && nNow > nLastSetChain + (int64_t)DATABASE_WRITE_INTERVAL * 1000000) {
+        // The wallet locator must not get ahead of the chainstate on disk. A periodic flush
+        // does not wait for a background write, a later one updates the wallet instead.
+        bool fCoinsWriting = futureCoinsFlush.valid() && futureCoinsFlush.wait_for(std::chrono::seconds(0)) != std::future_status::ready;
+        if ((mode == FLUSH_STATE_ALWAYS || (mode == FLUSH_STATE_PERIODIC && !fCoinsWriting)) && nNow > nLastSetChain + (int64_t)DATABASE_WRITE_INTERVAL * 1000000) {
+            if (!WaitForCoinsFlush())
+                return AbortNode(state, "Failed to write to coin database");
             // Update best block in wallet (so we can detect restored wallets).
             GetMainSignals().SetBestChain(chainActive.GetLocator());
             nLastSetChain = nNow;
@@ -4042,6 +4549,9 @@ bool static DisconnectTip(CValidationState &state, bool fBare = false) {
         assert(view.Flush());
         DisconnectNotarisations(block);
     }
+    AssetsOrderBookUpdate(block, false);
+    // cached CC eval results may have looked up transactions in the disconnected block
+    CCEvalChainEpoch++;
     pindexDelete->segid = -2;
     pindexDelete->nNotaryPay = 0; 
     pindexDelete->newcoins = 0;
@@ -4250,6 +4760,7 @@ bool static ConnectTip(CValidationState &state, CBlockIndex *pindexNew, CBlock *
 
     // Update chainActive & related variables.
     UpdateTip(pindexNew);
+    AssetsOrderBookUpdate(*pblock, true);
     if ( KOMODO_NSPV_FULLNODE )
     {
         // Tell wallet about transactions that went from mempool
@@ -5931,6 +6442,7 @@ bool PruneOneBlockFile(bool tempfile, const int fileNumber)
 
 void UnlinkPrunedFiles(std::set<int>& setFilesToPrune)
 {
+    blockFileHandles.Close(setFilesToPrune);
     for (set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
         CDiskBlockPos pos(*it, 0);
         boost::filesystem::remove(GetBlockPosFilename(pos, "blk"));
@@ -6077,9 +6589,7 @@ CBlockIndex * InsertBlockIndex(uint256 hash)
         return (*mi).second;
 
     // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
-    if (!pindexNew)
-        throw runtime_error("LoadBlockIndex(): new CBlockIndex failed");
+    CBlockIndex* pindexNew = blockIndexArena.Alloc();
     mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
     pindexNew->phashBlock = &((*mi).first);
     //LogPrintf("inserted to block index %s\n",hash.ToString().c_str());
@@ -6089,9 +6599,45 @@ CBlockIndex * InsertBlockIndex(uint256 hash)
 
 //void komodo_pindex_init(CBlockIndex *pindex,int32_t height);
 
+/** Solutions read back for trimmed block index entries, so that serving the same headers
+ *  to several peers reads the block tree db once. Keyed by block hash, oldest evicted first. */
+static CCriticalSection cs_solutioncache;
+static std::map<uint256, std::vector<unsigned char> > mapSolutionCache;
+static std::deque<uint256> solutionCacheOrder;
+static const size_t SOLUTION_CACHE_SIZE = 4096;
+
+std::vector<unsigned char> CBlockIndex::GetSolution() const
+{
+    if (HasSolution())
+        return nSolution;
+    uint256 hash = GetBlockHash();
+    {
+        LOCK(cs_solutioncache);
+        std::map<uint256, std::vector<unsigned char> >::const_iterator it = mapSolutionCache.find(hash);
+        if (it != mapSolutionCache.end())
+            return it->second;
+    }
+    CDiskBlockIndex dbindex;
+    if (pblocktree == nullptr || !pblocktree->ReadDiskBlockIndex(hash, dbindex) || !dbindex.HasSolution()) {
+        LogPrintf("%s: failed to read the solution of block %s\n", __func__, hash.ToString());
+        throw std::runtime_error("Failed to read block index entry");
+    }
+    std::vector<unsigned char> solution = dbindex.GetSolution();
+    LOCK(cs_solutioncache);
+    if (mapSolutionCache.insert(std::make_pair(hash, solution)).second) {
+        solutionCacheOrder.push_back(hash);
+        while (solutionCacheOrder.size() > SOLUTION_CACHE_SIZE) {
+            mapSolutionCache.erase(solutionCacheOrder.front());
+            solutionCacheOrder.pop_front();
+        }
+    }
+    return solution;
+}
+
 bool static LoadBlockIndexDB()
 {
     const CChainParams& chainparams = Params();
+    int64_t nTimeStart = GetTimeMillis();
     LogPrintf("%s: start loading guts\n", __func__);
     if (!pblocktree->LoadBlockIndexGuts())
         return false;
@@ -6100,6 +6646,7 @@ bool static LoadBlockIndexDB()
     
     if (ShutdownRequested())
         return false;
+    int64_t nTimeGuts = GetTimeMillis();
 
     // Calculate nChainWork
     vector<pair<int, CBlockIndex*> > vSortedByHeight;
@@ -6113,16 +6660,38 @@ bool static LoadBlockIndexDB()
     //LogPrintf("load blockindexDB paired %u\n",(uint32_t)time(NULL));
     sort(vSortedByHeight.begin(), vSortedByHeight.end());
     //LogPrintf("load blockindexDB sorted %u\n",(uint32_t)time(NULL));
+    int64_t nTimeSort = GetTimeMillis();
+
+    // The proof of each block only depends on its own nBits, so it is computed on several
+    // threads into nChainWork first, the pass below then adds the work of the parent.
+    {
+        const int nThreads = std::max(1, std::min(GetNumCores(), 8));
+        std::atomic<size_t> next(0);
+        auto worker = [&]() {
+            size_t i;
+            while ((i = next.fetch_add(1024)) < vSortedByHeight.size()) {
+                for (size_t j = i; j < std::min(i + 1024, vSortedByHeight.size()); j++)
+                    vSortedByHeight[j].second->nChainWork = GetBlockProof(*vSortedByHeight[j].second);
+            }
+        };
+        std::vector<std::thread> threads;
+        for (int i = 1; i < nThreads; i++)
+            threads.emplace_back(worker);
+        worker();
+        for (auto &thread : threads)
+            thread.join();
+    }
+    int64_t nTimeProof = GetTimeMillis();
 
     uiInterface.ShowProgress(_("Loading block index DB..."), 0, false);
-    int cur_height_num = 0;
+    int cur_height_num = 0, percentageDone = 0;
 
     BOOST_FOREACH(const PAIRTYPE(int, CBlockIndex*)& item, vSortedByHeight)
     {
         boost::this_thread::interruption_point();
 
         CBlockIndex* pindex = item.second;
-        pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
+        pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + pindex->nChainWork;
         // We can link the chain of blocks for which we've received transactions at some point.
         // Pruned nodes may have deleted the block.
         if (pindex->nTx > 0) {
@@ -6173,11 +6742,15 @@ bool static LoadBlockIndexDB()
         if (pindex->IsValid(BLOCK_VALID_TREE) && (pindexBestHeader == NULL || CBlockIndexWorkComparator()(pindexBestHeader, pindex)))
             pindexBestHeader = pindex;
         //komodo_pindex_init(pindex,(int32_t)pindex->nHeight);
-        uiInterface.ShowProgress(_("Loading block index DB..."), (int)((double)(cur_height_num*100)/(double)(vSortedByHeight.size())), false);
         cur_height_num++;
+        if ((int)((double)(cur_height_num*100)/(double)(vSortedByHeight.size())) != percentageDone) {
+            percentageDone = (int)((double)(cur_height_num*100)/(double)(vSortedByHeight.size()));
+            uiInterface.ShowProgress(_("Loading block index DB..."), percentageDone, false);
+        }
     }
 
     uiInterface.ShowProgress("", 100, false);
+    int64_t nTimeChain = GetTimeMillis();
 
     //LogPrintf("load blockindexDB chained %u\n",(uint32_t)time(NULL));
 
@@ -6230,6 +6803,7 @@ bool static LoadBlockIndexDB()
     }
     LogPrintf("[%s].\n", "DONE");
     uiInterface.ShowProgress("", 100, false);
+    int64_t nTimeFiles = GetTimeMillis();
 
     // Check whether we have ever pruned block & undo files
     pblocktree->ReadFlag("prunedblockfiles", fHavePruned);
@@ -6256,6 +6830,14 @@ bool static LoadBlockIndexDB()
     pblocktree->ReadFlag("spentindex", fSpentIndex);
     LogPrintf("%s: spent index %s\n", __func__, fSpentIndex ? "enabled" : "disabled");
 
+    // Check whether we have an oracles data index
+    pblocktree->ReadFlag("oraclesindex", fOraclesIndex);
+    LogPrintf("%s: oracles data index %s\n", __func__, fOraclesIndex ? "enabled" : "disabled");
+
+    // Check whether we have a tokens index
+    pblocktree->ReadFlag("tokensindex", fTokensIndex);
+    LogPrintf("%s: tokens index %s\n", __func__, fTokensIndex ? "enabled" : "disabled");
+
     // Fill in-memory data
     BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex)
     {
@@ -6270,6 +6852,9 @@ bool static LoadBlockIndexDB()
         }
         //komodo_pindex_init(pindex,(int32_t)pindex->nHeight);
     }
+    LogPrintf("%s: %u entries, guts %dms, sort %dms, block proofs %dms, chain work %dms, block files %dms, total %dms\n", __func__,
+        (unsigned)mapBlockIndex.size(), nTimeGuts - nTimeStart, nTimeSort - nTimeGuts, nTimeProof - nTimeSort,
+        nTimeChain - nTimeProof, nTimeFiles - nTimeChain, GetTimeMillis() - nTimeStart);
 
     // Load pointer to end of best chain
     BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
@@ -6555,6 +7140,149 @@ bool RewindBlockIndex(const CChainParams& params)
     return true;
 }
 
+
+/****
+ * Build the address, unspent and spent index records of a block from the block and its undo data,
+ * in the order ConnectBlock (fConnect) or DisconnectBlock (!fConnect) would produce them
+ */
+static void IndexRecordsFromUndo(const CBlock &block, const CBlockIndex *pindex, const CBlockUndo &blockundo, bool fConnect,
+        std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
+        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &addressUnspentIndex,
+        std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > &spentIndex)
+{
+    auto addInputs = [&](const CTransaction &tx, const uint256 &txhash, int i) {
+        if (tx.IsMint() || i == 0 || i > blockundo.vtxundo.size())
+            return;
+        const CTxUndo &txundo = blockundo.vtxundo[i-1];
+        for (size_t j = 0; j < tx.vin.size() && j < txundo.vprevout.size(); j++) {
+            const CTxIn &input = tx.vin[j];
+            const CTxInUndo &undo = txundo.vprevout[j];
+            const CTxOut &prevout = undo.txout;
+
+            vector<vector<unsigned char>> vSols;
+            CTxDestination vDest;
+            txnouttype txType = TX_PUBKEYHASH;
+            uint160 addrHash;
+            int keyType = GetAddressType(prevout.scriptPubKey, vDest, txType, vSols);
+            if ( keyType != 0 )
+            {
+                for (auto addr : vSols)
+                {
+                    addrHash = addr.size() == 20 ? uint160(addr) : Hash160(addr);
+                    if (fAddressIndex) {
+                        addressIndex.push_back(make_pair(CAddressIndexKey(keyType, addrHash, pindex->nHeight, i, txhash, j, true), prevout.nValue * -1));
+                        addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(keyType, addrHash, input.prevout.hash, input.prevout.n),
+                                fConnect ? CAddressUnspentValue() : CAddressUnspentValue(prevout.nValue, prevout.scriptPubKey, undo.nHeight)));
+                    }
+                }
+                if (fSpentIndex && fConnect)
+                    spentIndex.push_back(make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n), CSpentIndexValue(txhash, j, pindex->nHeight, prevout.nValue, keyType, addrHash)));
+            }
+            if (fSpentIndex && !fConnect)
+                spentIndex.push_back(make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n), CSpentIndexValue()));
+        }
+    };
+    auto addOutputs = [&](const CTransaction &tx, const uint256 &txhash, int i) {
+        if (!fAddressIndex)
+            return;
+        for (unsigned int k = 0; k < tx.vout.size(); k++) {
+            const CTxOut &out = tx.vout[k];
+
+            vector<vector<unsigned char>> vSols;
+            CTxDestination vDest;
+            txnouttype txType = TX_PUBKEYHASH;
+            int keyType = GetAddressType(out.scriptPubKey, vDest, txType, vSols);
+            if ( keyType != 0 )
+            {
+                for (auto addr : vSols)
+                {
+                    uint160 addrHash = addr.size() == 20 ? uint160(addr) : Hash160(addr);
+                    addressIndex.push_back(make_pair(CAddressIndexKey(keyType, addrHash, pindex->nHeight, i, txhash, k, false), out.nValue));
+                    addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(keyType, addrHash, txhash, k),
+                            fConnect ? CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->nHeight) : CAddressUnspentValue()));
+                }
+            }
+        }
+    };
+    // the records go into one batch where the last update of a key wins, so keep the order
+    // of spends and creations within the block
+    for (int n = 0; n < block.vtx.size(); n++) {
+        int i = fConnect ? n : block.vtx.size() - 1 - n;
+        const CTransaction &tx = block.vtx[i];
+        const uint256 txhash = tx.GetHash();
+        if (fConnect) {
+            addInputs(tx, txhash, i);
+            addOutputs(tx, txhash, i);
+        } else {
+            addOutputs(tx, txhash, i);
+            addInputs(tx, txhash, i);
+        }
+    }
+}
+
+bool CatchUpIndexes()
+{
+    LOCK(cs_main);
+    if (!fAddressIndex && !fSpentIndex && !fTimestampIndex)
+        return true;
+    CBlockIndex *pindexTip = chainActive.Tip();
+    if (pindexTip == 0)
+        return true;
+
+    uint256 hashIndexBest;
+    if (!pblocktree->ReadIndexBestBlock(hashIndexBest)) {
+        // indexes from before the marker existed were written in step with the chain
+        LogPrintf("%s: no index best block recorded, assuming the indexes are at the chain tip\n", __func__);
+        return pblocktree->WriteIndexBestBlock(pindexTip->GetBlockHash());
+    }
+    BlockMap::iterator mi = mapBlockIndex.find(hashIndexBest);
+    if (mi == mapBlockIndex.end() || mi->second == 0)
+        return error("%s: index best block %s is not in the block index", __func__, hashIndexBest.ToString());
+    const CBlockIndex *pindex = mi->second;
+    if (pindex == pindexTip)
+        return true;
+    const CBlockIndex *pfork = chainActive.FindFork(pindex);
+    if (pfork == 0)
+        return error("%s: index best block %s does not connect to the active chain", __func__, hashIndexBest.ToString());
+    LogPrintf("%s: indexes are at height %d, chain tip at %d, fork at %d\n", __func__, pindex->nHeight, pindexTip->nHeight, pfork->nHeight);
+
+    // take out the blocks the indexes saw that did not make it into the flushed chain state,
+    // then add the active chain blocks they are missing, one batch per block
+    std::vector<const CBlockIndex*> vConnect;
+    for (const CBlockIndex *pindexWalk = pindexTip; pindexWalk != pfork; pindexWalk = pindexWalk->pprev)
+        vConnect.push_back(pindexWalk);
+    std::reverse(vConnect.begin(), vConnect.end());
+    std::vector<std::pair<const CBlockIndex*, bool> > vUpdates;
+    for (const CBlockIndex *pindexWalk = pindex; pindexWalk != pfork; pindexWalk = pindexWalk->pprev)
+        vUpdates.push_back(std::make_pair(pindexWalk, false));
+    for (const CBlockIndex *pindexWalk : vConnect)
+        vUpdates.push_back(std::make_pair(pindexWalk, true));
+
+    for (const std::pair<const CBlockIndex*, bool> &update : vUpdates) {
+        boost::this_thread::interruption_point();
+        const CBlockIndex *pindexUpdate = update.first;
+        bool fConnect = update.second;
+        CBlock block;
+        CBlockUndo blockundo;
+        if (!ReadBlockFromDisk(block, pindexUpdate, false))
+            return error("%s: failed to read block %s", __func__, pindexUpdate->GetBlockHash().ToString());
+        if (pindexUpdate->pprev == 0 || pindexUpdate->GetUndoPos().IsNull() ||
+            !UndoReadFromDisk(blockundo, pindexUpdate->GetUndoPos(), pindexUpdate->pprev->GetBlockHash()))
+            return error("%s: no undo data for block %s", __func__, pindexUpdate->GetBlockHash().ToString());
+
+        std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+        std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+        IndexRecordsFromUndo(block, pindexUpdate, blockundo, fConnect, addressIndex, addressUnspentIndex, spentIndex);
+        unsigned int logicalTS = (fConnect && fTimestampIndex) ? GetLogicalTimestamp(pindexUpdate) : 0;
+        if (!pblocktree->UpdateIndexes(addressIndex, !fConnect, addressUnspentIndex, spentIndex, pindexUpdate->GetBlockHash(),
+                logicalTS, fConnect ? pindexUpdate->GetBlockHash() : pindexUpdate->pprev->GetBlockHash()))
+            return error("%s: failed to write the indexes for block %s", __func__, pindexUpdate->GetBlockHash().ToString());
+    }
+    LogPrintf("%s: indexes caught up to %s\n", __func__, pindexTip->GetBlockHash().ToString());
+    return true;
+}
+
 void UnloadBlockIndex()
 {
     LOCK(cs_main);
@@ -6581,9 +7309,11 @@ void UnloadBlockIndex()
     recentRejects.reset(NULL);
 
     BOOST_FOREACH(BlockMap::value_type& entry, mapBlockIndex) {
-        delete entry.second;
+        if (!blockIndexArena.Owns(entry.second))
+            delete entry.second;
     }
     mapBlockIndex.clear();
+    blockIndexArena.Clear();
     fHavePruned = false;
 }
 
@@ -6636,6 +7366,10 @@ bool InitBlockIndex() {
         
         fSpentIndex = GetBoolArg("-spentindex", DEFAULT_SPENTINDEX);
         pblocktree->WriteFlag("spentindex", fSpentIndex);
+        fOraclesIndex = GetBoolArg("-oraclesindex", DEFAULT_ORACLESINDEX);
+        pblocktree->WriteFlag("oraclesindex", fOraclesIndex);
+        fTokensIndex = GetBoolArg("-tokensindex", DEFAULT_TOKENSINDEX);
+        pblocktree->WriteFlag("tokensindex", fTokensIndex);
         LogPrintf("fAddressIndex.%d/%d fSpentIndex.%d/%d\n",fAddressIndex,DEFAULT_ADDRESSINDEX,fSpentIndex,DEFAULT_SPENTINDEX);
         LogPrintf("Initializing databases...\n");
     }
@@ -8654,10 +9388,12 @@ public:
 //        for (; it1 != mapBlockIndex.end(); it1++)
 //            delete (*it1).second;
         BOOST_FOREACH(BlockMap::value_type& entry, mapBlockIndex) {
-            delete entry.second;
+            if (!blockIndexArena.Owns(entry.second))
+                delete entry.second;
         }
 
         mapBlockIndex.clear();
+        blockIndexArena.Clear();
 
         // orphan transactions
         mapOrphanTransactions.clear();
@@ -46,6 +46,7 @@
 
 #include <algorithm>
 #include <exception>
+#include <functional>
 #include <map>
 #include <set>
 #include <stdint.h>
@@ -58,6 +59,7 @@
 class CBlockIndex;
 class CBlockTreeDB;
 class CBloomFilter;
+class CCoinsViewDB;
 class CInv;
 class CScriptCheck;
 class CValidationInterface;
@@ -99,6 +101,16 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** -prefetchthreads default (threads loading a block's inputs into the coins cache, 0 = off) */
+static const int DEFAULT_PREFETCH_THREADS = 4;
+/** After a chainstate flush, clean coins cache entries are evicted down to this share of -dbcache's coins cache (percent) */
+static const unsigned int COINS_CACHE_TRIM_PERCENT = 75;
+/** Maximum number of coins prefetch threads allowed */
+static const int MAX_PREFETCH_THREADS = 16;
+/** -txlookupcache default (confirmed transactions kept decoded for GetTransaction, 0 = off) */
+static const unsigned int DEFAULT_TX_LOOKUP_CACHE = 20000;
+/** -blockfilehandles default (read-only blk file descriptors kept open for transaction lookups) */
+static const unsigned int DEFAULT_BLOCK_FILE_HANDLES = 16;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
@@ -125,6 +137,8 @@ static const int64_t DEFAULT_MAX_TIP_AGE = 24 * 60 * 60;
 #define DEFAULT_ADDRESSINDEX (GetArg("-ac_cc",0) != 0 || GetArg("-ac_ccactivate",0) != 0)
 #define DEFAULT_SPENTINDEX (GetArg("-ac_cc",0) != 0 || GetArg("-ac_ccactivate",0) != 0)
 static const bool DEFAULT_TIMESTAMPINDEX = false;
+static const bool DEFAULT_ORACLESINDEX = false;
+static const bool DEFAULT_TOKENSINDEX = false;
 static const unsigned int DEFAULT_DB_MAX_OPEN_FILES = 1000;
 static const bool DEFAULT_DB_COMPRESSION = true;
 /** Default NSPV support enabled */
@@ -159,7 +173,12 @@ extern bool fExperimentalMode;
 extern bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
+extern int nPrefetchThreads;
+extern unsigned int nTxLookupCacheSize;
+extern unsigned int nBlockFileHandles;
 extern bool fTxIndex;
+extern bool fOraclesIndex;
+extern bool fTokensIndex;
 extern bool fIsBareMultisigStd;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
@@ -310,6 +329,27 @@ void FlushStateToDisk();
 /** Prune block files and flush state to disk. */
 void PruneAndFlush();
 
+/** Chainstate flush counters and histograms, reported by getcoinscacheinfo */
+struct CCoinsFlushStats
+{
+    static const int BUCKETS = 6;
+    //! upper bounds of the first BUCKETS - 1 latency buckets, in milliseconds
+    static const int64_t LATENCY_BOUNDS[BUCKETS - 1];
+    //! upper bounds of the first BUCKETS - 1 size buckets, in entries written
+    static const int64_t SIZE_BOUNDS[BUCKETS - 1];
+
+    uint64_t nFlushes = 0;
+    uint64_t nBackgroundFlushes = 0;
+    uint64_t nEntriesWritten = 0;
+    uint64_t nEvicted = 0;
+    int64_t nLastFlushMicros = 0;
+    uint64_t nLastFlushEntries = 0;
+    bool fPending = false;
+    uint64_t vLatency[BUCKETS] = {};
+    uint64_t vSize[BUCKETS] = {};
+};
+CCoinsFlushStats GetCoinsFlushStats();
+
 /**
  * @brief Try to add transaction to memory pool 
  * @param pool
@@ -664,19 +704,220 @@ struct CAddressIndexIteratorHeightKey {
     }
 };
 
-struct CDiskTxPos : public CDiskBlockPos
-{
-    unsigned int nTxOffset; // after header
+/**
+ * Oracles data index: one entry per data ('D') transaction, ordered by
+ * oracle, publisher and height so that a publisher's samples can be
+ * read as a range in either direction.
+ */
+struct COraclesDataIndexKey {
+    uint256 oracletxid;
+    CPubKey publisher; // always compressed, stored as its 33 bytes
+    int blockHeight;
+    uint256 txid;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 101;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        oracletxid.Serialize(s);
+        s.write((const char *)publisher.begin(), CPubKey::COMPRESSED_PUBLIC_KEY_SIZE);
+        // Heights are stored big-endian for key sorting in LevelDB
+        ser_writedata32be(s, blockHeight);
+        txid.Serialize(s);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        unsigned char pk[CPubKey::COMPRESSED_PUBLIC_KEY_SIZE];
+        oracletxid.Unserialize(s);
+        s.read((char *)pk, sizeof(pk));
+        publisher.Set(pk, pk + sizeof(pk));
+        blockHeight = ser_readdata32be(s);
+        txid.Unserialize(s);
+    }
+
+    COraclesDataIndexKey(uint256 oracle, CPubKey pk, int height, uint256 hash) {
+        oracletxid = oracle;
+        publisher = pk;
+        blockHeight = height;
+        txid = hash;
+    }
+
+    COraclesDataIndexKey() {
+        SetNull();
+    }
+
+    void SetNull() {
+        oracletxid.SetNull();
+        publisher = CPubKey();
+        blockHeight = 0;
+        txid.SetNull();
+    }
+};
+
+struct COraclesDataIndexIteratorKey {
+    uint256 oracletxid;
+    CPubKey publisher;
+    unsigned int blockHeight;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 69;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        oracletxid.Serialize(s);
+        s.write((const char *)publisher.begin(), CPubKey::COMPRESSED_PUBLIC_KEY_SIZE);
+        ser_writedata32be(s, blockHeight);
+    }
+
+    COraclesDataIndexIteratorKey(uint256 oracle, CPubKey pk, unsigned int height) {
+        oracletxid = oracle;
+        publisher = pk;
+        blockHeight = height;
+    }
+};
+
+/** The baton address and the published data of an oracles data transaction */
+struct COraclesDataIndexValue {
+    std::string batonaddr;
+    std::vector<uint8_t> data;
 
     ADD_SERIALIZE_METHODS;
 
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action) {
-        READWRITE(*(CDiskBlockPos*)this);
-        READWRITE(VARINT(nTxOffset));
+        READWRITE(batonaddr);
+        READWRITE(data);
     }
 
-    CDiskTxPos(const CDiskBlockPos &blockIn, unsigned int nTxOffsetIn) : CDiskBlockPos(blockIn.nFile, blockIn.nPos), nTxOffset(nTxOffsetIn) {
+    COraclesDataIndexValue(const std::string &addr, const std::vector<uint8_t> &d) : batonaddr(addr), data(d) {}
+
+    COraclesDataIndexValue() {}
+};
+
+/**
+ * Tokens index: one entry per unspent token output, ordered by token and by
+ * the CC address holding it, so that an address's balance of a token, or all
+ * holders of a token, can be read with one range scan.
+ */
+struct CTokensIndexKey {
+    uint256 tokenid;
+    uint160 addressHash;
+    uint256 txhash;
+    uint32_t index;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 88;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        tokenid.Serialize(s);
+        addressHash.Serialize(s);
+        txhash.Serialize(s);
+        ser_writedata32(s, index);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        tokenid.Unserialize(s);
+        addressHash.Unserialize(s);
+        txhash.Unserialize(s);
+        index = ser_readdata32(s);
+    }
+
+    CTokensIndexKey(uint256 token, uint160 addrHash, uint256 txid, uint32_t indexValue) {
+        tokenid = token;
+        addressHash = addrHash;
+        txhash = txid;
+        index = indexValue;
+    }
+
+    CTokensIndexKey() {
+        SetNull();
+    }
+
+    void SetNull() {
+        tokenid.SetNull();
+        addressHash.SetNull();
+        txhash.SetNull();
+        index = 0;
+    }
+};
+
+struct CTokensIndexIteratorKey {
+    uint256 tokenid;
+    uint160 addressHash;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 52;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        tokenid.Serialize(s);
+        addressHash.Serialize(s);
+    }
+
+    CTokensIndexIteratorKey(uint256 token, uint160 addrHash) {
+        tokenid = token;
+        addressHash = addrHash;
+    }
+};
+
+/** The amount of a token output and the height of the block that created it */
+struct CTokensIndexValue {
+    CAmount satoshis;
+    int blockHeight;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(satoshis);
+        READWRITE(blockHeight);
+    }
+
+    CTokensIndexValue(CAmount sats, int height) : satoshis(sats), blockHeight(height) {}
+
+    CTokensIndexValue() : satoshis(0), blockHeight(0) {}
+};
+
+struct CDiskTxPos : public CDiskBlockPos
+{
+    unsigned int nTxOffset; // after header
+    uint256 hashBlock; // null for entries written before the block hash was stored
+    int nHeight;
+
+    template <typename Stream>
+    void Serialize(Stream& s) const {
+        // a position without its block is never written, VARINT would store -1 as a height
+        assert(nHeight >= 0);
+        ::Serialize(s, *(CDiskBlockPos*)this);
+        ::Serialize(s, VARINT(nTxOffset));
+        ::Serialize(s, hashBlock);
+        ::Serialize(s, VARINT(nHeight));
+    }
+
+    /**
+     * Only ever read back from the block tree database, where older
+     * entries end right after nTxOffset. Those keep a null hashBlock and
+     * are upgraded by GetTransaction the first time they are read.
+     */
+    template <typename Stream>
+    void Unserialize(Stream& s) {
+        ::Unserialize(s, *(CDiskBlockPos*)this);
+        ::Unserialize(s, VARINT(nTxOffset));
+        hashBlock.SetNull();
+        nHeight = -1;
+        if (!s.empty()) {
+            ::Unserialize(s, hashBlock);
+            ::Unserialize(s, VARINT(nHeight));
+        }
+    }
+
+    CDiskTxPos(const CDiskBlockPos &blockIn, unsigned int nTxOffsetIn) : CDiskBlockPos(blockIn.nFile, blockIn.nPos), nTxOffset(nTxOffsetIn), nHeight(-1) {
+    }
+
+    CDiskTxPos(const CDiskBlockPos &blockIn, unsigned int nTxOffsetIn, const uint256 &hashBlockIn, int nHeightIn) :
+        CDiskBlockPos(blockIn.nFile, blockIn.nPos), nTxOffset(nTxOffsetIn), hashBlock(hashBlockIn), nHeight(nHeightIn) {
     }
 
     CDiskTxPos() {
@@ -686,6 +927,8 @@ struct CDiskTxPos : public CDiskBlockPos
     void SetNull() {
         CDiskBlockPos::SetNull();
         nTxOffset = 0;
+        hashBlock.SetNull();
+        nHeight = -1;
     }
 };
 
@@ -832,11 +1075,54 @@ public:
 
 bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &hashes);
 bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
+/**
+ * @brief read one publisher's samples from the oracles data index
+ * @param oracletxid the oracle
+ * @param publisher the publisher
+ * @param fNewestFirst true to return the samples from the highest block down
+ * @param limit stop after this many samples (0 = no limit)
+ * @param samples the samples found
+ * @param start lowest block height to include (0 = no bound)
+ * @param end highest block height to include (0 = no bound)
+ * @returns false if the index is not enabled
+ */
+bool GetOraclesDataIndex(const uint256 &oracletxid, const CPubKey &publisher, bool fNewestFirst, int32_t limit,
+                         std::vector<std::pair<COraclesDataIndexKey, COraclesDataIndexValue> > &samples, int start = 0, int end = 0);
+/**
+ * @brief read the latest sample of every publisher of an oracle from the oracles data index
+ * @param oracletxid the oracle
+ * @param end highest block height to consider (0 = no bound)
+ * @param samples one sample per publisher
+ * @returns false if the index is not enabled
+ */
+bool GetOraclesDataPublishers(const uint256 &oracletxid, int end,
+                              std::vector<std::pair<COraclesDataIndexKey, COraclesDataIndexValue> > &samples);
+/**
+ * @brief read unspent token outputs from the tokens index
+ * @param tokenid the token
+ * @param addressHash the index key of the CC address holding them (null = every holder)
+ * @param outputs the outputs found, grouped by address
+ * @returns false if the index is not enabled
+ */
+bool GetTokensIndex(const uint256 &tokenid, const uint160 &addressHash,
+                    std::vector<std::pair<CTokensIndexKey, CTokensIndexValue> > &outputs);
 bool GetAddressIndex(uint160 addressHash, int type,
                      std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
                      int start = 0, int end = 0);
 bool GetAddressUnspent(uint160 addressHash, int type,
                        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs);
+/**
+ * @brief stream address index records to a visitor instead of collecting them
+ * @param addressHash the address
+ * @param type the address type
+ * @param visitor called for each record in height order, returns false to stop
+ * @param start first block height (0 = no bound)
+ * @param end last block height (0 = no bound)
+ * @returns false if the index is not enabled or could not be read
+ */
+bool ForEachAddressIndex(uint160 addressHash, int type,
+                         const std::function<bool(const CAddressIndexKey&, CAmount)> &visitor,
+                         int start = 0, int end = 0);
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
@@ -896,6 +1182,14 @@ bool AcceptBlockHeader(int32_t *futureblockp,const CBlockHeader& block, CValidat
  */
 bool RewindBlockIndex(const CChainParams& params);
 
+/**
+ * Bring the address, spent and timestamp indexes in line with the active chain after a restart.
+ * Blocks the indexes recorded past the flushed chain state are taken out and missing active
+ * chain blocks are added, using the block and undo files.
+ * @returns true on success
+ */
+bool CatchUpIndexes();
+
 class CBlockFileInfo
 {
 public:
@@ -977,6 +1271,9 @@ extern CChain chainActive;
 /** Global variable that points to the active CCoinsView (protected by cs_main) */
 extern CCoinsViewCache *pcoinsTip;
 
+/** Global variable that points to the coins database underneath pcoinsTip (protected by cs_main) */
+extern CCoinsViewDB *pcoinsdbview;
+
 /** Global variable that points to the active block tree (protected by cs_main) */
 extern CBlockTreeDB *pblocktree;
 
@@ -106,6 +106,132 @@ public:
 uint64_t nLastBlockTx = 0;
 uint64_t nLastBlockSize = 0;
 
+static CCriticalSection cs_templateStats;
+static CBlockTemplateStats templateStats;
+
+CBlockTemplateStats GetBlockTemplateStats()
+{
+    LOCK(cs_templateStats);
+    return templateStats;
+}
+
+void RecordGetBlockTemplate(int64_t nMicros, bool fReused)
+{
+    LOCK(cs_templateStats);
+    templateStats.nRPCCalls++;
+    if ( fReused )
+        templateStats.nRPCReused++;
+    templateStats.nRPCLastMicros = nMicros;
+    templateStats.nRPCTotalMicros += nMicros;
+    templateStats.nRPCMaxMicros = std::max(templateStats.nRPCMaxMicros, nMicros);
+}
+
+// Records how long CreateNewBlock took, on whichever path it returns
+class CTemplateTimer
+{
+    int64_t nStart;
+public:
+    int64_t nSelectMicros = 0;
+    uint64_t nScanned = 0, nReused = 0;
+    CTemplateTimer() : nStart(GetTimeMicros()) {}
+    ~CTemplateTimer()
+    {
+        int64_t nMicros = GetTimeMicros() - nStart;
+        LOCK(cs_templateStats);
+        templateStats.nTemplates++;
+        templateStats.nLastMicros = nMicros;
+        templateStats.nTotalMicros += nMicros;
+        templateStats.nMaxMicros = std::max(templateStats.nMaxMicros, nMicros);
+        templateStats.nLastSelectMicros = nSelectMicros;
+        templateStats.nTxScanned += nScanned;
+        templateStats.nTxReused += nReused;
+    }
+};
+
+// What CreateNewBlock learns about a mempool transaction from its inputs. It
+// only depends on the tip and on the active notaries, so it is kept for the
+// next template on the same tip and only new transactions have to be scanned.
+struct CTemplateTxInfo
+{
+    double dPriority = 0; // sum(valuein * age), before ComputePriority
+    CAmount nTotalIn = 0;
+    bool fMissingInputs = false;
+    std::vector<uint256> vDependsOn; // parents still in the mempool
+    std::vector<int8_t> vNotaries; // notaries that signed it, if it may be a notarisation
+};
+
+static uint256 hashTemplateCacheTip;
+static int8_t nTemplateCacheNotaries;
+static uint8_t templateCacheNotaryPubkeys[64][33];
+static std::map<uint256, CTemplateTxInfo> mapTemplateTxCache;
+
+// Number of unconfirmed ancestors looked at when ranking a transaction by its package
+static const size_t TEMPLATE_MAX_ANCESTORS = 100;
+
+static void ScanTemplateTx(const CTransaction &tx, const CCoinsViewCache &view, int nHeight, int8_t numSN, uint8_t notarypubkeys[64][33], CTemplateTxInfo &info)
+{
+    std::set<uint256> setDependsOn;
+    if (tx.IsCoinImport())
+    {
+        CAmount nValueIn = GetCoinImportValue(tx); // burn amount
+        info.nTotalIn += nValueIn;
+        info.dPriority += (double)nValueIn * 1000;  // flat multiplier... max = 1e16.
+        return;
+    }
+    bool fToCryptoAddress = false;
+    if ( numSN != 0 && notarypubkeys[0][0] != 0 && komodo_is_notarytx(tx) == 1 )
+        fToCryptoAddress = true;
+
+    BOOST_FOREACH(const CTxIn& txin, tx.vin)
+    {
+        // Read prev transaction
+        if (!view.HaveCoins(txin.prevout.hash))
+        {
+            // This should never happen; all transactions in the memory
+            // pool should connect to either transactions in the chain
+            // or other transactions in the memory pool.
+            if (!mempool.mapTx.count(txin.prevout.hash))
+            {
+                LogPrintf("ERROR: mempool transaction missing input\n");
+                // if (fDebug) assert("mempool transaction missing input" == 0);
+                info.fMissingInputs = true;
+                return;
+            }
+
+            // Has to wait for dependencies
+            setDependsOn.insert(txin.prevout.hash);
+            info.nTotalIn += mempool.mapTx.find(txin.prevout.hash)->GetTx().vout[txin.prevout.n].nValue;
+            continue;
+        }
+        const CCoins* coins = view.AccessCoins(txin.prevout.hash);
+        assert(coins);
+
+        CAmount nValueIn = coins->vout[txin.prevout.n].nValue;
+        info.nTotalIn += nValueIn;
+
+        int nConf = nHeight - coins->nHeight;
+
+        uint8_t *script; int32_t scriptlen; uint256 hash; CTransaction tx1;
+        // loop over notaries array and extract index of signers.
+        if ( fToCryptoAddress && myGetTransaction(txin.prevout.hash,tx1,hash) )
+        {
+            for (int8_t i = 0; i < numSN; i++)
+            {
+                script = (uint8_t *)&tx1.vout[txin.prevout.n].scriptPubKey[0];
+                scriptlen = (int32_t)tx1.vout[txin.prevout.n].scriptPubKey.size();
+                if ( scriptlen == 35 && script[0] == 33 && script[34] == OP_CHECKSIG && memcmp(script+1,notarypubkeys[i],33) == 0 )
+                {
+                    // We can add the index of each notary to vector, and clear it if this notarisation is not valid later on.
+                    info.vNotaries.push_back(i);
+                }
+            }
+        }
+        info.dPriority += (double)nValueIn * nConf;
+    }
+    info.vDependsOn.assign(setDependsOn.begin(), setDependsOn.end());
+    info.nTotalIn += tx.GetShieldedValueIn();
+}
+
 // We want to sort transactions by priority and fee rate, so:
 typedef boost::tuple<double, CFeeRate, const CTransaction*> TxPriority;
 class TxPriorityCompare
@@ -185,6 +311,7 @@ int32_t komodo_waituntilelegible(uint32_t blocktime, int32_t stakeHeight, uint32
  */
 CBlockTemplate* CreateNewBlock(const CPubKey _pk,const CScript& _scriptPubKeyIn, int32_t gpucount, bool isStake)
 {
+    CTemplateTimer timer;
     CScript scriptPubKeyIn(_scriptPubKeyIn);
 
     CPubKey pk;
@@ -257,6 +384,7 @@ CBlockTemplate* CreateNewBlock(const CPubKey _pk,const CScript& _scriptPubKeyIn,
         boost::this_thread::disable_interruption();
         ENTER_CRITICAL_SECTION(cs_main);
         ENTER_CRITICAL_SECTION(mempool.cs);
+        int64_t nSelectStart = GetTimeMicros();
         pindexPrev = chainActive.Tip();
         const int nHeight = pindexPrev->nHeight + 1;
         const Consensus::Params &consensusParams = chainparams.GetConsensus();
@@ -300,6 +428,17 @@ CBlockTemplate* CreateNewBlock(const CPubKey _pk,const CScript& _scriptPubKeyIn,
         vector<TxPriority> vecPriority;
         vecPriority.reserve(mempool.mapTx.size() + 1);
 
+        // the scan results of the last template can be reused on the same tip and notaries
+        if ( hashTemplateCacheTip != pindexPrev->GetBlockHash() || nTemplateCacheNotaries != numSN || memcmp(templateCacheNotaryPubkeys,notarypubkeys,sizeof(notarypubkeys)) != 0 )
+        {
+            mapTemplateTxCache.clear();
+            hashTemplateCacheTip = pindexPrev->GetBlockHash();
+            nTemplateCacheNotaries = numSN;
+            memcpy(templateCacheNotaryPubkeys,notarypubkeys,sizeof(notarypubkeys));
+        }
+        std::map<uint256, CTemplateTxInfo> mapNextTemplateTxCache;
+        std::map<uint256, CFeeRate> mapPackageFeeRate;
+
         // now add transactions from the mem pool
         int32_t Notarisations = 0; uint64_t txvalue;
         for (CTxMemPool::indexed_transaction_set::iterator mi = mempool.mapTx.begin();
@@ -339,92 +478,47 @@ CBlockTemplate* CreateNewBlock(const CPubKey _pk,const CScript& _scriptPubKeyIn,
                 continue;
             }
 
+            const uint256 &txid = tx.GetHash();
+            std::map<uint256, CTemplateTxInfo>::iterator itCache = mapTemplateTxCache.find(txid);
+            if ( itCache != mapTemplateTxCache.end() )
+            {
+                mapNextTemplateTxCache[txid] = itCache->second;
+                timer.nReused++;
+            }
+            else
+            {
+                ScanTemplateTx(tx, view, nHeight, numSN, notarypubkeys, mapNextTemplateTxCache[txid]);
+                timer.nScanned++;
+            }
+            const CTemplateTxInfo &info = mapNextTemplateTxCache[txid];
+            if (info.fMissingInputs) continue;
+
             COrphan* porphan = NULL;
-            double dPriority = 0;
-            CAmount nTotalIn = 0;
-            bool fMissingInputs = false;
+            double dPriority = info.dPriority;
+            CAmount nTotalIn = info.nTotalIn;
             bool fNotarisation = false;
-            std::vector<int8_t> TMP_NotarisationNotaries;
-            if (tx.IsCoinImport())
+            const std::vector<int8_t> &TMP_NotarisationNotaries = info.vNotaries;
+            if ( !info.vDependsOn.empty() )
             {
-                CAmount nValueIn = GetCoinImportValue(tx); // burn amount
-                nTotalIn += nValueIn;
-                dPriority += (double)nValueIn * 1000;  // flat multiplier... max = 1e16.
-            } else {
-                TMP_NotarisationNotaries.clear();
-                bool fToCryptoAddress = false;
-                if ( numSN != 0 && notarypubkeys[0][0] != 0 && komodo_is_notarytx(tx) == 1 )
-                    fToCryptoAddress = true;
-
-                BOOST_FOREACH(const CTxIn& txin, tx.vin)
+                // Use list for automatic deletion
+                vOrphan.push_back(COrphan(&tx));
+                porphan = &vOrphan.back();
+                for (const uint256 &parent : info.vDependsOn)
                 {
-                    // Read prev transaction
-                    if (!view.HaveCoins(txin.prevout.hash))
-                    {
-                        // This should never happen; all transactions in the memory
-                        // pool should connect to either transactions in the chain
-                        // or other transactions in the memory pool.
-                        if (!mempool.mapTx.count(txin.prevout.hash))
-                        {
-                            LogPrintf("ERROR: mempool transaction missing input\n");
-                            // if (fDebug) assert("mempool transaction missing input" == 0);
-                            fMissingInputs = true;
-                            if (porphan)
-                                vOrphan.pop_back();
-                            break;
-                        }
-
-                        // Has to wait for dependencies
-                        if (!porphan)
-                        {
-                            // Use list for automatic deletion
-                            vOrphan.push_back(COrphan(&tx));
-                            porphan = &vOrphan.back();
-                        }
-                        mapDependers[txin.prevout.hash].push_back(porphan);
-                        porphan->setDependsOn.insert(txin.prevout.hash);
-                        nTotalIn += mempool.mapTx.find(txin.prevout.hash)->GetTx().vout[txin.prevout.n].nValue;
-                        continue;
-                    }
-                    const CCoins* coins = view.AccessCoins(txin.prevout.hash);
-                    assert(coins);
-
-                    CAmount nValueIn = coins->vout[txin.prevout.n].nValue;
-                    nTotalIn += nValueIn;
-
-                    int nConf = nHeight - coins->nHeight;
-                    
-                    uint8_t *script; int32_t scriptlen; uint256 hash; CTransaction tx1;
-                    // loop over notaries array and extract index of signers.
-                    if ( fToCryptoAddress && myGetTransaction(txin.prevout.hash,tx1,hash) )
-                    {
-                        for (int8_t i = 0; i < numSN; i++) 
-                        {
-                            script = (uint8_t *)&tx1.vout[txin.prevout.n].scriptPubKey[0];
-                            scriptlen = (int32_t)tx1.vout[txin.prevout.n].scriptPubKey.size();
-                            if ( scriptlen == 35 && script[0] == 33 && script[34] == OP_CHECKSIG && memcmp(script+1,notarypubkeys[i],33) == 0 )
-                            {
-                                // We can add the index of each notary to vector, and clear it if this notarisation is not valid later on.
-                                TMP_NotarisationNotaries.push_back(i);                          
-                            }
-                        }
-                    }
-                    dPriority += (double)nValueIn * nConf;
+                    mapDependers[parent].push_back(porphan);
+                    porphan->setDependsOn.insert(parent);
                 }
-                if ( numSN != 0 && notarypubkeys[0][0] != 0 && TMP_NotarisationNotaries.size() >= numSN / 5 )
+            }
+            if ( numSN != 0 && notarypubkeys[0][0] != 0 && TMP_NotarisationNotaries.size() >= numSN / 5 )
+            {
+                // check a notary didnt sign twice (this would be an invalid notarisation later on and cause problems)
+                std::set<int> checkdupes( TMP_NotarisationNotaries.begin(), TMP_NotarisationNotaries.end() );
+                if ( checkdupes.size() != TMP_NotarisationNotaries.size() )
                 {
-                    // check a notary didnt sign twice (this would be an invalid notarisation later on and cause problems)
-                    std::set<int> checkdupes( TMP_NotarisationNotaries.begin(), TMP_NotarisationNotaries.end() );
-                    if ( checkdupes.size() != TMP_NotarisationNotaries.size() ) 
-                    {
-                        LogPrintf( "possible notarisation is signed multiple times by same notary, passed as normal transaction.\n");
-                    } else fNotarisation = true;
-                }
-                nTotalIn += tx.GetShieldedValueIn();
+                    LogPrintf( "possible notarisation is signed multiple times by same notary, passed as normal transaction.\n");
+                } else fNotarisation = true;
             }
 
-            if (fMissingInputs) continue;
-
             // Priority is sum(valuein * age) / modified_txsize
             unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
             dPriority = tx.ComputePriority(dPriority, nTxSize);
@@ -477,6 +571,44 @@ CBlockTemplate* CreateNewBlock(const CPubKey _pk,const CScript& _scriptPubKeyIn,
                 vecPriority.push_back(TxPriority(dPriority, feeRate, &(mi->GetTx())));
         }
 
+        mapTemplateTxCache.swap(mapNextTemplateTxCache);
+
+        // Rank parents by the best fee rate of the packages they unlock, so a
+        // transaction with a low fee is not left behind a child paying for it.
+        // A transaction with too many ancestors keeps its own fee rate
+        BOOST_FOREACH(COrphan &orphan, vOrphan)
+        {
+            CAmount nPackageFees; size_t nPackageSize; std::set<uint256> setAncestors;
+            if ( !mempool.CalculateAncestorPackage(orphan.ptx->GetHash(), TEMPLATE_MAX_ANCESTORS, nPackageFees, nPackageSize, setAncestors) )
+                continue;
+            CFeeRate packageFeeRate(nPackageFees, nPackageSize);
+            if ( orphan.feeRate < packageFeeRate )
+                orphan.feeRate = packageFeeRate;
+            for (const uint256 &ancestor : setAncestors)
+            {
+                std::map<uint256, CFeeRate>::iterator it = mapPackageFeeRate.find(ancestor);
+                if ( it == mapPackageFeeRate.end() )
+                    mapPackageFeeRate[ancestor] = packageFeeRate;
+                else if ( it->second < packageFeeRate )
+                    it->second = packageFeeRate;
+            }
+        }
+        if ( !mapPackageFeeRate.empty() )
+        {
+            BOOST_FOREACH(TxPriority &txPriority, vecPriority)
+            {
+                std::map<uint256, CFeeRate>::iterator it = mapPackageFeeRate.find(txPriority.get<2>()->GetHash());
+                if ( it != mapPackageFeeRate.end() && txPriority.get<1>() < it->second )
+                    txPriority.get<1>() = it->second;
+            }
+            BOOST_FOREACH(COrphan &orphan, vOrphan)
+            {
+                std::map<uint256, CFeeRate>::iterator it = mapPackageFeeRate.find(orphan.ptx->GetHash());
+                if ( it != mapPackageFeeRate.end() && orphan.feeRate < it->second )
+                    orphan.feeRate = it->second;
+            }
+        }
+
         // Collect transactions into block
         uint64_t nBlockSize = 1000;
         uint64_t nBlockTx = 0;
@@ -629,6 +761,7 @@ CBlockTemplate* CreateNewBlock(const CPubKey _pk,const CScript& _scriptPubKeyIn,
 
         nLastBlockTx = nBlockTx;
         nLastBlockSize = nBlockSize;
+        timer.nSelectMicros = GetTimeMicros() - nSelectStart;
         if ( ASSETCHAINS_ADAPTIVEPOW <= 0 )
             blocktime = 1 + std::max(pindexPrev->GetMedianTimePast()+1, GetTime());
         else blocktime = 1 + std::max((int64_t)(pindexPrev->nTime+1), GetTime());
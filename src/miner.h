@@ -45,6 +45,27 @@ struct CBlockTemplate
 };
 #define KOMODO_MAXGPUCOUNT 65
 
+/***
+ * Block template latency, reported by getmininginfo
+ */
+struct CBlockTemplateStats
+{
+    uint64_t nTemplates = 0; //! CreateNewBlock calls, for mining, staking and getblocktemplate
+    int64_t nLastMicros = 0;
+    int64_t nTotalMicros = 0;
+    int64_t nMaxMicros = 0;
+    int64_t nLastSelectMicros = 0; //! time spent selecting transactions with cs_main held, last template
+    uint64_t nTxScanned = 0; //! mempool transactions whose inputs were looked up
+    uint64_t nTxReused = 0; //! ... and those taken from the previous template on the same tip
+    uint64_t nRPCCalls = 0; //! getblocktemplate calls
+    uint64_t nRPCReused = 0; //! ... answered with the cached template
+    int64_t nRPCLastMicros = 0;
+    int64_t nRPCTotalMicros = 0;
+    int64_t nRPCMaxMicros = 0;
+};
+CBlockTemplateStats GetBlockTemplateStats();
+void RecordGetBlockTemplate(int64_t nMicros, bool fReused);
+
 /** Generate a new block, without valid proof-of-work */
 CBlockTemplate* CreateNewBlock(const CPubKey _pk,const CScript& scriptPubKeyIn, int32_t gpucount, bool isStake = false);
 #ifdef ENABLE_WALLET
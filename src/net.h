@@ -314,6 +314,8 @@ public:
     int64_t nTimeConnected;
     int64_t nTimeOffset;
     uint32_t prevtimes[16];
+    uint32_t nspvtaggedtime;
+    int32_t nspvtaggedcount;
     // Address of this peer
     CAddress addr;
     // Bind address of our side of the connection
@@ -36,6 +36,7 @@
 #include "script/script_error.h"
 #include "script/sign.h"
 #include "script/standard.h"
+#include "txdb.h"
 #include "komodo_defs.h"
 #include "komodo_structs.h"
 #include "komodo_globals.h"
@@ -45,6 +46,7 @@
 #include "komodo_kv.h"
 #include "komodo_gateway.h"
 #include "rpc/rawtransaction.h"
+#include "utxosnapshot.h"
 
 #include <stdint.h>
 
@@ -165,7 +167,7 @@ UniValue blockheaderToJSON(const CBlockIndex* blockindex)
     result.push_back(Pair("finalsaplingroot", blockindex->hashFinalSaplingRoot.GetHex()));
     result.push_back(Pair("time", (int64_t)blockindex->nTime));
     result.push_back(Pair("nonce", blockindex->nNonce.GetHex()));
-    result.push_back(Pair("solution", HexStr(blockindex->nSolution)));
+    result.push_back(Pair("solution", HexStr(blockindex->GetSolution())));
     result.push_back(Pair("bits", strprintf("%08x", blockindex->nBits)));
     result.push_back(Pair("difficulty", GetDifficulty(blockindex)));
     result.push_back(Pair("chainwork", blockindex->nChainWork.GetHex()));
@@ -908,43 +910,162 @@ UniValue getblock(const UniValue& params, bool fHelp, const CPubKey& mypk)
 
 UniValue gettxoutsetinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
 {
-    if (fHelp || params.size() != 0)
+    if (fHelp || params.size() > 1)
         throw runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( \"hash_type\" )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "Note this call may take some time, as the default walks the whole chainstate.\n"
+            "\"muhash\" answers from the running MuHash commitment kept with the chainstate and returns at once\n"
+            "(the first call after upgrading builds the commitment, which takes as long as a full scan).\n"
+            "\nArguments:\n"
+            "1. \"hash_type\"      (string, optional, default=\"hash_serialized\") \"hash_serialized\" or \"muhash\"\n"
             "\nResult:\n"
             "{\n"
             "  \"height\":n,     (numeric) The current block height (index)\n"
             "  \"bestblock\": \"hex\",   (string) the best block hash hex\n"
             "  \"transactions\": n,      (numeric) The number of transactions\n"
             "  \"txouts\": n,            (numeric) The number of output transactions\n"
-            "  \"bytes_serialized\": n,  (numeric) The serialized size\n"
-            "  \"hash_serialized\": \"hash\",   (string) The serialized hash\n"
+            "  \"bytes_serialized\": n,  (numeric) The serialized size (not with \"muhash\")\n"
+            "  \"hash_serialized\": \"hash\",   (string) The serialized hash (not with \"muhash\")\n"
+            "  \"muhash\": \"hash\",            (string) The order independent MuHash of the unspent outputs\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("gettxoutsetinfo", "")
+            + HelpExampleCli("gettxoutsetinfo", "\"muhash\"")
             + HelpExampleRpc("gettxoutsetinfo", "")
         );
 
+    std::string strHashType = params.size() > 0 ? params[0].get_str() : "hash_serialized";
+    if (strHashType != "hash_serialized" && strHashType != "muhash")
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "hash_type must be hash_serialized or muhash");
+    bool fSerialized = strHashType == "hash_serialized";
+
     UniValue ret(UniValue::VOBJ);
 
     CCoinsStats stats;
     FlushStateToDisk();
-    if (pcoinsTip->GetStats(stats)) {
+    if (fSerialized ? pcoinsTip->GetStats(stats) : pcoinsdbview->GetCommitmentStats(stats)) {
         ret.push_back(Pair("height", (int64_t)stats.nHeight));
         ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
         ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
         ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
-        ret.push_back(Pair("bytes_serialized", (int64_t)stats.nSerializedSize));
-        ret.push_back(Pair("hash_serialized", stats.hashSerialized.GetHex()));
+        if (fSerialized) {
+            ret.push_back(Pair("bytes_serialized", (int64_t)stats.nSerializedSize));
+            ret.push_back(Pair("hash_serialized", stats.hashSerialized.GetHex()));
+        }
+        ret.push_back(Pair("muhash", stats.hashMuHash.GetHex()));
         ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
     }
     return ret;
 }
 
 
+static UniValue UTXOSnapshotToJSON(const CUTXOSnapshotInfo &info, const boost::filesystem::path &path)
+{
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("path", path.string()));
+    ret.push_back(Pair("height", (int64_t)info.header.nHeight));
+    ret.push_back(Pair("base_hash", info.header.hashBlock.GetHex()));
+    ret.push_back(Pair("transactions", (int64_t)info.stats.nTransactions));
+    ret.push_back(Pair("txouts", (int64_t)info.stats.nTransactionOutputs));
+    ret.push_back(Pair("anchors", (int64_t)info.nAnchors));
+    ret.push_back(Pair("nullifiers", (int64_t)info.nNullifiers));
+    ret.push_back(Pair("checkpoints", (int64_t)info.nCheckpoints));
+    ret.push_back(Pair("hash_serialized", info.stats.hashSerialized.GetHex()));
+    ret.push_back(Pair("muhash", info.stats.hashMuHash.GetHex()));
+    ret.push_back(Pair("total_amount", ValueFromAmount(info.stats.nTotalAmount)));
+    ret.push_back(Pair("bytes", (int64_t)info.nFileSize));
+    ret.push_back(Pair("checksum", info.checksum.GetHex()));
+    ret.push_back(Pair("checkpoints_match", info.fCheckpointsMatch));
+    return ret;
+}
+
+static boost::filesystem::path GetSnapshotPath(const UniValue& param)
+{
+    boost::filesystem::path exportdir;
+    try {
+        exportdir = GetExportDir();
+    } catch (const std::runtime_error& e) {
+        throw JSONRPCError(RPC_INTERNAL_ERROR, e.what());
+    }
+    if (exportdir.empty()) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Cannot access snapshots until the komodod -exportdir option has been set");
+    }
+    std::string unclean = param.get_str();
+    std::string clean = SanitizeFilename(unclean);
+    if (clean.compare(unclean) != 0) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Filename is invalid as only alphanumeric characters are allowed.  Try '%s' instead.", clean));
+    }
+    return exportdir / clean;
+}
+
+UniValue dumptxoutset(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "dumptxoutset \"filename\"\n"
+            "\nWrite the UTXO set (coins, shielded anchors and nullifiers) and the notarized checkpoints\n"
+            "as of the current tip to a checksummed snapshot file.\n"
+            "Note this call may take some time; cs_main is only held while the database view is captured.\n"
+            "\nArguments:\n"
+            "1. \"filename\"    (string, required) The filename, saved in folder set by komodod -exportdir option\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"path\": \"xxxx\",            (string) The full path of the snapshot\n"
+            "  \"height\": n,                (numeric) The height of the snapshot base block\n"
+            "  \"base_hash\": \"hash\",       (string) The hash of the snapshot base block\n"
+            "  \"transactions\": n,          (numeric) The number of transactions with unspent outputs\n"
+            "  \"txouts\": n,                (numeric) The number of unspent outputs\n"
+            "  \"anchors\": n,               (numeric) The number of Sprout and Sapling anchors\n"
+            "  \"nullifiers\": n,            (numeric) The number of Sprout and Sapling nullifiers\n"
+            "  \"checkpoints\": n,           (numeric) The number of notarized checkpoints\n"
+            "  \"hash_serialized\": \"hash\", (string) The UTXO set hash, as reported by gettxoutsetinfo\n"
+            "  \"muhash\": \"hash\",          (string) The MuHash of the unspent outputs, as reported by gettxoutsetinfo\n"
+            "  \"total_amount\": x.xxx,      (numeric) The total amount\n"
+            "  \"bytes\": n,                 (numeric) The size of the snapshot file\n"
+            "  \"checksum\": \"hash\",        (string) The checksum stored at the end of the file\n"
+            "  \"checkpoints_match\": true|false (boolean) If the checkpoints equal this node's notarized checkpoints up to the base height\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("dumptxoutset", "\"utxos\"")
+            + HelpExampleRpc("dumptxoutset", "\"utxos\"")
+        );
+
+    boost::filesystem::path path = GetSnapshotPath(params[0]);
+    CUTXOSnapshotInfo info;
+    std::string strError;
+    if (!DumpUTXOSnapshot(path, info, strError))
+        throw JSONRPCError(RPC_MISC_ERROR, strError);
+    return UTXOSnapshotToJSON(info, path);
+}
+
+UniValue verifytxoutset(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "verifytxoutset \"filename\"\n"
+            "\nRead a snapshot written by dumptxoutset and verify it, without loading it: the file checksum, and its totals\n"
+            "and UTXO set hash against its contents. Compare hash_serialized with gettxoutsetinfo on a trusted node at the\n"
+            "same height; it covers the coins only. The anchors and nullifiers are only covered by the checksum, and the\n"
+            "checkpoints are compared with this node's.\n"
+            "\nArguments:\n"
+            "1. \"filename\"    (string, required) The filename, in folder set by komodod -exportdir option\n"
+            "\nResult:\n"
+            "Same as dumptxoutset\n"
+            "\nExamples:\n"
+            + HelpExampleCli("verifytxoutset", "\"utxos\"")
+            + HelpExampleRpc("verifytxoutset", "\"utxos\"")
+        );
+
+    boost::filesystem::path path = GetSnapshotPath(params[0]);
+    CUTXOSnapshotInfo info;
+    std::string strError;
+    if (!VerifyUTXOSnapshot(path, info, strError))
+        throw JSONRPCError(RPC_VERIFY_ERROR, strError);
+    return UTXOSnapshotToJSON(info, path);
+}
+
 UniValue kvsearch(const UniValue& params, bool fHelp, const CPubKey& mypk)
 {
     UniValue ret(UniValue::VOBJ); uint32_t flags; uint8_t value[IGUANA_MAXSCRIPTSIZE*8],key[IGUANA_MAXSCRIPTSIZE*8]; int32_t duration,j,height,valuesize,keylen; uint256 refpubkey; static uint256 zeroes;
@@ -1001,6 +1122,113 @@ UniValue kvsearch(const UniValue& params, bool fHelp, const CPubKey& mypk)
     return ret;
 }
 
+static UniValue KVItemsToJSON(const std::vector<komodo_kvitem> &items)
+{
+    static uint256 zeroes;
+    UniValue ret(UniValue::VARR);
+    for (const komodo_kvitem &item : items)
+    {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("key",item.key));
+        if ( item.pubkey != zeroes )
+            obj.push_back(Pair("owner",item.pubkey.GetHex()));
+        obj.push_back(Pair("height",item.height));
+        obj.push_back(Pair("expiration",(int64_t)item.height + komodo_kvduration(item.flags)));
+        obj.push_back(Pair("flags",(int64_t)item.flags));
+        obj.push_back(Pair("value",item.value));
+        obj.push_back(Pair("valuesize",(int64_t)item.value.size()));
+        ret.push_back(obj);
+    }
+    return ret;
+}
+
+static int32_t KVCountParam(const UniValue& params, size_t i)
+{
+    int32_t count = params.size() > i ? params[i].get_int() : 100;
+    if ( count <= 0 || count > 10000 )
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "count must be between 1 and 10000");
+    return count;
+}
+
+UniValue kvlist(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    if ( fHelp || params.size() < 1 || params.size() > 3 )
+        throw runtime_error(
+            "kvlist \"prefix\" ( count skip )\n"
+            "\nList the live keys stored via the kvupdate command that start with a prefix, in key order.\n"
+            "This feature is only available for asset chains.\n"
+            "\nArguments:\n"
+            "1. \"prefix\"     (string, required) the key prefix, \"\" lists every key\n"
+            "2. count          (numeric, optional, default=100) the most keys to return, at most 10000\n"
+            "3. skip           (numeric, optional, default=0) the number of matching keys to skip\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"key\": \"xxxxx\",         (string) key\n"
+            "    \"owner\": \"xxxxx\"        (string) hex string representing the owner of the key\n"
+            "    \"height\": xxxxx,          (numeric) height the key was stored at\n"
+            "    \"expiration\": xxxxx,      (numeric) height the key will expire\n"
+            "    \"flags\": x,               (numeric) 1 if the key was created with a password; 0 otherwise\n"
+            "    \"value\": \"xxxxx\",       (string) stored value\n"
+            "    \"valuesize\": xxxxx        (numeric) amount of characters stored\n"
+            "  },...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("kvlist", "\"user.\" 50")
+            + HelpExampleRpc("kvlist", "\"user.\", 50")
+        );
+    std::string prefix = params[0].get_str();
+    int32_t count = KVCountParam(params,1);
+    int32_t skip = params.size() > 2 ? params[2].get_int() : 0;
+    if ( skip < 0 )
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "skip must not be negative");
+    // the first key after every key with the prefix: drop trailing 0xff bytes and bump the last one
+    std::string end = prefix;
+    while ( end.size() > 0 && (uint8_t)end.back() == 0xff )
+        end.pop_back();
+    if ( end.size() > 0 )
+        end.back() = (char)((uint8_t)end.back() + 1);
+    int32_t height;
+    {
+        LOCK(cs_main);
+        height = chainActive.Height();
+    }
+    std::vector<komodo_kvitem> items;
+    komodo_kvlist(items,height,prefix,end,skip,count);
+    return KVItemsToJSON(items);
+}
+
+UniValue kvrange(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    if ( fHelp || params.size() < 1 || params.size() > 3 )
+        throw runtime_error(
+            "kvrange \"start\" ( \"end\" count )\n"
+            "\nList the live keys stored via the kvupdate command from start up to, not including, end, in key order.\n"
+            "To page through a range pass the last key returned followed by a zero byte as the next start.\n"
+            "This feature is only available for asset chains.\n"
+            "\nArguments:\n"
+            "1. \"start\"      (string, required) the first key\n"
+            "2. \"end\"        (string, optional, default=\"\") the key to stop before, \"\" for no limit\n"
+            "3. count          (numeric, optional, default=100) the most keys to return, at most 10000\n"
+            "\nResult:\n"
+            "[ ... ]           (array) entries as returned by kvlist\n"
+            "\nExamples:\n"
+            + HelpExampleCli("kvrange", "\"a\" \"m\" 50")
+            + HelpExampleRpc("kvrange", "\"a\", \"m\", 50")
+        );
+    std::string start = params[0].get_str();
+    std::string end = params.size() > 1 ? params[1].get_str() : "";
+    int32_t count = KVCountParam(params,2);
+    int32_t height;
+    {
+        LOCK(cs_main);
+        height = chainActive.Height();
+    }
+    std::vector<komodo_kvitem> items;
+    komodo_kvlist(items,height,start,end,0,count);
+    return KVItemsToJSON(items);
+}
+
 UniValue minerids(const UniValue& params, bool fHelp, const CPubKey& mypk)
 {
     uint32_t timestamp = 0; UniValue ret(UniValue::VOBJ); UniValue a(UniValue::VARR); uint8_t minerids[2000],pubkeys[65][33]; int32_t i,j,n,numnotaries,tally[129];
@@ -1561,6 +1789,113 @@ UniValue getmempoolinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
     return mempoolInfoToJSON();
 }
 
+static UniValue FlushHistogramToJSON(const uint64_t *vCounts, const int64_t *vBounds, const std::string &strUnit)
+{
+    UniValue ret(UniValue::VOBJ);
+    for (int i = 0; i < CCoinsFlushStats::BUCKETS; i++)
+    {
+        std::string strKey = i < CCoinsFlushStats::BUCKETS - 1 ? strprintf("<%d%s", vBounds[i], strUnit) : strprintf(">=%d%s", vBounds[i - 1], strUnit);
+        ret.push_back(Pair(strKey, (uint64_t)vCounts[i]));
+    }
+    return ret;
+}
+
+UniValue getcoinscacheinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getcoinscacheinfo\n"
+            "\nReturns details on the in-memory UTXO cache and how it has been flushed to disk.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"entries\": xxxxx             (numeric) Number of transactions with cached coins\n"
+            "  \"usage\": xxxxx               (numeric) Memory usage of the cache in bytes\n"
+            "  \"maxusage\": xxxxx            (numeric) Cache size that triggers a flush, from -dbcache\n"
+            "  \"flushes\": xxxxx             (numeric) Chainstate writes since startup\n"
+            "  \"background_flushes\": xxxxx  (numeric) How many of them ran in the background\n"
+            "  \"flush_pending\": true|false  (boolean) Whether a background write is in progress\n"
+            "  \"entries_written\": xxxxx     (numeric) Dirty entries written in total\n"
+            "  \"entries_evicted\": xxxxx     (numeric) Clean entries evicted from the cache in total\n"
+            "  \"last_flush_ms\": xxx.xx      (numeric) Duration of the last write\n"
+            "  \"last_flush_entries\": xxxxx  (numeric) Entries in the last write\n"
+            "  \"latency_histogram\": {...}   (object) Number of writes by duration\n"
+            "  \"size_histogram\": {...}      (object) Number of writes by entries written\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getcoinscacheinfo", "")
+            + HelpExampleRpc("getcoinscacheinfo", "")
+        );
+
+    CCoinsFlushStats stats = GetCoinsFlushStats();
+    UniValue ret(UniValue::VOBJ);
+    {
+        LOCK(cs_main);
+        ret.push_back(Pair("entries", (uint64_t)pcoinsTip->GetCacheSize()));
+        ret.push_back(Pair("usage", (uint64_t)pcoinsTip->DynamicMemoryUsage()));
+    }
+    ret.push_back(Pair("maxusage", (uint64_t)nCoinCacheUsage));
+    ret.push_back(Pair("flushes", stats.nFlushes));
+    ret.push_back(Pair("background_flushes", stats.nBackgroundFlushes));
+    ret.push_back(Pair("flush_pending", stats.fPending));
+    ret.push_back(Pair("entries_written", stats.nEntriesWritten));
+    ret.push_back(Pair("entries_evicted", stats.nEvicted));
+    ret.push_back(Pair("last_flush_ms", stats.nLastFlushMicros * 0.001));
+    ret.push_back(Pair("last_flush_entries", stats.nLastFlushEntries));
+    ret.push_back(Pair("latency_histogram", FlushHistogramToJSON(stats.vLatency, CCoinsFlushStats::LATENCY_BOUNDS, "ms")));
+    ret.push_back(Pair("size_histogram", FlushHistogramToJSON(stats.vSize, CCoinsFlushStats::SIZE_BOUNDS, "")));
+    return ret;
+}
+
+UniValue getdbstats(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getdbstats\n"
+            "\nReturns size, cache and compaction statistics for each open LevelDB database.\n"
+            "Counters start at zero when the database is opened.\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"name\": \"xxxxx\",             (string) Database path below the data directory\n"
+            "    \"size\": xxxxx,                 (numeric) Approximate size on disk in bytes\n"
+            "    \"memory\": xxxxx,               (numeric) Memory used by write buffers and block cache in bytes\n"
+            "    \"files\": xxxxx,                (numeric) Number of table files\n"
+            "    \"reads\": xxxxx,                (numeric) Point reads\n"
+            "    \"reads_found\": xxxxx,          (numeric) Point reads that found their key\n"
+            "    \"cache_lookups\": xxxxx,        (numeric) Block cache lookups\n"
+            "    \"cache_hitrate\": x.xxx,        (numeric) Share of block cache lookups that hit\n"
+            "    \"batches\": xxxxx,              (numeric) Write batches\n"
+            "    \"compaction_seconds\": xxx.xx,  (numeric) Time spent compacting\n"
+            "    \"compaction_read_mb\": xxx.xx,  (numeric) Data read by compactions\n"
+            "    \"compaction_write_mb\": xxx.xx  (numeric) Data written by compactions\n"
+            "  },...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getdbstats", "")
+            + HelpExampleRpc("getdbstats", "")
+        );
+
+    UniValue ret(UniValue::VARR);
+    for (const CDBStats &stats : CDBWrapper::GetAllStats())
+    {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("name", stats.strName));
+        obj.push_back(Pair("size", stats.nApproximateSize));
+        obj.push_back(Pair("memory", stats.nMemoryUsage));
+        obj.push_back(Pair("files", stats.nFiles));
+        obj.push_back(Pair("reads", stats.nReads));
+        obj.push_back(Pair("reads_found", stats.nReadsFound));
+        obj.push_back(Pair("cache_lookups", stats.nCacheLookups));
+        obj.push_back(Pair("cache_hitrate", stats.nCacheLookups == 0 ? 0. : (double)stats.nCacheHits / stats.nCacheLookups));
+        obj.push_back(Pair("batches", stats.nBatches));
+        obj.push_back(Pair("compaction_seconds", stats.nCompactionSeconds));
+        obj.push_back(Pair("compaction_read_mb", stats.nCompactionReadMB));
+        obj.push_back(Pair("compaction_write_mb", stats.nCompactionWriteMB));
+        ret.push_back(obj);
+    }
+    return ret;
+}
+
 inline CBlockIndex* LookupBlockIndex(const uint256& hash)
 {
     AssertLockHeld(cs_main);
@@ -164,6 +164,9 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "minerids", 1 },
     { "kvsearch", 1 },
     { "kvupdate", 4 },
+    { "kvlist", 1 },
+    { "kvlist", 2 },
+    { "kvrange", 2 },
     { "z_importkey", 2 },
     { "z_importviewingkey", 2 },
     { "z_getpaymentdisclosure", 1},
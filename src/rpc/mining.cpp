@@ -495,6 +495,20 @@ UniValue getmininginfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
             "  \"pooledtx\": n              (numeric) The size of the mem pool\n"
             "  \"testnet\": true|false      (boolean) If using testnet or not\n"
             "  \"chain\": \"xxxx\",         (string) current network name as defined in BIP70 (main, test, regtest)\n"
+            "  \"blocktemplate\": {          (object) block template latency\n"
+            "    \"templates\": n,            (numeric) templates created for mining, staking and getblocktemplate\n"
+            "    \"last_ms\": x.xx,           (numeric) time to create the last template\n"
+            "    \"avg_ms\": x.xx,            (numeric) average time to create a template\n"
+            "    \"max_ms\": x.xx,            (numeric) longest time to create a template\n"
+            "    \"last_select_ms\": x.xx,    (numeric) time spent selecting transactions for the last template\n"
+            "    \"txscanned\": n,            (numeric) mempool transactions whose inputs were looked up\n"
+            "    \"txreused\": n,             (numeric) mempool transactions reused from the previous template on the same tip\n"
+            "    \"rpc_calls\": n,            (numeric) getblocktemplate calls\n"
+            "    \"rpc_reused\": n,           (numeric) getblocktemplate calls answered from the cached template\n"
+            "    \"rpc_last_ms\": x.xx,       (numeric) latency of the last getblocktemplate call\n"
+            "    \"rpc_avg_ms\": x.xx,        (numeric) average getblocktemplate latency\n"
+            "    \"rpc_max_ms\": x.xx         (numeric) highest getblocktemplate latency\n"
+            "  }\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getmininginfo", "")
@@ -532,6 +546,21 @@ UniValue getmininginfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
     obj.push_back(Pair("generate",         GetBoolArg("-gen", false) && GetBoolArg("-genproclimit", -1) != 0 ));
     obj.push_back(Pair("numthreads",       (int64_t)KOMODO_MININGTHREADS));
 #endif
+    CBlockTemplateStats stats = GetBlockTemplateStats();
+    UniValue templ(UniValue::VOBJ);
+    templ.push_back(Pair("templates",      stats.nTemplates));
+    templ.push_back(Pair("last_ms",        stats.nLastMicros * 0.001));
+    templ.push_back(Pair("avg_ms",         stats.nTemplates == 0 ? 0.0 : stats.nTotalMicros * 0.001 / stats.nTemplates));
+    templ.push_back(Pair("max_ms",         stats.nMaxMicros * 0.001));
+    templ.push_back(Pair("last_select_ms", stats.nLastSelectMicros * 0.001));
+    templ.push_back(Pair("txscanned",      stats.nTxScanned));
+    templ.push_back(Pair("txreused",       stats.nTxReused));
+    templ.push_back(Pair("rpc_calls",      stats.nRPCCalls));
+    templ.push_back(Pair("rpc_reused",     stats.nRPCReused));
+    templ.push_back(Pair("rpc_last_ms",    stats.nRPCLastMicros * 0.001));
+    templ.push_back(Pair("rpc_avg_ms",     stats.nRPCCalls == 0 ? 0.0 : stats.nRPCTotalMicros * 0.001 / stats.nRPCCalls));
+    templ.push_back(Pair("rpc_max_ms",     stats.nRPCMaxMicros * 0.001));
+    obj.push_back(Pair("blocktemplate",    templ));
     return obj;
 }
 
@@ -793,9 +822,12 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp, const CPubKey& myp
     static CBlockIndex* pindexPrev;
     static int64_t nStart;
     static CBlockTemplate* pblocktemplate;
+    int64_t nTemplateStart = GetTimeMicros();
+    bool fTemplateReused = true;
     if (pindexPrev != chainActive.Tip() ||
         (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 5))
     {
+        fTemplateReused = false;
         // Clear pindexPrev so future calls make a new block, despite any failures from here on
         pindexPrev = NULL;
 
@@ -923,6 +955,7 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp, const CPubKey& myp
     result.push_back(Pair("height", (int64_t)(pindexPrev->nHeight+1)));
 
     //LogPrintf("return complete template\n");
+    RecordGetBlockTemplate(GetTimeMicros() - nTemplateStart, fTemplateReused);
     return result;
 }
 
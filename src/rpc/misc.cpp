@@ -1181,15 +1181,13 @@ CAmount checkburnaddress(CAmount &received, int64_t &nNotaryPay, int32_t &height
     uint160 hashBytes; int type = 0; CAmount balance = 0;
     if (address.GetIndexKey(hashBytes, type, false))
     {
-        std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
-        if (GetAddressIndex(hashBytes, type, addressIndex))
+        if (ForEachAddressIndex(hashBytes, type, [&](const CAddressIndexKey &key, CAmount nValue) {
+                if (nValue > 0)
+                    received += nValue;
+                balance += nValue;
+                return true;
+            }))
         {
-            for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++)
-            {
-                if (it->second > 0)
-                    received += it->second;
-                balance += it->second;
-            }
             // Get notary pay from current chain tip
             CBlockIndex* pindex = chainActive.Tip();
             nNotaryPay = pindex->nNotaryPay;
@@ -1306,22 +1304,20 @@ UniValue getaddressbalance(const UniValue& params, bool fHelp, const CPubKey& my
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
-
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-        }
-    }
-
     CAmount balance = 0;
     CAmount received = 0;
 
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
-        if (it->second > 0) {
-            received += it->second;
+    // the records are summed as they are read, an address with a long history is never held in memory
+    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
+        if (!ForEachAddressIndex((*it).first, (*it).second, [&](const CAddressIndexKey &key, CAmount nValue) {
+                if (nValue > 0) {
+                    received += nValue;
+                }
+                balance += nValue;
+                return true;
+            })) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
         }
-        balance += it->second;
     }
 
     UniValue result(UniValue::VOBJ);
@@ -29,8 +29,11 @@
 #include "utilstrencodings.h"
 #include "asyncrpcqueue.h"
 #include "assetchain.h"
+#include "httpserver.h"
 
+#include <atomic>
 #include <memory>
+#include <thread>
 
 #include <univalue.h>
 
@@ -283,6 +286,100 @@ UniValue stop(const UniValue& params, bool fHelp, const CPubKey& mypk)
     return buf;
 }
 
+/** Per method call counters, see getrpcstats */
+struct CRPCMethodStats
+{
+    uint64_t nCalls = 0;
+    uint64_t nErrors = 0;
+    int64_t nTotalMicros = 0;
+    int64_t nMaxMicros = 0;
+};
+
+static CCriticalSection cs_rpcStats;
+static std::map<std::string, CRPCMethodStats> mapRPCStats;
+
+/** Records the duration of one call when it goes out of scope, thrown errors included */
+class CRPCMethodTimer
+{
+public:
+    bool fSuccess = false;
+
+    CRPCMethodTimer(const std::string &strMethodIn) : strMethod(strMethodIn), nStart(GetTimeMicros()) {}
+    ~CRPCMethodTimer()
+    {
+        int64_t nElapsed = GetTimeMicros() - nStart;
+        LOCK(cs_rpcStats);
+        CRPCMethodStats &stats = mapRPCStats[strMethod];
+        stats.nCalls++;
+        if (!fSuccess)
+            stats.nErrors++;
+        stats.nTotalMicros += nElapsed;
+        stats.nMaxMicros = std::max(stats.nMaxMicros, nElapsed);
+    }
+
+private:
+    std::string strMethod;
+    int64_t nStart;
+};
+
+UniValue getrpcstats(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    if (fHelp || params.size() > 0)
+        throw runtime_error(
+            "getrpcstats\n"
+            "\nReturns call counts and latencies of the RPC methods called since startup, and the HTTP work queue counters.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"methods\": {\n"
+            "    \"name\": {                (object) one entry per method called\n"
+            "      \"calls\": n,            (numeric) number of calls\n"
+            "      \"errors\": n,           (numeric) number of calls that returned an error\n"
+            "      \"avg_ms\": x.xxx,       (numeric) average duration in milliseconds\n"
+            "      \"max_ms\": x.xxx        (numeric) longest duration in milliseconds\n"
+            "    }, ...\n"
+            "  },\n"
+            "  \"workqueue\": {\n"
+            "    \"depth\": n,              (numeric) requests waiting for a worker\n"
+            "    \"max_depth\": n,          (numeric) highest depth seen\n"
+            "    \"processed\": n,          (numeric) requests handled by the workers\n"
+            "    \"rejected\": n,           (numeric) requests rejected because the queue was full\n"
+            "    \"avg_wait_ms\": x.xxx     (numeric) average time a request waited in the queue\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getrpcstats", "")
+            + HelpExampleRpc("getrpcstats", "")
+        );
+
+    UniValue methods(UniValue::VOBJ);
+    {
+        LOCK(cs_rpcStats);
+        for (std::map<std::string, CRPCMethodStats>::const_iterator it = mapRPCStats.begin(); it != mapRPCStats.end(); it++)
+        {
+            UniValue entry(UniValue::VOBJ);
+            entry.push_back(Pair("calls", (uint64_t)it->second.nCalls));
+            entry.push_back(Pair("errors", (uint64_t)it->second.nErrors));
+            entry.push_back(Pair("avg_ms", it->second.nTotalMicros * 0.001 / std::max(it->second.nCalls, (uint64_t)1)));
+            entry.push_back(Pair("max_ms", it->second.nMaxMicros * 0.001));
+            methods.push_back(Pair(it->first, entry));
+        }
+    }
+
+    HTTPWorkQueueStats queueStats;
+    UniValue workqueue(UniValue::VOBJ);
+    GetHTTPWorkQueueStats(queueStats);
+    workqueue.push_back(Pair("depth", (uint64_t)queueStats.nDepth));
+    workqueue.push_back(Pair("max_depth", (uint64_t)queueStats.nMaxDepth));
+    workqueue.push_back(Pair("processed", (uint64_t)queueStats.nProcessed));
+    workqueue.push_back(Pair("rejected", (uint64_t)queueStats.nRejected));
+    workqueue.push_back(Pair("avg_wait_ms", queueStats.nWaitMicros * 0.001 / std::max(queueStats.nProcessed, (uint64_t)1)));
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("methods", methods));
+    result.push_back(Pair("workqueue", workqueue));
+    return result;
+}
+
 /**
  * Call Table
  */
@@ -295,6 +392,7 @@ static const CRPCCommand vRPCCommands[] =
     { "control",            "getnotarysendmany",      &getnotarysendmany,      true  },
     { "control",            "geterablockheights",     &geterablockheights,     true  },
     { "control",            "stop",                   &stop,                   true  },
+    { "control",            "getrpcstats",            &getrpcstats,            true  },
 
     /* P2P networking */
     { "network",            "getnetworkinfo",         &getnetworkinfo,         true  },
@@ -324,11 +422,15 @@ static const CRPCCommand vRPCCommands[] =
     { "blockchain",         "getchaintips",           &getchaintips,           true  },
     { "blockchain",         "getdifficulty",          &getdifficulty,          true  },
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true  },
+    { "blockchain",         "getcoinscacheinfo",      &getcoinscacheinfo,      true  },
+    { "blockchain",         "getdbstats",             &getdbstats,             true  },
     { "blockchain",         "getrawmempool",          &getrawmempool,          true  },
     { "blockchain",         "gettxout",               &gettxout,               true  },
     { "blockchain",         "gettxoutproof",          &gettxoutproof,          true  },
     { "blockchain",         "verifytxoutproof",       &verifytxoutproof,       true  },
     { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true  },
+    { "blockchain",         "dumptxoutset",           &dumptxoutset,           true  },
+    { "blockchain",         "verifytxoutset",         &verifytxoutset,         true  },
     { "blockchain",         "verifychain",            &verifychain,            true  },
     { "blockchain",         "getspentinfo",           &getspentinfo,           false },
     { "blockchain",         "notaries",               &notaries,               true  },
@@ -337,6 +439,8 @@ static const CRPCCommand vRPCCommands[] =
     { "blockchain",         "minerids",               &minerids,               true  },
     { "blockchain",         "kvsearch",               &kvsearch,               true  },
     { "blockchain",         "kvupdate",               &kvupdate,               true  },
+    { "blockchain",         "kvlist",                 &kvlist,                 true  },
+    { "blockchain",         "kvrange",                &kvrange,                true  },
     { "blockchain",         "letsdebug",              &letsdebug,              true  },
 
     /* Cross chain utilities */
@@ -523,6 +627,7 @@ static const CRPCCommand vRPCCommands[] =
     { "tokens",       "tokenlist",        &tokenlist,         true },
     { "tokens",       "tokenorders",      &tokenorders,       true },
     { "tokens",       "mytokenorders",    &mytokenorders,     true },
+    { "tokens",       "tokentopofbook",   &tokentopofbook,    true },
     { "tokens",       "tokenaddress",     &tokenaddress,      true },
     { "tokens",       "tokenbalance",     &tokenbalance,      true },
     { "tokens",       "tokencreate",      &tokencreate,       true },
@@ -794,12 +899,62 @@ static UniValue JSONRPCExecOne(const UniValue& req)
     return rpc_result;
 }
 
+/**
+ * Read only methods which may run in parallel with each other inside one batch.
+ * Every RPC already has to be safe to run concurrently with calls from other HTTP workers,
+ * so this only keeps calls with side effects in the order they were sent.
+ */
+static const std::set<std::string> setConcurrentBatchMethods = {
+    "getrawtransaction", "decoderawtransaction", "decodescript", "gettxout",
+    "getblock", "getblockhash", "getblockheader", "getblockhashes",
+    "getaddressdeltas", "getaddressbalance", "getaddressutxos", "getaddresstxids", "getaddressmempool",
+    "getspentinfo", "getsnapshot", "validateaddress", "z_validateaddress",
+};
+
+static bool IsConcurrentBatchRequest(const UniValue& req)
+{
+    if (!req.isObject())
+        return false;
+    const UniValue& valMethod = find_value(req.get_obj(), "method");
+    return valMethod.isStr() && setConcurrentBatchMethods.count(valMethod.get_str()) != 0;
+}
+
 std::string JSONRPCExecBatch(const UniValue& vReq)
 {
-    UniValue ret(UniValue::VARR);
-    for (size_t reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
+    std::vector<UniValue> vResults(vReq.size());
+    int nThreads = GetArg("-rpcbatchthreads", DEFAULT_RPC_BATCH_THREADS);
+
+    for (size_t reqIdx = 0; reqIdx < vReq.size(); )
+    {
+        // run a stretch of concurrent requests on this thread and up to nThreads - 1 helpers,
+        // a request with side effects ends the stretch and runs on its own
+        size_t nEnd = reqIdx;
+        while (nEnd < vReq.size() && IsConcurrentBatchRequest(vReq[nEnd]))
+            nEnd++;
+        if (nEnd - reqIdx < 2 || nThreads < 2) {
+            vResults[reqIdx] = JSONRPCExecOne(vReq[reqIdx]);
+            reqIdx++;
+            continue;
+        }
 
+        std::atomic<size_t> nNext(reqIdx);
+        auto worker = [&]() {
+            size_t i;
+            while ((i = nNext++) < nEnd)
+                vResults[i] = JSONRPCExecOne(vReq[i]);
+        };
+        std::vector<std::thread> vHelpers;
+        for (int i = 1; i < nThreads && i < (int)(nEnd - reqIdx); i++)
+            vHelpers.emplace_back(worker);
+        worker();
+        for (std::thread &t : vHelpers)
+            t.join();
+        reqIdx = nEnd;
+    }
+
+    UniValue ret(UniValue::VARR);
+    for (size_t reqIdx = 0; reqIdx < vResults.size(); reqIdx++)
+        ret.push_back(vResults[reqIdx]);
     return ret.write() + "\n";
 }
 
@@ -821,10 +976,13 @@ UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params
 
     g_rpcSignals.PreCommand(*pcmd);
 
+    CRPCMethodTimer timer(strMethod);
     try
     {
         // Execute
-        return pcmd->actor(params, false, CPubKey());
+        UniValue result = pcmd->actor(params, false, CPubKey());
+        timer.fSuccess = true;
+        return result;
     }
     catch (const std::exception& e)
     {
@@ -206,6 +206,9 @@ extern void EnsureWalletIsUnlocked();
 bool StartRPC();
 void InterruptRPC();
 void StopRPC();
+/** Number of threads that run the read only calls of one JSON-RPC batch, including the HTTP worker serving it */
+static const int DEFAULT_RPC_BATCH_THREADS = 4;
+/** Execute a JSON-RPC batch, returning the replies in request order */
 std::string JSONRPCExecBatch(const UniValue& vReq);
 
 extern std::string experimentalDisabledHelpMsg(const std::string& rpc, const std::string& enableArg);
@@ -252,6 +255,7 @@ extern UniValue tokeninfo(const UniValue& params, bool fHelp, const CPubKey& myp
 extern UniValue tokenlist(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue tokenorders(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue mytokenorders(const UniValue& params, bool fHelp, const CPubKey& mypk);
+extern UniValue tokentopofbook(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue tokenbalance(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue assetsaddress(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue tokenaddress(const UniValue& params, bool fHelp, const CPubKey& mypk);
@@ -417,6 +421,8 @@ extern UniValue getbestblockhash(const UniValue& params, bool fHelp, const CPubK
 extern UniValue getdifficulty(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue settxfee(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getmempoolinfo(const UniValue& params, bool fHelp, const CPubKey& mypk);
+extern UniValue getcoinscacheinfo(const UniValue& params, bool fHelp, const CPubKey& mypk);
+extern UniValue getdbstats(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getrawmempool(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getblockhashes(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getblockdeltas(const UniValue& params, bool fHelp, const CPubKey& mypk);
@@ -425,6 +431,8 @@ extern UniValue getblockheader(const UniValue& params, bool fHelp, const CPubKey
 extern UniValue getlastsegidstakes(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getblock(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue gettxoutsetinfo(const UniValue& params, bool fHelp, const CPubKey& mypk);
+extern UniValue dumptxoutset(const UniValue& params, bool fHelp, const CPubKey& mypk);
+extern UniValue verifytxoutset(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue gettxout(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue verifychain(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getchaintips(const UniValue& params, bool fHelp, const CPubKey& mypk);
@@ -503,6 +511,8 @@ extern UniValue notaries(const UniValue& params, bool fHelp, const CPubKey& mypk
 extern UniValue minerids(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue kvsearch(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue kvupdate(const UniValue& params, bool fHelp, const CPubKey& mypk);
+extern UniValue kvlist(const UniValue& params, bool fHelp, const CPubKey& mypk);
+extern UniValue kvrange(const UniValue& params, bool fHelp, const CPubKey& mypk);
 
 extern UniValue letsdebug(const UniValue& params, bool fHelp, const CPubKey& mypk);
 
@@ -1403,20 +1403,23 @@ int TransactionSignatureChecker::CheckCryptoCondition(
         LogPrintf("%02x",((uint8_t *)&sighash)[z]);
     LogPrintf(" sighash nIn.%d nHashType.%d %.8f id.%d\n",(int32_t)nIn,(int32_t)nHashType,(double)amount/COIN,(int32_t)consensusBranchId);
      */
-    VerifyEval eval = [] (CC *cond, void *checker) {
-        //LogPrintf("checker.%p\n",(TransactionSignatureChecker*)checker);
-        return ((TransactionSignatureChecker*)checker)->CheckEvalCondition(cond);
+    struct EvalContext { const TransactionSignatureChecker *checker; uint32_t consensusBranchId; };
+    EvalContext context = { this, consensusBranchId };
+    VerifyEval eval = [] (CC *cond, void *context) {
+        EvalContext *ctx = (EvalContext*)context;
+        //LogPrintf("checker.%p\n",ctx->checker);
+        return ctx->checker->CheckEvalCondition(cond, ctx->consensusBranchId);
     };
     //LogPrintf("non-checker path\n");
     int out = cc_verify(cond, (const unsigned char*)&sighash, 32, 0,
-                        condBin.data(), condBin.size(), eval, (void*)this);
+                        condBin.data(), condBin.size(), eval, (void*)&context);
     //LogPrintf("out.%d from cc_verify\n",(int32_t)out);
     cc_free(cond);
     return out;
 }
 
 
-int TransactionSignatureChecker::CheckEvalCondition(const CC *cond) const
+int TransactionSignatureChecker::CheckEvalCondition(const CC *cond, uint32_t consensusBranchId) const
 {
     //LogPrintf( "Cannot check crypto-condition Eval outside of server, returning true in pre-checks\n");
     return true;
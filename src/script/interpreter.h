@@ -178,7 +178,7 @@ public:
         const std::vector<unsigned char>& ffillBin,
         const CScript& scriptCode,
         uint32_t consensusBranchId) const;
-    virtual int CheckEvalCondition(const CC *cond) const;
+    virtual int CheckEvalCondition(const CC *cond, uint32_t consensusBranchId = 0) const;
 };
 
 class MutableTransactionSignatureChecker : public TransactionSignatureChecker
@@ -22,6 +22,7 @@
 #include "script/cc.h"
 #include "cc/eval.h"
 
+#include "hash.h"
 #include "pubkey.h"
 #include "random.h"
 #include "uint256.h"
@@ -90,6 +91,55 @@ public:
     }
 };
 
+/**
+ * Valid CC eval cache, to avoid running a module's validator twice for every
+ * transaction (once when accepted into memory pool, and again when accepted
+ * into the block chain). Only modules that declare their result cacheable
+ * are stored; entries are keyed on the height the validator saw, so a result
+ * is not reused across a module's height cutoffs, and on the chain epoch so
+ * that a reorg invalidates them.
+ */
+class CCEvalCache
+{
+private:
+    std::set<uint256> setValid;
+    boost::shared_mutex cs_ccevalcache;
+
+public:
+    static uint256 Entry(const CTransaction &tx, unsigned int nIn, uint32_t consensusBranchId, int32_t nHeight, const CC *cond)
+    {
+        CHashWriter ss(SER_GETHASH, 0);
+        ss << tx.GetHash() << nIn << consensusBranchId << nHeight << CCEvalChainEpoch.load();
+        ss << std::vector<uint8_t>(cond->code, cond->code + cond->codeLength);
+        return ss.GetHash();
+    }
+
+    bool Get(const uint256 &entry)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_ccevalcache);
+        return setValid.count(entry) != 0;
+    }
+
+    void Set(const uint256 &entry)
+    {
+        int64_t nMaxCacheSize = GetArg("-maxccevalcachesize", 50000);
+        if (nMaxCacheSize <= 0) return;
+
+        boost::unique_lock<boost::shared_mutex> lock(cs_ccevalcache);
+
+        while (static_cast<int64_t>(setValid.size()) > nMaxCacheSize)
+        {
+            // Evict a random entry, as in CSignatureCache.
+            std::set<uint256>::iterator it = setValid.lower_bound(GetRandHash());
+            if (it == setValid.end())
+                it = setValid.begin();
+            setValid.erase(it);
+        }
+
+        setValid.insert(entry);
+    }
+};
+
 }
 
 bool ServerTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
@@ -116,8 +166,19 @@ bool ServerTransactionSignatureChecker::VerifySignature(const std::vector<unsign
  * code without pulling the whole bitcoin server code into bitcoin common was
  * using this class. Thus it has been renamed to ServerTransactionSignatureChecker.
  */
-int ServerTransactionSignatureChecker::CheckEvalCondition(const CC *cond) const
+int ServerTransactionSignatureChecker::CheckEvalCondition(const CC *cond, uint32_t consensusBranchId) const
 {
+    static CCEvalCache ccEvalCache;
+
+    uint256 entry = CCEvalCache::Entry(*txTo, nIn, consensusBranchId, CCEvalHeight(), cond);
+    if (ccEvalCache.Get(entry))
+        return true;
+
     //LogPrintf("call RunCCeval from ServerTransactionSignatureChecker::CheckEvalCondition\n");
-    return RunCCEval(cond, *txTo, nIn);
+    if (!RunCCEval(cond, *txTo, nIn))
+        return false;
+
+    if (store && IsCCEvalCacheable(cond))
+        ccEvalCache.Set(entry);
+    return true;
 }
@@ -37,7 +37,7 @@ public:
     ServerTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nIn, const CAmount& amount, bool storeIn) : TransactionSignatureChecker(txToIn, nIn, amount), store(storeIn) {}
 
     bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
-    int CheckEvalCondition(const CC *cond) const;
+    int CheckEvalCondition(const CC *cond, uint32_t consensusBranchId = 0) const;
 };
 
 #endif // BITCOIN_SCRIPT_SERVERCHECKER_H
@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+#include <cryptoconditions.h>
+
+#include "cc/eval.h"
+#include "cc/utils.h"
+#include "chain.h"
+#include "main.h"
+#include "random.h"
+#include "script/cc.h"
+#include "script/serverchecker.h"
+
+#include "komodo_extern_globals.h"
+
+// ./komodo-test --gtest_filter=TestCCEvalCache.*
+namespace TestCCEvalCache {
+
+    /** a tokens spend without an opreturn, which TokensValidate only passes on ROGUE up to height 12500 */
+    class TestCCEvalCache : public ::testing::Test
+    {
+    protected:
+        assetchain oldChainName;
+        uint32_t oldCC;
+        int32_t oldConnecting;
+        CBlockIndex *oldTip;
+        CBlockIndex index;
+        CTransaction tx;
+        CC *cond;
+
+        void SetUp() override
+        {
+            oldChainName = chainName;
+            oldCC = ASSETCHAINS_CC;
+            oldConnecting = KOMODO_CONNECTING;
+            chainName = assetchain("ROGUE");
+            ASSETCHAINS_CC = 2;
+            {
+                LOCK(cs_main);
+                oldTip = chainActive.Tip();
+            }
+
+            CMutableTransaction mtx;
+            mtx.vin.resize(1);
+            mtx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+            mtx.vout.push_back(CTxOut(1, CScript() << OP_TRUE));
+            tx = CTransaction(mtx);
+            cond = CCNewEval(E_MARSHAL(ss << (uint8_t)EVAL_TOKENS));
+        }
+
+        void TearDown() override
+        {
+            cc_free(cond);
+            {
+                LOCK(cs_main);
+                chainActive.SetTip(oldTip);
+            }
+            KOMODO_CONNECTING = oldConnecting;
+            ASSETCHAINS_CC = oldCC;
+            chainName = oldChainName;
+        }
+
+        /** evaluate cond with the chain at nHeight, as mempool accept (connecting the next block) does */
+        bool Check(int32_t nHeight, int32_t connecting, bool store)
+        {
+            LOCK(cs_main);
+            index.nHeight = nHeight;
+            chainActive.SetTip(&index);
+            KOMODO_CONNECTING = connecting;
+            ServerTransactionSignatureChecker checker(&tx, 0, 1, store);
+            return checker.CheckEvalCondition(cond) != 0;
+        }
+    };
+
+    TEST_F(TestCCEvalCache, height_cutoff)
+    {
+        // passed and cached below the cutoff
+        EXPECT_TRUE(Check(12500, (1 << 30) + 12501, true));
+        EXPECT_TRUE(Check(12500, 12501, false));
+
+        // the same tx above the cutoff is evaluated again, and fails
+        EXPECT_FALSE(Check(12501, 12502, false));
+        EXPECT_FALSE(Check(12501, (1 << 30) + 12502, true));
+        EXPECT_FALSE(Check(12501, 12502, false));
+    }
+
+    TEST_F(TestCCEvalCache, not_connecting)
+    {
+        // the validator is skipped while not connecting, so the pass is not cached
+        EXPECT_TRUE(Check(20000, -1, true));
+        EXPECT_FALSE(Check(20000, 20001, false));
+    }
+
+} // namespace TestCCEvalCache
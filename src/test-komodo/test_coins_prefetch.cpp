@@ -0,0 +1,120 @@
+#include <gtest/gtest.h>
+#include "coins.h"
+#include "random.h"
+
+#include <mutex>
+
+namespace TestCoinsPrefetch {
+
+    // A base view that can be read from several threads and counts the reads
+    class CCoinsViewCounting : public CCoinsView
+    {
+    public:
+        std::map<uint256, CCoins> mapCoins;
+        mutable std::mutex mutex;
+        mutable int nReads = 0;
+
+        bool GetCoins(const uint256 &txid, CCoins &coins) const
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            nReads++;
+            auto it = mapCoins.find(txid);
+            if (it == mapCoins.end())
+                return false;
+            coins = it->second;
+            return true;
+        }
+        bool HaveCoins(const uint256 &txid) const
+        {
+            CCoins coins;
+            return GetCoins(txid, coins);
+        }
+    };
+
+    TEST(TestCoinsPrefetch, loadsmissingcoins)
+    {
+        CCoinsViewCounting base;
+        std::vector<uint256> vTxids;
+        for (int i = 0; i < 200; i++)
+        {
+            uint256 txid = GetRandHash();
+            CCoins coins;
+            coins.vout.resize(2);
+            coins.vout[1].nValue = i + 1;
+            coins.nHeight = i;
+            base.mapCoins[txid] = coins;
+            vTxids.push_back(txid);
+        }
+        vTxids.push_back(vTxids[0]); // duplicate
+        vTxids.push_back(GetRandHash()); // unknown
+
+        CCoinsViewCache cache(&base);
+        ASSERT_EQ(cache.PrefetchCoins(vTxids, 4), (size_t)201);
+        ASSERT_EQ(base.nReads, 201);
+        ASSERT_EQ(cache.GetCacheSize(), 200u);
+
+        // everything found is now served from the cache
+        for (int i = 0; i < 200; i++)
+        {
+            const CCoins *coins = cache.AccessCoins(vTxids[i]);
+            ASSERT_TRUE(coins != NULL);
+            ASSERT_EQ(coins->vout[1].nValue, i + 1);
+            ASSERT_EQ(coins->nHeight, i);
+        }
+        ASSERT_EQ(base.nReads, 201);
+
+        // a second prefetch only reads what is still missing
+        ASSERT_EQ(cache.PrefetchCoins(vTxids, 4), (size_t)1);
+        ASSERT_EQ(base.nReads, 202);
+    }
+
+    TEST(TestCoinsPrefetch, extractdirtyandtrim)
+    {
+        CCoinsViewCounting base;
+        std::vector<uint256> vTxids;
+        for (int i = 0; i < 100; i++)
+        {
+            uint256 txid = GetRandHash();
+            CCoins coins;
+            coins.vout.resize(1);
+            coins.vout[0].nValue = i + 1;
+            base.mapCoins[txid] = coins;
+            vTxids.push_back(txid);
+        }
+        CCoinsViewCache cache(&base);
+        cache.PrefetchCoins(vTxids, 1);
+        {
+            CCoinsModifier coins = cache.ModifyCoins(vTxids[0]);
+            coins->vout[0].nValue = 1000;
+        }
+
+        // only the modified entry is dirty, and it stays cached after extraction
+        CCoinsCacheDelta delta;
+        cache.ExtractDirty(delta);
+        ASSERT_EQ(delta.mapCoins.size(), (size_t)1);
+        ASSERT_EQ(delta.mapCoins.begin()->second.coins.vout[0].nValue, 1000);
+        ASSERT_EQ(cache.GetCacheSize(), 100u);
+        CCoinsCacheDelta empty;
+        cache.ExtractDirty(empty);
+        ASSERT_EQ(empty.GetCount(), (size_t)0);
+
+        // recently used entries survive eviction
+        cache.AccessCoins(vTxids[50]);
+        ASSERT_EQ(cache.Trim(0), (size_t)100);
+        ASSERT_EQ(cache.GetCacheSize(), 0u);
+        cache.PrefetchCoins(vTxids, 1);
+        cache.AccessCoins(vTxids[50]);
+        {
+            CCoinsModifier coins = cache.ModifyCoins(vTxids[1]);
+            coins->vout[0].nValue = 2000;
+        }
+        size_t nUsage = cache.DynamicMemoryUsage();
+        ASSERT_GT(cache.Trim(nUsage / 2), (size_t)0);
+        ASSERT_LE(cache.DynamicMemoryUsage(), nUsage / 2);
+        int nReads = base.nReads;
+        ASSERT_EQ(cache.AccessCoins(vTxids[50])->vout[0].nValue, 51);
+        ASSERT_EQ(cache.AccessCoins(vTxids[1])->vout[0].nValue, 2000);
+        ASSERT_EQ(base.nReads, nReads);
+    }
+
+}
@@ -11,6 +11,12 @@
 
 #include "testutils.h"
 
+// the two condition encoders behind cc_conditionBinary, from cryptoconditions/src/internal.h
+extern "C" {
+size_t derConditionBinary(const CC *cond, uint8_t *buf, size_t bufLength);
+size_t asnConditionBinary(const CC *cond, unsigned char *buf);
+}
+
 
 
 class CCTest : public ::testing::Test {
@@ -198,3 +204,109 @@ TEST_F(CCTest, testLargeCondition)
     EXPECT_EQ(1744, CCSig(cond).size());
     ASSERT_TRUE(CCVerify(mtxTo, cond));
 }
+
+
+static void ExpectDerMatchesAsn(const CC *cond)
+{
+    unsigned char der[1000], asn[1000];
+    size_t derLength = derConditionBinary(cond, der, sizeof(der));
+    size_t asnLength = asnConditionBinary(cond, asn);
+    ASSERT_GT(derLength, 0u);
+    ASSERT_EQ(asnLength, derLength);
+    EXPECT_EQ(0, memcmp(der, asn, derLength));
+}
+
+
+TEST_F(CCTest, testDerConditionBinary)
+{
+    CKey otherKey;
+    otherKey.MakeNewKey(true);
+
+    CC *cond = CCNewSecp256k1(notaryKey.GetPubKey());
+    ExpectDerMatchesAsn(cond);
+    cc_free(cond);
+
+    cond = CCNewEval({ 0xe4, 0x01 });
+    ExpectDerMatchesAsn(cond);
+    cc_free(cond);
+
+    cond = CCNewThreshold(2, { CCNewThreshold(1, { CCNewSecp256k1(notaryKey.GetPubKey()),
+                                                   CCNewSecp256k1(otherKey.GetPubKey()) }),
+                               CCNewEval({ 0xe4 }), CCNewSecp256k1(otherKey.GetPubKey()) });
+    ExpectDerMatchesAsn(cond);
+    cc_free(cond);
+
+    std::vector<CC*> ccs;
+    for (int i=0; i<18; i++)
+        ccs.push_back(CCNewSecp256k1(notaryKey.GetPubKey()));
+    cond = CCNewThreshold(16, ccs);
+    ExpectDerMatchesAsn(cond);
+    cc_free(cond);
+
+    // a partially signed 1of2 reads back with the unsigned branch as an anonymous condition
+    CC *signedCond = CCNewThreshold(1, { CCNewSecp256k1(notaryKey.GetPubKey()), CCNewSecp256k1(otherKey.GetPubKey()) });
+    CMutableTransaction mtx;
+    CCSign(mtx, signedCond);
+    unsigned char ffill[2048];
+    size_t ffillLength = cc_fulfillmentBinary(signedCond, ffill, sizeof(ffill));
+    CC *parsed = cc_readFulfillmentBinary(ffill, ffillLength);
+    ASSERT_TRUE(parsed != NULL);
+    ExpectDerMatchesAsn(parsed);
+    unsigned char a[1000], b[1000];
+    size_t aLength = cc_conditionBinary(signedCond, a);
+    ASSERT_EQ(aLength, cc_conditionBinary(parsed, b));
+    EXPECT_EQ(0, memcmp(a, b, aLength));
+    cc_free(parsed);
+    cc_free(signedCond);
+}
+
+
+static CC *NewEvalThreshold(int n)
+{
+    std::vector<CC*> ccs;
+    for (int i=0; i<n; i++)
+        ccs.push_back(CCNewEval({ (unsigned char)(i >> 8), (unsigned char)i }));
+    return CCNewThreshold(n, ccs);
+}
+
+
+TEST_F(CCTest, testDerConditionBinaryLargeThreshold)
+{
+    unsigned char der[1000];
+
+    // the largest threshold of evals whose fingerprint contents fit in the asn1c buffer
+    CC *cond = NewEvalThreshold(99);
+    ExpectDerMatchesAsn(cond);
+    cc_free(cond);
+
+    // past that asn1c fails the fingerprint, the DER path must not produce one either
+    cond = NewEvalThreshold(100);
+    EXPECT_EQ(0u, derConditionBinary(cond, der, sizeof(der)));
+    cc_free(cond);
+
+    // 255 subfulfillments still read back through the DER reader
+    cond = NewEvalThreshold(255);
+    EXPECT_EQ(0u, derConditionBinary(cond, der, sizeof(der)));
+    unsigned char ffill[2048];
+    size_t ffillLength = cc_fulfillmentBinary(cond, ffill, sizeof(ffill));
+    ASSERT_GT(ffillLength, 0u);
+    CC *parsed = cc_readFulfillmentBinary(ffill, ffillLength);
+    ASSERT_TRUE(parsed != NULL);
+    EXPECT_EQ(cond->size, parsed->size);
+    cc_free(parsed);
+    cc_free(cond);
+
+    // 300 eval subfulfillments fit in a fulfillment but not in a CC, both readers reject them
+    std::vector<unsigned char> big = { 0xa2, 0x82, 0x07, 0x0e, 0xa0, 0x82, 0x07, 0x08 };
+    for (int i=0; i<300; i++) {
+        std::vector<unsigned char> eval = { 0xaf, 0x04, 0x80, 0x02, (unsigned char)(i >> 8), (unsigned char)i };
+        big.insert(big.end(), eval.begin(), eval.end());
+    }
+    big.push_back(0xa1);
+    big.push_back(0x00);
+    ASSERT_LE(big.size(), 2048u);
+    EXPECT_TRUE(cc_readFulfillmentBinary(big.data(), big.size()) == NULL);
+    CC *ext = NULL;
+    cc_readFulfillmentBinaryExt(big.data(), big.size(), &ext);
+    EXPECT_TRUE(ext == NULL);
+}
@@ -0,0 +1,106 @@
+#include <gtest/gtest.h>
+#include <boost/filesystem.hpp>
+#include "dbwrapper.h"
+#include "util.h"
+
+namespace TestDBWrapper {
+
+    class RangeCursorTest : public ::testing::Test
+    {
+    protected:
+        CDBWrapper dbw;
+
+        RangeCursorTest() : dbw(GetTempPath() / boost::filesystem::unique_path(), 1 << 20, true, false) {}
+
+        void SetUp() override
+        {
+            for (char prefix : {'a', 'b', 'c'}) {
+                for (int x = 0x00; x < 256; ++x) {
+                    uint8_t key = x;
+                    uint32_t value = x*x;
+                    ASSERT_TRUE(dbw.Write(std::make_pair(prefix, key), value));
+                }
+            }
+        }
+    };
+
+    TEST_F(RangeCursorTest, whole_prefix)
+    {
+        // the whole prefix, and nothing of the records around it
+        int count = 0;
+        CDBRangeCursor cursor(dbw.NewRangeCursor('b'));
+        bool fOk = cursor.ForEach<std::pair<char, uint8_t>, uint32_t>([&](const std::pair<char, uint8_t> &key, uint32_t value) {
+            EXPECT_EQ(key.first, 'b');
+            EXPECT_EQ(key.second, count);
+            EXPECT_EQ(value, (uint32_t)(count*count));
+            count++;
+            return true;
+        });
+        EXPECT_TRUE(fOk);
+        EXPECT_EQ(count, 256);
+        EXPECT_FALSE(cursor.Valid());
+    }
+
+    TEST_F(RangeCursorTest, seek_and_upper_bound)
+    {
+        CDBRangeCursor range(dbw.NewRangeCursor('b'));
+        range.Seek(std::make_pair('b', (uint8_t)0x10));
+        range.SetUpperBound(std::make_pair('b', (uint8_t)0x20));
+        for (int x = 0x10; x < 0x20; ++x) {
+            std::pair<char, uint8_t> key;
+            uint32_t value;
+            ASSERT_TRUE(range.Valid());
+            EXPECT_TRUE(range.GetKey(key));
+            EXPECT_TRUE(range.GetValue(value));
+            EXPECT_EQ(key.second, x);
+            EXPECT_EQ(value, (uint32_t)(x*x));
+            range.Next();
+        }
+        EXPECT_FALSE(range.Valid());
+
+        // a bound past the prefix stops at the end of the prefix
+        int count = 0;
+        CDBRangeCursor past(dbw.NewRangeCursor('a'));
+        past.SetUpperBound('z');
+        EXPECT_TRUE((past.ForEach<std::pair<char, uint8_t>, uint32_t>([&](const std::pair<char, uint8_t> &key, uint32_t value) {
+            count++;
+            return true;
+        })));
+        EXPECT_EQ(count, 256);
+    }
+
+    TEST_F(RangeCursorTest, stop_early)
+    {
+        int count = 0;
+        CDBRangeCursor early(dbw.NewRangeCursor('c'));
+        bool fOk = early.ForEach<std::pair<char, uint8_t>, uint32_t>([&](const std::pair<char, uint8_t> &key, uint32_t value) {
+            return ++count < 5;
+        });
+        EXPECT_TRUE(fOk);
+        EXPECT_EQ(count, 5);
+    }
+
+    TEST_F(RangeCursorTest, undecodable)
+    {
+        // a value too short for the type is reported
+        CDBRangeCursor wrongtype(dbw.NewRangeCursor('a'));
+        EXPECT_FALSE((wrongtype.ForEach<std::pair<char, uint8_t>, uint64_t>([&](const std::pair<char, uint8_t> &key, uint64_t value) {
+            return true;
+        })));
+
+        // a key too short for the type ends the range: 'd' 00000000..03000000, then 'd' 05, then 'd' 06000000
+        for (uint32_t x = 0; x < 4; x++)
+            ASSERT_TRUE(dbw.Write(std::make_pair('d', x), x));
+        ASSERT_TRUE(dbw.Write(std::make_pair('d', (uint8_t)5), (uint32_t)5));
+        ASSERT_TRUE(dbw.Write(std::make_pair('d', (uint32_t)6), (uint32_t)6));
+        std::vector<uint32_t> keys;
+        CDBRangeCursor shortkey(dbw.NewRangeCursor('d'));
+        EXPECT_TRUE((shortkey.ForEach<std::pair<char, uint32_t>, uint32_t>([&](const std::pair<char, uint32_t> &key, uint32_t value) {
+            keys.push_back(key.second);
+            return true;
+        })));
+        EXPECT_EQ(keys, std::vector<uint32_t>({0, 1, 2, 3}));
+        EXPECT_TRUE(shortkey.Valid());
+    }
+
+} // namespace TestDBWrapper
@@ -0,0 +1,166 @@
+#include <gtest/gtest.h>
+#include <boost/filesystem.hpp>
+#include "komodo_defs.h"
+#include "komodo_events.h"
+#include "komodo_kv.h"
+#include "komodo_structs.h"
+#include "komodo_utils.h"
+#include "util.h"
+
+namespace TestKV {
+
+    char symbol[] = "TST";
+
+    class KVIndexTest : public ::testing::Test
+    {
+    protected:
+        komodo_state state;
+
+        static void SetUpTestCase()
+        {
+            chainName = assetchain("TST");
+            // the index opens under the data directory on first use
+            ClearDatadirCache();
+            boost::filesystem::path temp = GetTempPath() / boost::filesystem::unique_path();
+            boost::filesystem::create_directories(temp);
+            mapArgs["-datadir"] = temp.string();
+        }
+
+        void SetUp() override
+        {
+            // an earlier test may have left records, a rewind with no events clears them
+            komodo_event_rewind(&state,symbol,1);
+        }
+
+        /** a KV update carried by the block at height */
+        static komodo::event_opreturn Opret(int32_t height,const std::string &key,const std::string &value,uint32_t flags = 0)
+        {
+            komodo::event_opreturn ev(height);
+            uint16_t keylen = key.size(), valuesize = value.size();
+            ev.opret.resize(13 + keylen + valuesize);
+            ev.opret[0] = 'K';
+            iguana_rwnum(1,&ev.opret[1],sizeof(keylen),&keylen);
+            iguana_rwnum(1,&ev.opret[3],sizeof(valuesize),&valuesize);
+            iguana_rwnum(1,&ev.opret[5],sizeof(height),&height);
+            iguana_rwnum(1,&ev.opret[9],sizeof(flags),&flags);
+            memcpy(&ev.opret[13],key.data(),keylen);
+            memcpy(&ev.opret[13+keylen],value.data(),valuesize);
+            ev.value = 1000000;
+            return ev;
+        }
+
+        /** add a KV update to the events, as komodostate does */
+        void Update(int32_t height,const std::string &key,const std::string &value,uint32_t flags = 0)
+        {
+            komodo::event_opreturn ev = Opret(height,key,value,flags);
+            komodo_eventadd_opreturn(&state,symbol,height,ev);
+        }
+
+        /** the live value of key at current_height, "-" if there is none */
+        std::string Lookup(const std::string &key,int32_t current_height)
+        {
+            uint256 pubkey; uint32_t flags; int32_t height;
+            uint8_t value[IGUANA_MAXSCRIPTSIZE];
+            int32_t len = komodo_kvsearch(&pubkey,current_height,&flags,&height,value,(uint8_t *)key.data(),key.size());
+            if ( len < 0 )
+                return "-";
+            return std::string((char *)value,len);
+        }
+
+        /** every key in the index, expired or not */
+        std::string Keys()
+        {
+            std::vector<komodo_kvitem> items;
+            std::string keys;
+            komodo_kvlist(items,0,"","",0,1000);
+            for (const komodo_kvitem &item : items)
+                keys += item.key;
+            return keys;
+        }
+    };
+
+    TEST_F(KVIndexTest, undo)
+    {
+        Update(10,"a","one");
+        Update(20,"a","two");
+        Update(20,"b","x");
+        Update(30,"c","y");
+        EXPECT_EQ(Lookup("a",30), "two");
+        EXPECT_EQ(Keys(), "abc");
+
+        komodo_event_rewind(&state,symbol,20);
+        EXPECT_EQ(Lookup("a",30), "one");
+        EXPECT_EQ(Lookup("b",30), "-");
+        EXPECT_EQ(Lookup("c",30), "-");
+        EXPECT_EQ(Keys(), "a");
+
+        // the blocks connected after the rewind are stored again
+        Update(20,"b","z");
+        EXPECT_EQ(Lookup("b",30), "z");
+
+        // connecting a block below the best one again replaces what it and the later blocks wrote
+        Update(25,"c","q");
+        Update(20,"b","w");
+        EXPECT_EQ(Lookup("b",30), "w");
+        EXPECT_EQ(Lookup("c",30), "-");
+        EXPECT_EQ(Lookup("a",30), "one");
+    }
+
+    TEST_F(KVIndexTest, deep_rewind)
+    {
+        Update(10,"a","one");
+        Update(50,"c","c50");
+        Update(60,"c","c60");
+        // enough blocks that the undo data of the first ones is dropped
+        for (int32_t height=100; height<=400; height+=10)
+            Update(height,"d",std::to_string(height));
+        EXPECT_EQ(Lookup("d",400), "400");
+
+        komodo_event_rewind(&state,symbol,60);
+        EXPECT_EQ(Lookup("a",60), "one");
+        EXPECT_EQ(Lookup("c",60), "c50");
+        EXPECT_EQ(Lookup("d",60), "-");
+        EXPECT_EQ(Keys(), "ac");
+
+        // the rebuilt index holds everything below the rewind, a restart skips those events
+        komodo::event_opreturn replayed = Opret(40,"a","replayed");
+        komodo_kvreplay(true);
+        komodo_kvupdate(replayed.opret.data(),replayed.opret.size(),replayed.value,40);
+        komodo_kvreplay(false);
+        EXPECT_EQ(Lookup("a",60), "one");
+
+        // and has undo data again for the blocks connected after it
+        Update(60,"d","d60");
+        Update(70,"c","c70");
+        EXPECT_EQ(Keys(), "acd");
+        komodo_event_rewind(&state,symbol,65);
+        EXPECT_EQ(Lookup("c",70), "c50");
+        EXPECT_EQ(Lookup("d",70), "d60");
+    }
+
+    TEST_F(KVIndexTest, sweep)
+    {
+        Update(10,"a","one");
+        Update(1000,"b","two");
+        int32_t expiry = 10 + KOMODO_KVDURATION;
+        EXPECT_EQ(Lookup("a",expiry), "one");
+        EXPECT_EQ(Lookup("a",expiry+1), "-");
+
+        // expired but not swept yet, still listed
+        komodo_kvsweep(expiry);
+        EXPECT_EQ(Keys(), "ab");
+        komodo_kvsweep(expiry+1);
+        EXPECT_EQ(Keys(), "b");
+
+        // undoing the block that swept puts the record back
+        komodo_event_rewind(&state,symbol,expiry+1);
+        EXPECT_EQ(Keys(), "ab");
+        EXPECT_EQ(Lookup("a",expiry), "one");
+
+        // an expired key is written as a new one
+        Update(expiry+1,"a","three");
+        EXPECT_EQ(Lookup("a",expiry+1), "three");
+        EXPECT_EQ(Lookup("b",expiry+1), "two");
+    }
+
+} // namespace TestKV
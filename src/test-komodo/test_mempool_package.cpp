@@ -0,0 +1,74 @@
+#include <gtest/gtest.h>
+#include "amount.h"
+#include "random.h"
+#include "txmempool.h"
+
+namespace TestMempoolPackage {
+
+    /** a chain of unconfirmed transactions, each spending the one before it */
+    class AncestorPackageTest : public ::testing::Test
+    {
+    protected:
+        CTxMemPool pool;
+        std::vector<CTransaction> chain;
+        std::vector<CAmount> fees;
+        size_t nTotalSize;
+
+        AncestorPackageTest() : pool(CFeeRate(0)), nTotalSize(0) {}
+
+        void SetUp() override
+        {
+            uint256 prevout = GetRandHash();
+            for (int i = 0; i < 5; i++) {
+                CMutableTransaction mtx;
+                mtx.vin.resize(1);
+                mtx.vin[0].prevout = COutPoint(prevout, 0);
+                mtx.vout.push_back(CTxOut((10 - i) * COIN, CScript() << OP_TRUE));
+                CTransaction tx(mtx);
+                chain.push_back(tx);
+                fees.push_back(1000 * (i + 1));
+                CTxMemPoolEntry entry(tx, fees.back(), 0, 0.0, 1, i == 0, false, 0);
+                nTotalSize += entry.GetTxSize();
+                pool.addUnchecked(tx.GetHash(), entry);
+                prevout = tx.GetHash();
+            }
+        }
+    };
+
+    TEST_F(AncestorPackageTest, whole_package)
+    {
+        CAmount nFees; size_t nSize; std::set<uint256> setAncestors;
+        ASSERT_TRUE(pool.CalculateAncestorPackage(chain.back().GetHash(), 4, nFees, nSize, setAncestors));
+        EXPECT_EQ(setAncestors.size(), 4u);
+        EXPECT_EQ(nFees, 1000 + 2000 + 3000 + 4000 + 5000);
+        EXPECT_EQ(nSize, nTotalSize);
+
+        // a prioritisation delta counts toward the package
+        pool.PrioritiseTransaction(chain[0].GetHash(), chain[0].GetHash().ToString(), 0.0, 500);
+        setAncestors.clear();
+        ASSERT_TRUE(pool.CalculateAncestorPackage(chain.back().GetHash(), 4, nFees, nSize, setAncestors));
+        EXPECT_EQ(nFees, 15500);
+
+        // a transaction without unconfirmed parents is its own package
+        setAncestors.clear();
+        ASSERT_TRUE(pool.CalculateAncestorPackage(chain[0].GetHash(), 0, nFees, nSize, setAncestors));
+        EXPECT_TRUE(setAncestors.empty());
+        EXPECT_EQ(nFees, 1500);
+    }
+
+    TEST_F(AncestorPackageTest, too_many_ancestors)
+    {
+        // the limit cuts the package short, which is reported instead of returning part of it
+        CAmount nFees; size_t nSize; std::set<uint256> setAncestors;
+        EXPECT_FALSE(pool.CalculateAncestorPackage(chain.back().GetHash(), 3, nFees, nSize, setAncestors));
+        setAncestors.clear();
+        EXPECT_FALSE(pool.CalculateAncestorPackage(chain.back().GetHash(), 0, nFees, nSize, setAncestors));
+        setAncestors.clear();
+        EXPECT_TRUE(pool.CalculateAncestorPackage(chain[3].GetHash(), 3, nFees, nSize, setAncestors));
+        EXPECT_EQ(nFees, 1000 + 2000 + 3000 + 4000);
+
+        setAncestors.clear();
+        EXPECT_FALSE(pool.CalculateAncestorPackage(GetRandHash(), 10, nFees, nSize, setAncestors));
+    }
+
+} // namespace TestMempoolPackage
@@ -0,0 +1,191 @@
+#include <gtest/gtest.h>
+#include "coins.h"
+#include "crypto/muhash.h"
+#include "main.h"
+#include "random.h"
+#include "txdb.h"
+
+namespace TestMuHash {
+
+    /** the set holding the one 32 byte element {i, 0, ...} */
+    MuHash3072 FromInt(unsigned char i)
+    {
+        unsigned char tmp[32] = {i, 0};
+        MuHash3072 muhash;
+        muhash.Insert(tmp, sizeof(tmp));
+        return muhash;
+    }
+
+    TEST(TestMuHash, known_answers)
+    {
+        // the same vectors as the upstream MuHash3072
+        MuHash3072 acc = FromInt(0);
+        acc *= FromInt(1);
+        acc /= FromInt(2);
+        EXPECT_EQ(FinalizeMuHash(acc).GetHex(), "10d312b100cbd32ada024a6646e40d3482fcff103668d2625f10002a607d5863");
+
+        MuHash3072 acc2 = FromInt(0);
+        unsigned char tmp[32] = {1, 0};
+        acc2.Insert(tmp, sizeof(tmp));
+        unsigned char tmp2[32] = {2, 0};
+        acc2.Remove(tmp2, sizeof(tmp2));
+        EXPECT_EQ(FinalizeMuHash(acc2).GetHex(), "10d312b100cbd32ada024a6646e40d3482fcff103668d2625f10002a607d5863");
+
+        EXPECT_EQ(FinalizeMuHash(MuHash3072()).GetHex(), "dd5ad2a105c2d29495f577245c357409002329b9f4d6182c0af3dc2f462555c8");
+    }
+
+    TEST(TestMuHash, insert_remove)
+    {
+        uint256 empty = FinalizeMuHash(MuHash3072());
+        for (int iter = 0; iter < 10; iter++) {
+            // the same set in any order, with removals before or after the insertions they cancel
+            int table[4];
+            for (int i = 0; i < 4; i++)
+                table[i] = insecure_rand() & 7;
+            uint256 first;
+            for (int order = 0; order < 4; order++) {
+                MuHash3072 acc;
+                for (int i = 0; i < 4; i++) {
+                    int t = table[i ^ order];
+                    if (t & 4)
+                        acc /= FromInt(t & 3);
+                    else
+                        acc *= FromInt(t & 3);
+                }
+                uint256 out = FinalizeMuHash(acc);
+                if (order == 0)
+                    first = out;
+                else
+                    EXPECT_EQ(first, out);
+            }
+
+            // x * y / (y * x) is the empty set
+            MuHash3072 x = FromInt(insecure_rand() & 15);
+            MuHash3072 y = FromInt(insecure_rand() & 15);
+            MuHash3072 z;
+            z *= x;
+            z *= y;
+            y *= x;
+            z /= y;
+            EXPECT_EQ(FinalizeMuHash(z), empty);
+        }
+
+        // the state survives a round trip, denominator included
+        MuHash3072 acc = FromInt(3);
+        acc /= FromInt(4);
+        unsigned char state[MuHash3072::STATE_SIZE];
+        acc.ToBytes(state);
+        MuHash3072 restored;
+        restored.FromBytes(state);
+        EXPECT_EQ(FinalizeMuHash(restored), FinalizeMuHash(acc));
+        EXPECT_NE(FinalizeMuHash(restored), empty);
+    }
+
+    class CCoinsViewDBTest : public CCoinsViewDB
+    {
+    public:
+        CCoinsViewDBTest() : CCoinsViewDB(1 << 20, true, true) {}
+
+        /** forget the running commitment, as a chainstate from an older version has none */
+        void DropCommitment()
+        {
+            LOCK(cs_commitment);
+            fCommitmentValid = false;
+            commitment = CCoinsCommitment();
+        }
+    };
+
+    /** flush the cache as the block hashBlock, the scan looks its height up */
+    void FlushAs(CCoinsViewCache &cache, const uint256 &hashBlock, CBlockIndex &index)
+    {
+        {
+            LOCK(cs_main);
+            mapBlockIndex[hashBlock] = &index;
+        }
+        cache.SetBestBlock(hashBlock);
+        EXPECT_TRUE(cache.Flush());
+    }
+
+    TEST(TestMuHash, commitment_matches_scan)
+    {
+        CCoinsViewDBTest db;
+        CBlockIndex index[3];
+        uint256 hashBlock[3];
+        std::vector<uint256> txids;
+        for (int i = 0; i < 3; i++) {
+            index[i].nHeight = i + 1;
+            hashBlock[i] = GetRandHash();
+        }
+
+        CCoinsViewCache cache(&db);
+        for (int i = 0; i < 20; i++) {
+            uint256 txid = GetRandHash();
+            CCoinsModifier coins = cache.ModifyCoins(txid);
+            coins->nVersion = 1;
+            coins->nHeight = 1;
+            coins->fCoinBase = i == 0;
+            coins->vout.resize(3);
+            for (int n = 0; n < 3; n++) {
+                coins->vout[n].nValue = 1000 * (i + 1) + n;
+                coins->vout[n].scriptPubKey = CScript() << OP_TRUE;
+            }
+            txids.push_back(txid);
+        }
+        FlushAs(cache, hashBlock[0], index[0]);
+
+        // spend some outputs, whole transactions and outputs added in the same flush
+        for (int i = 0; i < 10; i++) {
+            CCoinsModifier coins = cache.ModifyCoins(txids[i]);
+            coins->Spend(i % 3);
+            if (i < 3) {
+                coins->Spend((i + 1) % 3);
+                coins->Spend((i + 2) % 3);
+            }
+        }
+        for (int i = 0; i < 5; i++) {
+            uint256 txid = GetRandHash();
+            CCoinsModifier coins = cache.ModifyCoins(txid);
+            coins->nVersion = 1;
+            coins->nHeight = 2;
+            coins->vout.resize(2);
+            coins->vout[0].nValue = 7 + i;
+            coins->vout[1].nValue = 9 + i;
+            if (i == 4)
+                coins->Spend(1);
+        }
+        FlushAs(cache, hashBlock[1], index[1]);
+
+        CCoinsStats running, scanned;
+        ASSERT_TRUE(db.GetCommitmentStats(running));
+        ASSERT_TRUE(db.GetStats(scanned));
+        EXPECT_EQ(running.hashBlock, hashBlock[1]);
+        EXPECT_EQ(running.nHeight, 2);
+        EXPECT_EQ(running.hashMuHash, scanned.hashMuHash);
+        EXPECT_EQ(running.nTransactions, scanned.nTransactions);
+        EXPECT_EQ(running.nTransactionOutputs, scanned.nTransactionOutputs);
+        EXPECT_EQ(running.nTotalAmount, scanned.nTotalAmount);
+        EXPECT_EQ(scanned.nTransactions, (uint64_t)22);
+        EXPECT_EQ(scanned.nTransactionOutputs, (uint64_t)(7 * 2 + 10 * 3 + 9));
+
+        // without a stored commitment the first query builds it from a scan, and later flushes carry on from there
+        db.DropCommitment();
+        CCoinsStats rebuilt;
+        ASSERT_TRUE(db.GetCommitmentStats(rebuilt));
+        EXPECT_EQ(rebuilt.hashMuHash, scanned.hashMuHash);
+        {
+            CCoinsModifier coins = cache.ModifyCoins(txids[19]);
+            coins->Spend(0);
+        }
+        FlushAs(cache, hashBlock[2], index[2]);
+        ASSERT_TRUE(db.GetCommitmentStats(running));
+        ASSERT_TRUE(db.GetStats(scanned));
+        EXPECT_EQ(running.hashMuHash, scanned.hashMuHash);
+        EXPECT_NE(running.hashMuHash, rebuilt.hashMuHash);
+        EXPECT_EQ(running.nTotalAmount, scanned.nTotalAmount);
+
+        LOCK(cs_main);
+        for (int i = 0; i < 3; i++)
+            mapBlockIndex.erase(hashBlock[i]);
+    }
+
+} // namespace TestMuHash
@@ -0,0 +1,195 @@
+#include <gtest/gtest.h>
+#include "primitives/transaction.h"
+#include "random.h"
+#include "univalue.h"
+#include "komodo_nSPV_defs.h"
+
+// the superlite caches are defined in komodo_nSPV_superlite.h, which is built into main.cpp
+int32_t NSPV_txproof_find(struct NSPV_txproof *dest,uint256 txid);
+void NSPV_txproof_add(struct NSPV_txproof *ptr);
+void NSPV_txproof_purge(struct NSPV_txproof *ptr);
+int32_t NSPV_ntzsresp_find(struct NSPV_ntzsresp *dest,int32_t reqheight);
+void NSPV_ntzsresp_add(struct NSPV_ntzsresp *ptr);
+int32_t NSPV_ntzsproof_find(struct NSPV_ntzsproofresp *dest,uint256 prevtxid,uint256 nexttxid);
+void NSPV_ntzsproof_add(struct NSPV_ntzsproofresp *ptr);
+void NSPV_ntzsproofresp_purge(struct NSPV_ntzsproofresp *ptr);
+
+namespace TestNSPVCache {
+
+    // NSPV_CACHE_NTZS, NSPV_CACHE_NTZSPROOFS and NSPV_CACHE_TXPROOFS
+    const int32_t CACHE_NTZS = NSPV_MAXVINS;
+    const int32_t CACHE_NTZSPROOFS = NSPV_MAXVINS * 2;
+    const int32_t CACHE_TXPROOFS = NSPV_MAXVINS * 4;
+
+    /** a txproof whose tx and proof bytes are filled with fill */
+    struct NSPV_txproof MakeTxproof(uint256 txid,uint8_t fill,int32_t txprooflen = 40)
+    {
+        struct NSPV_txproof P;
+        memset(&P,0,sizeof(P));
+        P.txid = txid;
+        P.height = 777;
+        P.txlen = 100;
+        P.tx = (uint8_t *)malloc(P.txlen);
+        memset(P.tx,fill,P.txlen);
+        if ( (P.txprooflen= txprooflen) > 0 )
+        {
+            P.txproof = (uint8_t *)malloc(P.txprooflen);
+            memset(P.txproof,fill,P.txprooflen);
+        }
+        return P;
+    }
+
+    bool Filled(const uint8_t *ptr,int32_t len,uint8_t fill)
+    {
+        for (int32_t i=0; i<len; i++)
+            if ( ptr[i] != fill )
+                return false;
+        return true;
+    }
+
+    TEST(TestNSPVCache, txproof_hit_miss)
+    {
+        uint256 txid = GetRandHash();
+        struct NSPV_txproof P = MakeTxproof(txid,0x11), Q;
+        EXPECT_EQ(NSPV_txproof_find(0,txid), 0);
+        NSPV_txproof_add(&P);
+        NSPV_txproof_purge(&P);
+
+        // the copy owns its buffers
+        memset(&Q,0,sizeof(Q));
+        ASSERT_EQ(NSPV_txproof_find(&Q,txid), 1);
+        EXPECT_EQ(Q.txid, txid);
+        EXPECT_EQ(Q.height, 777);
+        ASSERT_EQ(Q.txlen, 100);
+        ASSERT_EQ(Q.txprooflen, 40);
+        EXPECT_TRUE(Filled(Q.tx,Q.txlen,0x11));
+        EXPECT_TRUE(Filled(Q.txproof,Q.txprooflen,0x11));
+        NSPV_txproof_purge(&Q);
+        EXPECT_EQ(NSPV_txproof_find(0,txid), 1);
+
+        // a miss leaves dest alone
+        memset(&Q,0,sizeof(Q));
+        EXPECT_EQ(NSPV_txproof_find(&Q,GetRandHash()), 0);
+        EXPECT_TRUE(Q.tx == 0 && Q.txproof == 0 && Q.txid.IsNull());
+    }
+
+    TEST(TestNSPVCache, txproof_proof_replaces)
+    {
+        uint256 txid = GetRandHash();
+        struct NSPV_txproof P = MakeTxproof(txid,0x22,0), Q;
+        NSPV_txproof_add(&P);
+        NSPV_txproof_purge(&P);
+        memset(&Q,0,sizeof(Q));
+        ASSERT_EQ(NSPV_txproof_find(&Q,txid), 1);
+        EXPECT_EQ(Q.txprooflen, 0);
+        NSPV_txproof_purge(&Q);
+
+        // an entry without merkle proof is replaced by one with it, but not the other way round
+        P = MakeTxproof(txid,0x33);
+        NSPV_txproof_add(&P);
+        NSPV_txproof_purge(&P);
+        P = MakeTxproof(txid,0x44,0);
+        NSPV_txproof_add(&P);
+        NSPV_txproof_purge(&P);
+        ASSERT_EQ(NSPV_txproof_find(&Q,txid), 1);
+        ASSERT_EQ(Q.txprooflen, 40);
+        EXPECT_TRUE(Filled(Q.txproof,Q.txprooflen,0x33));
+        NSPV_txproof_purge(&Q);
+    }
+
+    TEST(TestNSPVCache, txproof_eviction)
+    {
+        uint256 first = GetRandHash(), last;
+        struct NSPV_txproof P = MakeTxproof(first,0x55), Q;
+        NSPV_txproof_add(&P);
+        NSPV_txproof_purge(&P);
+        memset(&Q,0,sizeof(Q));
+        ASSERT_EQ(NSPV_txproof_find(&Q,first), 1);
+
+        // a full cache drops the oldest entry, the copy taken before stays valid
+        for (int32_t i=0; i<CACHE_TXPROOFS; i++)
+        {
+            last = GetRandHash();
+            P = MakeTxproof(last,0x66);
+            NSPV_txproof_add(&P);
+            NSPV_txproof_purge(&P);
+        }
+        EXPECT_EQ(NSPV_txproof_find(0,first), 0);
+        EXPECT_EQ(NSPV_txproof_find(0,last), 1);
+        EXPECT_TRUE(Filled(Q.tx,Q.txlen,0x55));
+        EXPECT_TRUE(Filled(Q.txproof,Q.txprooflen,0x55));
+        NSPV_txproof_purge(&Q);
+    }
+
+    TEST(TestNSPVCache, ntzsresp)
+    {
+        struct NSPV_ntzsresp N,R;
+        int32_t base = 1000000 + (GetRand(1000) * 1000);
+        memset(&N,0,sizeof(N));
+        N.reqheight = base;
+        N.prevntz.height = base - 5;
+        N.nextntz.height = base + 5;
+        N.prevntz.txid = GetRandHash();
+        EXPECT_EQ(NSPV_ntzsresp_find(0,base), 0);
+        NSPV_ntzsresp_add(&N);
+
+        memset(&R,0,sizeof(R));
+        ASSERT_EQ(NSPV_ntzsresp_find(&R,base), 1);
+        EXPECT_EQ(R.reqheight, base);
+        EXPECT_EQ(R.prevntz.txid, N.prevntz.txid);
+        EXPECT_EQ(R.nextntz.height, base + 5);
+        EXPECT_EQ(NSPV_ntzsresp_find(0,base + 1), 0);
+
+        // the oldest goes first
+        for (int32_t i=1; i<=CACHE_NTZS; i++)
+        {
+            N.reqheight = base + i;
+            NSPV_ntzsresp_add(&N);
+        }
+        EXPECT_EQ(NSPV_ntzsresp_find(0,base), 0);
+        EXPECT_EQ(NSPV_ntzsresp_find(0,base + 1), 1);
+        EXPECT_EQ(NSPV_ntzsresp_find(0,base + CACHE_NTZS), 1);
+        EXPECT_EQ(R.reqheight, base);
+    }
+
+    TEST(TestNSPVCache, ntzsproof)
+    {
+        struct NSPV_ntzsproofresp P,R;
+        uint256 prevtxid = GetRandHash(), nexttxid = GetRandHash();
+        memset(&P,0,sizeof(P));
+        P.prevtxid = prevtxid;
+        P.nexttxid = nexttxid;
+        P.common.numhdrs = 3;
+        P.common.hdrs = (struct NSPV_equihdr *)calloc(P.common.numhdrs,sizeof(*P.common.hdrs));
+        P.common.hdrs[2].nTime = 12345;
+        P.prevtxlen = 10;
+        P.prevntz = (uint8_t *)malloc(P.prevtxlen);
+        memset(P.prevntz,0x77,P.prevtxlen);
+        EXPECT_EQ(NSPV_ntzsproof_find(0,prevtxid,nexttxid), 0);
+        NSPV_ntzsproof_add(&P);
+        NSPV_ntzsproofresp_purge(&P);
+
+        memset(&R,0,sizeof(R));
+        ASSERT_EQ(NSPV_ntzsproof_find(&R,prevtxid,nexttxid), 1);
+        ASSERT_EQ(R.common.numhdrs, 3);
+        EXPECT_EQ(R.common.hdrs[2].nTime, 12345u);
+        ASSERT_EQ(R.prevtxlen, 10);
+        EXPECT_TRUE(Filled(R.prevntz,R.prevtxlen,0x77));
+        EXPECT_TRUE(R.nextntz == 0);
+        EXPECT_EQ(NSPV_ntzsproof_find(0,nexttxid,prevtxid), 0);
+
+        // evicted while the copy is still in use
+        for (int32_t i=0; i<CACHE_NTZSPROOFS; i++)
+        {
+            memset(&P,0,sizeof(P));
+            P.prevtxid = GetRandHash();
+            P.nexttxid = nexttxid;
+            NSPV_ntzsproof_add(&P);
+        }
+        EXPECT_EQ(NSPV_ntzsproof_find(0,prevtxid,nexttxid), 0);
+        EXPECT_EQ(R.common.hdrs[2].nTime, 12345u);
+        EXPECT_TRUE(Filled(R.prevntz,R.prevtxlen,0x77));
+        NSPV_ntzsproofresp_purge(&R);
+    }
+
+} // namespace TestNSPVCache
@@ -0,0 +1,468 @@
+#include <gtest/gtest.h>
+#include <boost/filesystem.hpp>
+#include "dbwrapper.h"
+#include "main.h"
+#include "random.h"
+#include "txdb.h"
+#include "util.h"
+#include "testutils.h"
+
+namespace TestTxDB {
+
+    typedef std::map<std::string, std::string> RawRecords;
+
+    /** every record of db as raw key and value bytes */
+    RawRecords Records(CDBWrapper &db)
+    {
+        RawRecords records;
+        boost::scoped_ptr<CDBIterator> pcursor(db.NewIterator());
+        for (pcursor->SeekToFirst(); pcursor->Valid(); pcursor->Next()) {
+            CDataStream ssKey(SER_DISK, CLIENT_VERSION), ssValue(SER_DISK, CLIENT_VERSION);
+            EXPECT_TRUE(pcursor->GetKeyDataStream(ssKey));
+            EXPECT_TRUE(pcursor->GetValueDataStream(ssValue));
+            records[std::string(ssKey.begin(), ssKey.end())] = std::string(ssValue.begin(), ssValue.end());
+        }
+        return records;
+    }
+
+    /** the address, unspent, spent, timestamp and index best block records */
+    bool IsIndexRecord(const std::string &key)
+    {
+        return !key.empty() && std::string("dupSzI").find(key[0]) != std::string::npos;
+    }
+
+    void Split(const RawRecords &records, RawRecords &index, RawRecords &other)
+    {
+        for (const RawRecords::value_type &record : records)
+            (IsIndexRecord(record.first) ? index : other).insert(record);
+    }
+
+    class MoveIndexRecordsTest : public ::testing::Test
+    {
+    protected:
+        CBlockTreeDB blocktree;
+        CDBWrapper indexdb;
+        uint160 addressHash;
+        uint256 txid, blockhash;
+        RawRecords index, other;
+
+        MoveIndexRecordsTest() : blocktree(1 << 20, true, true),
+            indexdb(GetTempPath() / boost::filesystem::unique_path(), 1 << 20, true, true) {}
+
+        void SetUp() override
+        {
+            GetRandBytes(addressHash.begin(), addressHash.size());
+            txid = GetRandHash();
+            blockhash = GetRandHash();
+
+            // more address records than one batch of the move holds
+            std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+            for (int i = 0; i < 100010; i++)
+                addressIndex.push_back(std::make_pair(CAddressIndexKey(1, addressHash, 1 + i / 10, i % 10, txid, i, false), (CAmount)i));
+            ASSERT_TRUE(blocktree.WriteAddressIndex(addressIndex));
+
+            std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspent;
+            unspent.push_back(std::make_pair(CAddressUnspentKey(1, addressHash, txid, 0), CAddressUnspentValue(50, CScript() << OP_TRUE, 7)));
+            ASSERT_TRUE(blocktree.UpdateAddressUnspentIndex(unspent));
+
+            std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spent;
+            spent.push_back(std::make_pair(CSpentIndexKey(txid, 0), CSpentIndexValue(GetRandHash(), 1, 8, 50, 1, addressHash)));
+            ASSERT_TRUE(blocktree.UpdateSpentIndex(spent));
+
+            ASSERT_TRUE(blocktree.WriteTimestampIndex(CTimestampIndexKey(1234, blockhash)));
+            ASSERT_TRUE(blocktree.WriteTimestampBlockIndex(CTimestampBlockIndexKey(blockhash), CTimestampBlockIndexValue(1234)));
+            ASSERT_TRUE(blocktree.WriteIndexBestBlock(blockhash));
+
+            // records that stay in the block index database
+            ASSERT_TRUE(blocktree.WriteFlag("addressindex", true));
+            ASSERT_TRUE(blocktree.WriteReindexing(true));
+
+            Split(Records(blocktree), index, other);
+            ASSERT_EQ(index.size(), (size_t)(100010 + 5));
+            ASSERT_FALSE(other.empty());
+        }
+
+        /** the index records are in the block index database, and nowhere else */
+        void ExpectJoined()
+        {
+            RawRecords records = Records(blocktree), joined = other;
+            joined.insert(index.begin(), index.end());
+            EXPECT_TRUE(records == joined);
+            EXPECT_TRUE(indexdb.IsEmpty());
+        }
+
+        /** the index records are in the index database, and nowhere else */
+        void ExpectSplit()
+        {
+            EXPECT_TRUE(Records(blocktree) == other);
+            EXPECT_TRUE(Records(indexdb) == index);
+        }
+
+        /** the records read back through the block index database */
+        void ExpectReadable()
+        {
+            std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+            ASSERT_TRUE(blocktree.ReadAddressIndex(addressHash, 1, addressIndex));
+            EXPECT_EQ(addressIndex.size(), (size_t)100010);
+            std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspent;
+            ASSERT_TRUE(blocktree.ReadAddressUnspentIndex(addressHash, 1, unspent));
+            ASSERT_EQ(unspent.size(), (size_t)1);
+            EXPECT_EQ(unspent[0].second.satoshis, 50);
+            CSpentIndexKey spentKey(txid, 0);
+            CSpentIndexValue spentValue;
+            ASSERT_TRUE(blocktree.ReadSpentIndex(spentKey, spentValue));
+            EXPECT_EQ(spentValue.blockHeight, 8);
+            unsigned int logicalTS = 0;
+            ASSERT_TRUE(blocktree.ReadTimestampBlockIndex(blockhash, logicalTS));
+            EXPECT_EQ(logicalTS, 1234u);
+            uint256 hashBest;
+            ASSERT_TRUE(blocktree.ReadIndexBestBlock(hashBest));
+            EXPECT_EQ(hashBest, blockhash);
+            bool fValue = false;
+            ASSERT_TRUE(blocktree.ReadFlag("addressindex", fValue));
+            EXPECT_TRUE(fValue);
+        }
+    };
+
+    TEST_F(MoveIndexRecordsTest, split_and_join)
+    {
+        ASSERT_TRUE(CBlockTreeDB::MoveIndexRecords(blocktree, indexdb));
+        ExpectSplit();
+
+        // nothing left to move
+        ASSERT_TRUE(CBlockTreeDB::MoveIndexRecords(blocktree, indexdb));
+        ExpectSplit();
+
+        ASSERT_TRUE(CBlockTreeDB::MoveIndexRecords(indexdb, blocktree));
+        ExpectJoined();
+        ExpectReadable();
+    }
+
+    TEST_F(MoveIndexRecordsTest, interrupted)
+    {
+        // the state a move leaves behind when it stops between batches, and between the
+        // write of a batch and the erase of its originals
+        CDBBatch batchTo(indexdb), batchFrom(blocktree);
+        size_t n = 0;
+        for (const RawRecords::value_type &record : index) {
+            CDataStream ssKey(record.first.data(), record.first.data() + record.first.size(), SER_DISK, CLIENT_VERSION);
+            CDataStream ssValue(record.second.data(), record.second.data() + record.second.size(), SER_DISK, CLIENT_VERSION);
+            if (n < index.size() / 2)
+                batchTo.Write(ssKey, ssValue);
+            if (n < index.size() / 4)
+                batchFrom.Erase(ssKey);
+            n++;
+        }
+        ASSERT_TRUE(indexdb.WriteBatch(batchTo, true));
+        ASSERT_TRUE(blocktree.WriteBatch(batchFrom));
+
+        // running it again finishes the move
+        ASSERT_TRUE(CBlockTreeDB::MoveIndexRecords(blocktree, indexdb));
+        ExpectSplit();
+
+        // and the same for a move back that stopped half way
+        CDBBatch batchBack(blocktree);
+        n = 0;
+        for (const RawRecords::value_type &record : index) {
+            CDataStream ssKey(record.first.data(), record.first.data() + record.first.size(), SER_DISK, CLIENT_VERSION);
+            CDataStream ssValue(record.second.data(), record.second.data() + record.second.size(), SER_DISK, CLIENT_VERSION);
+            if (n >= index.size() / 3)
+                break;
+            batchBack.Write(ssKey, ssValue);
+            n++;
+        }
+        ASSERT_TRUE(blocktree.WriteBatch(batchBack, true));
+        ASSERT_TRUE(CBlockTreeDB::MoveIndexRecords(indexdb, blocktree));
+        ExpectJoined();
+        ExpectReadable();
+    }
+
+    class IndexRangeTest : public ::testing::Test
+    {
+    protected:
+        CBlockTreeDB blocktree;
+        uint160 addressHash;
+        std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+        std::vector<std::pair<uint256, unsigned int> > timestamps;
+
+        IndexRangeTest() : blocktree(1 << 20, true, true) {}
+
+        void SetUp() override
+        {
+            GetRandBytes(addressHash.begin(), addressHash.size());
+            uint160 otherHash = addressHash;
+            *otherHash.begin() ^= 1;
+
+            // three records at each of the heights 1..20, and the same heights for another
+            // address and for another type of the same address
+            std::vector<std::pair<CAddressIndexKey, CAmount> > records;
+            for (int height = 1; height <= 20; height++) {
+                for (int i = 0; i < 3; i++) {
+                    CAddressIndexKey key(1, addressHash, height, i, GetRandHash(), 0, i == 2);
+                    addressIndex.push_back(std::make_pair(key, (CAmount)(height * 10 + i)));
+                    records.push_back(addressIndex.back());
+                    records.push_back(std::make_pair(CAddressIndexKey(1, otherHash, height, i, GetRandHash(), 0, false), (CAmount)1));
+                    records.push_back(std::make_pair(CAddressIndexKey(2, addressHash, height, i, GetRandHash(), 0, false), (CAmount)1));
+                }
+            }
+            ASSERT_TRUE(blocktree.WriteAddressIndex(records));
+
+            for (unsigned int timestamp = 100; timestamp <= 120; timestamp++) {
+                for (int i = 0; i < 2; i++) {
+                    timestamps.push_back(std::make_pair(GetRandHash(), timestamp));
+                    ASSERT_TRUE(blocktree.WriteTimestampIndex(CTimestampIndexKey(timestamp, timestamps.back().first)));
+                }
+            }
+        }
+
+        /** the records the scan stopping at the first height past end returned */
+        std::vector<std::pair<CAddressIndexKey, CAmount> > ExpectedAddressIndex(int start, int end)
+        {
+            std::vector<std::pair<CAddressIndexKey, CAmount> > expected;
+            for (const std::pair<CAddressIndexKey, CAmount> &record : addressIndex) {
+                if (start > 0 && end > 0 && record.first.blockHeight < start)
+                    continue;
+                if (end > 0 && record.first.blockHeight > end)
+                    continue;
+                expected.push_back(record);
+            }
+            return expected;
+        }
+
+        void ExpectAddressIndex(int start, int end)
+        {
+            std::vector<std::pair<CAddressIndexKey, CAmount> > expected = ExpectedAddressIndex(start, end), read;
+            ASSERT_TRUE(blocktree.ReadAddressIndex(addressHash, 1, read, start, end));
+            ASSERT_EQ(read.size(), expected.size()) << "start " << start << " end " << end;
+            for (size_t i = 0; i < read.size(); i++) {
+                EXPECT_EQ(read[i].first.blockHeight, expected[i].first.blockHeight);
+                EXPECT_EQ(read[i].first.txindex, expected[i].first.txindex);
+                EXPECT_EQ(read[i].first.txhash, expected[i].first.txhash);
+                EXPECT_EQ(read[i].first.spending, expected[i].first.spending);
+                EXPECT_EQ(read[i].second, expected[i].second);
+            }
+        }
+
+        /** the blocks the scan stopping at the first timestamp at or past high returned */
+        void ExpectTimestampIndex(unsigned int high, unsigned int low)
+        {
+            std::vector<std::pair<uint256, unsigned int> > expected, read;
+            for (const std::pair<uint256, unsigned int> &timestamp : timestamps)
+                if (timestamp.second >= low && timestamp.second < high)
+                    expected.push_back(timestamp);
+            ASSERT_TRUE(blocktree.ReadTimestampIndex(high, low, false, read));
+            std::sort(expected.begin(), expected.end());
+            std::sort(read.begin(), read.end());
+            EXPECT_TRUE(read == expected) << "high " << high << " low " << low;
+        }
+    };
+
+    TEST_F(IndexRangeTest, address_index_bounds)
+    {
+        ExpectAddressIndex(0, 0);
+        ExpectAddressIndex(5, 10);
+        ExpectAddressIndex(10, 10);
+        ExpectAddressIndex(0, 10);
+        ExpectAddressIndex(1, 20);
+        ExpectAddressIndex(15, 100);
+        ExpectAddressIndex(21, 30);
+        ExpectAddressIndex(1, std::numeric_limits<int>::max());
+        // a start without an end is ignored
+        ExpectAddressIndex(5, 0);
+
+        // the streaming visitor sees the same records, and can stop early
+        int count = 0;
+        ASSERT_TRUE(blocktree.ForEachAddressIndex(addressHash, 1, [&](const CAddressIndexKey &key, CAmount nValue) {
+            EXPECT_GE(key.blockHeight, 5);
+            EXPECT_LE(key.blockHeight, 10);
+            return ++count < 4;
+        }, 5, 10));
+        EXPECT_EQ(count, 4);
+    }
+
+    TEST_F(IndexRangeTest, timestamp_index_bounds)
+    {
+        ExpectTimestampIndex(110, 105);
+        ExpectTimestampIndex(106, 105);
+        ExpectTimestampIndex(105, 105);
+        ExpectTimestampIndex(121, 100);
+        ExpectTimestampIndex(200, 0);
+        ExpectTimestampIndex(std::numeric_limits<unsigned int>::max(), 0);
+        ExpectTimestampIndex(100, 0);
+        ExpectTimestampIndex(105, 110);
+    }
+
+    /** a txindex entry as written before the block hash and height were stored */
+    struct CDiskTxPosOld : public CDiskBlockPos
+    {
+        unsigned int nTxOffset;
+
+        ADD_SERIALIZE_METHODS;
+
+        template <typename Stream, typename Operation>
+        inline void SerializationOp(Stream& s, Operation ser_action) {
+            READWRITE(*(CDiskBlockPos*)this);
+            READWRITE(VARINT(nTxOffset));
+        }
+
+        CDiskTxPosOld(const CDiskBlockPos &blockIn, unsigned int nTxOffsetIn) : CDiskBlockPos(blockIn), nTxOffset(nTxOffsetIn) {}
+    };
+
+    TEST(TestDiskTxPos, serialization)
+    {
+        uint256 hashBlock = GetRandHash();
+        CDiskTxPos pos(CDiskBlockPos(3, 100000), 81, hashBlock, 123456);
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        ss << pos;
+        CDiskTxPos read;
+        ss >> read;
+        EXPECT_TRUE(ss.empty());
+        EXPECT_EQ(read.nFile, 3);
+        EXPECT_EQ(read.nPos, 100000u);
+        EXPECT_EQ(read.nTxOffset, 81u);
+        EXPECT_EQ(read.hashBlock, hashBlock);
+        EXPECT_EQ(read.nHeight, 123456);
+
+        // the genesis height is written too
+        ss << CDiskTxPos(CDiskBlockPos(0, 8), 1, hashBlock, 0);
+        ss >> read;
+        EXPECT_EQ(read.nHeight, 0);
+
+        // an old entry ends after the offset, and reads without block
+        ss << CDiskTxPosOld(CDiskBlockPos(3, 100000), 81);
+        EXPECT_EQ(ss.size(), ::GetSerializeSize(CDiskBlockPos(3, 100000), SER_DISK, CLIENT_VERSION) + 1);
+        ss >> read;
+        EXPECT_TRUE(ss.empty());
+        EXPECT_EQ(read.nFile, 3);
+        EXPECT_EQ(read.nPos, 100000u);
+        EXPECT_EQ(read.nTxOffset, 81u);
+        EXPECT_TRUE(read.hashBlock.IsNull());
+        EXPECT_EQ(read.nHeight, -1);
+    }
+
+    class TxIndexUpgradeTest : public ::testing::Test
+    {
+    protected:
+        static void SetUpTestCase() { setupChain(); }
+    };
+
+    TEST_F(TxIndexUpgradeTest, old_entry_is_upgraded)
+    {
+        CBlock block;
+        generateBlock(&block);
+        uint256 txid = block.vtx[0].GetHash(), hashBlock;
+        int nHeight;
+        {
+            LOCK(cs_main);
+            nHeight = mapBlockIndex[block.GetHash()]->nHeight;
+        }
+        ASSERT_TRUE(fTxIndex);
+
+        // connecting the block wrote the entry with its block
+        CDiskTxPos pos;
+        ASSERT_TRUE(pblocktree->ReadTxIndex(txid, pos));
+        EXPECT_EQ(pos.hashBlock, block.GetHash());
+        EXPECT_EQ(pos.nHeight, nHeight);
+
+        // put it back the way an older node wrote it
+        ASSERT_TRUE(pblocktree->Write(std::make_pair('t', txid), CDiskTxPosOld(pos, pos.nTxOffset)));
+        CDiskTxPos old;
+        ASSERT_TRUE(pblocktree->ReadTxIndex(txid, old));
+        EXPECT_TRUE(old.hashBlock.IsNull());
+        EXPECT_EQ(old.nHeight, -1);
+        EXPECT_EQ(old.nFile, pos.nFile);
+        EXPECT_EQ(old.nPos, pos.nPos);
+        EXPECT_EQ(old.nTxOffset, pos.nTxOffset);
+
+        // the lookup finds the block from the header on disk, and rewrites the entry
+        CTransaction tx;
+        ASSERT_TRUE(GetTransaction(txid, tx, hashBlock, false));
+        EXPECT_EQ(tx.GetHash(), txid);
+        EXPECT_EQ(hashBlock, block.GetHash());
+        CDiskTxPos upgraded;
+        ASSERT_TRUE(pblocktree->ReadTxIndex(txid, upgraded));
+        EXPECT_EQ(upgraded.hashBlock, block.GetHash());
+        EXPECT_EQ(upgraded.nHeight, nHeight);
+        EXPECT_EQ(upgraded.nFile, pos.nFile);
+        EXPECT_EQ(upgraded.nPos, pos.nPos);
+        EXPECT_EQ(upgraded.nTxOffset, pos.nTxOffset);
+    }
+
+    TEST(TestDBStats, parse_compaction_stats)
+    {
+        std::string strStats =
+            "                               Compactions\n"
+            "Level  Files Size(MB) Time(sec) Read(MB) Write(MB)\n"
+            "--------------------------------------------------\n"
+            "  0        2        1         0        0         3\n"
+            "  1        5        8         2        9         8\n"
+            "  2       11       20         1        4         5\n";
+        CDBStats stats;
+        CDBWrapper::ParseCompactionStats(strStats, stats);
+        EXPECT_EQ(stats.nFiles, 18);
+        EXPECT_EQ(stats.nCompactionSeconds, 3.0);
+        EXPECT_EQ(stats.nCompactionReadMB, 13.0);
+        EXPECT_EQ(stats.nCompactionWriteMB, 16.0);
+
+        // the totals add up, and a table without rows adds nothing
+        CDBWrapper::ParseCompactionStats("                               Compactions\n"
+            "Level  Files Size(MB) Time(sec) Read(MB) Write(MB)\n"
+            "--------------------------------------------------\n", stats);
+        CDBWrapper::ParseCompactionStats("", stats);
+        CDBWrapper::ParseCompactionStats(strStats, stats);
+        EXPECT_EQ(stats.nFiles, 36);
+        EXPECT_EQ(stats.nCompactionWriteMB, 32.0);
+    }
+
+    TEST(TestDBStats, get_stats)
+    {
+        boost::filesystem::path path = GetTempPath() / boost::filesystem::unique_path();
+        std::string strName;
+        {
+            CDBWrapper db(path, 1 << 20, false, true);
+            CDBStats stats = db.GetStats();
+            // named relative to the data directory when it is below it
+            strName = stats.strName;
+            EXPECT_EQ(boost::filesystem::path(strName).filename(), path.filename());
+            EXPECT_EQ(stats.nReads, 0u);
+            EXPECT_EQ(stats.nBatches, 0u);
+            EXPECT_EQ(stats.nFiles, 0);
+
+            uint256 value = GetRandHash(), res;
+            ASSERT_TRUE(db.Write('k', value));
+            CDBBatch batch(db);
+            for (int i = 0; i < 1000; i++)
+                batch.Write(std::make_pair('b', i), GetRandHash());
+            ASSERT_TRUE(db.WriteBatch(batch));
+            EXPECT_TRUE(db.Read('k', res));
+            EXPECT_FALSE(db.Read('x', res));
+            EXPECT_TRUE(db.Exists('k'));
+
+            stats = db.GetStats();
+            EXPECT_EQ(stats.nReads, 3u);
+            EXPECT_EQ(stats.nReadsFound, 2u);
+            EXPECT_EQ(stats.nBatches, 2u);
+            EXPECT_GT(stats.nMemoryUsage, 0u);
+
+            // listed with the other open databases
+            int nFound = 0;
+            for (const CDBStats &open : CDBWrapper::GetAllStats())
+                if (open.strName == strName)
+                    nFound++;
+            EXPECT_EQ(nFound, 1);
+        }
+        for (const CDBStats &open : CDBWrapper::GetAllStats())
+            EXPECT_NE(open.strName, strName);
+
+        // reopening writes the log out as a table file, which the stats count
+        {
+            CDBWrapper db(path, 1 << 20, false, false);
+            CDBStats stats = db.GetStats();
+            EXPECT_GT(stats.nFiles, 0);
+            EXPECT_GT(stats.nApproximateSize, 0u);
+            EXPECT_EQ(stats.nReads, 0u);
+        }
+        boost::filesystem::remove_all(path);
+    }
+
+} // namespace TestTxDB
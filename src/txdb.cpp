@@ -34,6 +34,11 @@
 
 #include <stdint.h>
 
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#include <boost/filesystem.hpp>
 #include <boost/thread.hpp>
 
 using namespace std;
@@ -52,6 +57,9 @@ static const char DB_ADDRESSUNSPENTINDEX = 'u';
 static const char DB_TIMESTAMPINDEX = 'S';
 static const char DB_BLOCKHASHINDEX = 'z';
 static const char DB_SPENTINDEX = 'p';
+static const char DB_ORACLESDATAINDEX = 'O';
+static const char DB_TOKENSINDEX = 'K';
+static const char DB_TOKENSOUTPUT = 'k';
 static const char DB_BLOCK_INDEX = 'b';
 
 static const char DB_BEST_BLOCK = 'B';
@@ -60,13 +68,33 @@ static const char DB_BEST_SAPLING_ANCHOR = 'z';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_COINS_COMMITMENT = 'M';
+static const char DB_INDEX_BEST_BLOCK = 'I';
 
 
 CCoinsViewDB::CCoinsViewDB(std::string dbName, size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / dbName, nCacheSize, fMemory, fWipe) {
+    ReadCommitment();
 }
 
 CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe)
 {
+    ReadCommitment();
+}
+
+void CCoinsViewDB::ReadCommitment()
+{
+    fCommitmentValid = false;
+    fCommitmentScanning = false;
+    uint256 hashBest;
+    if (!db.Read(DB_BEST_BLOCK, hashBest)) {
+        // A new database, the commitment starts out as the empty set.
+        fCommitmentValid = true;
+    } else if (db.Read(DB_COINS_COMMITMENT, commitment) && commitment.hashBlock == hashBest) {
+        fCommitmentValid = true;
+    } else {
+        // Written by a version that did not keep the commitment; it is rebuilt on first use.
+        commitment = CCoinsCommitment();
+    }
 }
 
 
@@ -189,8 +217,19 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins,
     CDBBatch batch(db);
     size_t count = 0;
     size_t changed = 0;
+    LOCK(cs_commitment);
+    bool fTrack = fCommitmentValid || fCommitmentScanning;
+    CCoinsCommitment delta;
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
+            if (fTrack) {
+                // A FRESH entry is known not to be in the database, so there is nothing to take out.
+                CCoins coinsOld;
+                if (!(it->second.flags & CCoinsCacheEntry::FRESH) && db.Read(make_pair(DB_COINS, it->first), coinsOld))
+                    delta.Apply(it->first, coinsOld, false);
+                if (!it->second.coins.IsPruned())
+                    delta.Apply(it->first, it->second.coins, true);
+            }
             if (it->second.coins.IsPruned())
                 batch.Erase(make_pair(DB_COINS, it->first));
             else
@@ -215,11 +254,105 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins,
     if (!hashSaplingAnchor.IsNull())
         batch.Write(DB_BEST_SAPLING_ANCHOR, hashSaplingAnchor);
 
+    delta.hashBlock = hashBlock;
+    CCoinsCommitment updated;
+    if (fCommitmentValid) {
+        updated = commitment;
+        updated += delta;
+        batch.Write(DB_COINS_COMMITMENT, updated);
+    }
+
     LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
-    return db.WriteBatch(batch);
+    if (!db.WriteBatch(batch))
+        return false;
+    if (fCommitmentValid)
+        commitment = updated;
+    else if (fCommitmentScanning)
+        commitmentPending += delta;
+    return true;
+}
+
+/** The index database takes mostly batched appends and prefix scans: favour the write buffers over
+    the block cache and use larger table files, so that there are fewer, less frequent compactions */
+static CDBTuning IndexDBTuning()
+{
+    CDBTuning tuning;
+    tuning.nBlockCachePercent = 30;
+    tuning.nWriteBufferPercent = 35;
+    tuning.nMaxFileSize = 8 << 20;
+    return tuning;
+}
+
+CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe, bool compression, int maxOpenFiles, size_t nIndexCacheSize) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe, compression, maxOpenFiles) {
+    pindexdb = NULL;
+    boost::filesystem::path indexpath = GetDataDir() / "blocks" / "addressindex";
+    if (nIndexCacheSize != 0)
+        pindexdb = new CDBWrapper(indexpath, nIndexCacheSize, fMemory, fWipe, compression, maxOpenFiles, IndexDBTuning());
+    else if (fWipe && !fMemory && boost::filesystem::exists(indexpath))
+        boost::filesystem::remove_all(indexpath);
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe, bool compression, int maxOpenFiles) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe, compression, maxOpenFiles) {
+CBlockTreeDB::~CBlockTreeDB() {
+    delete pindexdb;
+    pindexdb = NULL;
+}
+
+static const char vIndexPrefixes[] = { DB_ADDRESSINDEX, DB_ADDRESSUNSPENTINDEX, DB_SPENTINDEX, DB_TIMESTAMPINDEX, DB_BLOCKHASHINDEX, DB_INDEX_BEST_BLOCK };
+
+bool CBlockTreeDB::MoveIndexRecords(CDBWrapper &from, CDBWrapper &to) {
+    const size_t nBatchRecords = 100000;
+    int64_t nMoved = 0;
+    for (char chPrefix : vIndexPrefixes) {
+        bool fMore = true;
+        while (fMore) {
+            boost::this_thread::interruption_point();
+            CDBBatch batchTo(to), batchFrom(from);
+            size_t nRecords = 0;
+            fMore = false;
+            {
+                boost::scoped_ptr<CDBIterator> pcursor(from.NewIterator());
+                for (pcursor->Seek(chPrefix); pcursor->Valid(); pcursor->Next()) {
+                    CDataStream ssKey(SER_DISK, CLIENT_VERSION), ssValue(SER_DISK, CLIENT_VERSION);
+                    if (!pcursor->GetKeyDataStream(ssKey) || ssKey.empty() || ssKey[0] != chPrefix)
+                        break;
+                    if (nRecords == nBatchRecords) {
+                        fMore = true;
+                        break;
+                    }
+                    if (!pcursor->GetValueDataStream(ssValue))
+                        return error("%s: unreadable index record", __func__);
+                    // streams serialize as their raw bytes, so the records are copied unchanged
+                    batchTo.Write(ssKey, ssValue);
+                    batchFrom.Erase(ssKey);
+                    nRecords++;
+                }
+            }
+            if (nRecords == 0)
+                break;
+            // the copy lands before the originals go, so an interrupted move just runs again
+            if (!to.WriteBatch(batchTo, true) || !from.WriteBatch(batchFrom))
+                return false;
+            nMoved += nRecords;
+            LogPrintf("%s: moved %lld index records\n", __func__, (long long)nMoved);
+        }
+    }
+    return true;
+}
+
+bool CBlockTreeDB::MigrateIndexes() {
+    boost::filesystem::path indexpath = GetDataDir() / "blocks" / "addressindex";
+    if (pindexdb != NULL)
+        return MoveIndexRecords(*this, *pindexdb);
+    if (!boost::filesystem::exists(indexpath))
+        return true;
+    LogPrintf("%s: moving the indexes in %s back into the block index database\n", __func__, indexpath.string());
+    {
+        CDBWrapper indexdb(indexpath, 8 << 20, false, false, false, 64, IndexDBTuning());
+        if (!MoveIndexRecords(indexdb, *this))
+            return false;
+    }
+    boost::filesystem::remove_all(indexpath);
+    return true;
 }
 
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo &info) {
@@ -242,35 +375,99 @@ bool CBlockTreeDB::ReadLastBlockFile(int &nFile) {
     return Read(DB_LAST_BLOCK, nFile);
 }
 
+/**
+ * Each unspent output enters the MuHash as its outpoint, height and coinbase flag, and
+ * the output itself, so the hash does not depend on how outputs are grouped in records.
+ */
+static void ApplyCoinsToMuHash(MuHash3072 &muhash, const uint256 &txid, const CCoins &coins, bool fAdd)
+{
+    for (unsigned int i=0; i<coins.vout.size(); i++) {
+        const CTxOut &out = coins.vout[i];
+        if (out.IsNull())
+            continue;
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        ss << COutPoint(txid, i);
+        ss << (uint32_t)(coins.nHeight * 2 + (coins.fCoinBase ? 1 : 0));
+        ss << out;
+        if (fAdd)
+            muhash.Insert((const unsigned char*)&ss[0], ss.size());
+        else
+            muhash.Remove((const unsigned char*)&ss[0], ss.size());
+    }
+}
+
+void CCoinsCommitment::Apply(const uint256 &txid, const CCoins &coins, bool fAdd)
+{
+    ApplyCoinsToMuHash(muhash, txid, coins, fAdd);
+    uint64_t nOutputs = 0;
+    CAmount nAmount = 0;
+    for (unsigned int i=0; i<coins.vout.size(); i++) {
+        if (!coins.vout[i].IsNull()) {
+            nOutputs++;
+            nAmount += coins.vout[i].nValue;
+        }
+    }
+    if (fAdd) {
+        nTransactions++;
+        nTransactionOutputs += nOutputs;
+        nTotalAmount += nAmount;
+    } else {
+        nTransactions--;
+        nTransactionOutputs -= nOutputs;
+        nTotalAmount -= nAmount;
+    }
+}
+
+CCoinsCommitment& CCoinsCommitment::operator+=(const CCoinsCommitment &delta)
+{
+    if (!delta.hashBlock.IsNull())
+        hashBlock = delta.hashBlock;
+    nTransactions += delta.nTransactions;
+    nTransactionOutputs += delta.nTransactionOutputs;
+    nTotalAmount += delta.nTotalAmount;
+    muhash *= delta.muhash;
+    return *this;
+}
+
+uint256 FinalizeMuHash(MuHash3072 muhash)
+{
+    unsigned char hash[MuHash3072::OUTPUT_SIZE];
+    muhash.Finalize(hash);
+    return uint256(std::vector<unsigned char>(hash, hash + sizeof(hash)));
+}
+
+void UpdateCoinsStats(CCoinsStats &stats, CHashWriter &ss, MuHash3072 &muhash, const uint256 &txid, const CCoins &coins, unsigned int nValueSize)
+{
+    stats.nTransactions++;
+    for (unsigned int i=0; i<coins.vout.size(); i++) {
+        const CTxOut &out = coins.vout[i];
+        if (!out.IsNull()) {
+            stats.nTransactionOutputs++;
+            ss << VARINT(i+1);
+            ss << out;
+            stats.nTotalAmount += out.nValue;
+        }
+    }
+    stats.nSerializedSize += 32 + nValueSize;
+    ss << VARINT(0);
+    ApplyCoinsToMuHash(muhash, txid, coins, true);
+}
+
 bool CCoinsViewDB::GetStats(CCoinsStats &stats) const {
-    /* It seems that there are no "const iterators" for LevelDB.  Since we
-       only need read operations on it, use a const-cast to get around
-       that restriction.  */
-    boost::scoped_ptr<CDBIterator> pcursor(const_cast<CDBWrapper*>(&db)->NewIterator());
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
     pcursor->Seek(DB_COINS);
 
     CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    MuHash3072 muhash;
     stats.hashBlock = GetBestBlock();
     ss << stats.hashBlock;
-    CAmount nTotalAmount = 0;
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         std::pair<char, uint256> key;
         CCoins coins;
         if (pcursor->GetKey(key) && key.first == DB_COINS) {
             if (pcursor->GetValue(coins)) {
-                stats.nTransactions++;
-                for (unsigned int i=0; i<coins.vout.size(); i++) {
-                    const CTxOut &out = coins.vout[i];
-                    if (!out.IsNull()) {
-                        stats.nTransactionOutputs++;
-                        ss << VARINT(i+1);
-                        ss << out;
-                        nTotalAmount += out.nValue;
-                    }
-                }
-                stats.nSerializedSize += 32 + pcursor->GetValueSize();
-                ss << VARINT(0);
+                UpdateCoinsStats(stats, ss, muhash, key.second, coins, pcursor->GetValueSize());
             } else {
                 return error("CCoinsViewDB::GetStats() : unable to read value");
             }
@@ -284,10 +481,100 @@ bool CCoinsViewDB::GetStats(CCoinsStats &stats) const {
         stats.nHeight = mapBlockIndex.find(stats.hashBlock)->second->nHeight;
     }
     stats.hashSerialized = ss.GetHash();
-    stats.nTotalAmount = nTotalAmount;
+    stats.hashMuHash = FinalizeMuHash(muhash);
     return true;
 }
 
+bool CCoinsViewDB::GetCommitmentStats(CCoinsStats &stats)
+{
+    static CCriticalSection cs_scan;
+    CCoinsCommitment result;
+    {
+        LOCK(cs_scan);
+        bool fValid;
+        boost::scoped_ptr<CDBIterator> pcursor;
+        {
+            LOCK(cs_commitment);
+            fValid = fCommitmentValid;
+            if (fValid) {
+                result = commitment;
+            } else {
+                // Writes that land after the iterator is taken are collected while the scan runs.
+                pcursor.reset(NewIterator());
+                result.hashBlock = GetBestBlock();
+                commitmentPending = CCoinsCommitment();
+                fCommitmentScanning = true;
+            }
+        }
+        if (!fValid) {
+            LogPrintf("%s: building the UTXO set commitment\n", __func__);
+            bool fOk = true;
+            try {
+                for (pcursor->Seek(DB_COINS); pcursor->Valid(); pcursor->Next()) {
+                    boost::this_thread::interruption_point();
+                    std::pair<char, uint256> key;
+                    CCoins coins;
+                    if (!pcursor->GetKey(key) || key.first != DB_COINS)
+                        break;
+                    if (!pcursor->GetValue(coins)) {
+                        fOk = false;
+                        break;
+                    }
+                    result.Apply(key.second, coins, true);
+                }
+            } catch (...) {
+                LOCK(cs_commitment);
+                fCommitmentScanning = false;
+                throw;
+            }
+            LOCK(cs_commitment);
+            fCommitmentScanning = false;
+            if (!fOk)
+                return error("CCoinsViewDB::GetCommitmentStats() : unable to read value");
+            result += commitmentPending;
+            commitmentPending = CCoinsCommitment();
+            if (!db.Write(DB_COINS_COMMITMENT, result))
+                return error("CCoinsViewDB::GetCommitmentStats() : unable to write the commitment");
+            commitment = result;
+            fCommitmentValid = true;
+        }
+    }
+    stats.hashBlock = result.hashBlock;
+    stats.nTransactions = result.nTransactions;
+    stats.nTransactionOutputs = result.nTransactionOutputs;
+    stats.nTotalAmount = result.nTotalAmount;
+    stats.hashMuHash = FinalizeMuHash(result.muhash);
+    {
+        LOCK(cs_main);
+        BlockMap::iterator mi = mapBlockIndex.find(stats.hashBlock);
+        if (mi != mapBlockIndex.end() && mi->second != NULL)
+            stats.nHeight = mi->second->nHeight;
+    }
+    return true;
+}
+
+CDBIterator *CCoinsViewDB::NewIterator() const {
+    /* It seems that there are no "const iterators" for LevelDB.  Since we
+       only need read operations on it, use a const-cast to get around
+       that restriction.  */
+    return const_cast<CDBWrapper*>(&db)->NewIterator();
+}
+
+CCoinsViewDB::SnapshotKeyType CCoinsViewDB::GetSnapshotKeyType(char chPrefix) {
+    switch (chPrefix) {
+        case DB_COINS:
+            return SNAPSHOT_KEY_COINS;
+        case DB_SPROUT_ANCHOR:
+        case DB_SAPLING_ANCHOR:
+            return SNAPSHOT_KEY_ANCHOR;
+        case DB_NULLIFIER:
+        case DB_SAPLING_NULLIFIER:
+            return SNAPSHOT_KEY_NULLIFIER;
+        default:
+            return SNAPSHOT_KEY_NONE;
+    }
+}
+
 bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo) {
     CDBBatch batch(*this);
     for (std::vector<std::pair<int, const CBlockFileInfo*> >::const_iterator it=fileInfo.begin(); it != fileInfo.end(); it++) {
@@ -308,6 +595,10 @@ bool CBlockTreeDB::EraseBatchSync(const std::vector<const CBlockIndex*>& blockin
     return WriteBatch(batch, true);
 }
 
+bool CBlockTreeDB::ReadDiskBlockIndex(const uint256 &blockhash, CDiskBlockIndex &dbindex) {
+    return Read(make_pair(DB_BLOCK_INDEX, blockhash), dbindex);
+}
+
 bool CBlockTreeDB::ReadTxIndex(const uint256 &txid, CDiskTxPos &pos) {
     return Read(make_pair(DB_TXINDEX, txid), pos);
 }
@@ -320,11 +611,11 @@ bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos>
 }
 
 bool CBlockTreeDB::ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value) {
-    return Read(make_pair(DB_SPENTINDEX, key), value);
+    return IndexDB().Read(make_pair(DB_SPENTINDEX, key), value);
 }
 
 bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect) {
-    CDBBatch batch(*this);
+    CDBBatch batch(IndexDB());
     for (std::vector<std::pair<CSpentIndexKey,CSpentIndexValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
         if (it->second.IsNull()) {
             batch.Erase(make_pair(DB_SPENTINDEX, it->first));
@@ -332,11 +623,11 @@ bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey,
             batch.Write(make_pair(DB_SPENTINDEX, it->first), it->second);
         }
     }
-    return WriteBatch(batch);
+    return IndexDB().WriteBatch(batch);
 }
 
 bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect) {
-    CDBBatch batch(*this);
+    CDBBatch batch(IndexDB());
     for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
         if (it->second.IsNull()) {
             batch.Erase(make_pair(DB_ADDRESSUNSPENTINDEX, it->first));
@@ -344,97 +635,273 @@ bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddres
             batch.Write(make_pair(DB_ADDRESSUNSPENTINDEX, it->first), it->second);
         }
     }
-    return WriteBatch(batch);
+    return IndexDB().WriteBatch(batch);
 }
 
-bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
-                                           std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs) {
-
-    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+bool CBlockTreeDB::ForEachAddressUnspent(uint160 addressHash, int type,
+        const std::function<bool(const CAddressUnspentKey&, const CAddressUnspentValue&)> &visitor) {
 
-    pcursor->Seek(make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash)));
+    CDBRangeCursor cursor(IndexDB().NewRangeCursor(make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash))));
 
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        try {
-            CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-            pair<char, CAddressUnspentKey> keyObj;
-            pcursor->GetKey(keyObj);
-            char chType = keyObj.first;
-            CAddressUnspentKey indexKey = keyObj.second;
-
-            if (chType == DB_ADDRESSUNSPENTINDEX && indexKey.hashBytes == addressHash) {
-                try {
-                    CAddressUnspentValue nValue;
-                    pcursor->GetValue(nValue);
-                    unspentOutputs.push_back(make_pair(indexKey, nValue));
-                    pcursor->Next();
-                } catch (const std::exception& e) {
-                    return error("failed to get address unspent value");
-                }
-            } else {
-                break;
-            }
-        } catch (const std::exception& e) {
-            break;
-        }
-    }
+    if (!cursor.ForEach<pair<char, CAddressUnspentKey>, CAddressUnspentValue>(
+            [&](const pair<char, CAddressUnspentKey> &key, const CAddressUnspentValue &value) {
+                boost::this_thread::interruption_point();
+                return visitor(key.second, value);
+            }))
+        return error("failed to get address unspent value");
     return true;
 }
 
+bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
+                                           std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs) {
+    return ForEachAddressUnspent(addressHash, type,
+            [&](const CAddressUnspentKey &key, const CAddressUnspentValue &value) {
+                unspentOutputs.push_back(make_pair(key, value));
+                return true;
+            });
+}
+
 bool CBlockTreeDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
-    CDBBatch batch(*this);
+    CDBBatch batch(IndexDB());
     for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
         batch.Write(make_pair(DB_ADDRESSINDEX, it->first), it->second);
-    return WriteBatch(batch);
+    return IndexDB().WriteBatch(batch);
 }
 
 bool CBlockTreeDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
-    CDBBatch batch(*this);
+    CDBBatch batch(IndexDB());
     for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
         batch.Erase(make_pair(DB_ADDRESSINDEX, it->first));
-    return WriteBatch(batch);
+    return IndexDB().WriteBatch(batch);
+}
+
+bool CBlockTreeDB::UpdateIndexes(const std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex, bool fEraseAddressIndex,
+        const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &addressUnspentIndex,
+        const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > &spentIndex,
+        const uint256 &hashBlock, unsigned int logicalTS, const uint256 &hashIndexBest) {
+    CDBBatch batch(IndexDB());
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
+        if (fEraseAddressIndex)
+            batch.Erase(make_pair(DB_ADDRESSINDEX, it->first));
+        else
+            batch.Write(make_pair(DB_ADDRESSINDEX, it->first), it->second);
+    }
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=addressUnspentIndex.begin(); it!=addressUnspentIndex.end(); it++) {
+        if (it->second.IsNull()) {
+            batch.Erase(make_pair(DB_ADDRESSUNSPENTINDEX, it->first));
+        } else {
+            batch.Write(make_pair(DB_ADDRESSUNSPENTINDEX, it->first), it->second);
+        }
+    }
+    for (std::vector<std::pair<CSpentIndexKey,CSpentIndexValue> >::const_iterator it=spentIndex.begin(); it!=spentIndex.end(); it++) {
+        if (it->second.IsNull()) {
+            batch.Erase(make_pair(DB_SPENTINDEX, it->first));
+        } else {
+            batch.Write(make_pair(DB_SPENTINDEX, it->first), it->second);
+        }
+    }
+    if (logicalTS != 0) {
+        batch.Write(make_pair(DB_TIMESTAMPINDEX, CTimestampIndexKey(logicalTS, hashBlock)), 0);
+        batch.Write(make_pair(DB_BLOCKHASHINDEX, CTimestampBlockIndexKey(hashBlock)), CTimestampBlockIndexValue(logicalTS));
+    }
+    // the marker goes in the same batch, so after a crash it always names the last block whose records made it to disk
+    batch.Write(DB_INDEX_BEST_BLOCK, hashIndexBest);
+    return IndexDB().WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadIndexBestBlock(uint256 &hashBlock) {
+    return IndexDB().Read(DB_INDEX_BEST_BLOCK, hashBlock);
+}
+
+bool CBlockTreeDB::WriteIndexBestBlock(const uint256 &hashBlock) {
+    return IndexDB().Write(DB_INDEX_BEST_BLOCK, hashBlock);
+}
+
+bool CBlockTreeDB::ForEachAddressIndex(uint160 addressHash, int type,
+        const std::function<bool(const CAddressIndexKey&, CAmount)> &visitor,
+        int start, int end) {
+
+    CDBRangeCursor cursor(IndexDB().NewRangeCursor(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, addressHash))));
+
+    if (start > 0 && end > 0) {
+        cursor.Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, start)));
+    }
+    // heights are serialized big endian, so the records of the blocks after end all sort at or past this key
+    if (end > 0 && end < std::numeric_limits<int>::max()) {
+        cursor.SetUpperBound(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, end + 1)));
+    }
+
+    if (!cursor.ForEach<pair<char, CAddressIndexKey>, CAmount>(
+            [&](const pair<char, CAddressIndexKey> &key, CAmount nValue) {
+                boost::this_thread::interruption_point();
+                return visitor(key.second, nValue);
+            }))
+        return error("failed to get address index value");
+    return true;
 }
 
 bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
                                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
                                     int start, int end) {
+    return ForEachAddressIndex(addressHash, type,
+            [&](const CAddressIndexKey &key, CAmount nValue) {
+                addressIndex.push_back(make_pair(key, nValue));
+                return true;
+            }, start, end);
+}
+
+bool CBlockTreeDB::WriteOraclesDataIndex(const std::vector<std::pair<COraclesDataIndexKey, COraclesDataIndexValue> >&vect) {
+    CDBBatch batch(*this);
+    for (std::vector<std::pair<COraclesDataIndexKey, COraclesDataIndexValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
+        batch.Write(make_pair(DB_ORACLESDATAINDEX, it->first), it->second);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::EraseOraclesDataIndex(const std::vector<std::pair<COraclesDataIndexKey, COraclesDataIndexValue> >&vect) {
+    CDBBatch batch(*this);
+    for (std::vector<std::pair<COraclesDataIndexKey, COraclesDataIndexValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
+        batch.Erase(make_pair(DB_ORACLESDATAINDEX, it->first));
+    return WriteBatch(batch);
+}
+
+/***
+ * Read the oracles data index record under the cursor
+ * @param pcursor the cursor
+ * @param oracletxid the oracle the record must belong to
+ * @param publisher the publisher the record must belong to (invalid = any)
+ * @param indexKey the key read
+ * @returns true if the cursor is on a matching record
+ */
+static bool GetOraclesDataKey(CDBIterator *pcursor, const uint256 &oracletxid, const CPubKey &publisher, COraclesDataIndexKey &indexKey) {
+    if (!pcursor->Valid())
+        return false;
+    try {
+        pair<char, COraclesDataIndexKey> keyObj;
+        if (!pcursor->GetKey(keyObj) || keyObj.first != DB_ORACLESDATAINDEX)
+            return false;
+        indexKey = keyObj.second;
+    } catch (const std::exception& e) {
+        return false;
+    }
+    return indexKey.oracletxid == oracletxid && (!publisher.IsValid() || indexKey.publisher == publisher);
+}
+
+bool CBlockTreeDB::ReadOraclesDataIndex(const uint256 &oracletxid, const CPubKey &publisher, bool fNewestFirst, int32_t limit,
+                                        std::vector<std::pair<COraclesDataIndexKey, COraclesDataIndexValue> > &vect,
+                                        int start, int end) {
+    if (!publisher.IsCompressed())
+        return true;
 
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    COraclesDataIndexKey indexKey;
+
+    if (fNewestFirst) {
+        // land on the first record above the range and step back into it
+        pcursor->Seek(make_pair(DB_ORACLESDATAINDEX, COraclesDataIndexIteratorKey(oracletxid, publisher, end > 0 ? end + 1 : 0xffffffff)));
+        if (pcursor->Valid())
+            pcursor->Prev();
+        else
+            pcursor->SeekToLast();
+    } else {
+        pcursor->Seek(make_pair(DB_ORACLESDATAINDEX, COraclesDataIndexIteratorKey(oracletxid, publisher, start > 0 ? start : 0)));
+    }
 
-    if (start > 0 && end > 0) {
-        pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, start)));
+    while (GetOraclesDataKey(pcursor.get(), oracletxid, publisher, indexKey)) {
+        boost::this_thread::interruption_point();
+        if ((start > 0 && indexKey.blockHeight < start) || (end > 0 && indexKey.blockHeight > end))
+            break;
+        COraclesDataIndexValue value;
+        if (!pcursor->GetValue(value))
+            return error("failed to get oracles data index value");
+        vect.push_back(make_pair(indexKey, value));
+        if (limit > 0 && vect.size() >= (size_t)limit)
+            break;
+        if (fNewestFirst)
+            pcursor->Prev();
+        else
+            pcursor->Next();
+    }
+
+    return true;
+}
+
+bool CBlockTreeDB::ReadOraclesDataPublishers(const uint256 &oracletxid, int end,
+                                             std::vector<std::pair<COraclesDataIndexKey, COraclesDataIndexValue> > &vect) {
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    COraclesDataIndexKey indexKey;
+
+    pcursor->Seek(make_pair(DB_ORACLESDATAINDEX, oracletxid));
+    while (GetOraclesDataKey(pcursor.get(), oracletxid, CPubKey(), indexKey)) {
+        boost::this_thread::interruption_point();
+        CPubKey publisher = indexKey.publisher;
+
+        // newest record of this publisher at or below end
+        pcursor->Seek(make_pair(DB_ORACLESDATAINDEX, COraclesDataIndexIteratorKey(oracletxid, publisher, end > 0 ? end + 1 : 0xffffffff)));
+        if (pcursor->Valid())
+            pcursor->Prev();
+        else
+            pcursor->SeekToLast();
+        if (GetOraclesDataKey(pcursor.get(), oracletxid, publisher, indexKey)) {
+            COraclesDataIndexValue value;
+            if (!pcursor->GetValue(value))
+                return error("failed to get oracles data index value");
+            vect.push_back(make_pair(indexKey, value));
+        }
+
+        // no record has height 0xffffffff, so this lands on the next publisher
+        pcursor->Seek(make_pair(DB_ORACLESDATAINDEX, COraclesDataIndexIteratorKey(oracletxid, publisher, 0xffffffff)));
+    }
+
+    return true;
+}
+
+bool CBlockTreeDB::UpdateTokensIndex(const std::vector<std::pair<CTokensIndexKey, CTokensIndexValue> > &created,
+                                     const std::vector<std::pair<CTokensIndexKey, CTokensIndexValue> > &spent, bool fConnect) {
+    CDBBatch batch(*this);
+    // an output created and spent in the same block must end up absent, so
+    // the erases of each direction come after its writes
+    if (fConnect) {
+        for (std::vector<std::pair<CTokensIndexKey, CTokensIndexValue> >::const_iterator it=created.begin(); it!=created.end(); it++) {
+            batch.Write(make_pair(DB_TOKENSOUTPUT, COutPoint(it->first.txhash, it->first.index)), *it);
+            batch.Write(make_pair(DB_TOKENSINDEX, it->first), it->second);
+        }
+        for (std::vector<std::pair<CTokensIndexKey, CTokensIndexValue> >::const_iterator it=spent.begin(); it!=spent.end(); it++)
+            batch.Erase(make_pair(DB_TOKENSINDEX, it->first));
     } else {
-        pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, addressHash)));
+        for (std::vector<std::pair<CTokensIndexKey, CTokensIndexValue> >::const_iterator it=spent.begin(); it!=spent.end(); it++)
+            batch.Write(make_pair(DB_TOKENSINDEX, it->first), it->second);
+        for (std::vector<std::pair<CTokensIndexKey, CTokensIndexValue> >::const_iterator it=created.begin(); it!=created.end(); it++) {
+            batch.Erase(make_pair(DB_TOKENSOUTPUT, COutPoint(it->first.txhash, it->first.index)));
+            batch.Erase(make_pair(DB_TOKENSINDEX, it->first));
+        }
     }
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadTokensOutput(const COutPoint &outpoint, std::pair<CTokensIndexKey, CTokensIndexValue> &output) {
+    return Read(make_pair(DB_TOKENSOUTPUT, outpoint), output);
+}
+
+bool CBlockTreeDB::ReadTokensIndex(const uint256 &tokenid, const uint160 &addressHash,
+                                   std::vector<std::pair<CTokensIndexKey, CTokensIndexValue> > &vect) {
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+
+    if (addressHash.IsNull())
+        pcursor->Seek(make_pair(DB_TOKENSINDEX, tokenid));
+    else
+        pcursor->Seek(make_pair(DB_TOKENSINDEX, CTokensIndexIteratorKey(tokenid, addressHash)));
 
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
-        try {
-            pair<char, CAddressIndexKey> keyObj;
-            pcursor->GetKey(keyObj);
-            char chType = keyObj.first;
-            CAddressIndexKey indexKey = keyObj.second;
-
-            if (chType == DB_ADDRESSINDEX && indexKey.hashBytes == addressHash) {
-                if (end > 0 && indexKey.blockHeight > end) {
-                    break;
-                }
-                try {
-                    CAmount nValue;
-                    pcursor->GetValue(nValue);
-
-                    addressIndex.push_back(make_pair(indexKey, nValue));
-                    pcursor->Next();
-                } catch (const std::exception& e) {
-                    return error("failed to get address index value");
-                }
-            } else {
-                break;
-            }
-        } catch (const std::exception& e) {
+        std::pair<char, CTokensIndexKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_TOKENSINDEX || key.second.tokenid != tokenid ||
+            (!addressHash.IsNull() && key.second.addressHash != addressHash))
             break;
-        }
+        CTokensIndexValue value;
+        if (!pcursor->GetValue(value))
+            return error("failed to get tokens index value");
+        vect.push_back(make_pair(key.second, value));
+        pcursor->Next();
     }
 
     return true;
@@ -467,74 +934,60 @@ bool CBlockTreeDB::Snapshot2(std::map <std::string, CAmount> &addressAmounts, Un
     int64_t total = 0; int64_t totalAddresses = 0; std::string address;
     int64_t utxos = 0; int64_t ignoredAddresses = 0, cryptoConditionsUTXOs = 0, cryptoConditionsTotals = 0;
     DECLARE_IGNORELIST
-    boost::scoped_ptr<CDBIterator> iter(NewIterator());
+    // only the unspent index records are visited; the key is read up to the address and the value up to the amount
+    CDBRangeCursor cursor(IndexDB().NewRangeCursor(DB_ADDRESSUNSPENTINDEX));
     //std::map <std::string, CAmount> addressAmounts;
-    for (iter->SeekToLast(); iter->Valid(); iter->Prev())
+    for (; cursor.Valid(); cursor.Next())
     {
         boost::this_thread::interruption_point();
-        try
+        pair<char, CAddressIndexIteratorKey> keyObj;
+        if (!cursor.GetKey(keyObj))
         {
-            std::vector<unsigned char> slKey = std::vector<unsigned char>();
-            pair<char, CAddressIndexIteratorKey> keyObj;
-            iter->GetKey(keyObj);
-
-            char chType = keyObj.first;
-            CAddressIndexIteratorKey indexKey = keyObj.second;
-            //LogPrintf( "chType=%d\n", chType);
-            if (chType == DB_ADDRESSUNSPENTINDEX)
-            {
-                try {
-                    CAmount nValue;
-                    iter->GetValue(nValue);
-                    if ( nValue == 0 )
-                        continue;
-                    getAddressFromIndex(indexKey.type, indexKey.hashBytes, address);
-                    if ( indexKey.type == 3 )
-                    {
-                        cryptoConditionsUTXOs++;
-                        cryptoConditionsTotals += nValue;
-                        total += nValue;
-                        continue;
-                    }
-                    std::map <std::string, int>::iterator ignored = ignoredMap.find(address);
-                    if (ignored != ignoredMap.end())
-                    {
-                        LogPrintf("ignoring %s\n", address.c_str());
-                        ignoredAddresses++;
-                        continue;
-                    }
+            LogPrintf( "DONE reading index entries\n");
+            break;
+        }
+        CAddressIndexIteratorKey indexKey = keyObj.second;
+        CAmount nValue;
+        if (!cursor.GetValue(nValue))
+        {
+            LogPrintf( "DONE %s: LevelDB addressindex exception!\n", __func__);
+            return false; //break; this means failiure of DB? we need to exit here if so for consensus code!
+        }
+        if ( nValue == 0 )
+            continue;
+        getAddressFromIndex(indexKey.type, indexKey.hashBytes, address);
+        if ( indexKey.type == 3 )
+        {
+            cryptoConditionsUTXOs++;
+            cryptoConditionsTotals += nValue;
+            total += nValue;
+            continue;
+        }
+        std::map <std::string, int>::iterator ignored = ignoredMap.find(address);
+        if (ignored != ignoredMap.end())
+        {
+            LogPrintf("ignoring %s\n", address.c_str());
+            ignoredAddresses++;
+            continue;
+        }
 
-                    std::map <std::string, CAmount>::iterator pos = addressAmounts.find(address);
-                    if ( pos == addressAmounts.end() )
-                    {
-                        // insert new address + utxo amount
-                        //LogPrintf( "inserting new address %s with amount %li\n", address.c_str(), nValue);
-                        addressAmounts[address] = nValue;
-                        totalAddresses++;
-                    }
-                    else
-                    {
-                        // update unspent tally for this address
-                        //LogPrintf( "updating address %s with new utxo amount %li\n", address.c_str(), nValue);
-                        addressAmounts[address] += nValue;
-                    }
-                    //LogPrintf("{\"%s\", %.8f},\n",address.c_str(),(double)nValue/COIN);
-                    // total += nValue;
-                    utxos++;
-                    total += nValue;
-                }
-                catch (const std::exception& e)
-                {
-                    LogPrintf( "DONE %s: LevelDB addressindex exception! - %s\n", __func__, e.what());
-                    return false; //break; this means failiure of DB? we need to exit here if so for consensus code!
-                }
-            }
+        std::map <std::string, CAmount>::iterator pos = addressAmounts.find(address);
+        if ( pos == addressAmounts.end() )
+        {
+            // insert new address + utxo amount
+            //LogPrintf( "inserting new address %s with amount %li\n", address.c_str(), nValue);
+            addressAmounts[address] = nValue;
+            totalAddresses++;
         }
-        catch (const std::exception& e)
+        else
         {
-            LogPrintf( "DONE reading index entries\n");
-            break;
+            // update unspent tally for this address
+            //LogPrintf( "updating address %s with new utxo amount %li\n", address.c_str(), nValue);
+            pos->second += nValue;
         }
+        //LogPrintf("{\"%s\", %.8f},\n",address.c_str(),(double)nValue/COIN);
+        utxos++;
+        total += nValue;
     }
     //LogPrintf( "total=%f, totalAddresses=%li, utxos=%li, ignored=%li\n", (double) total / COIN, totalAddresses, utxos, ignoredAddresses);
     
@@ -609,56 +1062,38 @@ UniValue CBlockTreeDB::Snapshot(int top)
 }
 
 bool CBlockTreeDB::WriteTimestampIndex(const CTimestampIndexKey &timestampIndex) {
-    CDBBatch batch(*this);
+    CDBBatch batch(IndexDB());
     batch.Write(make_pair(DB_TIMESTAMPINDEX, timestampIndex), 0);
-    return WriteBatch(batch);
+    return IndexDB().WriteBatch(batch);
 }
 
 bool CBlockTreeDB::ReadTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &hashes) {
 
-    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
-
-    pcursor->Seek(make_pair(DB_TIMESTAMPINDEX, CTimestampIndexIteratorKey(low)));
+    CDBRangeCursor cursor(IndexDB().NewRangeCursor(DB_TIMESTAMPINDEX));
+    cursor.Seek(make_pair(DB_TIMESTAMPINDEX, CTimestampIndexIteratorKey(low)));
+    cursor.SetUpperBound(make_pair(DB_TIMESTAMPINDEX, CTimestampIndexIteratorKey(high)));
 
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        try {
-            pair<char, CTimestampIndexKey> keyObj;
-            pcursor->GetKey(keyObj);
-            char chType = keyObj.first;
-            CTimestampIndexKey indexKey = keyObj.second;
-
-            if (chType == DB_TIMESTAMPINDEX && indexKey.timestamp < high) {
-                if (fActiveOnly) {
-                    if (blockOnchainActive(indexKey.blockHash)) {
-                        hashes.push_back(std::make_pair(indexKey.blockHash, indexKey.timestamp));
-                    }
-                } else {
-                    hashes.push_back(std::make_pair(indexKey.blockHash, indexKey.timestamp));
-                }
-
-                pcursor->Next();
-            } else {
-                break;
-            }
-        } catch (const std::exception& e) {
-            break;
-        }
-    }
+    cursor.ForEach<pair<char, CTimestampIndexKey>, int>(
+            [&](const pair<char, CTimestampIndexKey> &key, int) {
+                boost::this_thread::interruption_point();
+                if (!fActiveOnly || blockOnchainActive(key.second.blockHash))
+                    hashes.push_back(std::make_pair(key.second.blockHash, key.second.timestamp));
+                return true;
+            });
 
     return true;
 }
 
 bool CBlockTreeDB::WriteTimestampBlockIndex(const CTimestampBlockIndexKey &blockhashIndex, const CTimestampBlockIndexValue &logicalts) {
-    CDBBatch batch(*this);
+    CDBBatch batch(IndexDB());
     batch.Write(make_pair(DB_BLOCKHASHINDEX, blockhashIndex), logicalts);
-    return WriteBatch(batch);
+    return IndexDB().WriteBatch(batch);
 }
 
 bool CBlockTreeDB::ReadTimestampBlockIndex(const uint256 &hash, unsigned int &ltimestamp) {
 
     CTimestampBlockIndexValue(lts);
-    if (!Read(std::make_pair(DB_BLOCKHASHINDEX, hash), lts))
+    if (!IndexDB().Read(std::make_pair(DB_BLOCKHASHINDEX, hash), lts))
 	return false;
 
     ltimestamp = lts.ltimestamp;
@@ -690,82 +1125,121 @@ bool CBlockTreeDB::blockOnchainActive(const uint256 &hash) {
     return true;
 }
 
-bool CBlockTreeDB::LoadBlockIndexGuts()
+/****
+ * Load the block index records whose hash starts with a byte in [nFirst, nEnd) into mapBlockIndex
+ * @param nFirst first leading byte of the range
+ * @param nEnd one past the last leading byte of the range
+ * @param cs guards mapBlockIndex, the records are decoded and hashed outside of it
+ * @param count incremented for each record loaded
+ * @param fFailed set by any range that fails, so the others stop early
+ * @param strError the reason of the first failure
+ * @param fReport true for the range that reports the progress
+ * @returns true on success
+ */
+bool CBlockTreeDB::LoadBlockIndexRange(int nFirst, int nEnd, std::mutex &cs, std::atomic<int64_t> &count,
+        std::atomic<bool> &fFailed, std::string &strError, bool fReport)
 {
-    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
-
-    pcursor->Seek(make_pair(DB_BLOCK_INDEX, uint256()));
-    int64_t count = 0; int reportDone = 0;
-    uiInterface.ShowProgress(_("Loading guts..."), 0, false);
+    CDBRangeCursor cursor(NewRangeCursor(DB_BLOCK_INDEX));
+    uint256 start;
+    *start.begin() = (unsigned char)nFirst;
+    cursor.Seek(make_pair(DB_BLOCK_INDEX, start));
+    if (nEnd < 256) {
+        uint256 end;
+        *end.begin() = (unsigned char)nEnd;
+        cursor.SetUpperBound(make_pair(DB_BLOCK_INDEX, end));
+    }
+    int reportDone = 0;
 
-    // Load mapBlockIndex
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
+    for (; cursor.Valid() && !fFailed; cursor.Next()) {
         if (ShutdownRequested()) return false;
 
         std::pair<char, uint256> key;
+        if (!cursor.GetKey(key))
+            break;
 
-        if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX) {
-
-            if (count++ % 256 == 0) {
-                uint32_t high = 0x100 * *key.second.begin() + *(key.second.begin() + 1);
-                int percentageDone = (int)(high * 100.0 / 65536.0 + 0.5);
-                uiInterface.ShowProgress(_("Loading guts..."), percentageDone, false);
-                if (reportDone < percentageDone/10) {
-                    // report max. every 10% step
-                    LogPrintf("[%d%%]...", percentageDone); /* Continued */
-                    reportDone = percentageDone/10;
-                }
+        if (fReport && count % 256 == 0) {
+            int percentageDone = (int)((*key.second.begin() - nFirst) * 100.0 / (nEnd - nFirst) + 0.5);
+            uiInterface.ShowProgress(_("Loading guts..."), percentageDone, false);
+            if (reportDone < percentageDone/10) {
+                // report max. every 10% step
+                LogPrintf("[%d%%]...", percentageDone); /* Continued */
+                reportDone = percentageDone/10;
             }
+        }
 
-            CDiskBlockIndex diskindex;
-            if (pcursor->GetValue(diskindex)) {
-                // Construct block index object
-                CBlockIndex* pindexNew = InsertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev          = InsertBlockIndex(diskindex.hashPrev);
-                pindexNew->nHeight = diskindex.nHeight;
-                pindexNew->nFile          = diskindex.nFile;
-                pindexNew->nDataPos       = diskindex.nDataPos;
-                pindexNew->nUndoPos       = diskindex.nUndoPos;
-                pindexNew->hashSproutAnchor     = diskindex.hashSproutAnchor;
-                pindexNew->nVersion       = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->hashFinalSaplingRoot   = diskindex.hashFinalSaplingRoot;
-                pindexNew->nTime          = diskindex.nTime;
-                pindexNew->nBits          = diskindex.nBits;
-                pindexNew->nNonce         = diskindex.nNonce;
-                pindexNew->nSolution      = diskindex.nSolution;
-                pindexNew->nStatus        = diskindex.nStatus;
-                pindexNew->nCachedBranchId = diskindex.nCachedBranchId;
-                pindexNew->nTx            = diskindex.nTx;
-                pindexNew->nSproutValue   = diskindex.nSproutValue;
-                pindexNew->nSaplingValue  = diskindex.nSaplingValue;
-                pindexNew->segid          = diskindex.segid;
-                pindexNew->nNotaryPay     = diskindex.nNotaryPay;
-//LogPrintf("loadguts ht.%d\n",pindexNew->nHeight);
-                // Consistency checks
-                auto header = pindexNew->GetBlockHeader();
-                if (header.GetHash() != pindexNew->GetBlockHash())
-                    return error("LoadBlockIndex(): block header inconsistency detected: on-disk = %s, in-memory = %s",
-                                 diskindex.ToString(),  pindexNew->ToString());
-                if ( 0 ) // POW will be checked before any block is connected
-                {
-                    uint8_t pubkey33[33];
-                    komodo_index2pubkey33(pubkey33,pindexNew,pindexNew->nHeight);
-                    if (!CheckProofOfWork(header,pubkey33,pindexNew->nHeight,Params().GetConsensus()))
-                        return error("LoadBlockIndex(): CheckProofOfWork failed: %s", pindexNew->ToString());
-                }
-                pcursor->Next();
-            } else {
-                return error("LoadBlockIndex() : failed to read value");
-            }
-        } else {
-            break;
+        CDiskBlockIndex diskindex;
+        if (!cursor.GetValue(diskindex)) {
+            std::lock_guard<std::mutex> lock(cs);
+            if (!fFailed.exchange(true))
+                strError = "LoadBlockIndex() : failed to read value";
+            return false;
+        }
+        // Consistency check, the expensive part of loading, done outside of the lock
+        if (diskindex.GetBlockHash() != key.second) {
+            std::lock_guard<std::mutex> lock(cs);
+            if (!fFailed.exchange(true))
+                strError = strprintf("LoadBlockIndex(): block header inconsistency detected: on-disk = %s, key = %s",
+                                     diskindex.ToString(), key.second.ToString());
+            return false;
+        }
+        // POW will be checked before any block is connected
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            // Construct block index object
+            CBlockIndex* pindexNew = InsertBlockIndex(key.second);
+            pindexNew->pprev          = InsertBlockIndex(diskindex.hashPrev);
+            pindexNew->nHeight = diskindex.nHeight;
+            pindexNew->nFile          = diskindex.nFile;
+            pindexNew->nDataPos       = diskindex.nDataPos;
+            pindexNew->nUndoPos       = diskindex.nUndoPos;
+            pindexNew->hashSproutAnchor     = diskindex.hashSproutAnchor;
+            pindexNew->nVersion       = diskindex.nVersion;
+            pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+            pindexNew->hashFinalSaplingRoot   = diskindex.hashFinalSaplingRoot;
+            pindexNew->nTime          = diskindex.nTime;
+            pindexNew->nBits          = diskindex.nBits;
+            pindexNew->nNonce         = diskindex.nNonce;
+            pindexNew->nStatus        = diskindex.nStatus;
+            pindexNew->nCachedBranchId = diskindex.nCachedBranchId;
+            pindexNew->nTx            = diskindex.nTx;
+            pindexNew->nSproutValue   = diskindex.nSproutValue;
+            pindexNew->nSaplingValue  = diskindex.nSaplingValue;
+            pindexNew->segid          = diskindex.segid;
+            pindexNew->nNotaryPay     = diskindex.nNotaryPay;
         }
+        count++;
     }
+    return !fFailed;
+}
+
+bool CBlockTreeDB::LoadBlockIndexGuts()
+{
+    int64_t nStart = GetTimeMillis();
+    // the keyspace is split by the leading byte of the block hash, each range is read,
+    // decoded and hashed on its own thread, only the inserts into mapBlockIndex are serialized
+    const int nThreads = std::max(1, std::min(GetNumCores(), 8));
+    std::mutex cs;
+    std::atomic<int64_t> count(0);
+    std::atomic<bool> fFailed(false);
+    std::string strError;
+    uiInterface.ShowProgress(_("Loading guts..."), 0, false);
+
+    std::vector<std::thread> threads;
+    for (int i = 1; i < nThreads; i++)
+        threads.emplace_back([&, i]() {
+            LoadBlockIndexRange(256 * i / nThreads, 256 * (i + 1) / nThreads, cs, count, fFailed, strError, false);
+        });
+    bool fOk = LoadBlockIndexRange(0, 256 / nThreads, cs, count, fFailed, strError, true);
+    for (auto &thread : threads)
+        thread.join();
 
     uiInterface.ShowProgress("", 100, false);
     LogPrintf("[%s].\n", ShutdownRequested() ? "CANCELLED" : "DONE");
+    if (fFailed)
+        return error("%s", strError);
+    if (!fOk || ShutdownRequested())
+        return false;
+    LogPrintf("%s: %d block index entries loaded and checked on %d threads in %dms\n", __func__, (int64_t)count, nThreads, GetTimeMillis() - nStart);
 
     return true;
 }
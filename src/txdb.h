@@ -22,9 +22,14 @@
 #define BITCOIN_TXDB_H
 
 #include "coins.h"
+#include "crypto/muhash.h"
 #include "dbwrapper.h"
+#include "sync.h"
 
+#include <atomic>
+#include <functional>
 #include <map>
+#include <mutex>
 #include <string>
 #include <utility>
 #include <vector>
@@ -32,6 +37,7 @@
 
 class CBlockFileInfo;
 class CBlockIndex;
+class CDiskBlockIndex;
 struct CDiskTxPos;
 struct CAddressUnspentKey;
 struct CAddressUnspentValue;
@@ -44,6 +50,11 @@ struct CTimestampBlockIndexKey;
 struct CTimestampBlockIndexValue;
 struct CSpentIndexKey;
 struct CSpentIndexValue;
+struct COraclesDataIndexKey;
+struct COraclesDataIndexValue;
+struct CTokensIndexKey;
+struct CTokensIndexValue;
+class CHashWriter;
 class uint256;
 
 //! -dbcache default (MiB)
@@ -52,6 +63,45 @@ static const int64_t nDefaultDbCache = 450;
 static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 16384 : 1024;
 //! min. -dbcache in (MiB)
 static const int64_t nMinDbCache = 4;
+//! -splitindexdb default
+static const bool DEFAULT_SPLITINDEXDB = false;
+
+/**
+ * Running totals and MuHash of the unspent outputs in the chainstate. It is updated
+ * with the delta of every BatchWrite and stored in the same batch as the best block,
+ * so gettxoutsetinfo can answer without walking the whole coins database.
+ * The counters wrap like unsigned integers, which lets a delta carry removals too.
+ */
+struct CCoinsCommitment
+{
+    uint256 hashBlock;
+    uint64_t nTransactions;
+    uint64_t nTransactionOutputs;
+    CAmount nTotalAmount;
+    MuHash3072 muhash;
+
+    CCoinsCommitment() : nTransactions(0), nTransactionOutputs(0), nTotalAmount(0) {}
+
+    //! Add one coins record (fAdd) or take it back out (!fAdd)
+    void Apply(const uint256 &txid, const CCoins &coins, bool fAdd);
+    CCoinsCommitment& operator+=(const CCoinsCommitment &delta);
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        unsigned char state[MuHash3072::STATE_SIZE];
+        if (!ser_action.ForRead())
+            muhash.ToBytes(state);
+        READWRITE(hashBlock);
+        READWRITE(nTransactions);
+        READWRITE(nTransactionOutputs);
+        READWRITE(nTotalAmount);
+        READWRITE(FLATDATA(state));
+        if (ser_action.ForRead())
+            muhash.FromBytes(state);
+    }
+};
 
 /** 
  * CCoinsView backed by the coin database (chainstate/) 
@@ -61,6 +111,17 @@ class CCoinsViewDB : public CCoinsView
 protected:
     CDBWrapper db;
     CCoinsViewDB(std::string dbName, size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+    //! Guards the commitment; held across each BatchWrite so the commitment always matches the database
+    mutable CCriticalSection cs_commitment;
+    CCoinsCommitment commitment;
+    //! The commitment matches the coins in the database
+    bool fCommitmentValid;
+    //! A scan is building the commitment; writes meanwhile are collected in commitmentPending
+    bool fCommitmentScanning;
+    CCoinsCommitment commitmentPending;
+
+    void ReadCommitment();
 public:
     CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
 
@@ -90,8 +151,52 @@ public:
                     CNullifiersMap &mapSproutNullifiers,
                     CNullifiersMap &mapSaplingNullifiers);
     bool GetStats(CCoinsStats &stats) const;
+    /****
+     * Fill the totals and MuHash of the UTXO set from the running commitment, without a scan.
+     * The first call on a database written before the commitment existed walks the coins once
+     * to build it; nSerializedSize and hashSerialized are not filled.
+     * @param stats the result
+     * @returns false if the commitment could not be built
+     */
+    bool GetCommitmentStats(CCoinsStats &stats);
+    /****
+     * Get an iterator over the whole chainstate. LevelDB iterators see the database as it was
+     * when they were created, so callers may release cs_main while walking it.
+     * NOTE: you are responsible for deletion of the returned iterator
+     * @returns an iterator
+     */
+    CDBIterator *NewIterator() const;
+    //! Kinds of chainstate records carried by a UTXO snapshot
+    enum SnapshotKeyType {
+        SNAPSHOT_KEY_NONE,
+        SNAPSHOT_KEY_COINS,
+        SNAPSHOT_KEY_ANCHOR,
+        SNAPSHOT_KEY_NULLIFIER,
+    };
+    /****
+     * @param chPrefix the first byte of a chainstate key
+     * @returns the kind of snapshot record, SNAPSHOT_KEY_NONE if it is not part of a UTXO snapshot
+     */
+    static SnapshotKeyType GetSnapshotKeyType(char chPrefix);
 };
 
+/****
+ * Add one coins record to the totals and hashes reported by gettxoutsetinfo
+ * @param stats the totals to update
+ * @param ss the running hash_serialized writer
+ * @param muhash the running MuHash of the outputs
+ * @param txid the transaction the record belongs to
+ * @param coins the record
+ * @param nValueSize the serialized size of the record in the database
+ */
+void UpdateCoinsStats(CCoinsStats &stats, CHashWriter &ss, MuHash3072 &muhash, const uint256 &txid, const CCoins &coins, unsigned int nValueSize);
+
+/****
+ * @param muhash the MuHash of the outputs
+ * @returns the 32 byte set hash reported as hash_muhash
+ */
+uint256 FinalizeMuHash(MuHash3072 muhash);
+
 /** 
  * Access to the block database (blocks/index/)
  * This database consists of:
@@ -115,11 +220,20 @@ public:
      * @param fWipe wipe data
      * @param compression enable leveldb compression
      * @param maxOpenFiles leveldb max open files
+     * @param nIndexCacheSize if not 0, keep the address, spent and timestamp indexes in their own
+     *        database (blocks/addressindex) with this cache size
      */
-    CBlockTreeDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool compression = true, int maxOpenFiles = 1000);
+    CBlockTreeDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool compression = true, int maxOpenFiles = 1000,
+            size_t nIndexCacheSize = 0);
+    ~CBlockTreeDB();
 private:
     CBlockTreeDB(const CBlockTreeDB&);
     void operator=(const CBlockTreeDB&);
+    //! the database holding the address, spent and timestamp indexes, NULL when they share this one
+    CDBWrapper *pindexdb;
+    CDBWrapper &IndexDB() { return pindexdb != NULL ? *pindexdb : *this; }
+    bool LoadBlockIndexRange(int nFirst, int nEnd, std::mutex &cs, std::atomic<int64_t> &count,
+            std::atomic<bool> &fFailed, std::string &strError, bool fReport);
 public:
     /***
      * Write a batch of records and sync
@@ -136,6 +250,13 @@ public:
      * @returns true on success
      */
     bool EraseBatchSync(const std::vector<const CBlockIndex*>& blockinfo);
+    /***
+     * Read a single block index record, e.g. to get back a trimmed Equihash solution
+     * @param blockhash the block
+     * @param dbindex where to store the results
+     * @returns true on success
+     */
+    bool ReadDiskBlockIndex(const uint256 &blockhash, CDiskBlockIndex &dbindex);
     /***
      * Read the file information
      * @param nFile the file to read
@@ -202,6 +323,15 @@ public:
      */
     bool ReadAddressUnspentIndex(uint160 addressHash, int type,
                                  std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect);
+    /****
+     * Stream the unspent key/value pairs for a particular address, in key order, without collecting them
+     * @param addressHash the address
+     * @param type the address type
+     * @param visitor called for each record, returns false to stop
+     * @returns false if a record could not be read
+     */
+    bool ForEachAddressUnspent(uint160 addressHash, int type,
+            const std::function<bool(const CAddressUnspentKey&, const CAddressUnspentValue&)> &visitor);
     /*****
      * Write a batch of address index / amount records
      * @param vect a collection of address index/amount records
@@ -214,6 +344,49 @@ public:
      * @returns true on success
      */
     bool EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
+    /****
+     * Write the address, unspent, spent and timestamp index records of one block in a single batch,
+     * together with the block those indexes are synced to
+     * @param addressIndex address index / amount records
+     * @param fEraseAddressIndex true to erase the address index records (block disconnected), false to write them
+     * @param addressUnspentIndex unspent index updates, a null value erases the entry
+     * @param spentIndex spent index updates, a null value erases the entry
+     * @param hashBlock the block the records belong to
+     * @param logicalTS the logical timestamp of hashBlock to record, 0 to leave the timestamp index alone
+     * @param hashIndexBest the block the indexes are synced to after this batch
+     * @returns true on success
+     */
+    bool UpdateIndexes(const std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex, bool fEraseAddressIndex,
+            const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &addressUnspentIndex,
+            const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > &spentIndex,
+            const uint256 &hashBlock, unsigned int logicalTS, const uint256 &hashIndexBest);
+    /****
+     * Move the address, spent and timestamp index records to the database selected at construction,
+     * from the block tree database or from a separate index database left by an earlier run
+     * @returns true on success
+     */
+    bool MigrateIndexes();
+    /****
+     * Move the address, spent and timestamp index records between two databases, in batches.
+     * Each batch is written to the destination before it is erased from the source, so a move
+     * that was interrupted can simply be run again.
+     * @param from the database holding the records
+     * @param to the database they are moved to
+     * @returns true on success
+     */
+    static bool MoveIndexRecords(CDBWrapper &from, CDBWrapper &to);
+    /****
+     * Read the block the address, spent and timestamp indexes are synced to
+     * @param hashBlock where to store the result
+     * @returns false if no marker has been written yet
+     */
+    bool ReadIndexBestBlock(uint256 &hashBlock);
+    /****
+     * Set the block the address, spent and timestamp indexes are synced to
+     * @param hashBlock the block
+     * @returns true on success
+     */
+    bool WriteIndexBestBlock(const uint256 &hashBlock);
     /****
      * Read a range of address index / amount records for a particular address
      * @param addressHash the address to look for
@@ -226,6 +399,79 @@ public:
     bool ReadAddressIndex(uint160 addressHash, int type,
                           std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
                           int start = 0, int end = 0);
+    /****
+     * Stream a range of address index / amount records for a particular address, in key order,
+     * without collecting them
+     * @param addressHash the address to look for
+     * @param type the address type
+     * @param visitor called for each record, returns false to stop
+     * @param start the first block height, 0 for the whole history
+     * @param end the last block height, 0 for the whole history
+     * @returns false if a record could not be read
+     */
+    bool ForEachAddressIndex(uint160 addressHash, int type,
+            const std::function<bool(const CAddressIndexKey&, CAmount)> &visitor,
+            int start = 0, int end = 0);
+    /****
+     * Write a batch of oracles data index records
+     * @param vect the records to write
+     * @returns true on success
+     */
+    bool WriteOraclesDataIndex(const std::vector<std::pair<COraclesDataIndexKey, COraclesDataIndexValue> > &vect);
+    /****
+     * Remove a batch of oracles data index records
+     * @param vect the records to erase
+     * @returns true on success
+     */
+    bool EraseOraclesDataIndex(const std::vector<std::pair<COraclesDataIndexKey, COraclesDataIndexValue> > &vect);
+    /****
+     * Read a range of one publisher's oracles data index records
+     * @param oracletxid the oracle
+     * @param publisher the publisher
+     * @param fNewestFirst true to walk from the highest block down
+     * @param limit stop after this many records (0 = no limit)
+     * @param vect the records found
+     * @param start the lowest height (0 = no bound)
+     * @param end the highest height (0 = no bound)
+     * @returns true on success
+     */
+    bool ReadOraclesDataIndex(const uint256 &oracletxid, const CPubKey &publisher, bool fNewestFirst, int32_t limit,
+                              std::vector<std::pair<COraclesDataIndexKey, COraclesDataIndexValue> > &vect,
+                              int start = 0, int end = 0);
+    /****
+     * Read the newest oracles data index record of each publisher of an oracle
+     * @param oracletxid the oracle
+     * @param end the highest height to consider (0 = no bound)
+     * @param vect one record per publisher
+     * @returns true on success
+     */
+    bool ReadOraclesDataPublishers(const uint256 &oracletxid, int end,
+                                   std::vector<std::pair<COraclesDataIndexKey, COraclesDataIndexValue> > &vect);
+    /****
+     * Apply the tokens index changes of a block
+     * @param created the token outputs the block creates
+     * @param spent the indexed token outputs the block spends
+     * @param fConnect true if the block is being connected, false if disconnected
+     * @returns true on success
+     */
+    bool UpdateTokensIndex(const std::vector<std::pair<CTokensIndexKey, CTokensIndexValue> > &created,
+                           const std::vector<std::pair<CTokensIndexKey, CTokensIndexValue> > &spent, bool fConnect);
+    /****
+     * Read the tokens index record of an output, whether or not it is spent
+     * @param outpoint the output
+     * @param output the record
+     * @returns true if the output is an indexed token output
+     */
+    bool ReadTokensOutput(const COutPoint &outpoint, std::pair<CTokensIndexKey, CTokensIndexValue> &output);
+    /****
+     * Read the unspent outputs of a token
+     * @param tokenid the token
+     * @param addressHash the index key of the CC address holding them (null = every holder)
+     * @param vect the outputs found
+     * @returns true on success
+     */
+    bool ReadTokensIndex(const uint256 &tokenid, const uint160 &addressHash,
+                         std::vector<std::pair<CTokensIndexKey, CTokensIndexValue> > &vect);
     /****
      * Write a timestamp entry to the db
      * @param timestampIndex the record to write
@@ -271,8 +517,8 @@ public:
      */
     bool ReadFlag(const std::string &name, bool &fValue);
     /****
-     * Load the block headers from disk
-     * NOTE: this does no consistency check beyond verifying records exist
+     * Load the block headers from disk, spread over several threads
+     * NOTE: the only consistency check is that each header hashes to the key it is stored under
      * @returns true on success
      */
     bool LoadBlockIndexGuts();
@@ -34,6 +34,7 @@
 #include "komodo_globals.h"
 #include "komodo_utils.h"
 #include "komodo_bitcoind.h"
+#include "cc/CCinclude.h"
 
 using namespace std;
 
@@ -138,6 +139,7 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
     for (const SpendDescription &spendDescription : tx.vShieldedSpend) {
         mapSaplingNullifiers[spendDescription.nullifier] = &tx;
     }
+    addCCIndexes(tx);
     nTransactionsUpdated++;
     totalTxSize += entry.GetTxSize();
     cachedInnerUsage += entry.DynamicMemoryUsage();
@@ -251,6 +253,107 @@ bool CTxMemPool::removeAddressIndex(const uint256 txhash)
     return true;
 }
 
+/****
+ * Get the (evalcode, funcid) pairs a transaction is found under by getCCFuncTxids:
+ * the first two bytes of its opreturn, and for token transactions also those of
+ * the contract data carried in the token opreturn
+ */
+static void GetCCFuncKeys(const CTransaction &tx, std::vector<std::pair<uint8_t, uint8_t> > &keys)
+{
+    std::vector<uint8_t> vopret;
+    if ( tx.vout.size() < 2 || !GetOpReturnData(tx.vout.back().scriptPubKey, vopret) || vopret.size() < 2 )
+        return;
+    keys.push_back(std::make_pair(vopret[0], vopret[1]));
+    if ( vopret[0] == EVAL_TOKENS )
+    {
+        uint8_t evalcode; uint256 tokenid; std::vector<CPubKey> pubkeys; std::vector<std::pair<uint8_t, vscript_t> > oprets;
+        if ( DecodeTokenOpRet(tx.vout.back().scriptPubKey, evalcode, tokenid, pubkeys, oprets) != 0 )
+        {
+            for (const std::pair<uint8_t, vscript_t> &opret : oprets)
+            {
+                if ( opret.second.size() >= 2 && std::find(keys.begin(), keys.end(), std::make_pair(opret.second[0], opret.second[1])) == keys.end() )
+                    keys.push_back(std::make_pair(opret.second[0], opret.second[1]));
+            }
+        }
+    }
+}
+
+void CTxMemPool::addCCIndexes(const CTransaction &tx)
+{
+    const uint256 &txhash = tx.GetHash();
+    std::vector<std::pair<uint8_t, uint8_t> > keys;
+    GetCCFuncKeys(tx, keys);
+    if ( !keys.empty() )
+    {
+        for (const std::pair<uint8_t, uint8_t> &key : keys)
+            mapCCFunc[key].insert(txhash);
+        mapCCFuncInserted[txhash] = keys;
+    }
+
+    std::vector<std::string> dests(tx.vout.size());
+    char destaddr[64];
+    for (uint32_t i = 0; i < tx.vout.size(); i++)
+    {
+        if ( Getscriptaddress(destaddr, tx.vout[i].scriptPubKey) )
+        {
+            dests[i] = destaddr;
+            mapDest[dests[i]].insert(COutPoint(txhash, i));
+        }
+    }
+    mapDestInserted[txhash] = dests;
+}
+
+void CTxMemPool::removeCCIndexes(const uint256 &txhash)
+{
+    ccFuncIndexInserted::iterator it = mapCCFuncInserted.find(txhash);
+    if ( it != mapCCFuncInserted.end() )
+    {
+        for (const std::pair<uint8_t, uint8_t> &key : it->second)
+        {
+            ccFuncIndex::iterator mit = mapCCFunc.find(key);
+            if ( mit != mapCCFunc.end() && mit->second.erase(txhash) != 0 && mit->second.empty() )
+                mapCCFunc.erase(mit);
+        }
+        mapCCFuncInserted.erase(it);
+    }
+
+    destIndexInserted::iterator dit = mapDestInserted.find(txhash);
+    if ( dit != mapDestInserted.end() )
+    {
+        for (uint32_t i = 0; i < dit->second.size(); i++)
+        {
+            if ( dit->second[i].empty() )
+                continue;
+            destIndex::iterator mit = mapDest.find(dit->second[i]);
+            if ( mit != mapDest.end() && mit->second.erase(COutPoint(txhash, i)) != 0 && mit->second.empty() )
+                mapDest.erase(mit);
+        }
+        mapDestInserted.erase(dit);
+    }
+}
+
+void CTxMemPool::getCCFuncTxids(uint8_t evalcode, uint8_t funcid, std::vector<uint256> &txids) const
+{
+    LOCK(cs);
+    ccFuncIndex::const_iterator it = mapCCFunc.find(std::make_pair(evalcode, funcid));
+    if ( it != mapCCFunc.end() )
+        txids.insert(txids.end(), it->second.begin(), it->second.end());
+}
+
+void CTxMemPool::getDestOutputs(const std::string &addr, std::vector<COutPoint> &outputs) const
+{
+    LOCK(cs);
+    destIndex::const_iterator it = mapDest.find(addr);
+    if ( it != mapDest.end() )
+        outputs.insert(outputs.end(), it->second.begin(), it->second.end());
+}
+
+bool CTxMemPool::hasDestOutputs(const std::string &addr) const
+{
+    LOCK(cs);
+    return mapDest.count(addr) != 0;
+}
+
 void CTxMemPool::addSpentIndex(const CTxMemPoolEntry &entry, const CCoinsViewCache &view)
 {
     LOCK(cs);
@@ -388,6 +491,7 @@ void CTxMemPool::remove(const CTransaction &origTx, std::list<CTransaction>& rem
             minerPolicyEstimator->removeTx(hash);
             removeAddressIndex(hash);
             removeSpentIndex(hash);
+            removeCCIndexes(hash);
         }
     }
 }
@@ -586,6 +690,10 @@ void CTxMemPool::clear()
     LOCK(cs);
     mapTx.clear();
     mapNextTx.clear();
+    mapCCFunc.clear();
+    mapCCFuncInserted.clear();
+    mapDest.clear();
+    mapDestInserted.clear();
     totalTxSize = 0;
     cachedInnerUsage = 0;
     ++nTransactionsUpdated;
@@ -815,6 +923,39 @@ void CTxMemPool::ApplyDeltas(const uint256 hash, double &dPriorityDelta, CAmount
     nFeeDelta += deltas.second;
 }
 
+bool CTxMemPool::CalculateAncestorPackage(const uint256 &hash, size_t nMaxAncestors, CAmount &nFees, size_t &nSize, std::set<uint256> &setAncestors) const
+{
+    LOCK(cs);
+    nFees = 0;
+    nSize = 0;
+    if ( mapTx.count(hash) == 0 )
+        return false;
+    std::deque<uint256> toVisit;
+    toVisit.push_back(hash);
+    while ( !toVisit.empty() )
+    {
+        uint256 txid = toVisit.front();
+        toVisit.pop_front();
+        indexed_transaction_set::const_iterator it = mapTx.find(txid);
+        nFees += it->GetFee();
+        nSize += it->GetTxSize();
+        std::map<uint256, std::pair<double, CAmount> >::const_iterator pos = mapDeltas.find(txid);
+        if ( pos != mapDeltas.end() )
+            nFees += pos->second.second;
+        for (const CTxIn &txin : it->GetTx().vin)
+        {
+            if ( txin.prevout.hash == hash || mapTx.count(txin.prevout.hash) == 0 || setAncestors.count(txin.prevout.hash) != 0 )
+                continue;
+            // a package cut short would leave out the fees and sizes of the ancestors not visited
+            if ( setAncestors.size() >= nMaxAncestors )
+                return false;
+            setAncestors.insert(txin.prevout.hash);
+            toVisit.push_back(txin.prevout.hash);
+        }
+    }
+    return true;
+}
+
 void CTxMemPool::ClearPrioritisation(const uint256 hash)
 {
     LOCK(cs);
@@ -910,5 +1051,6 @@ bool CCoinsViewMemPool::HaveCoins(const uint256 &txid) const {
 size_t CTxMemPool::DynamicMemoryUsage() const {
     LOCK(cs);
     // Estimate the overhead of mapTx to be 6 pointers + an allocation, as no exact formula for boost::multi_index_contained is implemented.
-    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 6 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + cachedInnerUsage;
+    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 6 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) +
+        memusage::DynamicUsage(mapCCFunc) + memusage::DynamicUsage(mapCCFuncInserted) + memusage::DynamicUsage(mapDest) + memusage::DynamicUsage(mapDestInserted) + cachedInnerUsage;
 }
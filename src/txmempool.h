@@ -187,6 +187,23 @@ private:
     typedef std::map<uint256, std::vector<CSpentIndexKey> > mapSpentIndexInserted;
     mapSpentIndexInserted mapSpentInserted;
 
+    // CC transactions by (evalcode, funcid) of their opreturn
+    typedef std::map<std::pair<uint8_t, uint8_t>, std::set<uint256> > ccFuncIndex;
+    ccFuncIndex mapCCFunc;
+
+    typedef std::map<uint256, std::vector<std::pair<uint8_t, uint8_t> > > ccFuncIndexInserted;
+    ccFuncIndexInserted mapCCFuncInserted;
+
+    // outputs by destination address, as returned by Getscriptaddress
+    typedef std::map<std::string, std::set<COutPoint> > destIndex;
+    destIndex mapDest;
+
+    typedef std::map<uint256, std::vector<std::string> > destIndexInserted;
+    destIndexInserted mapDestInserted;
+
+    void addCCIndexes(const CTransaction &tx);
+    void removeCCIndexes(const uint256 &txhash);
+
 public:
     std::map<COutPoint, CInPoint> mapNextTx;
     std::map<uint256, std::pair<double, CAmount> > mapDeltas;
@@ -212,6 +229,24 @@ public:
     void addSpentIndex(const CTxMemPoolEntry &entry, const CCoinsViewCache &view);
     bool getSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
     bool removeSpentIndex(const uint256 txhash);
+
+    /**
+     * Get the mempool transactions whose opreturn (or the contract data inside a
+     * token opreturn) starts with evalcode and funcid
+     * @param evalcode the CC evalcode
+     * @param funcid the funcid
+     * @param txids the matching txids, in txid order
+     */
+    void getCCFuncTxids(uint8_t evalcode, uint8_t funcid, std::vector<uint256> &txids) const;
+
+    /**
+     * Get the mempool outputs paying to an address
+     * @param addr the address as returned by Getscriptaddress
+     * @param outputs the matching outputs, in txid order
+     */
+    void getDestOutputs(const std::string &addr, std::vector<COutPoint> &outputs) const;
+    //! @returns true if any mempool output pays to addr
+    bool hasDestOutputs(const std::string &addr) const;
     void remove(const CTransaction &tx, std::list<CTransaction>& removed, bool fRecursive = false);
     void removeWithAnchor(const uint256 &invalidRoot, ShieldedType type);
     void removeForReorg(const CCoinsViewCache *pcoins, unsigned int nMemPoolHeight, int flags);
@@ -231,6 +266,19 @@ public:
      */
     bool HasNoInputsOf(const CTransaction& tx) const;
 
+    /**
+     * Sum the modified fees and sizes of a transaction and its unconfirmed ancestors,
+     * for CreateNewBlock to rank parents by the fee rate of the packages they unlock
+     * @param hash the transaction
+     * @param nMaxAncestors give up on transactions with more ancestors than this
+     * @param nFees the fees of the package, including prioritisation deltas
+     * @param nSize the size of the package
+     * @param setAncestors the unconfirmed ancestors found
+     * @returns false if hash is not in the mempool or has more than nMaxAncestors unconfirmed ancestors,
+     * in which case the package is incomplete and must not be used
+     */
+    bool CalculateAncestorPackage(const uint256 &hash, size_t nMaxAncestors, CAmount &nFees, size_t &nSize, std::set<uint256> &setAncestors) const;
+
     /** Affect CreateNewBlock prioritisation of transactions */
     void PrioritiseTransaction(const uint256 hash, const std::string strHash, double dPriorityDelta, const CAmount& nFeeDelta);
     void ApplyDeltas(const uint256 hash, double &dPriorityDelta, CAmount &nFeeDelta);
@@ -0,0 +1,352 @@
+/******************************************************************************
+ * Copyright © 2014-2019 The SuperNET Developers.                             *
+ *                                                                            *
+ * See the AUTHORS, DEVELOPER-AGREEMENT and LICENSE files at                  *
+ * the top-level directory of this distribution for the individual copyright  *
+ * holder information and the developer policies on copyright and licensing.  *
+ *                                                                            *
+ * Unless otherwise agreed in a custom licensing agreement, no part of the    *
+ * SuperNET software, including this file may be copied, modified, propagated *
+ * or distributed except according to the terms contained in the LICENSE file *
+ *                                                                            *
+ * Removal or modification of this copyright notice is prohibited.            *
+ *                                                                            *
+ ******************************************************************************/
+#include "utxosnapshot.h"
+
+#include "clientversion.h"
+#include "hash.h"
+#include "main.h"
+#include "streams.h"
+#include "txdb.h"
+#include "util.h"
+#include "komodo_globals.h"
+#include "komodo_structs.h"
+#include "komodo_utils.h" // komodo_stateptr
+
+#include <boost/filesystem.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+
+/****
+ * Serialization wrapper for a notarized checkpoint, which is a plain struct shared with the C-style code
+ */
+class CSnapshotCheckpoint
+{
+public:
+    notarized_checkpoint &np;
+    CSnapshotCheckpoint(notarized_checkpoint &npIn) : np(npIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(np.notarized_hash);
+        READWRITE(np.notarized_desttxid);
+        READWRITE(np.MoM);
+        READWRITE(np.MoMoM);
+        READWRITE(np.nHeight);
+        READWRITE(np.notarized_height);
+        READWRITE(np.MoMdepth);
+        READWRITE(np.MoMoMdepth);
+        READWRITE(np.MoMoMoffset);
+        READWRITE(np.kmdstarti);
+        READWRITE(np.kmdendi);
+    }
+};
+
+/****
+ * Writes to a file while hashing everything written
+ */
+class CHashedFileWriter
+{
+private:
+    CAutoFile &file;
+    CHashWriter hasher;
+public:
+    CHashedFileWriter(CAutoFile &fileIn) : file(fileIn), hasher(SER_GETHASH, PROTOCOL_VERSION) {}
+
+    template<typename T>
+    CHashedFileWriter& operator<<(const T& obj) {
+        file << obj;
+        hasher << obj;
+        return (*this);
+    }
+
+    uint256 GetHash() { return hasher.GetHash(); }
+};
+
+/****
+ * Hash of the checkpoint records of a snapshot
+ */
+static uint256 HashCheckpoints(std::vector<notarized_checkpoint> &checkpoints)
+{
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    for (notarized_checkpoint &np : checkpoints)
+        ss << CSnapshotCheckpoint(np);
+    return ss.GetHash();
+}
+
+/****
+ * Fill in whether the snapshot's checkpoints agree with this node
+ * @param info the snapshot, with hashCheckpoints already computed
+ */
+static void CheckSnapshotCheckpoints(CUTXOSnapshotInfo &info)
+{
+    char symbol[KOMODO_ASSETCHAIN_MAXLEN],dest[KOMODO_ASSETCHAIN_MAXLEN]; komodo_state *sp;
+    if ( (sp= komodo_stateptr(symbol,dest)) != nullptr )
+    {
+        std::vector<notarized_checkpoint> checkpoints;
+        {
+            std::lock_guard<std::mutex> lock(komodo_mutex);
+            checkpoints = sp->CheckpointsUpTo(info.header.nHeight);
+        }
+        info.fCheckpointsMatch = checkpoints.size() == info.nCheckpoints && HashCheckpoints(checkpoints) == info.hashCheckpoints;
+    }
+}
+
+bool DumpUTXOSnapshot(const boost::filesystem::path &path, CUTXOSnapshotInfo &info, std::string &strError)
+{
+    boost::scoped_ptr<CDBIterator> pcursor;
+    std::vector<notarized_checkpoint> checkpoints;
+    {
+        LOCK(cs_main);
+        FlushStateToDisk();
+        info.header.strSymbol = chainName.symbol();
+        info.header.hashBlock = pcoinsdbview->GetBestBlock();
+        info.header.hashSproutAnchor = pcoinsdbview->GetBestAnchor(SPROUT);
+        info.header.hashSaplingAnchor = pcoinsdbview->GetBestAnchor(SAPLING);
+        BlockMap::const_iterator mi = mapBlockIndex.find(info.header.hashBlock);
+        if ( mi == mapBlockIndex.end() )
+        {
+            strError = "best block of the coins database not found";
+            return false;
+        }
+        info.header.nHeight = mi->second->nHeight;
+        // the iterator keeps seeing this state after cs_main is released
+        pcursor.reset(pcoinsdbview->NewIterator());
+
+        char symbol[KOMODO_ASSETCHAIN_MAXLEN],dest[KOMODO_ASSETCHAIN_MAXLEN]; komodo_state *sp;
+        if ( (sp= komodo_stateptr(symbol,dest)) != nullptr )
+        {
+            std::lock_guard<std::mutex> lock(komodo_mutex);
+            checkpoints = sp->CheckpointsUpTo(info.header.nHeight);
+        }
+    }
+
+    if ( boost::filesystem::exists(path) )
+    {
+        strError = "cannot overwrite existing file " + path.string();
+        return false;
+    }
+    boost::filesystem::path pathTmp = path;
+    pathTmp += ".incomplete";
+    FILE *fp = fopen(pathTmp.string().c_str(), "wb");
+    if ( fp == nullptr )
+    {
+        strError = "cannot open " + pathTmp.string();
+        return false;
+    }
+
+    try
+    {
+        CAutoFile file(fp, SER_DISK, CLIENT_VERSION);
+        CHashedFileWriter writer(file);
+        CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+        MuHash3072 muhash;
+        CUTXOSnapshotTrailer trailer;
+
+        writer << info.header;
+        ss << info.header.hashBlock;
+        for (pcursor->SeekToFirst(); pcursor->Valid(); pcursor->Next())
+        {
+            boost::this_thread::interruption_point();
+            CDataStream ssKey(SER_DISK, CLIENT_VERSION), ssValue(SER_DISK, CLIENT_VERSION);
+            if ( !pcursor->GetKeyDataStream(ssKey) || ssKey.empty() )
+                continue;
+            CCoinsViewDB::SnapshotKeyType type = CCoinsViewDB::GetSnapshotKeyType(ssKey[0]);
+            if ( type == CCoinsViewDB::SNAPSHOT_KEY_NONE )
+                continue;
+            if ( !pcursor->GetValueDataStream(ssValue) )
+                throw std::runtime_error("unable to read chainstate value");
+            if ( type == CCoinsViewDB::SNAPSHOT_KEY_COINS )
+            {
+                std::pair<char, uint256> key;
+                CDataStream ssTxid(ssKey);
+                ssTxid >> key;
+                CCoins coins;
+                CDataStream ssCoins(ssValue);
+                ssCoins >> coins;
+                UpdateCoinsStats(info.stats, ss, muhash, key.second, coins, ssValue.size());
+            }
+            else if ( type == CCoinsViewDB::SNAPSHOT_KEY_ANCHOR )
+                info.nAnchors++;
+            else
+                info.nNullifiers++;
+            std::vector<unsigned char> vKey(ssKey.begin(), ssKey.end()), vValue(ssValue.begin(), ssValue.end());
+            writer << SNAPSHOT_RECORD_CHAINSTATE << vKey << vValue;
+            trailer.nRecords++;
+        }
+        for (notarized_checkpoint &np : checkpoints)
+        {
+            writer << SNAPSHOT_RECORD_CHECKPOINT << CSnapshotCheckpoint(np);
+            trailer.nCheckpoints++;
+        }
+        info.hashCheckpoints = HashCheckpoints(checkpoints);
+        writer << SNAPSHOT_RECORD_END;
+
+        info.stats.hashBlock = info.header.hashBlock;
+        info.stats.nHeight = info.header.nHeight;
+        info.stats.hashSerialized = ss.GetHash();
+        info.stats.hashMuHash = FinalizeMuHash(muhash);
+        trailer.nTransactions = info.stats.nTransactions;
+        trailer.nTransactionOutputs = info.stats.nTransactionOutputs;
+        trailer.nTotalAmount = info.stats.nTotalAmount;
+        trailer.hashSerialized = info.stats.hashSerialized;
+        writer << trailer;
+        info.checksum = writer.GetHash();
+        file << info.checksum;
+        info.nCheckpoints = trailer.nCheckpoints;
+        info.nFileSize = ftell(file.Get());
+        FileCommit(file.Get());
+    }
+    catch (const std::exception &e)
+    {
+        boost::filesystem::remove(pathTmp);
+        strError = strprintf("error writing snapshot: %s", e.what());
+        return false;
+    }
+    if ( !RenameOver(pathTmp, path) )
+    {
+        strError = "cannot rename " + pathTmp.string();
+        return false;
+    }
+    CheckSnapshotCheckpoints(info);
+    LogPrintf("%s: wrote %s at height %d (%u coins records, %u checkpoints)\n", __func__,
+            path.string(), info.header.nHeight, (unsigned int)info.stats.nTransactions, (unsigned int)info.nCheckpoints);
+    return true;
+}
+
+bool VerifyUTXOSnapshot(const boost::filesystem::path &path, CUTXOSnapshotInfo &info, std::string &strError)
+{
+    FILE *fp = fopen(path.string().c_str(), "rb");
+    if ( fp == nullptr )
+    {
+        strError = "cannot open " + path.string();
+        return false;
+    }
+
+    try
+    {
+        CAutoFile file(fp, SER_DISK, CLIENT_VERSION);
+        CHashVerifier<CAutoFile> verifier(&file);
+        CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+        MuHash3072 muhash;
+        CUTXOSnapshotTrailer trailer;
+        uint64_t nRecords = 0;
+        CHashWriter ssCheckpoints(SER_GETHASH, PROTOCOL_VERSION);
+
+        verifier >> info.header;
+        if ( info.header.nMagic != CUTXOSnapshotHeader::MAGIC )
+        {
+            strError = "not a UTXO snapshot file";
+            return false;
+        }
+        if ( info.header.nVersion > CUTXOSnapshotHeader::CURRENT_VERSION )
+        {
+            strError = strprintf("unsupported snapshot version %u", info.header.nVersion);
+            return false;
+        }
+        if ( info.header.strSymbol != chainName.symbol() )
+        {
+            strError = strprintf("snapshot is for chain %s", info.header.strSymbol);
+            return false;
+        }
+        ss << info.header.hashBlock;
+        while ( true )
+        {
+            boost::this_thread::interruption_point();
+            unsigned char chRecord;
+            verifier >> chRecord;
+            if ( chRecord == SNAPSHOT_RECORD_END )
+                break;
+            else if ( chRecord == SNAPSHOT_RECORD_CHAINSTATE )
+            {
+                std::vector<unsigned char> vKey, vValue;
+                verifier >> vKey >> vValue;
+                CCoinsViewDB::SnapshotKeyType type = vKey.empty() ? CCoinsViewDB::SNAPSHOT_KEY_NONE : CCoinsViewDB::GetSnapshotKeyType(vKey[0]);
+                if ( type == CCoinsViewDB::SNAPSHOT_KEY_NONE )
+                {
+                    strError = "unexpected chainstate record";
+                    return false;
+                }
+                if ( type == CCoinsViewDB::SNAPSHOT_KEY_COINS )
+                {
+                    std::pair<char, uint256> key;
+                    CDataStream ssTxid(vKey, SER_DISK, CLIENT_VERSION);
+                    ssTxid >> key;
+                    CCoins coins;
+                    CDataStream ssCoins(vValue, SER_DISK, CLIENT_VERSION);
+                    ssCoins >> coins;
+                    UpdateCoinsStats(info.stats, ss, muhash, key.second, coins, vValue.size());
+                }
+                else if ( type == CCoinsViewDB::SNAPSHOT_KEY_ANCHOR )
+                    info.nAnchors++;
+                else
+                    info.nNullifiers++;
+                nRecords++;
+            }
+            else if ( chRecord == SNAPSHOT_RECORD_CHECKPOINT )
+            {
+                notarized_checkpoint np;
+                CSnapshotCheckpoint wrapper(np);
+                verifier >> wrapper;
+                if ( np.nHeight > info.header.nHeight )
+                {
+                    strError = "checkpoint above the snapshot base block";
+                    return false;
+                }
+                ssCheckpoints << wrapper;
+                info.nCheckpoints++;
+            }
+            else
+            {
+                strError = strprintf("unknown record type %d", (int)chRecord);
+                return false;
+            }
+        }
+        info.hashCheckpoints = ssCheckpoints.GetHash();
+        verifier >> trailer;
+        info.checksum = verifier.GetHash();
+        uint256 checksum;
+        file >> checksum;
+        info.nFileSize = ftell(file.Get());
+        if ( checksum != info.checksum )
+        {
+            strError = "checksum mismatch";
+            return false;
+        }
+
+        info.stats.hashBlock = info.header.hashBlock;
+        info.stats.nHeight = info.header.nHeight;
+        info.stats.hashSerialized = ss.GetHash();
+        info.stats.hashMuHash = FinalizeMuHash(muhash);
+        if ( trailer.nRecords != nRecords || trailer.nCheckpoints != info.nCheckpoints
+                || trailer.nTransactions != info.stats.nTransactions
+                || trailer.nTransactionOutputs != info.stats.nTransactionOutputs
+                || trailer.nTotalAmount != info.stats.nTotalAmount
+                || trailer.hashSerialized != info.stats.hashSerialized )
+        {
+            strError = "snapshot totals do not match its contents";
+            return false;
+        }
+    }
+    catch (const std::exception &e)
+    {
+        strError = strprintf("error reading snapshot: %s", e.what());
+        return false;
+    }
+
+    CheckSnapshotCheckpoints(info);
+    return true;
+}
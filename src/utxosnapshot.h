@@ -0,0 +1,138 @@
+/******************************************************************************
+ * Copyright © 2014-2019 The SuperNET Developers.                             *
+ *                                                                            *
+ * See the AUTHORS, DEVELOPER-AGREEMENT and LICENSE files at                  *
+ * the top-level directory of this distribution for the individual copyright  *
+ * holder information and the developer policies on copyright and licensing.  *
+ *                                                                            *
+ * Unless otherwise agreed in a custom licensing agreement, no part of the    *
+ * SuperNET software, including this file may be copied, modified, propagated *
+ * or distributed except according to the terms contained in the LICENSE file *
+ *                                                                            *
+ * Removal or modification of this copyright notice is prohibited.            *
+ *                                                                            *
+ ******************************************************************************/
+#pragma once
+
+#include "coins.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <boost/filesystem/path.hpp>
+
+#include <string>
+
+/****
+ * UTXO set snapshots (dumptxoutset / verifytxoutset)
+ *
+ * File layout, all in SER_DISK serialization:
+ * - CUTXOSnapshotHeader
+ * - a stream of records, each starting with a record type byte:
+ *   - SNAPSHOT_RECORD_CHAINSTATE: key and value of a chainstate entry (coins, anchor or nullifier)
+ *     exactly as stored in the database, the key including its prefix byte
+ *   - SNAPSHOT_RECORD_CHECKPOINT: a notarized checkpoint (NPOINTS entry) at or below the base block
+ *   - SNAPSHOT_RECORD_END: no payload, ends the stream
+ * - CUTXOSnapshotTrailer
+ * - checksum: double SHA256 of everything above
+ *
+ * The trailer carries the gettxoutsetinfo hash_serialized of the coins, which can be compared with
+ * that of a node at the base height. The anchors and nullifiers are only covered by the file
+ * checksum, and the checkpoints can only be compared with the node's own komodostate. Snapshots
+ * are verified, never loaded; the single chainstate of this tree cannot start from a snapshot and
+ * validate history behind it.
+ */
+
+static const unsigned char SNAPSHOT_RECORD_END = 0;
+static const unsigned char SNAPSHOT_RECORD_CHAINSTATE = 1;
+static const unsigned char SNAPSHOT_RECORD_CHECKPOINT = 2;
+
+class CUTXOSnapshotHeader
+{
+public:
+    static const uint32_t MAGIC = 0x4f54584b; // "KXTO"
+    static const uint32_t CURRENT_VERSION = 1;
+
+    uint32_t nMagic;
+    uint32_t nVersion;
+    std::string strSymbol; // chain the snapshot was taken from
+    uint256 hashBlock; // base block of the snapshot
+    int32_t nHeight;
+    uint256 hashSproutAnchor;
+    uint256 hashSaplingAnchor;
+
+    CUTXOSnapshotHeader() : nMagic(MAGIC), nVersion(CURRENT_VERSION), nHeight(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nMagic);
+        READWRITE(nVersion);
+        READWRITE(LIMITED_STRING(strSymbol, 65));
+        READWRITE(hashBlock);
+        READWRITE(nHeight);
+        READWRITE(hashSproutAnchor);
+        READWRITE(hashSaplingAnchor);
+    }
+};
+
+class CUTXOSnapshotTrailer
+{
+public:
+    uint64_t nRecords; // chainstate records
+    uint64_t nCheckpoints;
+    uint64_t nTransactions;
+    uint64_t nTransactionOutputs;
+    CAmount nTotalAmount;
+    uint256 hashSerialized;
+
+    CUTXOSnapshotTrailer() : nRecords(0), nCheckpoints(0), nTransactions(0), nTransactionOutputs(0), nTotalAmount(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nRecords);
+        READWRITE(nCheckpoints);
+        READWRITE(nTransactions);
+        READWRITE(nTransactionOutputs);
+        READWRITE(nTotalAmount);
+        READWRITE(hashSerialized);
+    }
+};
+
+/****
+ * What was written to or found in a snapshot file
+ */
+struct CUTXOSnapshotInfo
+{
+    CUTXOSnapshotHeader header;
+    CCoinsStats stats;
+    uint64_t nAnchors = 0;
+    uint64_t nNullifiers = 0;
+    uint64_t nCheckpoints = 0;
+    uint64_t nFileSize = 0;
+    uint256 checksum;
+    uint256 hashCheckpoints; // hash of the checkpoint records
+    bool fCheckpointsMatch = false; // checkpoints equal this node's komodostate up to the base height
+};
+
+/****
+ * Write the chainstate as of the current tip, with the matching notarized checkpoints, to a file.
+ * cs_main is only held while the database view is captured.
+ * @param path where to write (must not exist)
+ * @param info the results
+ * @param strError the reason on failure
+ * @returns true on success
+ */
+bool DumpUTXOSnapshot(const boost::filesystem::path &path, CUTXOSnapshotInfo &info, std::string &strError);
+
+/****
+ * Read a snapshot file, checking its checksum and that its totals and coins hash match its
+ * contents. Nothing is written to the node's databases.
+ * @param path the file to read
+ * @param info the results
+ * @param strError the reason on failure
+ * @returns true if the snapshot is intact
+ */
+bool VerifyUTXOSnapshot(const boost::filesystem::path &path, CUTXOSnapshotInfo &info, std::string &strError);
@@ -3286,6 +3286,12 @@ UniValue zc_benchmark(const UniValue& params, bool fHelp, const CPubKey& mypk)
 #endif
         } else if (benchmarktype == "verifyequihash") {
             sample_times.push_back(benchmark_verify_equihash());
+        } else if (benchmarktype == "verifyequihashbatch") {
+            int nSolutions = 1000;
+            if (params.size() >= 3) {
+                nSolutions = params[2].get_int();
+            }
+            sample_times.push_back(benchmark_verify_equihash_batch(nSolutions));
         } else if (benchmarktype == "validatelargetx") {
             // Number of inputs in the spending transaction that we will simulate
             int nInputs = 11130;
@@ -3293,17 +3299,44 @@ UniValue zc_benchmark(const UniValue& params, bool fHelp, const CPubKey& mypk)
                 nInputs = params[2].get_int();
             }
             sample_times.push_back(benchmark_large_tx(nInputs));
+        } else if (benchmarktype == "verifyccspend") {
+            int nInputs = 1000;
+            if (params.size() >= 3) {
+                nInputs = params[2].get_int();
+            }
+            sample_times.push_back(benchmark_verify_cc_spend(nInputs));
         } else if (benchmarktype == "trydecryptnotes") {
             int nAddrs = params[2].get_int();
             sample_times.push_back(benchmark_try_decrypt_notes(nAddrs));
         } else if (benchmarktype == "incnotewitnesses") {
             int nTxs = params[2].get_int();
-            sample_times.push_back(benchmark_increment_note_witnesses(nTxs));
+            int nCommitments = 0;
+            int nThreads = DEFAULT_WITNESS_THREADS;
+            if (params.size() >= 4) {
+                nCommitments = params[3].get_int();
+            }
+            if (params.size() >= 5) {
+                nThreads = params[4].get_int();
+            }
+            sample_times.push_back(benchmark_increment_note_witnesses(nTxs, nCommitments, nThreads));
         } else if (benchmarktype == "connectblockslow") {
             if (Params().NetworkIDString() != "regtest") {
                 throw JSONRPCError(RPC_TYPE_ERROR, "Benchmark must be run in regtest mode");
             }
             sample_times.push_back(benchmark_connectblock_slow());
+        } else if (benchmarktype == "prefetchcoins") {
+            int nBlocks = params[2].get_int();
+            int nThreads = DEFAULT_PREFETCH_THREADS;
+            if (params.size() >= 4) {
+                nThreads = params[3].get_int();
+            }
+            sample_times.push_back(benchmark_prefetch_coins(nBlocks, nThreads));
+        } else if (benchmarktype == "readblockheaders") {
+            int nHeaders = 2000;
+            if (params.size() >= 3) {
+                nHeaders = params[2].get_int();
+            }
+            sample_times.push_back(benchmark_read_block_headers(nHeaders));
         } else if (benchmarktype == "sendtoaddress") {
             if (Params().NetworkIDString() != "regtest") {
                 throw JSONRPCError(RPC_TYPE_ERROR, "Benchmark must be run in regtest mode");
@@ -7201,6 +7234,25 @@ UniValue tokenorders(const UniValue& params, bool fHelp, const CPubKey& mypk)
 }
 
 
+UniValue tokentopofbook(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    uint256 tokenid; int32_t depth = 1;
+    if ( fHelp || params.size() < 1 || params.size() > 2 )
+        throw runtime_error("tokentopofbook tokenid [depth]\n"
+                            "returns the best bids and asks for the tokenid, best price first, up to depth orders on each side (default 1)\n"
+                            "orders already spent in the mempool are skipped\n" "\n");
+    if (ensure_CCrequirements(EVAL_ASSETS) < 0 || ensure_CCrequirements(EVAL_TOKENS) < 0)
+        throw runtime_error(CC_REQUIREMENTS_MSG);
+    tokenid = Parseuint256((char *)params[0].get_str().c_str());
+    if (tokenid == zeroid)
+        throw runtime_error("incorrect tokenid\n");
+    if (params.size() == 2)
+        depth = atoi(params[1].get_str().c_str());
+    if (depth < 1)
+        throw runtime_error("depth must be positive\n");
+    return AssetTopOfBook(tokenid, depth);
+}
+
 UniValue mytokenorders(const UniValue& params, bool fHelp, const CPubKey& mypk)
 {
     uint256 tokenid;
@@ -46,6 +46,8 @@
 #include "komodo_globals.h"
 
 #include <assert.h>
+#include <atomic>
+#include <thread>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/filesystem.hpp>
@@ -65,6 +67,7 @@ unsigned int nTxConfirmTarget = DEFAULT_TX_CONFIRM_TARGET;
 bool bSpendZeroConfChange = true;
 bool fSendFreeTransactions = false;
 bool fPayAtLeastCustomFee = true;
+unsigned int nWitnessThreads = DEFAULT_WITNESS_THREADS;
 #include "komodo_defs.h"
 
 const char * DEFAULT_WALLET_DAT = "wallet.dat";
@@ -959,6 +962,13 @@ void CWallet::AddToSaplingSpends(const uint256& nullifier, const uint256& wtxid)
     SyncMetaData<uint256>(range);
 }
 
+void CWallet::AddToNoteTxids(const CWalletTx& wtx)
+{
+    if (!wtx.mapSproutNoteData.empty() || !wtx.mapSaplingNoteData.empty()) {
+        setNoteTxids.insert(wtx.GetHash());
+    }
+}
+
 void CWallet::AddToSpends(const uint256& wtxid)
 {
     assert(mapWallet.count(wtxid));
@@ -996,90 +1006,143 @@ void CWallet::ClearNoteWitnessCache()
     //LogPrintf("Clear witness cache\n");
 }
 
-template<typename NoteDataMap>
-void CopyPreviousWitnesses(NoteDataMap& noteDataMap, int indexHeight, int64_t nWitnessCacheSize)
+template<typename NoteDataMap, typename NoteData>
+void CollectNotesToWitness(NoteDataMap& noteDataMap, int indexHeight, std::vector<NoteData*>& vNotes)
 {
     for (auto& item : noteDataMap) {
-        auto* nd = &(item.second);
         // Only increment witnesses that are behind the current height
-        if (nd->witnessHeight < indexHeight) {
-            // Check the validity of the cache
-            // The only time a note witnessed above the current height
-            // would be invalid here is during a reindex when blocks
-            // have been decremented, and we are incrementing the blocks
-            // immediately after.
-            assert(nWitnessCacheSize >= nd->witnesses.size());
-            // Witnesses being incremented should always be either -1
-            // (never incremented or decremented) or one below indexHeight
-            assert((nd->witnessHeight == -1) || (nd->witnessHeight == indexHeight - 1));
-            // Copy the witness for the previous block if we have one
-            if (nd->witnesses.size() > 0) {
-                nd->witnesses.push_front(nd->witnesses.front());
-            }
-            if (nd->witnesses.size() > WITNESS_CACHE_SIZE) {
-                nd->witnesses.pop_back();
-            }
+        if (item.second.witnessHeight < indexHeight) {
+            vNotes.push_back(&(item.second));
         }
     }
 }
 
-template<typename NoteDataMap>
-void AppendNoteCommitment(NoteDataMap& noteDataMap, int indexHeight, int64_t nWitnessCacheSize, const uint256& note_commitment)
+template<typename NoteData>
+void CopyPreviousWitnesses(std::vector<NoteData*>& vNotes, int indexHeight, int64_t nWitnessCacheSize)
 {
-    for (auto& item : noteDataMap) {
-        auto* nd = &(item.second);
-        if (nd->witnessHeight < indexHeight && nd->witnesses.size() > 0) {
-            // Check the validity of the cache
-            // See comment in CopyPreviousWitnesses about validity.
-            assert(nWitnessCacheSize >= nd->witnesses.size());
-            nd->witnesses.front().append(note_commitment);
+    for (NoteData* nd : vNotes) {
+        // Check the validity of the cache
+        // The only time a note witnessed above the current height
+        // would be invalid here is during a reindex when blocks
+        // have been decremented, and we are incrementing the blocks
+        // immediately after.
+        assert(nWitnessCacheSize >= nd->witnesses.size());
+        // Witnesses being incremented should always be either -1
+        // (never incremented or decremented) or one below indexHeight
+        assert((nd->witnessHeight == -1) || (nd->witnessHeight == indexHeight - 1));
+        // Copy the witness for the previous block if we have one
+        if (nd->witnesses.size() > 0) {
+            nd->witnesses.push_front(nd->witnesses.front());
+        }
+        if (nd->witnesses.size() > WITNESS_CACHE_SIZE) {
+            nd->witnesses.pop_back();
         }
     }
 }
 
-template<typename OutPoint, typename NoteData, typename Witness>
-void WitnessNoteIfMine(std::map<OutPoint, NoteData>& noteDataMap, int indexHeight, int64_t nWitnessCacheSize, const OutPoint& key, const Witness& witness)
+/**
+ * Appends the block's note commitments to the newest witness of each note,
+ * starting every note at its own offset into vCommitments (notes witnessed
+ * inside the block only take the commitments that follow their own).
+ * Witnesses are independent of each other, so the notes are shared out
+ * between up to nThreads threads when there is enough hashing to do.
+ */
+template<typename NoteData>
+void AppendNoteCommitments(const std::vector<std::pair<NoteData*, size_t>>& vNotes, const std::vector<uint256>& vCommitments, unsigned int nThreads)
 {
-    if (noteDataMap.count(key) && noteDataMap[key].witnessHeight < indexHeight) {
-        auto* nd = &(noteDataMap[key]);
-        if (nd->witnesses.size() > 0) {
-            // We think this can happen because we write out the
-            // witness cache state after every block increment or
-            // decrement, but the block index itself is written in
-            // batches. So if the node crashes in between these two
-            // operations, it is possible for IncrementNoteWitnesses
-            // to be called again on previously-cached blocks. This
-            // doesn't affect existing cached notes because of the
-            // NoteData::witnessHeight checks. See #1378 for details.
-            LogPrintf("Inconsistent witness cache state found for %s\n- Cache size: %d\n- Top (height %d): %s\n- New (height %d): %s\n",
-                        key.ToString(), nd->witnesses.size(),
-                        nd->witnessHeight,
-                        nd->witnesses.front().root().GetHex(),
-                        indexHeight,
-                        witness.root().GetHex());
-            nd->witnesses.clear();
-        }
-        nd->witnesses.push_front(witness);
-        // Set height to one less than pindex so it gets incremented
-        nd->witnessHeight = indexHeight - 1;
+    static const size_t WITNESS_APPENDS_PER_THREAD = 256;
+
+    size_t nAppends = 0;
+    for (const std::pair<NoteData*, size_t>& item : vNotes) {
+        nAppends += vCommitments.size() - item.second;
+    }
+    if (nAppends == 0)
+        return;
+
+    std::atomic<size_t> nNext(0);
+    auto appender = [&]() {
+        size_t i;
+        while ((i = nNext++) < vNotes.size()) {
+            NoteData* nd = vNotes[i].first;
+            for (size_t j = vNotes[i].second; j < vCommitments.size(); j++) {
+                nd->witnesses.front().append(vCommitments[j]);
+            }
+        }
+    };
+    nThreads = std::min<size_t>(std::min<size_t>(nThreads, vNotes.size()), nAppends / WITNESS_APPENDS_PER_THREAD);
+    if (nThreads <= 1) {
+        appender();
+    } else {
+        std::vector<std::thread> vAppenders;
+        for (unsigned int i = 1; i < nThreads; i++)
+            vAppenders.emplace_back(appender);
+        appender();
+        for (std::thread &t : vAppenders)
+            t.join();
+    }
+}
+
+template<typename OutPoint, typename NoteData, typename Witness>
+NoteData* WitnessNoteIfMine(std::map<OutPoint, NoteData>& noteDataMap, int indexHeight, int64_t nWitnessCacheSize, const OutPoint& key, const Witness& witness)
+{
+    typename std::map<OutPoint, NoteData>::iterator it = noteDataMap.find(key);
+    if (it == noteDataMap.end() || it->second.witnessHeight >= indexHeight)
+        return nullptr;
+
+    auto* nd = &(it->second);
+    if (nd->witnesses.size() > 0) {
+        // We think this can happen because we write out the
+        // witness cache state after every block increment or
+        // decrement, but the block index itself is written in
+        // batches. So if the node crashes in between these two
+        // operations, it is possible for IncrementNoteWitnesses
+        // to be called again on previously-cached blocks. This
+        // doesn't affect existing cached notes because of the
+        // NoteData::witnessHeight checks. See #1378 for details.
+        // The top witness has not had this block's commitments
+        // appended yet, as they are applied in one batch later.
+        LogPrintf("Inconsistent witness cache state found for %s\n- Cache size: %d\n- Top (height %d): %s\n- New (height %d): %s\n",
+                    key.ToString(), nd->witnesses.size(),
+                    nd->witnessHeight,
+                    nd->witnesses.front().root().GetHex(),
+                    indexHeight,
+                    witness.root().GetHex());
+        nd->witnesses.clear();
+    }
+    nd->witnesses.push_front(witness);
+    // Set height to one less than pindex so it gets incremented
+    nd->witnessHeight = indexHeight - 1;
+    // Check the validity of the cache
+    assert(nWitnessCacheSize >= nd->witnesses.size());
+    return nd;
+}
+
+template<typename NoteData>
+void UpdateWitnessHeights(std::vector<NoteData*>& vNotes, int indexHeight, int64_t nWitnessCacheSize)
+{
+    for (NoteData* nd : vNotes) {
+        nd->witnessHeight = indexHeight;
         // Check the validity of the cache
+        // See comment in CopyPreviousWitnesses about validity.
         assert(nWitnessCacheSize >= nd->witnesses.size());
     }
 }
 
-
-template<typename NoteDataMap>
-void UpdateWitnessHeights(NoteDataMap& noteDataMap, int indexHeight, int64_t nWitnessCacheSize)
+template<typename NoteData>
+std::vector<std::pair<NoteData*, size_t>> GetWitnessAppendStarts(std::vector<NoteData*>& vNotes, std::map<NoteData*, size_t>& mapWitnessedInBlock, int64_t nWitnessCacheSize)
 {
-    for (auto& item : noteDataMap) {
-        auto* nd = &(item.second);
-        if (nd->witnessHeight < indexHeight) {
-            nd->witnessHeight = indexHeight;
-            // Check the validity of the cache
-            // See comment in CopyPreviousWitnesses about validity.
-            assert(nWitnessCacheSize >= nd->witnesses.size());
-        }
+    std::vector<std::pair<NoteData*, size_t>> vStarts;
+    vStarts.reserve(vNotes.size());
+    for (NoteData* nd : vNotes) {
+        if (nd->witnesses.size() == 0)
+            continue;
+        // Check the validity of the cache
+        // See comment in CopyPreviousWitnesses about validity.
+        assert(nWitnessCacheSize >= nd->witnesses.size());
+        typename std::map<NoteData*, size_t>::iterator it = mapWitnessedInBlock.find(nd);
+        vStarts.push_back(std::make_pair(nd, it == mapWitnessedInBlock.end() ? 0 : it->second));
     }
+    return vStarts;
 }
 
 void CWallet::IncrementNoteWitnesses(const CBlockIndex* pindex,
@@ -1088,10 +1151,23 @@ void CWallet::IncrementNoteWitnesses(const CBlockIndex* pindex,
                                      SaplingMerkleTree& saplingTree)
 {
     LOCK(cs_wallet);
-    for (std::pair<const uint256, CWalletTx>& wtxItem : mapWallet) {
-       ::CopyPreviousWitnesses(wtxItem.second.mapSproutNoteData, pindex->nHeight, nWitnessCacheSize);
-       ::CopyPreviousWitnesses(wtxItem.second.mapSaplingNoteData, pindex->nHeight, nWitnessCacheSize);
+    int64_t nTimeStart = GetTimeMicros();
+
+    // Only the transactions carrying notes can have witnesses to increment
+    std::vector<SproutNoteData*> vSproutNotes;
+    std::vector<SaplingNoteData*> vSaplingNotes;
+    for (std::set<uint256>::iterator it = setNoteTxids.begin(); it != setNoteTxids.end(); ) {
+        std::map<uint256, CWalletTx>::iterator mi = mapWallet.find(*it);
+        if (mi == mapWallet.end()) {
+            it = setNoteTxids.erase(it);
+            continue;
+        }
+        ::CollectNotesToWitness(mi->second.mapSproutNoteData, pindex->nHeight, vSproutNotes);
+        ::CollectNotesToWitness(mi->second.mapSaplingNoteData, pindex->nHeight, vSaplingNotes);
+        ++it;
     }
+    ::CopyPreviousWitnesses(vSproutNotes, pindex->nHeight, nWitnessCacheSize);
+    ::CopyPreviousWitnesses(vSaplingNotes, pindex->nHeight, nWitnessCacheSize);
 
     if (nWitnessCacheSize < WITNESS_CACHE_SIZE) {
         nWitnessCacheSize += 1;
@@ -1104,25 +1180,30 @@ void CWallet::IncrementNoteWitnesses(const CBlockIndex* pindex,
         pblock = &block;
     }
 
+    // Walk the block once, growing the trees and witnessing our own notes.
+    // Existing witnesses take all of the block's commitments, a note
+    // witnessed here only those after it.
+    std::vector<uint256> vSproutCommitments, vSaplingCommitments;
+    std::map<SproutNoteData*, size_t> mapSproutWitnessed;
+    std::map<SaplingNoteData*, size_t> mapSaplingWitnessed;
     for (const CTransaction& tx : pblock->vtx) {
         auto hash = tx.GetHash();
-        bool txIsOurs = mapWallet.count(hash);
+        std::map<uint256, CWalletTx>::iterator mi = mapWallet.find(hash);
+        bool txIsOurs = mi != mapWallet.end();
         // Sprout
         for (size_t i = 0; i < tx.vjoinsplit.size(); i++) {
             const JSDescription& jsdesc = tx.vjoinsplit[i];
             for (uint8_t j = 0; j < jsdesc.commitments.size(); j++) {
                 const uint256& note_commitment = jsdesc.commitments[j];
                 sproutTree.append(note_commitment);
-
-                // Increment existing witnesses
-                for (std::pair<const uint256, CWalletTx>& wtxItem : mapWallet) {
-                    ::AppendNoteCommitment(wtxItem.second.mapSproutNoteData, pindex->nHeight, nWitnessCacheSize, note_commitment);
-                }
+                vSproutCommitments.push_back(note_commitment);
 
                 // If this is our note, witness it
                 if (txIsOurs) {
                     JSOutPoint jsoutpt {hash, i, j};
-                    ::WitnessNoteIfMine(mapWallet[hash].mapSproutNoteData, pindex->nHeight, nWitnessCacheSize, jsoutpt, sproutTree.witness());
+                    SproutNoteData* nd = ::WitnessNoteIfMine(mi->second.mapSproutNoteData, pindex->nHeight, nWitnessCacheSize, jsoutpt, sproutTree.witness());
+                    if (nd)
+                        mapSproutWitnessed[nd] = vSproutCommitments.size();
                 }
             }
         }
@@ -1130,25 +1211,29 @@ void CWallet::IncrementNoteWitnesses(const CBlockIndex* pindex,
         for (uint32_t i = 0; i < tx.vShieldedOutput.size(); i++) {
             const uint256& note_commitment = tx.vShieldedOutput[i].cm;
             saplingTree.append(note_commitment);
-
-            // Increment existing witnesses
-            for (std::pair<const uint256, CWalletTx>& wtxItem : mapWallet) {
-                ::AppendNoteCommitment(wtxItem.second.mapSaplingNoteData, pindex->nHeight, nWitnessCacheSize, note_commitment);
-            }
+            vSaplingCommitments.push_back(note_commitment);
 
             // If this is our note, witness it
             if (txIsOurs) {
                 SaplingOutPoint outPoint {hash, i};
-                ::WitnessNoteIfMine(mapWallet[hash].mapSaplingNoteData, pindex->nHeight, nWitnessCacheSize, outPoint, saplingTree.witness());
+                SaplingNoteData* nd = ::WitnessNoteIfMine(mi->second.mapSaplingNoteData, pindex->nHeight, nWitnessCacheSize, outPoint, saplingTree.witness());
+                if (nd)
+                    mapSaplingWitnessed[nd] = vSaplingCommitments.size();
             }
         }
     }
 
+    // Increment existing witnesses
+    ::AppendNoteCommitments(::GetWitnessAppendStarts(vSproutNotes, mapSproutWitnessed, nWitnessCacheSize), vSproutCommitments, nWitnessThreads);
+    ::AppendNoteCommitments(::GetWitnessAppendStarts(vSaplingNotes, mapSaplingWitnessed, nWitnessCacheSize), vSaplingCommitments, nWitnessThreads);
+
     // Update witness heights
-    for (std::pair<const uint256, CWalletTx>& wtxItem : mapWallet) {
-        ::UpdateWitnessHeights(wtxItem.second.mapSproutNoteData, pindex->nHeight, nWitnessCacheSize);
-        ::UpdateWitnessHeights(wtxItem.second.mapSaplingNoteData, pindex->nHeight, nWitnessCacheSize);
-    }
+    ::UpdateWitnessHeights(vSproutNotes, pindex->nHeight, nWitnessCacheSize);
+    ::UpdateWitnessHeights(vSaplingNotes, pindex->nHeight, nWitnessCacheSize);
+
+    LogPrint("bench", "    - Increment note witnesses: %.2fms [%u sprout + %u sapling notes, %u + %u commitments]\n",
+             0.001 * (GetTimeMicros() - nTimeStart), vSproutNotes.size(), vSaplingNotes.size(),
+             vSproutCommitments.size(), vSaplingCommitments.size());
 
     // For performance reasons, we write out the witness cache in
     // CWallet::SetBestChain() (which also ensures that overall consistency
@@ -1204,10 +1289,13 @@ bool DecrementNoteWitnesses(NoteDataMap& noteDataMap, int indexHeight, int64_t n
 void CWallet::DecrementNoteWitnesses(const CBlockIndex* pindex)
 {
     LOCK(cs_wallet);
-    for (std::pair<const uint256, CWalletTx>& wtxItem : mapWallet) {
-        if (!::DecrementNoteWitnesses(wtxItem.second.mapSproutNoteData, pindex->nHeight, nWitnessCacheSize))
+    for (const uint256& wtxid : setNoteTxids) {
+        std::map<uint256, CWalletTx>::iterator mi = mapWallet.find(wtxid);
+        if (mi == mapWallet.end())
+            continue;
+        if (!::DecrementNoteWitnesses(mi->second.mapSproutNoteData, pindex->nHeight, nWitnessCacheSize))
             needsRescan = true;
-        if (!::DecrementNoteWitnesses(wtxItem.second.mapSaplingNoteData, pindex->nHeight, nWitnessCacheSize))
+        if (!::DecrementNoteWitnesses(mi->second.mapSaplingNoteData, pindex->nHeight, nWitnessCacheSize))
             needsRescan = true;
     }
     if ( WITNESS_CACHE_SIZE == _COINBASE_MATURITY+10 )
@@ -1497,6 +1585,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletD
         mapWallet[hash].BindWallet(this);
         UpdateNullifierNoteMapWithTx(mapWallet[hash]);
         AddToSpends(hash);
+        AddToNoteTxids(mapWallet[hash]);
     }
     else
     {
@@ -1584,6 +1673,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletD
                 fUpdated = true;
             }
         }
+        AddToNoteTxids(wtx);
 
         //// debug print
         LogPrintf("AddToWallet %s  %s%s\n", wtxIn.GetHash().ToString(), (fInsertedNew ? "new" : ""), (fUpdated ? "update" : ""));
@@ -1785,6 +1875,7 @@ void CWallet::EraseFromWallet(const uint256 &hash)
         return;
     {
         LOCK(cs_wallet);
+        setNoteTxids.erase(hash);
         if (mapWallet.erase(hash))
             CWalletDB(strWalletFile).EraseTx(hash);
     }
@@ -63,6 +63,7 @@ extern bool bSpendZeroConfChange;
 extern bool fSendFreeTransactions;
 extern bool fPayAtLeastCustomFee;
 extern bool fWalletRbf;
+extern unsigned int nWitnessThreads;
 
 //! -paytxfee default
 static const CAmount DEFAULT_TRANSACTION_FEE = 0;
@@ -83,6 +84,10 @@ static const CAmount MIN_CHANGE = CENT;
 
 static const bool DEFAULT_DISABLE_WALLET = false;
 static const bool DEFAULT_WALLET_RBF = false;
+//! -witnessthreads default
+static const unsigned int DEFAULT_WITNESS_THREADS = 4;
+//! Upper bound for -witnessthreads
+static const unsigned int MAX_WITNESS_THREADS = 16;
 
 //! Size of witness cache
 //  Should be large enough that we can expect not to reorg beyond our cache
@@ -803,6 +808,15 @@ private:
     void AddToSaplingSpends(const uint256& nullifier, const uint256& wtxid);
     void AddToSpends(const uint256& wtxid);
 
+    /**
+     * Txids of the wallet transactions that carry Sprout or Sapling note
+     * data, i.e. the only ones whose witnesses move when a block is
+     * connected or disconnected. Entries are dropped lazily once the
+     * transaction is no longer in mapWallet.
+     */
+    std::set<uint256> setNoteTxids;
+    void AddToNoteTxids(const CWalletTx& wtx);
+
 public:
     /*
      * Size of the incremental witness cache for the notes in our wallet.
@@ -19,6 +19,7 @@
 #include "miner.h"
 #include "pow.h"
 #include "rpc/server.h"
+#include "script/cc.h"
 #include "script/sign.h"
 #include "sodium.h"
 #include "streams.h"
@@ -229,6 +230,19 @@ double benchmark_verify_equihash()
     return timer_stop(tv_start);
 }
 
+double benchmark_verify_equihash_batch(size_t nSolutions)
+{
+    CChainParams params = Params(CBaseChainParams::MAIN);
+    CBlock genesis = Params(CBaseChainParams::MAIN).GenesisBlock();
+    CBlockHeader genesis_header = genesis.GetBlockHeader();
+    struct timeval tv_start;
+    timer_start(tv_start);
+    for (size_t i = 0; i < nSolutions; i++) {
+        CheckEquihashSolution(&genesis_header, params);
+    }
+    return timer_stop(tv_start);
+}
+
 double benchmark_large_tx(size_t nInputs)
 {
     // Create priv/pub key
@@ -284,6 +298,63 @@ double benchmark_large_tx(size_t nInputs)
     return timer_stop(tv_start);
 }
 
+// Verify nInputs spends of a 1of2 CC output, the shape MakeCCcond1of2 produces
+double benchmark_verify_cc_spend(size_t nInputs)
+{
+    CKey priv, other;
+    priv.MakeNewKey(true);
+    other.MakeNewKey(true);
+    uint8_t evalcode = 0xe4;
+
+    auto mkCond = [&]() {
+        CC *sig = CCNewThreshold(1, {CCNewSecp256k1(priv.GetPubKey()), CCNewSecp256k1(other.GetPubKey())});
+        return CCNewThreshold(2, {CCNewEval(std::vector<unsigned char>(1, evalcode)), sig});
+    };
+    CC *cond = mkCond();
+    CScript prevPubKey = CCPubKey(cond);
+
+    CMutableTransaction m_orig_tx;
+    m_orig_tx.vout.resize(1);
+    m_orig_tx.vout[0].nValue = 1000000;
+    m_orig_tx.vout[0].scriptPubKey = prevPubKey;
+    auto orig_tx = CTransaction(m_orig_tx);
+
+    CMutableTransaction spending_tx;
+    spending_tx.fOverwintered = true;
+    spending_tx.nVersionGroupId = SAPLING_VERSION_GROUP_ID;
+    spending_tx.nVersion = SAPLING_TX_VERSION;
+    for (size_t i = 0; i < nInputs; i++) {
+        spending_tx.vin.emplace_back(orig_tx.GetHash(), 0);
+    }
+
+    auto consensusBranchId = NetworkUpgradeInfo[Consensus::UPGRADE_SAPLING].nBranchId;
+    for (size_t i = 0; i < nInputs; i++) {
+        uint256 sighash = SignatureHash(prevPubKey, spending_tx, i, SIGHASH_ALL, 1000000, consensusBranchId);
+        if (cc_signTreeSecp256k1Msg32(cond, priv.begin(), sighash.begin()) == 0) {
+            cc_free(cond);
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Could not sign CC input");
+        }
+        spending_tx.vin[i].scriptSig = CCSig(cond);
+    }
+    cc_free(cond);
+
+    CTransaction final_spending_tx(spending_tx);
+
+    struct timeval tv_start;
+    timer_start(tv_start);
+    PrecomputedTransactionData txdata(final_spending_tx);
+    for (size_t i = 0; i < nInputs; i++) {
+        ScriptError serror = SCRIPT_ERR_OK;
+        assert(VerifyScript(final_spending_tx.vin[i].scriptSig,
+                            prevPubKey,
+                            STANDARD_SCRIPT_VERIFY_FLAGS,
+                            TransactionSignatureChecker(&final_spending_tx, i, 1000000, txdata),
+                            consensusBranchId,
+                            &serror));
+    }
+    return timer_stop(tv_start);
+}
+
 double benchmark_try_decrypt_notes(size_t nAddrs)
 {
     CWallet wallet;
@@ -301,7 +372,7 @@ double benchmark_try_decrypt_notes(size_t nAddrs)
     return timer_stop(tv_start);
 }
 
-double benchmark_increment_note_witnesses(size_t nTxs)
+double benchmark_increment_note_witnesses(size_t nTxs, size_t nCommitments, int nThreads)
 {
     CWallet wallet;
     SproutMerkleTree sproutTree;
@@ -349,13 +420,28 @@ double benchmark_increment_note_witnesses(size_t nTxs)
         wallet.AddToWallet(wtx, true, NULL);
         block2.vtx.push_back(wtx);
     }
+    // Commitments that are not ours, each of which has to be appended to
+    // every witness in the wallet
+    if (nCommitments > 0) {
+        CMutableTransaction mtx;
+        mtx.nVersion = 2;
+        mtx.vjoinsplit.resize((nCommitments + ZC_NUM_JS_OUTPUTS - 1) / ZC_NUM_JS_OUTPUTS);
+        for (size_t i = 0; i < nCommitments; i++) {
+            mtx.vjoinsplit[i / ZC_NUM_JS_OUTPUTS].commitments[i % ZC_NUM_JS_OUTPUTS] = GetRandHash();
+        }
+        block2.vtx.push_back(CTransaction(mtx));
+    }
     CBlockIndex index2(block2);
     index2.nHeight = 2;
 
+    unsigned int nPrevThreads = nWitnessThreads;
+    nWitnessThreads = std::max(1, nThreads);
     struct timeval tv_start;
     timer_start(tv_start);
     wallet.ChainTip(&index2, &block2, sproutTree, saplingTree, true);
-    return timer_stop(tv_start);
+    double duration = timer_stop(tv_start);
+    nWitnessThreads = nPrevThreads;
+    return duration;
 }
 
 // Fake the input of a given block
@@ -438,6 +524,71 @@ double benchmark_connectblock_slow()
     return duration;
 }
 
+// Reads the inputs of the last nBlocks blocks of the active chain into an empty
+// cache over the chainstate database, as ConnectBlock's prefetch does during IBD
+double benchmark_prefetch_coins(int nBlocks, int nThreads)
+{
+    if (nBlocks <= 0 || nBlocks > chainActive.Height())
+        throw std::runtime_error("Invalid block count");
+
+    std::vector<std::vector<uint256> > vBlockPrevTxids;
+    for (CBlockIndex *pindex = chainActive.Tip(); pindex != NULL && (int)vBlockPrevTxids.size() < nBlocks; pindex = pindex->pprev) {
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex, false))
+            throw std::runtime_error("Failed to read block");
+        std::vector<uint256> vPrevTxids;
+        for (const CTransaction &tx : block.vtx)
+            if (!tx.IsMint())
+                for (const CTxIn &txin : tx.vin)
+                    vPrevTxids.push_back(txin.prevout.hash);
+        vBlockPrevTxids.push_back(vPrevTxids);
+    }
+
+    CCoinsViewCache cache(pcoinsdbview);
+    size_t nInputs = 0, nRead = 0, nHits = 0;
+    struct timeval tv_start;
+    timer_start(tv_start);
+    for (auto it = vBlockPrevTxids.rbegin(); it != vBlockPrevTxids.rend(); ++it) {
+        nRead += cache.PrefetchCoins(*it, nThreads);
+        for (const uint256 &txid : *it)
+            if (cache.AccessCoins(txid) != NULL)
+                nHits++;
+        nInputs += it->size();
+    }
+    double duration = timer_stop(tv_start);
+    LogPrint("bench", "prefetchcoins: %d blocks, %u inputs, %u read, %u found, %u threads: %.3fs\n",
+        nBlocks, (unsigned)nInputs, (unsigned)nRead, (unsigned)nHits, nThreads, duration);
+    return duration;
+}
+
+// Rebuilds and rehashes the headers of the last nHeaders blocks of the active chain, as
+// serving getheaders does, reading trimmed solutions back from the block tree db
+double benchmark_read_block_headers(int nHeaders)
+{
+    if (nHeaders <= 0 || nHeaders > chainActive.Height())
+        throw std::runtime_error("Invalid header count");
+
+    size_t nInMemory = 0, nSolutionBytes = 0;
+    for (BlockMap::const_iterator it = mapBlockIndex.begin(); it != mapBlockIndex.end(); ++it) {
+        if (it->second->HasSolution()) {
+            nInMemory++;
+            nSolutionBytes += it->second->GetSolution().size();
+        }
+    }
+
+    struct timeval tv_start;
+    timer_start(tv_start);
+    int n = 0;
+    for (CBlockIndex *pindex = chainActive.Tip(); pindex != NULL && n < nHeaders; pindex = pindex->pprev, n++) {
+        if (pindex->GetBlockHeader().GetHash() != pindex->GetBlockHash())
+            throw std::runtime_error("Block header inconsistency");
+    }
+    double duration = timer_stop(tv_start);
+    LogPrint("bench", "readblockheaders: %d headers: %.3fs, %u of %u index entries hold %u solution bytes\n",
+        n, duration, (unsigned)nInMemory, (unsigned)mapBlockIndex.size(), (unsigned)nSolutionBytes);
+    return duration;
+}
+
 extern UniValue getnewaddress(const UniValue& params, bool fHelp, const CPubKey& mypk); // in rpcwallet.cpp
 extern UniValue sendtoaddress(const UniValue& params, bool fHelp, const CPubKey& mypk);
 
@@ -12,10 +12,14 @@ extern double benchmark_solve_equihash();
 extern std::vector<double> benchmark_solve_equihash_threaded(int nThreads);
 extern double benchmark_verify_joinsplit(const JSDescription &joinsplit);
 extern double benchmark_verify_equihash();
+extern double benchmark_verify_equihash_batch(size_t nSolutions);
 extern double benchmark_large_tx(size_t nInputs);
+extern double benchmark_verify_cc_spend(size_t nInputs);
 extern double benchmark_try_decrypt_notes(size_t nAddrs);
-extern double benchmark_increment_note_witnesses(size_t nTxs);
+extern double benchmark_increment_note_witnesses(size_t nTxs, size_t nCommitments, int nThreads);
 extern double benchmark_connectblock_slow();
+extern double benchmark_prefetch_coins(int nBlocks, int nThreads);
+extern double benchmark_read_block_headers(int nHeaders);
 extern double benchmark_sendtoaddress(CAmount amount);
 extern double benchmark_loadwallet();
 extern double benchmark_listunspent();